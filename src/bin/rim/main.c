@@ -1,7 +1,215 @@
-#include <stdlib.h>
+#include <errno.h>
+#include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../lib/rvm/heap.h"
+#include "../../util/arg/parse.h"
+
+static int stats(int argc, const char **argv);
+static int vacuum(int argc, const char **argv);
+static bool parseRevision(const char *string, uint64_t *out);
+static void printError(const char *path, rvm_Error error);
+static void printUsage(FILE *stream);
+
+int main(int argc, const char *argv[]) {
+    if (argc < 2) {
+        printUsage(stderr);
+        return EXIT_FAILURE;
+    }
+    if (strcmp(argv[1], "stats") == 0) {
+        return stats(argc - 2, &argv[2]);
+    }
+    if (strcmp(argv[1], "vacuum") == 0) {
+        return vacuum(argc - 2, &argv[2]);
+    }
+    if (strcmp(argv[1], "help") == 0) {
+        printUsage(stdout);
+        return EXIT_SUCCESS;
+    }
+    fprintf(stderr, "rim: Unknown command: %s\n", argv[1]);
+    printUsage(stderr);
+    return EXIT_FAILURE;
+}
+
+/// Prints statistics about the contents of heap file.
+int stats(int argc, const char **argv) {
+    const arg_Option options[] = {
+        {'h', "help", "Print help and exit.", NULL},
+        {0},
+    };
+    const char *out[1] = {0};
+    const arg_ParseResult result = arg_parse(argc, argv, options, out);
+    if (!result.ok) {
+        fprintf(stderr, "rim: Unknown option: %s\n", result.tailv[0]);
+        return EXIT_FAILURE;
+    }
+    if (out[0] != NULL) {
+        fprintf(stdout, "Usage: rim stats [OPTIONS] FILE\n\n");
+        arg_fprintOptions(stdout, options);
+        return EXIT_SUCCESS;
+    }
+    if (result.tailc != 1) {
+        fprintf(stderr, "Usage: rim stats [OPTIONS] FILE\n\n");
+        arg_fprintOptions(stderr, options);
+        return EXIT_FAILURE;
+    }
+    const char *path = result.tailv[0];
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "rim: %s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    const rvm_HeapResult opened = rvm_fileIntoHeap(file);
+    if (!opened.ok) {
+        printError(path, opened.as.error);
+        return EXIT_FAILURE;
+    }
+    rvm_Heap heap = opened.as.heap;
+    rvm_HeapStats s;
+    const rvm_Error err = heap.stats(&heap, &s);
+    rvm_freeHeap(&heap);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        printError(path, err);
+        return EXIT_FAILURE;
+    }
+
+    // Lazy nodes are never stored, which leaves the last kind out.
+    const char *kinds[RVM_HEAP_NODE_KINDS - 1] = {
+        "undefined", "bytes", "number", "symbol", "closure", "array", "link",
+    };
+    printf("Revision:  %" PRIu64 "\n", s.revision);
+    printf("Revisions: %" PRIu64 "\n", s.revisions);
+    printf("Length:    %" PRIu64 " bytes\n", s.length);
+    printf("Resident:  %" PRIu64 " bytes\n", s.resident);
+    printf("\n%-10s %12s %14s %12s %14s\n", "Kind", "Live", "Live bytes",
+        "Total", "Total bytes");
+    for (size_t i = 0; i < RVM_HEAP_NODE_KINDS - 1; ++i) {
+        printf("%-10s %12" PRIu64 " %14" PRIu64 " %12" PRIu64 " %14" PRIu64
+               "\n", kinds[i], s.live[i].count, s.live[i].bytes,
+            s.total[i].count, s.total[i].bytes);
+    }
+    return EXIT_SUCCESS;
+}
+
+/// Vacuums heap file, keeping only the revisions selected by the options.
+int vacuum(int argc, const char **argv) {
+    const arg_Option options[] = {
+        {'a', "keep-after", "Keep revisions newer than REVISION.", "REVISION"},
+        {'l', "keep-last", "Keep last COUNT revisions.", "COUNT"},
+        {'h', "help", "Print help and exit.", NULL},
+        {0},
+    };
+    const char *out[3] = {0};
+    const arg_ParseResult result = arg_parse(argc, argv, options, out);
+    if (!result.ok) {
+        fprintf(stderr, "rim: Unknown option: %s\n", result.tailv[0]);
+        return EXIT_FAILURE;
+    }
+    if (out[2] != NULL) {
+        fprintf(stdout, "Usage: rim vacuum [OPTIONS] FILE\n\n");
+        arg_fprintOptions(stdout, options);
+        return EXIT_SUCCESS;
+    }
+    uint64_t after = 0;
+    uint64_t last = UINT64_MAX;
+    if (result.tailc != 1 || (out[0] != NULL && !parseRevision(out[0], &after))
+        || (out[1] != NULL && !parseRevision(out[1], &last))) {
+        fprintf(stderr, "Usage: rim vacuum [OPTIONS] FILE\n\n");
+        arg_fprintOptions(stderr, options);
+        return EXIT_FAILURE;
+    }
+    const char *path = result.tailv[0];
 
-int main() {
-    puts("pac");
+    // The current revision is needed to tell which revisions are the last.
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "rim: %s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    const rvm_HeapResult opened = rvm_fileIntoHeap(file);
+    if (!opened.ok) {
+        printError(path, opened.as.error);
+        return EXIT_FAILURE;
+    }
+    rvm_Heap heap = opened.as.heap;
+    const uint64_t revision = heap.revision;
+    rvm_freeHeap(&heap);
+
+    uint64_t first = after + 1;
+    if (last < revision && revision - last + 1 > first) {
+        first = revision - last + 1;
+    }
+    const size_t count = first <= revision ? (size_t)(revision - first + 1) : 0;
+    uint64_t *revisions = malloc((count > 0 ? count : 1) * sizeof(uint64_t));
+    if (revisions == NULL) {
+        fprintf(stderr, "rim: %s\n", strerror(ENOMEM));
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        revisions[i] = first + i;
+    }
+    const rvm_Error err = rvm_vacuumHeapFile(path, revisions, count);
+    free(revisions);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        printError(path, err);
+        return EXIT_FAILURE;
+    }
     return EXIT_SUCCESS;
 }
+
+/// Parses decimal revision number.
+bool parseRevision(const char *string, uint64_t *out) {
+    char *end;
+    errno = 0;
+    const uintmax_t value = strtoumax(string, &end, 10);
+    if (errno != 0 || end == string || *end != '\0' || string[0] == '-'
+        || value > UINT64_MAX) {
+        return false;
+    }
+    *out = (uint64_t)value;
+    return true;
+}
+
+/// Prints and frees error related to heap file at given path.
+void printError(const char *path, rvm_Error error) {
+    const char *kind;
+    switch (rvm_getErrorKind(error)) {
+    case RVM_ERROR_NOMEMORY:
+        kind = "Out of memory";
+        break;
+
+    case RVM_ERROR_IO:
+        kind = "I/O error";
+        break;
+
+    case RVM_ERROR_CORRUPT:
+        kind = "Corrupt heap";
+        break;
+
+    case RVM_ERROR_REVISION:
+        kind = "No such revision";
+        break;
+
+    default:
+        kind = "Error";
+        break;
+    }
+    if (error.message != NULL) {
+        fprintf(stderr, "rim: %s: %s: %s\n", path, kind, error.message);
+    } else {
+        fprintf(stderr, "rim: %s: %s\n", path, kind);
+    }
+    rvm_freeError(error);
+}
+
+void printUsage(FILE *stream) {
+    fprintf(stream,
+        "Usage: rim COMMAND [OPTIONS]\n"
+        "\n"
+        "Commands:\n"
+        "  help    Print this help message.\n"
+        "  stats   Print node counts and sizes of heap file.\n"
+        "  vacuum  Drop old revisions of heap file and rewrite it compactly.\n");
+}
@@ -0,0 +1,242 @@
+#ifndef LIB_RVM_CELL_H
+#define LIB_RVM_CELL_H
+
+/// RVM heap cell layout.
+///
+/// Heaps store each rvm_Node they contain as a cell, which is a sequence of
+/// 64-bit words starting with a header word. The offset of a cell, in bytes
+/// from the beginning of its heap, is used as the index of its node, which is
+/// why cells are always aligned to RVM_CELL_ALIGNMENT. The words following the
+/// header depend on the kind of the cell, as follows:
+///
+/// | Kind                | Words after header                            |
+/// |---------------------|-----------------------------------------------|
+/// | RVM_NODE_UNDEFINED  | None.                                         |
+/// | RVM_NODE_BYTES      | Bytes, zero-padded to a multiple of 8.        |
+/// | RVM_NODE_NUMBER     | Integer.                                      |
+/// | RVM_NODE_SYMBOL     | Bytes, zero-padded to a multiple of 8.        |
+/// | RVM_NODE_CLOSURE    | Function identity, node offset.               |
+/// | RVM_NODE_ARRAY      | One node offset per element.                  |
+/// | RVM_NODE_LINK       | One head offset per link, tail offset.        |
+///
+/// Node offsets refer to other cells in the same heap, and are relative to the
+/// offset of the cell containing them, which makes cells position independent.
+/// As no cell refers to itself, a relative offset of zero is used to represent
+/// a `NULL` pointer. RVM_NODE_LAZY nodes are never stored as cells, as they
+/// only refer to cells.
+///
+/// ## Closures
+///
+/// Closures identify their functions by a hash of function name and arity,
+/// as calculated by rvm_getCellFunction(), rather than by address, which
+/// differs between processes. Heaps resolve function identities using a
+/// table of functions registered by their users.
+///
+/// ## Unrolled Links
+///
+/// Link cells may hold a chain of several links, in which case their length
+/// is the amount of links and they hold the head of each link in order. The
+/// tail of each link but the last is the link after it, while the tail of the
+/// last link is the tail offset of the cell. Link cells of length zero hold a
+/// single link.
+///
+/// ## Packed Arrays
+///
+/// Arrays whose elements are all numbers are stored packed, meaning that
+/// RVM_CELL_HEADER_PACKED is set in their headers and that their words after
+/// the header are the integers of their elements rather than node offsets.
+/// The elements of packed arrays are therefore contiguous `int64_t` values.
+///
+/// ## Immediate Nodes
+///
+/// Small integers and short byte sequences are not stored as cells of their
+/// own. Rather, the node offsets referring to them are replaced with
+/// immediate words holding their contents, and the rvm_NodeKind of the node in
+/// their three least significant bits. As cells are aligned, node offsets
+/// never have any of those bits set. Immediate integers are shifted to the
+/// left by RVM_CELL_IMMEDIATE_SHIFT bits. Immediate byte sequences have their
+/// length shifted by the same amount, and hold their bytes in the remaining
+/// bytes of the word, in order. Revision roots are always cells, and so are
+/// symbols, which heaps intern.
+///
+/// All words are stored in the byte order of the host machine.
+///
+/// \file
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "node.h"
+
+/// Alignment of every cell, in bytes.
+#define RVM_CELL_ALIGNMENT 8
+
+/// Bit mask for extracting rvm_NodeKind from cell header.
+#define RVM_CELL_HEADER_KIND 0x0000000000000007
+
+/// Bit mask of cell header bit set only for packed arrays.
+#define RVM_CELL_HEADER_PACKED 0x0000000000000008
+
+/// Bit mask of cell header bits reserved for future use. Must be zero.
+#define RVM_CELL_HEADER_RESERVED 0x00000000000000f0
+
+/// Amount of bits the cell length is shifted to the left in cell header.
+#define RVM_CELL_HEADER_LENGTH_SHIFT 8
+
+/// Creates cell header from given kind and length.
+///
+/// The meaning of the length depends on the kind. For byte sequences and
+/// symbols it is an amount of bytes, for arrays an amount of elements, for
+/// links an amount of links or zero, and for all other kinds it is zero.
+static inline uint64_t rvm_makeCellHeader(rvm_NodeKind kind, uint64_t length) {
+    return (length << RVM_CELL_HEADER_LENGTH_SHIFT) | (uint64_t)kind;
+}
+
+/// Resolves rvm_NodeKind of cell with given header.
+static inline rvm_NodeKind rvm_getCellKind(uint64_t header) {
+    return (rvm_NodeKind)(header & RVM_CELL_HEADER_KIND);
+}
+
+/// Resolves length of cell with given header.
+static inline uint64_t rvm_getCellLength(uint64_t header) {
+    return header >> RVM_CELL_HEADER_LENGTH_SHIFT;
+}
+
+/// Resolves amount of links held by link cell with given header.
+static inline uint64_t rvm_getCellLinks(uint64_t header) {
+    const uint64_t length = rvm_getCellLength(header);
+    return length > 0 ? length : 1;
+}
+
+/// Determines whether cell with given header is a packed array.
+static inline bool rvm_isCellPacked(uint64_t header) {
+    return (header & RVM_CELL_HEADER_PACKED) != 0;
+}
+
+/// Calculates identity of given function, as stored in closure cells.
+///
+/// The identity is a FNV-1a 64-bit hash of the bytes of the function name,
+/// followed by the eight bytes of its arity in little-endian order.
+static inline uint64_t rvm_getCellFunction(const rvm_Function *function) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (const char *c = function->name; *c != '\0'; ++c) {
+        hash = (hash ^ (uint8_t)*c) * 0x00000100000001b3;
+    }
+    const uint64_t arity = (uint64_t)function->arity;
+    for (unsigned i = 0; i < 64; i += 8) {
+        hash = (hash ^ ((arity >> i) & 0xff)) * 0x00000100000001b3;
+    }
+    return hash;
+}
+
+/// Bit mask for extracting rvm_NodeKind from immediate word.
+#define RVM_CELL_IMMEDIATE_KIND 0x0000000000000007
+
+/// Amount of bits the contents of immediate words are shifted to the left.
+#define RVM_CELL_IMMEDIATE_SHIFT 3
+
+/// Smallest integer that can be stored in an immediate word.
+#define RVM_CELL_IMMEDIATE_MIN (-((int64_t)1 << 60))
+
+/// Largest integer that can be stored in an immediate word.
+#define RVM_CELL_IMMEDIATE_MAX (((int64_t)1 << 60) - 1)
+
+/// Maximum length of byte sequences stored in immediate words.
+#define RVM_CELL_IMMEDIATE_LENGTH 7
+
+/// Offset of the bytes of immediate byte sequences within their word, which
+/// always follow its least significant byte.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define RVM_CELL_IMMEDIATE_BYTES 0
+#else
+#define RVM_CELL_IMMEDIATE_BYTES 1
+#endif
+
+/// Determines whether given node offset word is an immediate word.
+static inline bool rvm_isCellImmediate(uint64_t word) {
+    return (word & RVM_CELL_IMMEDIATE_KIND) != 0;
+}
+
+/// Resolves rvm_NodeKind of given immediate word.
+static inline rvm_NodeKind rvm_getImmediateKind(uint64_t word) {
+    return (rvm_NodeKind)(word & RVM_CELL_IMMEDIATE_KIND);
+}
+
+/// Resolves length of byte sequence in given immediate word.
+static inline uint64_t rvm_getImmediateLength(uint64_t word) {
+    return (word & 0xff) >> RVM_CELL_IMMEDIATE_SHIFT;
+}
+
+/// Resolves integer in given immediate word.
+static inline int64_t rvm_getImmediateInteger(uint64_t word) {
+    return (int64_t)(word & ~(uint64_t)RVM_CELL_IMMEDIATE_KIND)
+        / ((int64_t)1 << RVM_CELL_IMMEDIATE_SHIFT);
+}
+
+/// Attempts to create immediate word holding given node.
+///
+/// \returns `true` only if node is a number or byte sequence small enough to
+///          be stored in an immediate word.
+static inline bool rvm_makeCellImmediate(const rvm_Node *node, uint64_t *out) {
+    switch ((rvm_NodeKind)(node->flags & RVM_NODE_FLAGS_KIND)) {
+    case RVM_NODE_NUMBER:
+        if (node->as.number.integer < RVM_CELL_IMMEDIATE_MIN
+            || node->as.number.integer > RVM_CELL_IMMEDIATE_MAX) {
+            return false;
+        }
+        *out = ((uint64_t)node->as.number.integer << RVM_CELL_IMMEDIATE_SHIFT)
+            | (uint64_t)RVM_NODE_NUMBER;
+        return true;
+
+    case RVM_NODE_BYTES:
+        if (node->as.bytes.length > RVM_CELL_IMMEDIATE_LENGTH) {
+            return false;
+        }
+        *out = ((uint64_t)node->as.bytes.length << RVM_CELL_IMMEDIATE_SHIFT)
+            | (uint64_t)RVM_NODE_BYTES;
+        if (node->as.bytes.length > 0) {
+            memcpy((uint8_t *)out + RVM_CELL_IMMEDIATE_BYTES,
+                node->as.bytes.bytes, node->as.bytes.length);
+        }
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+/// Rounds given amount of bytes up to nearest multiple of RVM_CELL_ALIGNMENT.
+static inline uint64_t rvm_alignCellSize(uint64_t size) {
+    return (size + (RVM_CELL_ALIGNMENT - 1)) & ~(uint64_t)(RVM_CELL_ALIGNMENT - 1);
+}
+
+/// Calculates size of cell with given kind and length, in bytes.
+///
+/// \returns Cell size, including header, or 0 if kind cannot be stored.
+static inline uint64_t rvm_getCellSize(rvm_NodeKind kind, uint64_t length) {
+    switch (kind) {
+    case RVM_NODE_UNDEFINED:
+        return 8;
+
+    case RVM_NODE_BYTES:
+    case RVM_NODE_SYMBOL:
+        return 8 + rvm_alignCellSize(length);
+
+    case RVM_NODE_NUMBER:
+        return 16;
+
+    case RVM_NODE_CLOSURE:
+        return 24;
+
+    case RVM_NODE_LINK:
+        return 16 + (length > 0 ? length : 1) * 8;
+
+    case RVM_NODE_ARRAY:
+        return 8 + length * 8;
+
+    default:
+        return 0;
+    }
+}
+
+#endif
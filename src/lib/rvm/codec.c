@@ -0,0 +1,645 @@
+#include "codec.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+#include "heap.h"
+
+/// Identifies encoded nodes.
+#define HEADER_MAGIC "RVMN"
+
+/// Encoding format version.
+#define HEADER_VERSION 1
+
+/// Size of encoding header, in bytes.
+#define HEADER_SIZE 5
+
+/// Tag of absent nodes.
+#define TAG_ABSENT 0x07
+
+/// Tag of references to nodes written earlier.
+#define TAG_REFERENCE 0x08
+
+/// Amount of bytes buffered before being written to file.
+#define WRITER_CAPACITY 4096
+
+/// Amount of pending nodes that fit in stacks before they have to grow.
+#define STACK_CAPACITY_INITIAL 64
+
+/// Initial amount of entries that fit in tables of written nodes. Must be a
+/// power of two.
+#define TABLE_CAPACITY_INITIAL 256
+
+typedef rvm_Error Error;
+typedef rvm_Function Function;
+typedef rvm_Node Node;
+
+/// Buffered file writer.
+typedef struct Writer {
+    FILE *file;
+    size_t length;
+    bool failed;
+    uint8_t buffer[WRITER_CAPACITY];
+} Writer;
+
+/// Identifies node written by encoder.
+typedef struct Key {
+    /// Address of loaded node, or of heap of lazy node.
+    const void *address;
+
+    /// Index of lazy node, or 0 for loaded nodes.
+    uint64_t index;
+} Key;
+
+/// Entry of table of written nodes, which is unused if its address is `NULL`.
+typedef struct Written {
+    Key key;
+    uint64_t number;
+} Written;
+
+/// Table of written nodes, by key.
+typedef struct Table {
+    Written *entries;
+    size_t capacity;
+    size_t count;
+} Table;
+
+/// Nodes yet to be written, which are either one node referred to by some
+/// pointer, or the elements of an array.
+typedef struct Pending {
+    const Node *nodes;
+    size_t count;
+    bool elements;
+} Pending;
+
+/// Encoded bytes yet to be read.
+typedef struct Reader {
+    const uint8_t *at;
+    const uint8_t *end;
+} Reader;
+
+/// Nodes yet to be read, which are either one pointer to assign, or the
+/// elements of an array if `pointer` is `NULL`.
+typedef struct Slot {
+    const Node **pointer;
+    Node *elements;
+    size_t count;
+} Slot;
+
+/// Decoding state.
+typedef struct Decoder {
+    /// Functions closures may refer to.
+    const Function *const *functions;
+
+    /// Amount of functions.
+    size_t functionCount;
+
+    /// Memory receiving decoded nodes, or `NULL` if nodes are only counted.
+    Node *nodes;
+
+    /// Amount of nodes allocated from `nodes`, or that would have been.
+    size_t used;
+
+    /// Decoded nodes, by number, or `NULL` if nodes are only counted.
+    Node **numbered;
+
+    /// Amount of numbered nodes.
+    size_t numberedCount;
+
+    /// Receives nodes decoded while only counting.
+    Node sink;
+} Decoder;
+
+static Error encode(const Node *node, Writer *writer, Table *table);
+static bool push(void **stack, size_t *capacity, size_t count, size_t width);
+static Key keyOf(const Node *node);
+static bool lookup(const Table *table, Key key, uint64_t *out);
+static bool insert(Table *table, Key key, uint64_t number);
+static uint64_t hashKey(Key key);
+static void writeBytes(Writer *writer, const void *bytes, size_t length);
+static void writeByte(Writer *writer, uint8_t byte);
+static void writeVarint(Writer *writer, uint64_t value);
+static void flush(Writer *writer);
+static Error decode(Reader *reader, Decoder *decoder, const Node **root);
+static Node *allocate(Decoder *decoder, size_t count);
+static const Function *resolve(const Decoder *decoder, const uint8_t *name,
+    size_t length, intptr_t arity);
+static bool readByte(Reader *reader, uint8_t *out);
+static bool readVarint(Reader *reader, uint64_t *out);
+static bool readSpan(Reader *reader, size_t length, const uint8_t **out);
+
+rvm_Error rvm_encodeNode(const rvm_Node *node, FILE *file) {
+    assert(file != NULL);
+
+    Writer *writer = malloc(sizeof(Writer));
+    if (writer == NULL) {
+        return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+    }
+    writer->file = file;
+    writer->length = 0;
+    writer->failed = false;
+    Table table = {0};
+
+    writeBytes(writer, HEADER_MAGIC, 4);
+    writeByte(writer, HEADER_VERSION);
+    Error err = encode(node, writer, &table);
+    flush(writer);
+    if (rvm_getErrorKind(err) == RVM_ERROR_NONE && writer->failed) {
+        err = rvm_asError(RVM_ERROR_IO, NULL);
+    }
+    free(table.entries);
+    free(writer);
+
+    return err;
+}
+
+rvm_Error rvm_decodeNode(const uint8_t *bytes, size_t length,
+    const rvm_Function *const *functions, size_t count, rvm_Node **out) {
+    assert(bytes != NULL || length == 0);
+    assert(functions != NULL || count == 0);
+    assert(out != NULL);
+
+    if (length < HEADER_SIZE || memcmp(bytes, HEADER_MAGIC, 4) != 0
+        || bytes[4] != HEADER_VERSION) {
+        return rvm_asError(RVM_ERROR_CORRUPT, NULL);
+    }
+
+    // Nodes are first only counted, which lets them all be decoded into a
+    // single block of memory.
+    Decoder decoder = { .functions = functions, .functionCount = count };
+    Reader reader = { &bytes[HEADER_SIZE], &bytes[length] };
+    const Node *root;
+    Error err = decode(&reader, &decoder, &root);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        return err;
+    }
+    if (decoder.used == 0) {
+        *out = NULL;
+        return rvm_asError(RVM_ERROR_NONE, NULL);
+    }
+    Node *nodes = malloc(decoder.used * sizeof(Node));
+    Node **numbered = malloc(decoder.used * sizeof(Node *));
+    if (nodes == NULL || numbered == NULL) {
+        free(nodes);
+        free(numbered);
+        return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+    }
+    decoder = (Decoder){
+        .functions = functions,
+        .functionCount = count,
+        .nodes = nodes,
+        .numbered = numbered,
+    };
+    reader = (Reader){ &bytes[HEADER_SIZE], &bytes[length] };
+    err = decode(&reader, &decoder, &root);
+    free(numbered);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        free(nodes);
+        return err;
+    }
+    assert(root == nodes);
+    *out = nodes;
+
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+/// Writes node and all nodes it refers to, in depth-first order.
+///
+/// Nodes are visited using a stack of pending nodes rather than recursion,
+/// allowing for long lists and deep trees.
+Error encode(const Node *node, Writer *writer, Table *table) {
+    Pending *stack = malloc(STACK_CAPACITY_INITIAL * sizeof(Pending));
+    if (stack == NULL) {
+        return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+    }
+    size_t capacity = STACK_CAPACITY_INITIAL;
+    size_t count = 0;
+    uint64_t written = 0;
+    Error err = rvm_asError(RVM_ERROR_NONE, NULL);
+
+    stack[count++] = (Pending){ node, 1, false };
+    while (count > 0 && !writer->failed) {
+        Pending *top = &stack[count - 1];
+        const Node *next = top->nodes;
+        const bool element = top->elements;
+        if (--top->count == 0) {
+            count -= 1;
+        } else {
+            top->nodes += 1;
+        }
+
+        if (next == NULL) {
+            writeByte(writer, TAG_ABSENT);
+            continue;
+        }
+        const Key key = keyOf(next);
+        uint64_t number;
+        if (!element && lookup(table, key, &number)) {
+            writeByte(writer, TAG_REFERENCE);
+            writeVarint(writer, number);
+            continue;
+        }
+        if (!insert(table, key, written++)) {
+            err = rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+            goto done;
+        }
+        Node loaded = *next;
+        err = rvm_loadNode(&loaded);
+        if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+            goto done;
+        }
+        const rvm_NodeKind kind = rvm_getNodeKind(&loaded);
+        writeByte(writer, (uint8_t)kind);
+
+        // Children are pushed in reverse order, as they are written in the
+        // order they are popped.
+        switch (kind) {
+        case RVM_NODE_BYTES:
+        case RVM_NODE_SYMBOL:
+            writeVarint(writer, loaded.as.bytes.length);
+            writeBytes(writer, loaded.as.bytes.bytes, loaded.as.bytes.length);
+            break;
+
+        case RVM_NODE_NUMBER: {
+            const uint64_t integer = (uint64_t)loaded.as.number.integer;
+            writeVarint(writer,
+                (integer << 1) ^ (loaded.as.number.integer < 0 ? ~0ull : 0));
+            break;
+        }
+
+        case RVM_NODE_CLOSURE: {
+            const Function *function = loaded.as.closure.function;
+            const size_t length = function->name != NULL
+                ? strlen(function->name)
+                : 0;
+            writeVarint(writer, length);
+            writeBytes(writer, function->name, length);
+            writeVarint(writer, (uint64_t)function->arity);
+            if (!push((void **)&stack, &capacity, count, sizeof(Pending))) {
+                err = rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+                goto done;
+            }
+            stack[count++] = (Pending){ loaded.as.closure.node, 1, false };
+            break;
+        }
+
+        case RVM_NODE_ARRAY:
+            writeVarint(writer, loaded.as.array.length);
+            if (loaded.as.array.length == 0) {
+                break;
+            }
+            if (!push((void **)&stack, &capacity, count, sizeof(Pending))) {
+                err = rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+                goto done;
+            }
+            stack[count++] = (Pending){
+                loaded.as.array.nodes, loaded.as.array.length, true,
+            };
+            break;
+
+        case RVM_NODE_LINK:
+            if (!push((void **)&stack, &capacity, count + 1,
+                    sizeof(Pending))) {
+                err = rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+                goto done;
+            }
+            stack[count++] = (Pending){ loaded.as.link.tail, 1, false };
+            stack[count++] = (Pending){ loaded.as.link.head, 1, false };
+            break;
+
+        default:
+            break;
+        }
+    }
+
+done:
+    free(stack);
+    return err;
+}
+
+/// Ensures that the stack has room for at least one more item than `count`,
+/// growing it if required.
+bool push(void **stack, size_t *capacity, size_t count, size_t width) {
+    if (count < *capacity) {
+        return true;
+    }
+    void *grown = realloc(*stack, *capacity * 2 * width);
+    if (grown == NULL) {
+        return false;
+    }
+    *stack = grown;
+    *capacity *= 2;
+    return true;
+}
+
+/// Identifies node by heap and index if lazy, or by address otherwise.
+Key keyOf(const Node *node) {
+    if (rvm_getNodeKind((Node *)node) == RVM_NODE_LAZY) {
+        return (Key){ node->as.lazy.heap, rvm_getNodeIndex((Node *)node) };
+    }
+    return (Key){ node, 0 };
+}
+
+bool lookup(const Table *table, Key key, uint64_t *out) {
+    if (table->entries == NULL) {
+        return false;
+    }
+    const size_t mask = table->capacity - 1;
+    for (size_t i = (size_t)hashKey(key) & mask;; i = (i + 1) & mask) {
+        const Written *entry = &table->entries[i];
+        if (entry->key.address == NULL) {
+            return false;
+        }
+        if (entry->key.address == key.address
+            && entry->key.index == key.index) {
+            *out = entry->number;
+            return true;
+        }
+    }
+}
+
+/// Adds node to table of written nodes, growing the table if required.
+bool insert(Table *table, Key key, uint64_t number) {
+    if ((table->count + 1) * 2 > table->capacity) {
+        const size_t capacity = table->capacity > 0
+            ? table->capacity * 2
+            : TABLE_CAPACITY_INITIAL;
+        Written *entries = calloc(capacity, sizeof(Written));
+        if (entries == NULL) {
+            return false;
+        }
+        for (size_t i = 0; i < table->capacity; ++i) {
+            const Written *entry = &table->entries[i];
+            if (entry->key.address == NULL) {
+                continue;
+            }
+            size_t j = (size_t)hashKey(entry->key) & (capacity - 1);
+            while (entries[j].key.address != NULL) {
+                j = (j + 1) & (capacity - 1);
+            }
+            entries[j] = *entry;
+        }
+        free(table->entries);
+        table->entries = entries;
+        table->capacity = capacity;
+    }
+    const size_t mask = table->capacity - 1;
+    size_t i = (size_t)hashKey(key) & mask;
+    while (table->entries[i].key.address != NULL) {
+        i = (i + 1) & mask;
+    }
+    table->entries[i] = (Written){ key, number };
+    table->count += 1;
+    return true;
+}
+
+uint64_t hashKey(Key key) {
+    uint64_t hash = ((uint64_t)(uintptr_t)key.address ^ key.index)
+        * 0xff51afd7ed558ccd;
+    return hash ^ (hash >> 32);
+}
+
+void writeBytes(Writer *writer, const void *bytes, size_t length) {
+    const uint8_t *at = bytes;
+    while (length > 0) {
+        if (writer->length == WRITER_CAPACITY) {
+            flush(writer);
+        }
+        size_t n = WRITER_CAPACITY - writer->length;
+        n = n < length ? n : length;
+        memcpy(&writer->buffer[writer->length], at, n);
+        writer->length += n;
+        at += n;
+        length -= n;
+    }
+}
+
+void writeByte(Writer *writer, uint8_t byte) {
+    if (writer->length == WRITER_CAPACITY) {
+        flush(writer);
+    }
+    writer->buffer[writer->length++] = byte;
+}
+
+/// Writes value as unsigned LEB128 variable-length integer.
+void writeVarint(Writer *writer, uint64_t value) {
+    while (value >= 0x80) {
+        writeByte(writer, (uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    writeByte(writer, (uint8_t)value);
+}
+
+/// Writes buffered bytes to file.
+void flush(Writer *writer) {
+    if (writer->length > 0 && !writer->failed
+        && fwrite(writer->buffer, 1, writer->length, writer->file)
+            != writer->length) {
+        writer->failed = true;
+    }
+    writer->length = 0;
+}
+
+/// Reads node and all nodes it refers to, assigning the decoded node to
+/// `root`. If the decoder has no memory for nodes, they are only counted.
+///
+/// Nodes are visited using a stack of slots rather than recursion, allowing
+/// for long lists and deep trees.
+Error decode(Reader *reader, Decoder *decoder, const Node **root) {
+    Slot *stack = malloc(STACK_CAPACITY_INITIAL * sizeof(Slot));
+    if (stack == NULL) {
+        return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+    }
+    size_t capacity = STACK_CAPACITY_INITIAL;
+    size_t count = 0;
+    Error err = rvm_asError(RVM_ERROR_CORRUPT, NULL);
+
+    stack[count++] = (Slot){ root, NULL, 1 };
+    while (count > 0) {
+        Slot *top = &stack[count - 1];
+        const Node **pointer = top->pointer;
+        Node *node = top->elements;
+        if (top->elements != NULL) {
+            top->elements += 1;
+        }
+        if (--top->count == 0) {
+            count -= 1;
+        }
+
+        uint8_t tag;
+        if (!readByte(reader, &tag)) {
+            goto done;
+        }
+        if (pointer != NULL) {
+            if (tag == TAG_ABSENT) {
+                *pointer = NULL;
+                continue;
+            }
+            if (tag == TAG_REFERENCE) {
+                uint64_t number;
+                if (!readVarint(reader, &number)
+                    || number >= decoder->numberedCount) {
+                    goto done;
+                }
+                *pointer = decoder->numbered != NULL
+                    ? decoder->numbered[number]
+                    : NULL;
+                continue;
+            }
+            node = allocate(decoder, 1);
+            *pointer = node;
+        }
+        if (tag >= TAG_ABSENT) {
+            goto done;
+        }
+        if (node == NULL) {
+            node = &decoder->sink;
+        }
+        if (decoder->numbered != NULL) {
+            decoder->numbered[decoder->numberedCount] = node;
+        }
+        decoder->numberedCount += 1;
+        *node = (Node){ .flags = tag };
+
+        uint64_t length;
+        switch ((rvm_NodeKind)tag) {
+        case RVM_NODE_BYTES:
+        case RVM_NODE_SYMBOL:
+            if (!readVarint(reader, &length)
+                || !readSpan(reader, length, &node->as.bytes.bytes)) {
+                goto done;
+            }
+            node->as.bytes.length = length;
+            break;
+
+        case RVM_NODE_NUMBER: {
+            uint64_t integer;
+            if (!readVarint(reader, &integer)) {
+                goto done;
+            }
+            node->as.number.integer = (int64_t)(integer >> 1)
+                ^ -(int64_t)(integer & 1);
+            break;
+        }
+
+        case RVM_NODE_CLOSURE: {
+            const uint8_t *name;
+            uint64_t arity;
+            if (!readVarint(reader, &length)
+                || !readSpan(reader, length, &name)
+                || !readVarint(reader, &arity)) {
+                goto done;
+            }
+            node->as.closure.function = resolve(decoder, name, length,
+                (intptr_t)arity);
+            if (node->as.closure.function == NULL) {
+                goto done;
+            }
+            if (!push((void **)&stack, &capacity, count, sizeof(Slot))) {
+                err = rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+                goto done;
+            }
+            stack[count++] = (Slot){ &node->as.closure.node, NULL, 1 };
+            break;
+        }
+
+        case RVM_NODE_ARRAY: {
+            // Each element takes at least one byte, which bounds the
+            // memory allocated for arrays by the amount of encoded bytes.
+            if (!readVarint(reader, &length)
+                || length > (uint64_t)(reader->end - reader->at)) {
+                goto done;
+            }
+            Node *elements = allocate(decoder, length);
+            node->as.array.length = length;
+            node->as.array.nodes = elements;
+            if (length == 0) {
+                break;
+            }
+            if (!push((void **)&stack, &capacity, count, sizeof(Slot))) {
+                err = rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+                goto done;
+            }
+            stack[count++] = (Slot){ NULL, elements, length };
+            break;
+        }
+
+        case RVM_NODE_LINK:
+            if (!push((void **)&stack, &capacity, count + 1, sizeof(Slot))) {
+                err = rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+                goto done;
+            }
+            stack[count++] = (Slot){ &node->as.link.tail, NULL, 1 };
+            stack[count++] = (Slot){ &node->as.link.head, NULL, 1 };
+            break;
+
+        default:
+            break;
+        }
+    }
+    if (reader->at == reader->end) {
+        err = rvm_asError(RVM_ERROR_NONE, NULL);
+    }
+
+done:
+    free(stack);
+    return err;
+}
+
+/// Allocates nodes from decoder memory, or only counts them if the decoder
+/// has no memory, in which case `NULL` is returned.
+Node *allocate(Decoder *decoder, size_t count) {
+    Node *nodes = decoder->nodes != NULL
+        ? &decoder->nodes[decoder->used]
+        : NULL;
+    decoder->used += count;
+    return nodes;
+}
+
+/// Looks up function with given name and arity.
+const Function *resolve(const Decoder *decoder, const uint8_t *name,
+    size_t length, intptr_t arity) {
+    for (size_t i = 0; i < decoder->functionCount; ++i) {
+        const Function *function = decoder->functions[i];
+        const char *other = function->name != NULL ? function->name : "";
+        if (function->arity == arity && strlen(other) == length
+            && memcmp(other, name, length) == 0) {
+            return function;
+        }
+    }
+    return NULL;
+}
+
+bool readByte(Reader *reader, uint8_t *out) {
+    if (reader->at == reader->end) {
+        return false;
+    }
+    *out = *reader->at++;
+    return true;
+}
+
+/// Reads unsigned LEB128 variable-length integer.
+bool readVarint(Reader *reader, uint64_t *out) {
+    uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        uint8_t byte;
+        if (!readByte(reader, &byte)) {
+            return false;
+        }
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            *out = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Reads `length` bytes without copying them.
+bool readSpan(Reader *reader, size_t length, const uint8_t **out) {
+    if (length > (size_t)(reader->end - reader->at)) {
+        return false;
+    }
+    *out = reader->at;
+    reader->at += length;
+    return true;
+}
@@ -0,0 +1,75 @@
+#ifndef LIB_RVM_CODEC_H
+#define LIB_RVM_CODEC_H
+
+/// RVM node serialization utilities.
+///
+/// ## Format
+///
+/// Encoded trees start with the four magic bytes `RVMN` and a version byte,
+/// after which their nodes follow in depth-first order, each starting with a
+/// tag byte.
+///
+/// | Tag  | Node          | Followed by                                    |
+/// |:-----|:--------------|:-----------------------------------------------|
+/// | 0x00 | Undefined     | Nothing.                                       |
+/// | 0x01 | Bytes         | Length, bytes.                                 |
+/// | 0x02 | Number        | Zig-zag encoded integer.                       |
+/// | 0x03 | Symbol        | Length, bytes.                                 |
+/// | 0x04 | Closure       | Name length, name, arity, enclosed node.       |
+/// | 0x05 | Array         | Length, elements.                              |
+/// | 0x06 | Link          | Head node, tail node.                          |
+/// | 0x07 | Absent        | Nothing.                                       |
+/// | 0x08 | Reference     | Number of node referred to.                    |
+///
+/// All lengths and numbers are unsigned LEB128 variable-length integers. The
+/// absent tag marks `NULL` node pointers, such as the tail of the last link
+/// of a list. Each node written with any of the first seven tags is numbered
+/// in the order written, starting at 0. When the same node is reached more
+/// than once, it is written in full only the first time, after which it is
+/// written as a reference to its number. Shared subtrees, and even nodes
+/// referring to themselves, are therefore written only once. Array elements
+/// are always written in full, as they are stored inside their arrays.
+///
+/// Closures refer to functions by name and arity, which are resolved using a
+/// table of functions when decoded.
+///
+/// \file
+
+#include <stdint.h>
+#include <stdio.h>
+#include "error.h"
+#include "function.h"
+#include "node.h"
+
+/// Encodes given node and all nodes it refers to, writing them to file.
+///
+/// Nodes are written as they are visited, which means that encoding takes
+/// memory proportional to the amount of nodes encoded, but never to their
+/// encoded size. Lazy nodes are loaded as they are visited.
+///
+/// \param node Pointer to node, or `NULL`.
+/// \param file File to write to.
+/// \returns    Error object, indicating any issues.
+rvm_Error rvm_encodeNode(const rvm_Node *node, FILE *file);
+
+/// Decodes node encoded by rvm_encodeNode().
+///
+/// The decoded nodes are allocated in a single block of memory, which must be
+/// given to free() once no longer used. Decoded byte sequences and symbols
+/// refer directly to the encoded bytes rather than to copies, which is why
+/// those bytes must not be modified or freed while decoded nodes are used.
+///
+/// \param bytes     Pointer to encoded bytes.
+/// \param length    Amount of encoded bytes.
+/// \param functions Pointer to functions closures may refer to, unless
+///                  `count` is zero.
+/// \param count     Amount of functions.
+/// \param out       Pointer to receiver of decoded node, or of `NULL` if an
+///                  absent node was encoded.
+/// \returns         Error object, indicating any issues. Bytes not produced by
+///                  rvm_encodeNode(), and closures referring to functions not
+///                  in `functions`, cause RVM_ERROR_CORRUPT errors.
+rvm_Error rvm_decodeNode(const uint8_t *bytes, size_t length,
+    const rvm_Function *const *functions, size_t count, rvm_Node **out);
+
+#endif
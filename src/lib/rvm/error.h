@@ -24,6 +24,10 @@ typedef struct rvm_Error rvm_Error;
 typedef enum rvm_ErrorKind {
     RVM_ERROR_NONE = 0x0000,
     RVM_ERROR_NOMEMORY = 0x0001,
+    RVM_ERROR_IO = 0x0002,
+    RVM_ERROR_CORRUPT = 0x0003,
+    RVM_ERROR_REVISION = 0x0004,
+    RVM_ERROR_CYCLE = 0x0005,
     RVM_ERROR_USER = 0x7fff,
 } rvm_ErrorKind;
 
@@ -0,0 +1,880 @@
+#include "evaluate.h"
+#include <assert.h>
+#include <pthread.h>
+#include <string.h>
+#include "heap.h"
+
+/// Alignment of memory allocated from regions, in bytes.
+#define REGION_ALIGNMENT 8
+
+/// Amount of bindings that fit in evaluations before memory has to be
+/// allocated for more. Must be a power of two.
+#define BINDINGS_CAPACITY_INITIAL 256
+
+/// Amount of promoted nodes that fit in evaluations before memory has to be
+/// allocated for more.
+#define PROMOTED_CAPACITY_INITIAL 64
+
+/// Amount of frames that fit on evaluation stacks before memory has to be
+/// allocated for more.
+#define STACK_CAPACITY_INITIAL 256
+
+typedef rvm_Error Error;
+typedef rvm_Function Function;
+typedef rvm_Node Node;
+
+/// Chunk of region memory.
+typedef struct Chunk {
+    /// Chunk allocated before this one, if any.
+    struct Chunk *next;
+
+    /// Chunk memory, which follows the chunk unless adopted.
+    uint8_t *memory;
+
+    /// Amount of bytes of `memory` in use.
+    size_t used;
+
+    /// Size of `memory`, in bytes.
+    size_t capacity;
+} Chunk;
+
+/// Memory allocated by advancing through chunks, which are all freed at once.
+typedef struct Region {
+    /// Most recently allocated chunk, if any.
+    Chunk *chunks;
+
+    /// Size of next chunk, in bytes.
+    size_t next;
+
+    /// Indicates whether any allocation has failed.
+    bool failed;
+} Region;
+
+/// Identifies what remains to be done with the node of some Frame.
+typedef enum Step {
+    /// The node is to be loaded and its children evaluated.
+    STEP_REDUCE,
+
+    /// The head of the link is evaluated if `index` is 0, and the tail if 1.
+    STEP_LINK,
+
+    /// The array elements before `index` are evaluated.
+    STEP_ELEMENTS,
+
+    /// The enclosed node of the closure is evaluated, and the closure is to
+    /// be applied.
+    STEP_APPLY,
+
+    /// The result of the closure is evaluated.
+    STEP_RESULT,
+} Step;
+
+/// Pending evaluation work.
+///
+/// Each frame evaluates one node, after which it is popped and its evaluated
+/// node given to the frame below it.
+typedef struct Frame {
+    /// Step to take next.
+    Step step;
+
+    /// Node being evaluated.
+    const Node *node;
+
+    /// Loaded copy of node, unless being reduced.
+    Node loaded;
+
+    /// Position of next child to evaluate.
+    size_t index;
+
+    /// Evaluated link head, if evaluating a link tail.
+    const Node *head;
+
+    /// Copies of evaluated array elements, or `NULL` if none have changed.
+    Node *elements;
+} Frame;
+
+/// Identifies node, by heap and index if lazy, or by address otherwise.
+///
+/// Loading the same cell of a heap may give lazy nodes at different
+/// addresses, which are nevertheless the same node.
+typedef struct Key {
+    const void *address;
+    uint64_t index;
+} Key;
+
+/// Evaluated node of node, which is unused if its address is `NULL`.
+typedef struct Binding {
+    Key key;
+    const Node *value;
+} Binding;
+
+/// Evaluation state.
+typedef struct Evaluation {
+    /// Cache of function results, or `NULL` if unavailable.
+    rvm_Memo *memo;
+
+    /// Cache of hashes of the arguments of memoized functions. Arguments are
+    /// evaluated before being hashed, and evaluated nodes are neither
+    /// modified nor freed until evaluation is complete, which keeps the
+    /// cache valid.
+    rvm_HashCache hashes;
+
+    /// Memory allocated during evaluation.
+    Region region;
+
+    /// Evaluated nodes of nodes with children or lazy nodes, by key of node.
+    Binding *bindings;
+
+    /// Amount of bindings.
+    size_t bindingCount;
+
+    /// Amount of bindings that fit in `bindings`. Always zero or a power of
+    /// two.
+    size_t bindingCapacity;
+
+    /// Stack of pending work.
+    Frame *frames;
+
+    /// Amount of frames on stack.
+    size_t frameCount;
+
+    /// Amount of frames that fit in `frames`.
+    size_t frameCapacity;
+
+    /// Stack of promoted nodes whose references remain to be relocated.
+    Node **promoted;
+
+    /// Amount of promoted nodes on stack.
+    size_t promotedCount;
+
+    /// Amount of promoted nodes that fit in `promoted`.
+    size_t promotedCapacity;
+
+    /// Chunks of region ordered by address, which are only available during
+    /// promotion.
+    const Chunk **chunks;
+
+    /// Amount of chunks in `chunks`.
+    size_t chunkCount;
+} Evaluation;
+
+/// Value bound to nodes being evaluated, which only nodes referring to
+/// themselves ever reach.
+static const Node PENDING = {0};
+
+/// Cache of function results shared by all evaluations.
+static rvm_Memo *memo;
+
+/// Refers to region of evaluation of each thread.
+static pthread_key_t regionKey;
+
+/// Indicates whether `regionKey` was created.
+static bool hasRegionKey;
+
+/// Ensures that `memo` and `regionKey` are created at most once.
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+static void initialize(void);
+static Error reduce(const Node *node, Evaluation *evaluation,
+    const Node **out);
+static Error expand(Frame *frame, Evaluation *evaluation,
+    const Node **result);
+static Error join(Frame *frame, Evaluation *evaluation,
+    const Node **result);
+static Error gather(Frame *frame, Evaluation *evaluation,
+    const Node **result);
+static Error apply(Frame *frame, Evaluation *evaluation,
+    const Node **result);
+static Error descend(Evaluation *evaluation, const Node *node,
+    const Node **result);
+static Error settle(Evaluation *evaluation, const Node *value,
+    const Node **result);
+static Node *copyOf(Evaluation *evaluation, const Node *node);
+static bool push(Evaluation *evaluation, Frame frame);
+static Error recall(Evaluation *evaluation, const Function *function,
+    const Node *argument, Node *out, bool *found);
+static bool lookup(const Evaluation *evaluation, const Node *node,
+    const Node **out);
+static Key keyOf(const Node *node);
+static size_t positionOf(Key key, size_t mask);
+static bool bind(Evaluation *evaluation, const Node *node,
+    const Node *value);
+static Error promote(Evaluation *evaluation, Node *root, Region *out);
+static bool remember(Evaluation *evaluation, Node *node);
+static bool relocate(const Node **field, Evaluation *evaluation,
+    Region *out);
+static void forward(Node *node, Node *copy);
+static Node *forwardedOf(const Node *node);
+static void *allocateIn(Region *region, size_t size);
+static bool adoptIn(Region *region, void *memory, size_t size);
+static bool order(Evaluation *evaluation);
+static int compareChunks(const void *a, const void *b);
+static bool contains(const Evaluation *evaluation, const void *pointer);
+static void freeChunks(Chunk *chunk);
+
+rvm_Result rvm_evaluate(const rvm_Value *value) {
+    assert(value != NULL);
+
+    pthread_once(&once, initialize);
+    Evaluation evaluation = { .memo = memo };
+    void *outer = NULL;
+    if (hasRegionKey) {
+        outer = pthread_getspecific(regionKey);
+        pthread_setspecific(regionKey, &evaluation.region);
+    }
+    const Node *evaluated;
+    Error err = reduce(value, &evaluation, &evaluated);
+    if (hasRegionKey) {
+        pthread_setspecific(regionKey, outer);
+    }
+
+    Node root = *value;
+    Region promoted = {0};
+    if (rvm_getErrorKind(err) == RVM_ERROR_NONE) {
+        root = *evaluated;
+        err = promote(&evaluation, &root, &promoted);
+    }
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        freeChunks(promoted.chunks);
+        promoted.chunks = NULL;
+        root = *value;
+    }
+    freeChunks(evaluation.region.chunks);
+    free(evaluation.bindings);
+    free(evaluation.frames);
+    free(evaluation.promoted);
+    free(evaluation.chunks);
+    rvm_freeHashCache(&evaluation.hashes);
+
+    return (rvm_Result){
+        .error = err, .value = root, .memory = promoted.chunks,
+    };
+}
+
+void *rvm_allocate(size_t size) {
+    pthread_once(&once, initialize);
+    if (!hasRegionKey) {
+        return NULL;
+    }
+    Region *region = pthread_getspecific(regionKey);
+    if (region == NULL) {
+        return NULL;
+    }
+    return allocateIn(region, size);
+}
+
+void rvm_freeResult(rvm_Result *result) {
+    assert(result != NULL);
+
+    freeChunks(result->memory);
+    rvm_freeError(result->error);
+    *result = (rvm_Result){ .error = rvm_asError(RVM_ERROR_NONE, NULL) };
+}
+
+rvm_MemoStats rvm_getEvaluateMemoStats(void) {
+    pthread_once(&once, initialize);
+    if (memo == NULL) {
+        return (rvm_MemoStats){0};
+    }
+    return rvm_getMemoStats(memo);
+}
+
+/// Creates cache of function results and key of thread regions. Running out
+/// of memory causes function results not to be cached, or functions not to
+/// be able to allocate memory.
+void initialize(void) {
+    const rvm_MemoResult result = rvm_newMemo(RVM_EVALUATE_MEMO_CAPACITY);
+    if (result.ok) {
+        memo = result.as.memo;
+    } else {
+        rvm_freeError(result.as.error);
+    }
+    hasRegionKey = pthread_key_create(&regionKey, NULL) == 0;
+}
+
+/// Evaluates node, setting `out` to its evaluated node.
+///
+/// Nodes are never modified. Instead, every node whose children change is
+/// copied to the region of the evaluation, and bound to its copy, which
+/// makes nodes referred to more than once evaluated only once. Nodes whose
+/// children do not change are bound to themselves. Nodes are bound to
+/// PENDING while their children are evaluated, which is how nodes referring
+/// to themselves are detected.
+///
+/// Rather than recursing, pending work is kept on the explicit stack of the
+/// evaluation, which allows for arbitrarily long lists and deeply nested
+/// closures.
+Error reduce(const Node *node, Evaluation *evaluation, const Node **out) {
+    if (!push(evaluation, (Frame){ .step = STEP_REDUCE, .node = node })) {
+        return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+    }
+    const Node *result = NULL;
+    Error err = rvm_asError(RVM_ERROR_NONE, NULL);
+    while (evaluation->frameCount > 0) {
+        Frame *frame = &evaluation->frames[evaluation->frameCount - 1];
+        switch (frame->step) {
+        case STEP_REDUCE:
+            err = expand(frame, evaluation, &result);
+            break;
+
+        case STEP_LINK:
+            err = join(frame, evaluation, &result);
+            break;
+
+        case STEP_ELEMENTS:
+            err = gather(frame, evaluation, &result);
+            break;
+
+        case STEP_APPLY:
+            err = apply(frame, evaluation, &result);
+            break;
+
+        case STEP_RESULT:
+            err = settle(evaluation, result, &result);
+            break;
+        }
+        if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+            evaluation->frameCount = 0;
+            return err;
+        }
+    }
+    *out = result;
+    return err;
+}
+
+/// Loads node of frame, and either starts evaluating its children, or
+/// settles it right away if it has none or is already bound.
+Error expand(Frame *frame, Evaluation *evaluation, const Node **result) {
+    const Node *node = frame->node;
+    const Node *bound;
+    if (lookup(evaluation, node, &bound)) {
+        if (bound == &PENDING) {
+            return rvm_asError(RVM_ERROR_CYCLE, NULL);
+        }
+        evaluation->frameCount -= 1;
+        *result = bound;
+        return rvm_asError(RVM_ERROR_NONE, NULL);
+    }
+    frame->loaded = *node;
+    const Error err = rvm_loadNode(&frame->loaded);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        return err;
+    }
+
+    const rvm_NodeKind kind = rvm_getNodeKind(&frame->loaded);
+    switch (kind) {
+    case RVM_NODE_CLOSURE:
+    case RVM_NODE_ARRAY:
+    case RVM_NODE_LINK:
+        break;
+
+    default:
+        if (rvm_getNodeKind((Node *)node) != RVM_NODE_LAZY) {
+            evaluation->frameCount -= 1;
+            *result = node;
+            return rvm_asError(RVM_ERROR_NONE, NULL);
+        }
+        return settle(evaluation, copyOf(evaluation, &frame->loaded),
+            result);
+    }
+    if (!bind(evaluation, node, &PENDING)) {
+        return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+    }
+    frame->index = 0;
+    frame->head = NULL;
+    frame->elements = NULL;
+    switch (kind) {
+    case RVM_NODE_CLOSURE:
+        frame->step = STEP_APPLY;
+        return descend(evaluation, frame->loaded.as.closure.node, result);
+
+    case RVM_NODE_ARRAY:
+        frame->step = STEP_ELEMENTS;
+        return gather(frame, evaluation, result);
+
+    default:
+        frame->step = STEP_LINK;
+        return descend(evaluation, frame->loaded.as.link.head, result);
+    }
+}
+
+/// Receives evaluated head or tail of link, and settles the link once both
+/// are evaluated.
+Error join(Frame *frame, Evaluation *evaluation, const Node **result) {
+    if (frame->index == 0) {
+        frame->head = *result;
+        frame->index = 1;
+        return descend(evaluation, frame->loaded.as.link.tail, result);
+    }
+    const Node *tail = *result;
+    const rvm_NodeLink *link = &frame->loaded.as.link;
+    if (frame->head == link->head && tail == link->tail
+        && rvm_getNodeKind((Node *)frame->node) != RVM_NODE_LAZY) {
+        return settle(evaluation, frame->node, result);
+    }
+    const Node joined = {
+        .flags = RVM_NODE_LINK, .as.link = { frame->head, tail },
+    };
+    return settle(evaluation, copyOf(evaluation, &joined), result);
+}
+
+/// Receives evaluated array element, if any, and starts evaluating the next
+/// one, or settles the array if none remain. Elements are copied as soon as
+/// any of them changes.
+Error gather(Frame *frame, Evaluation *evaluation, const Node **result) {
+    const rvm_NodeArray *array = &frame->loaded.as.array;
+    if (frame->index > 0) {
+        const size_t i = frame->index - 1;
+        if (frame->elements == NULL && *result != &array->nodes[i]) {
+            frame->elements = allocateIn(&evaluation->region,
+                array->length * sizeof(Node));
+            if (frame->elements == NULL) {
+                return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+            }
+            memcpy(frame->elements, array->nodes, i * sizeof(Node));
+        }
+        if (frame->elements != NULL) {
+            frame->elements[i] = **result;
+        }
+    }
+    if (frame->index < array->length) {
+        const Node *element = &array->nodes[frame->index++];
+        return descend(evaluation, element, result);
+    }
+    if (frame->elements == NULL
+        && rvm_getNodeKind((Node *)frame->node) != RVM_NODE_LAZY) {
+        return settle(evaluation, frame->node, result);
+    }
+    Node gathered = frame->loaded;
+    if (frame->elements != NULL) {
+        gathered.as.array.nodes = frame->elements;
+    }
+    return settle(evaluation, copyOf(evaluation, &gathered), result);
+}
+
+/// Gives evaluated enclosed node of closure to its function, and starts
+/// evaluating the result.
+Error apply(Frame *frame, Evaluation *evaluation, const Node **result) {
+    const Function *function = frame->loaded.as.closure.function;
+    const Node *argument = *result;
+    const bool memoize = evaluation->memo != NULL
+        && (function->flags & RVM_FUNCTION_FLAGS_MEMOIZE) != 0;
+    Node applied;
+    bool found = false;
+    if (memoize) {
+        const Error err = recall(evaluation, function, argument, &applied,
+            &found);
+        if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+            return err;
+        }
+    }
+    if (!found) {
+        applied = function->pointer((Node *)argument);
+        if (evaluation->region.failed) {
+            return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+        }
+        if (memoize) {
+            const Error err = rvm_setMemoized(evaluation->memo, function,
+                argument, &applied, &evaluation->hashes);
+            if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+                return err;
+            }
+        }
+    }
+    Node *copy = copyOf(evaluation, &applied);
+    if (copy == NULL) {
+        return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+    }
+    frame->step = STEP_RESULT;
+    return descend(evaluation, copy, result);
+}
+
+/// Pushes frame evaluating node, or sets `result` to `NULL` right away if
+/// `node` is `NULL`.
+Error descend(Evaluation *evaluation, const Node *node, const Node **result) {
+    if (node == NULL) {
+        *result = NULL;
+        return rvm_asError(RVM_ERROR_NONE, NULL);
+    }
+    if (!push(evaluation, (Frame){ .step = STEP_REDUCE, .node = node })) {
+        return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+    }
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+/// Binds node of topmost frame to its evaluated node, which is `NULL` if out
+/// of memory, and pops the frame.
+Error settle(Evaluation *evaluation, const Node *value, const Node **result) {
+    const Frame *frame = &evaluation->frames[evaluation->frameCount - 1];
+    if (value == NULL || !bind(evaluation, frame->node, value)) {
+        return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+    }
+    evaluation->frameCount -= 1;
+    *result = value;
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+/// Copies node to the region of the evaluation, returning `NULL` if out of
+/// memory.
+Node *copyOf(Evaluation *evaluation, const Node *node) {
+    Node *copy = allocateIn(&evaluation->region, sizeof(Node));
+    if (copy != NULL) {
+        *copy = *node;
+    }
+    return copy;
+}
+
+/// Pushes frame to the stack of the evaluation.
+bool push(Evaluation *evaluation, Frame frame) {
+    if (evaluation->frameCount == evaluation->frameCapacity) {
+        const size_t capacity = evaluation->frameCapacity > 0
+            ? evaluation->frameCapacity * 2
+            : STACK_CAPACITY_INITIAL;
+        Frame *frames = realloc(evaluation->frames,
+            capacity * sizeof(Frame));
+        if (frames == NULL) {
+            return false;
+        }
+        evaluation->frames = frames;
+        evaluation->frameCapacity = capacity;
+    }
+    evaluation->frames[evaluation->frameCount++] = frame;
+    return true;
+}
+
+/// Looks up cached result of function, making the region of the evaluation
+/// hold any copy found.
+Error recall(Evaluation *evaluation, const Function *function,
+    const Node *argument, Node *out, bool *found) {
+    Node *copy;
+    size_t size;
+    const Error err = rvm_getMemoized(evaluation->memo, function, argument,
+        &evaluation->hashes, &copy, &size);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE || copy == NULL) {
+        *found = false;
+        return err;
+    }
+    if (!adoptIn(&evaluation->region, copy, size)) {
+        free(copy);
+        return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+    }
+    *out = *copy;
+    *found = true;
+
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+/// Resolves evaluated node bound to node, if any.
+bool lookup(const Evaluation *evaluation, const Node *node,
+    const Node **out) {
+    if (evaluation->bindingCapacity == 0) {
+        return false;
+    }
+    const Key key = keyOf(node);
+    const size_t mask = evaluation->bindingCapacity - 1;
+    for (size_t i = positionOf(key, mask);; i = (i + 1) & mask) {
+        const Binding *binding = &evaluation->bindings[i];
+        if (binding->key.address == NULL) {
+            return false;
+        }
+        if (binding->key.address == key.address
+            && binding->key.index == key.index) {
+            *out = binding->value;
+            return true;
+        }
+    }
+}
+
+/// Binds node to evaluated node, replacing any earlier binding. Bindings are
+/// doubled whenever more than three quarters of them are used.
+bool bind(Evaluation *evaluation, const Node *node, const Node *value) {
+    if ((evaluation->bindingCount + 1) * 4
+        > evaluation->bindingCapacity * 3) {
+        const size_t capacity = evaluation->bindingCapacity > 0
+            ? evaluation->bindingCapacity * 2
+            : BINDINGS_CAPACITY_INITIAL;
+        Binding *bindings = calloc(capacity, sizeof(Binding));
+        if (bindings == NULL) {
+            return false;
+        }
+        for (size_t i = 0; i < evaluation->bindingCapacity; ++i) {
+            const Binding *binding = &evaluation->bindings[i];
+            if (binding->key.address == NULL) {
+                continue;
+            }
+            size_t j = positionOf(binding->key, capacity - 1);
+            while (bindings[j].key.address != NULL) {
+                j = (j + 1) & (capacity - 1);
+            }
+            bindings[j] = *binding;
+        }
+        free(evaluation->bindings);
+        evaluation->bindings = bindings;
+        evaluation->bindingCapacity = capacity;
+    }
+    const Key key = keyOf(node);
+    const size_t mask = evaluation->bindingCapacity - 1;
+    size_t i = positionOf(key, mask);
+    while (evaluation->bindings[i].key.address != NULL
+        && (evaluation->bindings[i].key.address != key.address
+            || evaluation->bindings[i].key.index != key.index)) {
+        i = (i + 1) & mask;
+    }
+    if (evaluation->bindings[i].key.address == NULL) {
+        evaluation->bindingCount += 1;
+    }
+    evaluation->bindings[i] = (Binding){ key, value };
+    return true;
+}
+
+Key keyOf(const Node *node) {
+    if (rvm_getNodeKind((Node *)node) == RVM_NODE_LAZY) {
+        return (Key){ node->as.lazy.heap, rvm_getNodeIndex((Node *)node) };
+    }
+    return (Key){ node, 0 };
+}
+
+/// Calculates position of key in bindings, given mask of their capacity.
+size_t positionOf(Key key, size_t mask) {
+    uint64_t hash = ((uint64_t)(uintptr_t)key.address ^ key.index)
+        * 0x9e3779b97f4a7c15;
+    return (size_t)(hash ^ (hash >> 29)) & mask;
+}
+
+/// Copies the nodes and bytes of the region of the evaluation that are
+/// reachable from root to `out`, and makes all references to them refer to
+/// their copies instead.
+///
+/// Copied nodes are marked as forwarded to their copies, which makes nodes
+/// referred to more than once copied only once. Nodes outside of the region
+/// refer to no region memory, as they are never modified, which is why only
+/// root and copies need to be relocated. These are kept on a stack, which
+/// avoids recursion.
+Error promote(Evaluation *evaluation, Node *root, Region *out) {
+    if (!order(evaluation) || !remember(evaluation, root)) {
+        return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+    }
+    while (evaluation->promotedCount > 0) {
+        Node *node = evaluation->promoted[--evaluation->promotedCount];
+
+        bool ok = true;
+        switch (rvm_getNodeKind(node)) {
+        case RVM_NODE_BYTES:
+        case RVM_NODE_SYMBOL: {
+            const size_t length = node->as.bytes.length;
+            if (length == 0 || !contains(evaluation, node->as.bytes.bytes)) {
+                break;
+            }
+            uint8_t *bytes = allocateIn(out, length);
+            if ((ok = bytes != NULL)) {
+                memcpy(bytes, node->as.bytes.bytes, length);
+                node->as.bytes.bytes = bytes;
+            }
+            break;
+        }
+
+        case RVM_NODE_CLOSURE:
+            ok = relocate(&node->as.closure.node, evaluation, out);
+            break;
+
+        case RVM_NODE_ARRAY: {
+            const size_t length = node->as.array.length;
+            Node *elements = (Node *)node->as.array.nodes;
+            if (length == 0 || !contains(evaluation, elements)) {
+                break;
+            }
+            Node *copies = allocateIn(out, length * sizeof(Node));
+            if (!(ok = copies != NULL)) {
+                break;
+            }
+            for (size_t i = 0; i < length && ok; ++i) {
+                const Node *forwarded = forwardedOf(&elements[i]);
+                copies[i] = forwarded != NULL ? *forwarded : elements[i];
+                forward(&elements[i], &copies[i]);
+                ok = remember(evaluation, &copies[i]);
+            }
+            node->as.array.nodes = copies;
+            break;
+        }
+
+        case RVM_NODE_LINK:
+            ok = relocate(&node->as.link.head, evaluation, out)
+                && relocate(&node->as.link.tail, evaluation, out);
+            break;
+
+        default:
+            break;
+        }
+        if (!ok) {
+            return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+        }
+    }
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+/// Adds node to promoted nodes of evaluation.
+bool remember(Evaluation *evaluation, Node *node) {
+    if (evaluation->promotedCount == evaluation->promotedCapacity) {
+        const size_t capacity = evaluation->promotedCapacity > 0
+            ? evaluation->promotedCapacity * 2
+            : PROMOTED_CAPACITY_INITIAL;
+        Node **promoted = realloc(evaluation->promoted,
+            capacity * sizeof(Node *));
+        if (promoted == NULL) {
+            return false;
+        }
+        evaluation->promoted = promoted;
+        evaluation->promotedCapacity = capacity;
+    }
+    evaluation->promoted[evaluation->promotedCount++] = node;
+    return true;
+}
+
+/// Makes field refer to copy of node it refers to, if the node is in the
+/// region of the evaluation, copying the node first unless already copied.
+bool relocate(const Node **field, Evaluation *evaluation, Region *out) {
+    Node *node = (Node *)*field;
+    if (node == NULL || !contains(evaluation, node)) {
+        return true;
+    }
+    Node *copy = forwardedOf(node);
+    if (copy == NULL) {
+        copy = allocateIn(out, sizeof(Node));
+        if (copy == NULL || !remember(evaluation, copy)) {
+            return false;
+        }
+        *copy = *node;
+        forward(node, copy);
+    }
+    *field = copy;
+    return true;
+}
+
+/// Marks region node as copied to `copy`. Evaluated nodes are never lazy, and
+/// lazy nodes always refer to heaps, which tells forwarded nodes apart.
+void forward(Node *node, Node *copy) {
+    *node = (Node){
+        .flags = RVM_NODE_LAZY,
+        .as.lazy = { NULL, (const Node **)(void *)copy },
+    };
+}
+
+/// Resolves copy of forwarded region node, or `NULL` if not forwarded.
+Node *forwardedOf(const Node *node) {
+    if (rvm_getNodeKind((Node *)node) != RVM_NODE_LAZY
+        || node->as.lazy.heap != NULL) {
+        return NULL;
+    }
+    return (Node *)(void *)node->as.lazy.referrer;
+}
+
+/// Allocates memory from region, adding a chunk to the region if required.
+/// Chunks double in size up to a maximum, which keeps their count low.
+void *allocateIn(Region *region, size_t size) {
+    size = (size + REGION_ALIGNMENT - 1) & ~(size_t)(REGION_ALIGNMENT - 1);
+    Chunk *chunk = region->chunks;
+    if (chunk == NULL || chunk->capacity - chunk->used < size) {
+        size_t capacity = region->next > 0
+            ? region->next
+            : RVM_EVALUATE_CHUNK_SIZE_INITIAL;
+        region->next = capacity < RVM_EVALUATE_CHUNK_SIZE_MAXIMUM
+            ? capacity * 2
+            : capacity;
+        capacity = capacity > size ? capacity : size;
+        chunk = malloc(sizeof(Chunk) + capacity);
+        if (chunk == NULL) {
+            region->failed = true;
+            return NULL;
+        }
+        *chunk = (Chunk){ region->chunks, (uint8_t *)&chunk[1], 0, capacity };
+        region->chunks = chunk;
+    }
+    void *memory = &chunk->memory[chunk->used];
+    chunk->used += size;
+    return memory;
+}
+
+/// Makes region hold memory allocated elsewhere, which is freed along with
+/// the region. The memory is added behind the most recent chunk, which is
+/// therefore still used for allocations.
+bool adoptIn(Region *region, void *memory, size_t size) {
+    Chunk *chunk = malloc(sizeof(Chunk));
+    if (chunk == NULL) {
+        return false;
+    }
+    *chunk = (Chunk){ NULL, memory, size, size };
+    if (region->chunks != NULL) {
+        chunk->next = region->chunks->next;
+        region->chunks->next = chunk;
+    } else {
+        region->chunks = chunk;
+    }
+    return true;
+}
+
+/// Orders chunks of the region of the evaluation by address, which makes it
+/// possible to tell whether pointers refer to region memory in logarithmic
+/// time, however many memoized results were adopted.
+bool order(Evaluation *evaluation) {
+    size_t count = 0;
+    for (const Chunk *chunk = evaluation->region.chunks; chunk != NULL;
+         chunk = chunk->next) {
+        count += 1;
+    }
+    if (count == 0) {
+        return true;
+    }
+    const Chunk **chunks = malloc(count * sizeof(Chunk *));
+    if (chunks == NULL) {
+        return false;
+    }
+    size_t i = 0;
+    for (const Chunk *chunk = evaluation->region.chunks; chunk != NULL;
+         chunk = chunk->next) {
+        chunks[i++] = chunk;
+    }
+    qsort(chunks, count, sizeof(Chunk *), compareChunks);
+    evaluation->chunks = chunks;
+    evaluation->chunkCount = count;
+    return true;
+}
+
+/// Compares chunks by the addresses of their memory.
+int compareChunks(const void *a, const void *b) {
+    const uintptr_t x = (uintptr_t)(*(const Chunk *const *)a)->memory;
+    const uintptr_t y = (uintptr_t)(*(const Chunk *const *)b)->memory;
+    return (x > y) - (x < y);
+}
+
+/// Determines whether pointer refers to memory allocated from the region of
+/// the evaluation, by searching its ordered chunks for the last one starting
+/// at or before pointer.
+bool contains(const Evaluation *evaluation, const void *pointer) {
+    const uintptr_t address = (uintptr_t)pointer;
+    size_t low = 0;
+    size_t high = evaluation->chunkCount;
+    while (low < high) {
+        const size_t middle = low + (high - low) / 2;
+        if ((uintptr_t)evaluation->chunks[middle]->memory <= address) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low == 0) {
+        return false;
+    }
+    const Chunk *chunk = evaluation->chunks[low - 1];
+    return address - (uintptr_t)chunk->memory < chunk->used;
+}
+
+void freeChunks(Chunk *chunk) {
+    while (chunk != NULL) {
+        Chunk *next = chunk->next;
+        if (chunk->memory != (uint8_t *)&chunk[1]) {
+            free(chunk->memory);
+        }
+        free(chunk);
+        chunk = next;
+    }
+}
@@ -7,15 +7,105 @@
 
 #include <stdint.h>
 #include "error.h"
+#include "memo.h"
 #include "value.h"
 
+/// Maximum total size of the function results cached by rvm_evaluate(), in
+/// bytes.
+#define RVM_EVALUATE_MEMO_CAPACITY (64 * 1024 * 1024)
+
+/// Size of the first chunk of memory allocated for each evaluation, in bytes.
+#define RVM_EVALUATE_CHUNK_SIZE_INITIAL (64 * 1024)
+
+/// Maximum size of chunks of memory allocated for evaluations, in bytes,
+/// unless larger chunks are required to fit single allocations.
+#define RVM_EVALUATE_CHUNK_SIZE_MAXIMUM (16 * 1024 * 1024)
+
 typedef struct rvm_Result rvm_Result;
 
+/// The result of evaluating an rvm_Value.
+///
+/// \see rvm_freeResult()
 struct rvm_Result {
+    /// Error object, indicating any issues with evaluation.
     rvm_Error error;
+
+    /// Evaluated value, unless evaluation failed.
     rvm_Value value;
+
+    /// Memory allocated for nodes of evaluated value, if any.
+    void *memory;
 };
 
-rvm_Result rvm_evaluate(rvm_Value *value);
+/// Evaluates given value.
+///
+/// Values are evaluated by loading every lazy node and applying every
+/// closure, until neither remain. Closures are applied by evaluating their
+/// enclosed nodes and giving them to their functions, after which whatever
+/// the functions return is evaluated in turn. Pending work is kept on a
+/// stack in allocated memory rather than on the call stack, which means that
+/// values may be arbitrarily long or deeply nested.
+///
+/// ## Sharing
+///
+/// Given nodes are never modified, whether owned by the caller or by a heap,
+/// which means that the same nodes may be evaluated any amount of times, also
+/// by other threads at once. Rather, every node whose children change during
+/// evaluation is copied, and the copy changed instead. Each node is evaluated
+/// at most once by each evaluation, however many times it is referred to. Lazy
+/// nodes referring to the same node of the same heap are the same node.
+///
+/// A closure that depends on its own value reaches itself while being
+/// evaluated, which causes evaluation to fail with an RVM_ERROR_CYCLE error,
+/// rather than to go on forever.
+///
+/// ## Memory
+///
+/// Each evaluation has a region of memory, from which rvm_allocate() serves
+/// functions by advancing a pointer through large chunks, and which also
+/// holds copied nodes. Once evaluation is complete, the nodes and bytes of
+/// the region that are still referred to by the evaluated value are copied
+/// to memory held by the result, after which the whole region is freed at
+/// once. Temporary nodes are therefore never freed one by one, and the cost
+/// of an evaluation depends on how much memory it keeps rather than on how
+/// much it allocates. If evaluation fails, the whole region is freed.
+///
+/// ## Memoization
+///
+/// Results of closures whose functions have the RVM_FUNCTION_FLAGS_MEMOIZE
+/// flag are cached by function and enclosed node, and reused whenever equal
+/// closures are evaluated, by this or any later evaluation.
+///
+/// \param value Pointer to value to evaluate.
+/// \returns     Evaluated value, or error object indicating any issues, in
+///              which case the value is given value. Must be given to
+///              rvm_freeResult() once no longer used.
+///
+/// \see rvm_getEvaluateMemoStats()
+rvm_Result rvm_evaluate(const rvm_Value *value);
+
+/// Allocates memory for nodes or bytes created by a function being applied by
+/// rvm_evaluate() on the calling thread.
+///
+/// The memory is held by the evaluation, and is either freed when the
+/// evaluation is complete, or moved to memory held by its result if still
+/// referred to by the evaluated value. It must therefore not be referred to
+/// in any other way, nor be freed.
+///
+/// \param size Amount of bytes to allocate.
+/// \returns    Pointer to memory aligned for rvm_Node objects, or `NULL` if
+///             no function is being applied, or if out of memory, which makes
+///             the evaluation fail with an RVM_ERROR_NOMEMORY error.
+void *rvm_allocate(size_t size);
+
+/// Frees resources held by given result, including its error.
+///
+/// Nodes of the evaluated value may refer to memory held by the result, and
+/// must therefore not be used once the result is freed.
+void rvm_freeResult(rvm_Result *result);
+
+/// Resolves usage statistics of the cache of function results used by
+/// rvm_evaluate().
+rvm_MemoStats rvm_getEvaluateMemoStats(void);
 
 #endif
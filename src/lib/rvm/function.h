@@ -7,8 +7,16 @@
 
 #include <stdint.h>
 
+/// Indicates that some rvm_Function is pure, which means that its results
+/// depend only on the nodes it is given. Results of such functions may be
+/// memoized.
+///
+/// \see rvm_Memo
+#define RVM_FUNCTION_FLAGS_MEMOIZE 0x00000001
+
 typedef struct rvm_Function rvm_Function;
-typedef struct rvm_Node rvm_Node;
+
+struct rvm_Node;
 
 /// A named node function of known arity.
 struct rvm_Function {
@@ -19,7 +27,12 @@ struct rvm_Function {
     intptr_t arity;
 
     /// Pointer to actual C function.
-    rvm_Node (*pointer)(rvm_Node *);
+    struct rvm_Node (*pointer)(struct rvm_Node *);
+
+    /// Function flags.
+    ///
+    /// Contains bit flags, such as RVM_FUNCTION_FLAGS_MEMOIZE.
+    uint32_t flags;
 };
 
 #endif
@@ -0,0 +1,562 @@
+#include "hash.h"
+#include <string.h>
+#include "heap.h"
+
+/// Initial amount of entries that fit in hash caches. Must be a power of two.
+#define CACHE_CAPACITY_INITIAL 64
+
+/// Amount of nodes that can be pending while hashing or comparing nodes
+/// before memory has to be allocated for more.
+#define STACK_CAPACITY_INITIAL 32
+
+/// Initial hash state, which is the FNV-1a 64-bit offset basis.
+#define HASH_INITIAL 0xcbf29ce484222325
+
+/// Hash of absent nodes.
+#define HASH_NULL 0x9e3779b97f4a7c15
+
+typedef rvm_Error Error;
+typedef rvm_HashCache Cache;
+typedef rvm_Node Node;
+
+/// Cached hash, which is unused if its address is `NULL`.
+struct rvm_HashCacheEntry {
+    /// Address of loaded node, or of heap of lazy node.
+    const void *address;
+
+    /// Index of lazy node, or 0 for loaded nodes.
+    uint64_t index;
+
+    /// Hash of node.
+    uint64_t hash;
+};
+
+typedef struct rvm_HashCacheEntry Entry;
+
+/// Identifies node in hash cache.
+typedef struct Key {
+    const void *address;
+    uint64_t index;
+} Key;
+
+/// Node whose hash is yet to be calculated, as it depends on the hashes of
+/// its children.
+typedef struct Pending {
+    /// Identifies node in hash cache.
+    Key key;
+
+    /// Loaded copy of node.
+    Node loaded;
+
+    /// Position of next child to hash.
+    size_t next;
+
+    /// Hash of node and the children hashed so far.
+    uint64_t hash;
+} Pending;
+
+/// Nodes that remain to be compared.
+typedef struct Pair {
+    const Node *a;
+    const Node *b;
+} Pair;
+
+/// Set of pairs of nodes already compared, which is unused if its first node
+/// is `NULL`.
+typedef struct Compared {
+    /// Pairs of nodes, or `NULL` if none have been allocated.
+    Pair *pairs;
+
+    /// Amount of pairs that fit in `pairs`. Always zero or a power of two.
+    size_t capacity;
+
+    /// Amount of pairs in set.
+    size_t count;
+} Compared;
+
+/// Stack of items, which starts out in a buffer not owned by the stack.
+typedef struct Stack {
+    /// Items, which must be freed unless they are in the initial buffer.
+    void *items;
+
+    /// Amount of items on stack.
+    size_t count;
+
+    /// Amount of items that fit in `items`.
+    size_t capacity;
+
+    /// Size of each item, in bytes.
+    size_t size;
+} Stack;
+
+static Error hashOf(const Node *node, Cache *cache, uint64_t *out);
+static Error begin(const Node *node, Cache *cache, Stack *stack,
+    uint64_t *out, bool *resolved);
+static bool childOf(const Node *node, size_t index, const Node **out);
+static size_t countChildren(const Node *node);
+static Error equalOf(const Node *a, const Node *b, Cache *cache, bool *out);
+static bool push(Stack *stack);
+static bool compare(Compared *compared, Pair pair, bool *seen);
+static Error loadedOf(const Node *node, Node *out);
+static Key keyOf(const Node *node);
+static bool lookup(const Cache *cache, Key key, uint64_t *out);
+static void insert(Cache *cache, Key key, uint64_t hash);
+static bool grow(Cache *cache);
+static uint64_t hashKey(Key key);
+static uint64_t hashBytes(uint64_t hash, const uint8_t *bytes, size_t length);
+static uint64_t combine(uint64_t hash, uint64_t word);
+
+rvm_Error rvm_hashNode(const rvm_Node *node, rvm_HashCache *cache,
+    uint64_t *out) {
+    assert(out != NULL);
+
+    if (cache != NULL) {
+        return hashOf(node, cache, out);
+    }
+    // Shared nodes would otherwise be hashed once per path leading to them.
+    Cache visited = {0};
+    const Error err = hashOf(node, &visited, out);
+    rvm_freeHashCache(&visited);
+    return err;
+}
+
+rvm_Error rvm_equalNodes(const rvm_Node *a, const rvm_Node *b,
+    rvm_HashCache *cache, bool *out) {
+    assert(out != NULL);
+
+    return equalOf(a, b, cache, out);
+}
+
+void rvm_clearHashCache(rvm_HashCache *cache) {
+    assert(cache != NULL);
+
+    if (cache->entries != NULL) {
+        memset(cache->entries, 0, cache->capacity * sizeof(Entry));
+    }
+    cache->count = 0;
+}
+
+void rvm_freeHashCache(rvm_HashCache *cache) {
+    assert(cache != NULL);
+
+    free(cache->entries);
+    *cache = (Cache){0};
+}
+
+/// Calculates hash of node.
+///
+/// Rather than recursing, nodes whose hashes depend on those of their
+/// children are kept on an explicit stack until all of their children are
+/// hashed, allowing for long lists as well as deeply nested closures and
+/// arrays. The hash of each node is the combination of its kind, any
+/// contents, and the hashes of its children in order.
+Error hashOf(const Node *node, Cache *cache, uint64_t *out) {
+    Pending buffer[STACK_CAPACITY_INITIAL];
+    Stack stack = { buffer, 0, STACK_CAPACITY_INITIAL, sizeof(Pending) };
+    uint64_t hash;
+    bool resolved;
+    Error err = begin(node, cache, &stack, &hash, &resolved);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        goto done;
+    }
+    while (stack.count > 0) {
+        Pending *pending = &((Pending *)stack.items)[stack.count - 1];
+        if (resolved) {
+            pending->hash = combine(pending->hash, hash);
+        }
+        const Node *child;
+        if (!childOf(&pending->loaded, pending->next++, &child)) {
+            hash = pending->hash;
+            insert(cache, pending->key, hash);
+            stack.count -= 1;
+            resolved = true;
+            continue;
+        }
+        err = begin(child, cache, &stack, &hash, &resolved);
+        if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+            goto done;
+        }
+    }
+    *out = hash;
+
+done:
+    if (stack.items != buffer) {
+        free(stack.items);
+    }
+    return err;
+}
+
+/// Resolves hash of node if it has no children or is cached, or pushes it
+/// to stack of nodes whose children remain to be hashed otherwise.
+Error begin(const Node *node, Cache *cache, Stack *stack, uint64_t *out,
+    bool *resolved) {
+    *resolved = true;
+    if (node == NULL) {
+        *out = HASH_NULL;
+        return rvm_asError(RVM_ERROR_NONE, NULL);
+    }
+    const Key key = keyOf(node);
+    if (lookup(cache, key, out)) {
+        return rvm_asError(RVM_ERROR_NONE, NULL);
+    }
+    Node loaded;
+    const Error err = loadedOf(node, &loaded);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        return err;
+    }
+    const rvm_NodeKind kind = rvm_getNodeKind(&loaded);
+    uint64_t hash = combine(HASH_INITIAL, kind);
+    switch (kind) {
+    case RVM_NODE_BYTES:
+    case RVM_NODE_SYMBOL:
+        hash = hashBytes(hash, loaded.as.bytes.bytes, loaded.as.bytes.length);
+        break;
+
+    case RVM_NODE_NUMBER:
+        hash = combine(hash, (uint64_t)loaded.as.number.integer);
+        break;
+
+    case RVM_NODE_CLOSURE:
+        hash = combine(hash, (uint64_t)(uintptr_t)loaded.as.closure.function);
+        goto pending;
+
+    case RVM_NODE_ARRAY:
+        hash = combine(hash, loaded.as.array.length);
+        goto pending;
+
+    case RVM_NODE_LINK:
+        goto pending;
+
+    default:
+        break;
+    }
+    insert(cache, key, hash);
+    *out = hash;
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+
+pending:
+    if (!push(stack)) {
+        return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+    }
+    ((Pending *)stack->items)[stack->count - 1] = (Pending){
+        key, loaded, 0, hash,
+    };
+    *resolved = false;
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+/// Resolves child of loaded node at given position, if any, which is either
+/// the enclosed node of a closure, an array element, or the head or tail of
+/// a link, in that order.
+bool childOf(const Node *node, size_t index, const Node **out) {
+    switch (rvm_getNodeKind((Node *)node)) {
+    case RVM_NODE_CLOSURE:
+        *out = node->as.closure.node;
+        return index == 0;
+
+    case RVM_NODE_ARRAY:
+        if (index >= node->as.array.length) {
+            return false;
+        }
+        *out = &node->as.array.nodes[index];
+        return true;
+
+    case RVM_NODE_LINK:
+        *out = index == 0 ? node->as.link.head : node->as.link.tail;
+        return index < 2;
+
+    default:
+        return false;
+    }
+}
+
+/// Counts children of loaded node.
+size_t countChildren(const Node *node) {
+    switch (rvm_getNodeKind((Node *)node)) {
+    case RVM_NODE_CLOSURE:
+        return 1;
+
+    case RVM_NODE_ARRAY:
+        return node->as.array.length;
+
+    case RVM_NODE_LINK:
+        return 2;
+
+    default:
+        return 0;
+    }
+}
+
+/// Determines whether nodes are equal.
+///
+/// Rather than recursing, pairs of nodes that remain to be compared are kept
+/// on an explicit stack, allowing for long lists as well as deeply nested
+/// closures and arrays. Each pair is compared at most once, which keeps
+/// comparisons of nodes sharing children from taking exponential time.
+Error equalOf(const Node *a, const Node *b, Cache *cache, bool *out) {
+    Pair buffer[STACK_CAPACITY_INITIAL];
+    Stack stack = { buffer, 1, STACK_CAPACITY_INITIAL, sizeof(Pair) };
+    buffer[0] = (Pair){ a, b };
+    Compared compared = {0};
+    Error err = rvm_asError(RVM_ERROR_NONE, NULL);
+    *out = true;
+
+    while (*out && stack.count > 0) {
+        const Pair pair = ((Pair *)stack.items)[--stack.count];
+        a = pair.a;
+        b = pair.b;
+        if (a == b) {
+            continue;
+        }
+        if (a == NULL || b == NULL) {
+            *out = false;
+            break;
+        }
+        const Key x = keyOf(a);
+        const Key y = keyOf(b);
+        if (x.index != 0 && x.address == y.address && x.index == y.index) {
+            continue;
+        }
+        if (cache != NULL) {
+            uint64_t p;
+            uint64_t q;
+            if (rvm_getErrorKind(err = hashOf(a, cache, &p)) != RVM_ERROR_NONE
+                || rvm_getErrorKind(err = hashOf(b, cache, &q))
+                    != RVM_ERROR_NONE) {
+                goto done;
+            }
+            if (p != q) {
+                *out = false;
+                break;
+            }
+        }
+        Node m;
+        Node n;
+        if (rvm_getErrorKind(err = loadedOf(a, &m)) != RVM_ERROR_NONE
+            || rvm_getErrorKind(err = loadedOf(b, &n)) != RVM_ERROR_NONE) {
+            goto done;
+        }
+        const rvm_NodeKind kind = rvm_getNodeKind(&m);
+        if (kind != rvm_getNodeKind(&n)) {
+            *out = false;
+            break;
+        }
+        switch (kind) {
+        case RVM_NODE_BYTES:
+        case RVM_NODE_SYMBOL:
+            *out = m.as.bytes.length == n.as.bytes.length
+                && (m.as.bytes.length == 0
+                    || memcmp(m.as.bytes.bytes, n.as.bytes.bytes,
+                           m.as.bytes.length) == 0);
+            continue;
+
+        case RVM_NODE_NUMBER:
+            *out = m.as.number.integer == n.as.number.integer;
+            continue;
+
+        case RVM_NODE_CLOSURE:
+            *out = m.as.closure.function == n.as.closure.function;
+            break;
+
+        case RVM_NODE_ARRAY:
+            *out = m.as.array.length == n.as.array.length;
+            break;
+
+        default:
+            break;
+        }
+        // Pairs with children are only expanded the first time reached.
+        bool seen = false;
+        if (*out && countChildren(&m) > 0 && !compare(&compared, pair, &seen)) {
+            err = rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+            goto done;
+        }
+        if (seen) {
+            continue;
+        }
+        // Children are pushed in reverse, which makes them be compared in
+        // order, and link heads before tails.
+        for (size_t i = countChildren(&m); *out && i > 0; --i) {
+            const Node *p = NULL;
+            const Node *q = NULL;
+            childOf(&m, i - 1, &p);
+            childOf(&n, i - 1, &q);
+            if (!push(&stack)) {
+                err = rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+                goto done;
+            }
+            ((Pair *)stack.items)[stack.count - 1] = (Pair){ p, q };
+        }
+    }
+
+done:
+    if (stack.items != buffer) {
+        free(stack.items);
+    }
+    free(compared.pairs);
+    return err;
+}
+
+/// Adds item to top of stack, leaving it uninitialized. Items are moved to
+/// allocated memory of twice the size whenever the stack is full.
+bool push(Stack *stack) {
+    if (stack->count == stack->capacity) {
+        void *items = malloc(stack->capacity * 2 * stack->size);
+        if (items == NULL) {
+            return false;
+        }
+        memcpy(items, stack->items, stack->count * stack->size);
+        if (stack->capacity != STACK_CAPACITY_INITIAL) {
+            free(stack->items);
+        }
+        stack->items = items;
+        stack->capacity *= 2;
+    }
+    stack->count += 1;
+    return true;
+}
+
+/// Adds pair to set of compared pairs, setting `seen` if already added. The
+/// set is doubled whenever more than three quarters of it is used.
+bool compare(Compared *compared, Pair pair, bool *seen) {
+    if ((compared->count + 1) * 4 > compared->capacity * 3) {
+        const size_t capacity = compared->capacity > 0
+            ? compared->capacity * 2
+            : CACHE_CAPACITY_INITIAL;
+        Compared grown = { calloc(capacity, sizeof(Pair)), capacity, 0 };
+        if (grown.pairs == NULL) {
+            return false;
+        }
+        for (size_t i = 0; i < compared->capacity; ++i) {
+            if (compared->pairs[i].a != NULL) {
+                compare(&grown, compared->pairs[i], seen);
+            }
+        }
+        free(compared->pairs);
+        *compared = grown;
+    }
+    const size_t mask = compared->capacity - 1;
+    const uint64_t hash = combine(
+        combine(HASH_INITIAL, (uint64_t)(uintptr_t)pair.a),
+        (uint64_t)(uintptr_t)pair.b);
+    for (size_t i = (size_t)hash & mask;; i = (i + 1) & mask) {
+        Pair *entry = &compared->pairs[i];
+        if (entry->a == NULL) {
+            *entry = pair;
+            compared->count += 1;
+            *seen = false;
+            return true;
+        }
+        if (entry->a == pair.a && entry->b == pair.b) {
+            *seen = true;
+            return true;
+        }
+    }
+}
+
+/// Copies node to `out`, loading it if lazy.
+Error loadedOf(const Node *node, Node *out) {
+    *out = *node;
+    return rvm_loadNode(out);
+}
+
+/// Identifies node by heap and index if lazy, or by address otherwise.
+Key keyOf(const Node *node) {
+    if (rvm_getNodeKind((Node *)node) == RVM_NODE_LAZY) {
+        return (Key){ node->as.lazy.heap, rvm_getNodeIndex((Node *)node) };
+    }
+    return (Key){ node, 0 };
+}
+
+bool lookup(const Cache *cache, Key key, uint64_t *out) {
+    if (cache == NULL || cache->entries == NULL) {
+        return false;
+    }
+    const size_t mask = cache->capacity - 1;
+    for (size_t i = (size_t)hashKey(key) & mask;; i = (i + 1) & mask) {
+        const Entry *entry = &cache->entries[i];
+        if (entry->address == NULL) {
+            return false;
+        }
+        if (entry->address == key.address && entry->index == key.index) {
+            *out = entry->hash;
+            return true;
+        }
+    }
+}
+
+/// Caches hash of node, unless the cache cannot grow to fit it.
+void insert(Cache *cache, Key key, uint64_t hash) {
+    if (cache == NULL
+        || ((cache->count + 1) * 4 > cache->capacity * 3 && !grow(cache))) {
+        return;
+    }
+    const size_t mask = cache->capacity - 1;
+    for (size_t i = (size_t)hashKey(key) & mask;; i = (i + 1) & mask) {
+        Entry *entry = &cache->entries[i];
+        if (entry->address == NULL) {
+            *entry = (Entry){ key.address, key.index, hash };
+            cache->count += 1;
+            return;
+        }
+        if (entry->address == key.address && entry->index == key.index) {
+            entry->hash = hash;
+            return;
+        }
+    }
+}
+
+/// Doubles capacity of cache, moving all entries to new memory.
+bool grow(Cache *cache) {
+    const size_t capacity = cache->capacity > 0
+        ? cache->capacity * 2
+        : CACHE_CAPACITY_INITIAL;
+    Entry *entries = calloc(capacity, sizeof(Entry));
+    if (entries == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < cache->capacity; ++i) {
+        const Entry *entry = &cache->entries[i];
+        if (entry->address == NULL) {
+            continue;
+        }
+        const Key key = { entry->address, entry->index };
+        size_t j = (size_t)hashKey(key) & (capacity - 1);
+        while (entries[j].address != NULL) {
+            j = (j + 1) & (capacity - 1);
+        }
+        entries[j] = *entry;
+    }
+    free(cache->entries);
+    cache->entries = entries;
+    cache->capacity = capacity;
+    return true;
+}
+
+uint64_t hashKey(Key key) {
+    return combine(combine(HASH_INITIAL, (uint64_t)(uintptr_t)key.address),
+        key.index);
+}
+
+/// Hashes bytes eight at a time, zero-padding the last word.
+uint64_t hashBytes(uint64_t hash, const uint8_t *bytes, size_t length) {
+    hash = combine(hash, length);
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, &bytes[i], 8);
+        hash = combine(hash, word);
+    }
+    if (i < length) {
+        uint64_t word = 0;
+        memcpy(&word, &bytes[i], length - i);
+        hash = combine(hash, word);
+    }
+    return hash;
+}
+
+/// Mixes word into hash.
+uint64_t combine(uint64_t hash, uint64_t word) {
+    hash = (hash ^ word) * 0xff51afd7ed558ccd;
+    return hash ^ (hash >> 32);
+}
@@ -0,0 +1,84 @@
+#ifndef LIB_RVM_HASH_H
+#define LIB_RVM_HASH_H
+
+/// RVM node hashing and equality utilities.
+///
+/// Nodes are hashed and compared structurally, meaning that two nodes are
+/// equal if they are of the same kind and have equal contents and children,
+/// regardless of where they are stored. Lazy nodes are loaded as needed, and
+/// are equal to the nodes they refer to. Closures are equal if they refer to
+/// the same function and equal nodes.
+///
+/// \file
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "error.h"
+#include "node.h"
+
+typedef struct rvm_HashCache rvm_HashCache;
+
+struct rvm_HashCacheEntry;
+
+/// A cache of node hashes.
+///
+/// Hashes of loaded nodes are cached by node address, while those of lazy
+/// nodes are cached by heap and index. Hashing a tree again, or any part of
+/// it, therefore takes constant time, and so does telling apart nodes whose
+/// hashes differ. As addresses are only meaningful while nodes exist and are
+/// not modified, caches must be cleared or freed before any node hashed with
+/// them is modified or freed. Caches must not be used by multiple threads at
+/// once.
+///
+/// Caches are created by zero-initializing them, and freed using
+/// rvm_freeHashCache(). Running out of memory while growing a cache only
+/// causes hashes not to be cached.
+struct rvm_HashCache {
+    /// Cache entries, or `NULL` if none have been allocated.
+    struct rvm_HashCacheEntry *entries;
+
+    /// Amount of entries that fit in `entries`.
+    size_t capacity;
+
+    /// Amount of cached hashes.
+    size_t count;
+};
+
+/// Calculates hash of given node and all nodes it refers to.
+///
+/// Each distinct node is hashed once, no matter how many nodes refer to it,
+/// which makes the time taken linear in the amount of distinct nodes. When
+/// not given a cache, a cache is allocated for the duration of the call, which
+/// takes memory linear in that same amount. Hashing nodes sharing children
+/// repeatedly is therefore best done with a cache.
+///
+/// \param node  Pointer to node, or `NULL`.
+/// \param cache Pointer to cache of hashes, or `NULL`.
+/// \param out   Pointer to hash receiver.
+/// \returns     Error object, indicating any issues with loading nodes.
+rvm_Error rvm_hashNode(const rvm_Node *node, rvm_HashCache *cache,
+    uint64_t *out);
+
+/// Determines whether given nodes are structurally equal.
+///
+/// Nodes at the same address, and lazy nodes referring to the same index of
+/// the same heap, are equal without being visited. When given a cache, nodes
+/// are hashed before being compared, and nodes whose hashes differ are not
+/// visited either.
+///
+/// \param a     Pointer to first node, or `NULL`.
+/// \param b     Pointer to second node, or `NULL`.
+/// \param cache Pointer to cache of hashes, or `NULL`.
+/// \param out   Pointer to receiver of `true` only if nodes are equal.
+/// \returns     Error object, indicating any issues with loading nodes.
+rvm_Error rvm_equalNodes(const rvm_Node *a, const rvm_Node *b,
+    rvm_HashCache *cache, bool *out);
+
+/// Forgets all hashes of given cache.
+void rvm_clearHashCache(rvm_HashCache *cache);
+
+/// Frees memory held by given cache, which is left empty.
+void rvm_freeHashCache(rvm_HashCache *cache);
+
+#endif
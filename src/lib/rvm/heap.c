@@ -1,33 +1,3895 @@
+#define _DEFAULT_SOURCE
+
+#include "heap.h"
 #include <errno.h>
 #include <fcntl.h>
-#include <stdint.h>
-#include <stdio.h>
-#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
+#include "cell.h"
+
+/// Identifies heap memory. Spells "RVMHEAP" in little-endian ASCII.
+#define HEADER_MAGIC 0x00504145484d5652
+
+/// Heap memory format version.
+#define HEADER_VERSION 5
+
+/// Oldest heap memory format version that can be read. Version 2 lacks
+/// immediate words, version 3 packed arrays and version 4 unrolled links, but
+/// they are otherwise identical.
+#define HEADER_VERSION_MINIMUM 2
+
+/// Identifies revision records. Spells "RVMRECRD" in little-endian ASCII.
+#define RECORD_MAGIC 0x44524345524d5652
+
+/// Identifies checkpoints. Spells "RVMCHKPT" in little-endian ASCII.
+#define CHECKPOINT_MAGIC 0x54504b48434d5652
+
+/// Identifies deltas. Spells "RVMDELTA" in little-endian ASCII.
+#define DELTA_MAGIC 0x41544c45444d5652
+
+/// Delta format version.
+#define DELTA_VERSION 1
+
+/// Amount of bytes read at a time when applying deltas.
+#define DELTA_CHUNK_LENGTH 65536
+
+/// Amount of pages whose residency is queried at a time.
+#define RESIDENCY_PAGES 4096
+
+/// Initial checksum state, which is the FNV-1a 64-bit offset basis.
+#define CHECKSUM_INITIAL 0xcbf29ce484222325
+
+/// Size of new heap files, in bytes.
+#define FILE_CAPACITY_INITIAL 65536
+
+/// Size of the chunks heap files are extended by once they have reached this
+/// size through doubling, in bytes.
+#define FILE_CHUNK_LENGTH 0x0000000004000000
+
+/// Size of the virtual address range reserved for each file heap, in bytes.
+#if UINTPTR_MAX > 0xffffffff
+#define FILE_RESERVATION_LENGTH 0x0000010000000000
+#else
+#define FILE_RESERVATION_LENGTH 0x0000000040000000
+#endif
+
+/// Alignment of file heap reservations, which allows for their mappings to
+/// be backed by huge pages.
+#define HUGE_PAGE_LENGTH 0x0000000000200000
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+/// Minimum amount of bytes allocated at once by the private pools of file
+/// heaps.
+#define POOL_BLOCK_CAPACITY 32768
+
+/// Initial amount of revisions that fit in revision tables.
+#define REVISIONS_CAPACITY_INITIAL 16
+
+/// Initial amount of slots in hash-consing tables. Must be a power of two.
+#define CELLS_CAPACITY_INITIAL 16
+
+/// Initial amount of slots in tables of loaded nodes. Must be a power of two.
+#define SWIZZLES_CAPACITY_INITIAL 1024
+
+/// Initial amount of offsets that fit in stacks of cells pending traversal.
+#define PENDING_CAPACITY_INITIAL 256
+
+/// Amount of bytes of file heaps read ahead when a node refers to a cell
+/// outside of the range read ahead last.
+#define READAHEAD_LENGTH 262144
+
+/// Amount of children of each loaded node whose cells are prefetched.
+#define PREFETCH_CHILDREN 8
+
+/// Maximum amount of links stored in a single link cell.
+#define LINK_UNROLL_MAX 8
+
+/// Suffix of temporary files created while vacuuming heap files.
+#define VACUUM_SUFFIX ".vacuum-XXXXXX"
+
+/// Maximum amount of threads reading from a heap at the same time. Any
+/// additional readers wait for a slot to become available.
+#define READER_SLOTS 64
+
+/// Cell header bit marking cells already copied during collection, in which
+/// case the header holds the new cell offset instead of the cell length.
+#define CELL_FORWARDED 0x0000000000000080
+
+typedef rvm_Error Error;
+typedef rvm_Heap Heap;
+typedef rvm_HeapResult HeapResult;
+typedef rvm_Node Node;
+
+typedef struct CellEntry CellEntry;
+typedef struct CellTable CellTable;
+typedef struct Checkpoint Checkpoint;
+typedef struct Delta Delta;
+typedef struct DeltaTrailer DeltaTrailer;
+typedef struct Header Header;
+typedef struct LogState LogState;
+typedef struct Mapping Mapping;
+typedef struct Pending Pending;
+typedef struct PoolBlock PoolBlock;
+typedef struct Record Record;
+typedef struct Retired Retired;
+typedef struct Store Store;
+typedef struct Swizzle Swizzle;
+typedef struct Swizzles Swizzles;
+
+/// # Heap Memory Layout
+///
+/// Heap memory is an append-only log, consisting of a header followed by
+/// segments. Each segment consists of any number of commits, optionally
+/// followed by a checkpoint. A commit consists of the cells stored by a call
+/// to `set`, followed by a revision record. A checkpoint consists of the root
+/// offsets of a range of revisions, followed by a checkpoint trailer. Nothing
+/// written to heap memory is ever modified.
+///
+/// ```
+/// | Header | Cells | Record | Cells | Record | Roots | Checkpoint | ...
+///          '-------- commit --------'        '--- checkpoint ---'
+///          '--------------------- segment ----------------------'
+/// ```
+///
+/// Both records and checkpoint trailers end with a checksum and a magic word,
+/// which means that the last commit or checkpoint of a heap can be found by
+/// reading its last words. Checkpoints are only written when heaps are
+/// synchronized, after any preceding commits have been committed to disk, and
+/// file heaps are truncated to end right after them. Opening a heap that was
+/// synchronized before it was last closed therefore only requires reading its
+/// last checkpoint, as well as the checkpoints that one refers to.
+///
+/// The checksum of a record covers every word from the beginning of its
+/// segment up to the checksum itself. As a consequence, a valid record proves
+/// that every commit before it in the same segment is intact. If a heap was
+/// not synchronized before it was last closed, its last segment is verified
+/// when opened. Any commits that turn out to be incomplete are discarded,
+/// which is only ever the case if the heap was never synchronized after they
+/// were created.
+
+/// Heap header, located at offset 0 of every heap memory.
+struct Header {
+    uint64_t magic;
+    uint64_t version;
+};
+
+/// Revision record, ending every commit.
+struct Record {
+    /// Revision created by commit.
+    uint64_t revision;
+
+    /// Offset of root cell of revision.
+    uint64_t root;
+
+    /// Offset of record of previous revision, if any.
+    uint64_t previous;
+
+    /// Offset of latest checkpoint trailer preceding this record, if any.
+    uint64_t checkpoint;
+
+    /// Checksum of segment up to this field.
+    uint64_t checksum;
+
+    /// Always RECORD_MAGIC.
+    uint64_t magic;
+};
+
+/// Checkpoint trailer, ending every checkpoint.
+///
+/// Each checkpoint contains the roots of a range of revisions ending with the
+/// latest revision at the time it was written. Ranges are chosen such that the
+/// range of each checkpoint is at least as large as the ranges of all newer
+/// checkpoints combined, which means that the roots of all revisions can be
+/// collected from a logarithmic amount of checkpoints.
+struct Checkpoint {
+    /// Last revision covered by checkpoint.
+    uint64_t revision;
+
+    /// Amount of revisions covered by checkpoint, which is also the amount of
+    /// roots preceding this trailer.
+    uint64_t count;
+
+    /// Offset of trailer of previous checkpoint, if any.
+    uint64_t previous;
+
+    /// Offset of record of last revision covered by checkpoint.
+    uint64_t record;
+
+    /// Checksum of roots and above fields.
+    uint64_t checksum;
+
+    /// Always CHECKPOINT_MAGIC.
+    uint64_t magic;
+};
+
+/// Delta header, preceding the log segment of every delta.
+///
+/// A delta contains the part of the log of a heap that follows the last
+/// record or checkpoint of its base revision, up to the end of its target
+/// revision. As cells refer to each other by relative offsets, such a
+/// segment can only be applied to a heap whose log is identical up to where
+/// the segment begins, which is verified using the checksum of the record or
+/// checkpoint it follows.
+struct Delta {
+    /// Always DELTA_MAGIC.
+    uint64_t magic;
+
+    /// Always DELTA_VERSION.
+    uint64_t version;
+
+    /// Revision delta applies to.
+    uint64_t base;
+
+    /// Revision reached when applied.
+    uint64_t revision;
+
+    /// Offset at which log segment begins.
+    uint64_t begin;
+
+    /// Checksum of record or checkpoint ending at `begin`, or 0 if the
+    /// segment begins right after the heap header.
+    uint64_t anchor;
+
+    /// Length of log segment, in bytes.
+    uint64_t length;
+};
+
+/// Delta trailer, following the log segment of every delta.
+struct DeltaTrailer {
+    /// Checksum of log segment.
+    uint64_t checksum;
+
+    /// Always DELTA_MAGIC.
+    uint64_t magic;
+};
+
+/// Position of the end of a heap log, saved while applying a delta.
+struct LogState {
+    uint64_t top;
+    uint64_t revision;
+    uint64_t record;
+    uint64_t checkpoint;
+    uint64_t checksum;
+
+    /// Trailer of the checkpoint replaced by the delta, if `top` is past the
+    /// beginning of the delta. The roots it covers remain in the revision
+    /// table, from which the checkpoint is rebuilt.
+    Checkpoint replaced;
+};
+
+/// Stack of offsets of cells whose children remain to be traversed, which
+/// lets heaps of any depth be traversed without recursion. Buffer heaps keep
+/// it in scratch memory claimed via claimScratch().
+struct Pending {
+    uint64_t *offsets;
+    size_t count;
+    size_t capacity;
+};
+
+/// Hash-consing table entry.
+struct CellEntry {
+    /// Cell offset, or RVM_NODE_INDEX_NONE if entry is unused.
+    uint64_t offset;
+
+    /// Hash of cell contents.
+    uint64_t hash;
+};
+
+/// Hash table of cell offsets, keyed by cell contents.
+struct CellTable {
+    CellEntry *entries;
+    uint64_t capacity;
+    uint64_t count;
+};
+
+/// A file mapping replaced by a larger one.
+///
+/// Replaced mappings are kept until their heap is freed, as nodes loaded from
+/// them may still refer to their bytes.
+struct Mapping {
+    Mapping *next;
+    uint8_t *memory;
+    uint64_t length;
+};
+
+/// A revision table replaced by a larger one, which is freed once no reader
+/// can be using it.
+struct Retired {
+    Retired *next;
+    uint64_t *roots;
+
+    /// Epoch during which table was replaced.
+    uint64_t epoch;
+};
+
+/// Table entry associating a cell with the node loaded from it.
+struct Swizzle {
+    /// Cell offset, or RVM_NODE_INDEX_NONE if entry is unused.
+    uint64_t offset;
+
+    /// Loaded node, or `NULL` if not yet published.
+    const Node *node;
+};
 
-int main(void) {
-    int fd = open("tmp.mmap", O_RDWR | O_CREAT);
+/// Table of nodes loaded from a file heap.
+///
+/// Entries are claimed by atomically setting their offsets, and are never
+/// removed. Full tables are replaced by copies twice as large, which may lose
+/// entries added while being copied. As the table only serves as a cache, such
+/// entries are simply loaded again when next needed.
+struct Swizzles {
+    uint64_t capacity;
+
+    /// Amount of entries claimed, or about to be claimed.
+    uint64_t count;
+
+    Swizzle entries[];
+};
+
+/// A block of private memory owned by a file heap.
+struct PoolBlock {
+    PoolBlock *next;
+    size_t length;
+    size_t capacity;
+    uint64_t words[];
+};
+
+/// Private data of heaps.
+///
+/// Cells are allocated from `memory` by bumping `top` until `capacity` is
+/// reached. What happens then depends on the kind of heap. File heaps grow
+/// their files, while buffer heaps fail. Buffer heaps also store this
+/// structure and all other private data, such as loaded nodes, at the end of
+/// their buffers, which is why their capacities shrink over time. Memory only
+/// needed during a single operation, such as traversal stacks, is instead
+/// claimed right after their cells, and released when the operation is done.
+///
+/// All fields are guarded by `lock`, which is only ever released while
+/// holding it would block other threads for the duration of a disk flush.
+/// The exception are the fields read by `get` and `load`, which never take
+/// `lock`. Those fields are `memory`, `top`, `revision` and `roots`, which are
+/// only ever replaced via atomic stores, as well as the fields related to
+/// private memory, which are guarded by `poolLock`.
+///
+/// Revision tables are replaced when they become full. As readers may still be
+/// using a replaced table, it is retired rather than freed. Each reader
+/// announces the epoch it started in while reading, and retired tables are
+/// freed once every active reader started in a later epoch than the one in
+/// which they were retired. This is only done by file heaps, as buffer heaps
+/// cannot free private memory, which is also why buffer heap readers do not
+/// announce themselves.
+struct Store {
+    pthread_mutex_t lock;
+
+    /// Broadcast whenever a flush completes.
+    pthread_cond_t flushed;
+
+    /// Signalled whenever a flush is requested or the flusher is stopped.
+    pthread_cond_t requested;
+
+    /// Guards allocation of private memory, as well as the capacity of buffer
+    /// heaps. Never held while taking `lock`.
+    pthread_mutex_t poolLock;
+
+    /// Offset of first byte after all cells allocated by the writer, whether
+    /// committed or not. Buffer heaps only.
+    uint64_t allocated;
+
+    /// Current epoch.
+    uint64_t epoch;
+
+    /// Epochs during which active readers started, or 0 for unused slots.
+    /// Holds READER_SLOTS slots. File heaps only.
+    uint64_t *readers;
+
+    /// Replaced revision tables not yet freed.
+    Retired *retired;
+
+    uint8_t *memory;
+    uint64_t capacity;
+
+    /// Offset of first byte after latest commit or checkpoint.
+    uint64_t top;
+
+    /// Latest revision.
+    uint64_t revision;
+
+    /// Offset of record of latest revision, if any.
+    uint64_t record;
+
+    /// Offset of latest checkpoint trailer, if any.
+    uint64_t checkpoint;
+
+    /// Checksum of current segment, up to `top`.
+    uint64_t checksum;
+
+    /// Root cell offsets, indexed by revision.
+    uint64_t *roots;
+    uint64_t rootsCapacity;
+
+    /// Hash-consing table of cell offsets, if hash-consing is enabled.
+    CellTable cells;
+    bool isHashConsing;
+
+    /// Interning table of symbol cell offsets, used while not hash-consing.
+    /// Filled with the symbols in heap memory when first needed.
+    CellTable symbols;
+    bool isSymbolsIndexed;
+
+    /// Functions loaded closures may refer to, and their identities, as
+    /// calculated by rvm_getCellFunction().
+    const rvm_Function *const *functions;
+    uint64_t *functionIdentities;
+    size_t functionCount;
+
+    /// Nodes loaded so far, by cell offset. File heaps only.
+    Swizzles *swizzles;
+
+    /// Range of heap memory read ahead last. File heaps only.
+    uint64_t readAheadBegin;
+    uint64_t readAheadEnd;
+
+    /// Number of lazy nodes loaded, and of cells decoded to load them.
+    uint64_t loads;
+    uint64_t decodes;
+
+    /// Grows memory to hold at least `minimum` bytes, or fails.
+    Error (*grow)(Store *s, uint64_t minimum);
+
+    /// Allocates `size` bytes of memory that lives as long as this heap.
+    void *(*allocPrivate)(Store *s, size_t size);
+
+    // File heaps only.
+    FILE *file;
+    int fd;
+    bool isOwner;
+    bool isWritable;
+    uint64_t length;
+    Mapping *mappings;
+    PoolBlock *pool;
+
+    /// Virtual address range reserved for heap memory, which starts at an
+    /// aligned offset within it, or `NULL` if reservation failed.
+    uint8_t *reservation;
+    uint64_t reservationLength;
+
+    /// Latest revision known to be committed to disk.
+    uint64_t durable;
+
+    /// Offset of first byte after last commit or checkpoint known to be
+    /// committed to disk.
+    uint64_t durableTop;
+
+    /// Latest revision requested to be committed to disk.
+    uint64_t pending;
+
+    /// Number of completed flushes, by duration. Holds
+    /// RVM_HEAP_LATENCY_BUCKETS buckets.
+    uint64_t *flushLatencies;
+
+    /// Whether some thread is currently flushing heap memory.
+    bool isFlushing;
+
+    /// Background flusher, if any.
+    pthread_t flusher;
+    bool hasFlusher;
+    bool isStopping;
+    uint64_t interval;
+};
+
+static HeapResult openFile(FILE *file, bool isOwner);
+static Error initFile(Store *s);
+static Error mapFile(Store *s, uint64_t length);
+static void unmapFile(Store *s);
+static Error growFile(Store *s, uint64_t minimum);
+static bool isReserved(Store *s, uint8_t *memory);
+static void adviseHugePages(uint8_t *memory, uint64_t length);
+static void prefetchCell(Store *s, const uint8_t *memory, uint64_t top,
+    uint64_t offset);
+static void *allocFilePrivate(Store *s, size_t size);
+static Error growBuffer(Store *s, uint64_t minimum);
+static void *allocBufferPrivate(Store *s, size_t size);
+static void *claimScratch(Store *s, size_t size);
+static void releaseScratch(Store *s, size_t size);
+
+static unsigned enterEpoch(Store *s);
+static void exitEpoch(Store *s, unsigned slot);
+static uint64_t *allocRoots(Store *s, uint64_t capacity);
+static void retireRoots(Store *s, uint64_t *roots);
+static void reclaimRoots(Store *s, bool isForced);
+static void initLock(Store *s);
+static void freeLock(Store *s);
+static void initHeader(Store *s);
+static void resetLog(Store *s);
+static Error openLog(Store *s, uint64_t end);
+static Error readCheckpoints(Store *s, uint64_t offset);
+static void readCommits(Store *s, uint64_t end);
+static bool isCheckpointAt(Store *s, uint64_t offset);
+static Error writeRecord(Store *s, uint64_t *top, uint64_t root);
+static Error writeCheckpoint(Store *s);
+static Error reserveRevision(Store *s, uint64_t revision);
+static uint64_t checksumOf(const uint8_t *memory, uint64_t begin,
+    uint64_t end, uint64_t checksum);
+static Error flushStore(Store *s, uint64_t revision);
+static int flushRange(uint8_t *memory, uint64_t begin, uint64_t end);
+static void countFlush(Store *s, const struct timespec *start);
+static void *runFlusher(void *argument);
+static Error stopFlusher(Store *s);
+static Heap heapOf(Store *s);
+
+static void heapFree(Heap *self);
+static Error heapGet(Heap *self, rvm_Value *out, const uint64_t revision);
+static Error heapLoad(const Heap *self, Node *node);
+static const int64_t *heapIntegersOf(const Heap *self, const Node *node,
+    size_t *length);
+static Error heapSet(Heap *self, const rvm_Value value);
+static Error heapUseFunctions(Heap *self,
+    const rvm_Function *const *functions, size_t count);
+static const rvm_Function *functionOf(const Store *s, uint64_t identity);
+static uint64_t *identifyFunctions(Store *s,
+    const rvm_Function *const *functions, size_t count);
+static Error heapSync(Heap *self);
+static Error heapSyncAsync(Heap *self, rvm_HeapTicket *out);
+static Error heapAwait(Heap *self, rvm_HeapTicket ticket);
+static Error heapFlushEvery(Heap *self, uint64_t milliseconds);
+static Error heapCollect(Heap *self, const uint64_t *revisions,
+    size_t count);
+static Error heapHashCons(Heap *self, bool isEnabled);
+static Error heapWriteDelta(Heap *self, uint64_t base, uint64_t revision,
+    FILE *out);
+static Error heapApplyDelta(Heap *self, FILE *in);
+static Error applyDelta(Heap *self, const Delta *delta, FILE *in);
+static bool isTruncated(FILE *in, uint64_t length);
+static bool findAnchor(Store *s, uint64_t revision, uint64_t *begin,
+    uint64_t *anchor);
+static void rewindLog(Store *s, uint64_t begin);
+static void restoreLog(Store *s, const LogState *state, uint64_t begin);
+static Error heapStats(Heap *self, rvm_HeapStats *out);
+static Error scanCells(Store *s, uint64_t begin,
+    Error (*visit)(Store *s, uint64_t offset, void *context), void *context);
+static Error countCell(Store *s, uint64_t offset, void *context);
+static Error countLive(Store *s, rvm_HeapNodeStats *out);
+static Error countReachable(Store *s, uint64_t offset, uint64_t *marks,
+    rvm_HeapNodeStats *out);
+static uint64_t countResident(Store *s);
+static bool pushPending(Store *s, Pending *pending, uint64_t offset);
+static void freePending(Store *s, Pending *pending);
+
+static Error loadNode(const Heap *self, Node *node);
+static Error decodeCell(const Heap *self, uint64_t offset, Node *out);
+static const Node *childNode(const Heap *self, Node *out,
+    const uint64_t *word, uint64_t parent, const Node **referrer);
+static const Node *findLoaded(Store *s, uint64_t offset);
+static const Node *publishLoaded(Store *s, uint64_t offset, const Node *node);
+static Swizzles *growSwizzles(Store *s, Swizzles *table);
+static uint64_t hashOffset(uint64_t offset);
+static void copyLoaded(Node *out, const Node *node);
+static Error setValue(Heap *self, const rvm_Value value);
+
+static Error collectStore(Store *s, const uint64_t *revisions, size_t count);
+static Error copyReachable(Store *s, const uint64_t *fromRoots, uint8_t *from,
+    uint64_t end, const uint64_t *revisions, size_t count, uint64_t *top,
+    uint64_t *roots);
+static Error vacuumStore(Store *s, Store *t, const uint64_t *revisions,
+    size_t count);
+static int syncDirectoryOf(const char *path);
+static Error copyCell(Store *s, uint8_t *from, uint64_t end, uint64_t offset,
+    uint64_t *top, uint64_t *out);
+static void moveRoots(const Store *s, uint64_t *roots, uint64_t from,
+    uint64_t to);
+static Error commitCollection(Store *s, uint64_t *roots, uint64_t top);
+static void reclaimPrivate(Store *s);
+
+static Error allocCell(Store *s, uint64_t size, uint64_t *top, uint64_t *out);
+static Error storeNode(Heap *self, const Heap *source, const Node *node,
+    uint64_t *top, uint64_t *out);
+static Error storeChild(Heap *self, const Heap *source, const Node *node,
+    uint64_t *top, uint64_t *out);
+static Node *allocNodes(Store *s, size_t count);
+#ifndef NDEBUG
+static bool isCellOf(Store *s, const Node *node);
+#endif
+static Error internCell(Store *s, uint64_t offset, uint64_t *top,
+    uint64_t *out);
+static Error insertCell(Store *s, CellTable *table, uint64_t offset,
+    uint64_t *out);
+static void forgetCells(CellTable *table, uint64_t top);
+static Error indexSymbol(Store *s, uint64_t offset, void *context);
+static Error indexRevisions(Heap *self);
+static Error indexCell(Heap *self, uint64_t offset);
+static uint64_t hashCell(Store *s, uint64_t offset);
+static bool equalCells(Store *s, uint64_t a, uint64_t b);
+static void childSlotsOf(uint64_t header, uint64_t *first, uint64_t *last);
+static uint64_t tailSlotOf(uint64_t header);
+static uint64_t unrolledLengthOf(const Node *link);
+static bool isPackable(const Node *array);
+static void storeSlot(Store *s, uint64_t parent, uint64_t slot,
+    uint64_t target);
+static void lazyNode(const Heap *self, Node *node, uint64_t offset,
+    const Node **referrer);
+
+static uint64_t toRelative(uint64_t offset, uint64_t target);
+static uint64_t fromRelative(uint64_t offset, uint64_t relative);
+
+static Error errorFromErrno(void);
+
+rvm_HeapResult rvm_bufferAsHeap(uint8_t *buffer, const size_t length) {
+    assert(buffer != NULL || length == 0);
+
+    const uintptr_t begin = rvm_alignCellSize((uintptr_t)buffer);
+    const uintptr_t end = ((uintptr_t)buffer + length)
+        & ~(uintptr_t)(RVM_CELL_ALIGNMENT - 1);
+    if (end < begin || end - begin < sizeof(Header) + sizeof(Store)) {
+        return (HeapResult){
+            .ok = false,
+            .as.error = rvm_asError(RVM_ERROR_NOMEMORY, NULL),
+        };
+    }
+    Store *s = (Store *)(end - rvm_alignCellSize(sizeof(Store)));
+    *s = (Store){
+        .memory = (uint8_t *)begin,
+        .capacity = (uint64_t)((uintptr_t)s - begin),
+        .grow = growBuffer,
+        .allocPrivate = allocBufferPrivate,
+    };
+    initLock(s);
+    initHeader(s);
+    s->allocated = s->top;
+    const Error err = reserveRevision(s, 0);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        freeLock(s);
+        return (HeapResult){ .ok = false, .as.error = err };
+    }
+    return (HeapResult){ .ok = true, .as.heap = heapOf(s) };
+}
+
+rvm_HeapResult rvm_fileAsHeap(FILE *file) {
+    assert(file != NULL);
+
+    return openFile(file, false);
+}
+
+rvm_HeapResult rvm_fileIntoHeap(FILE *file) {
+    assert(file != NULL);
+
+    return openFile(file, true);
+}
+
+rvm_Error rvm_vacuumHeapFile(const char *path, const uint64_t *revisions,
+    size_t count) {
+    assert(path != NULL);
+    assert(revisions != NULL || count == 0);
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return errorFromErrno();
+    }
+    HeapResult source = openFile(file, true);
+    if (!source.ok) {
+        return source.as.error;
+    }
+
+    // The copy is created next to the original, as it can only be renamed
+    // atomically within the same file system.
+    Error err = rvm_asError(RVM_ERROR_NONE, NULL);
+    const size_t length = strlen(path);
+    char *copyPath = malloc(length + sizeof(VACUUM_SUFFIX));
+    if (copyPath == NULL) {
+        err = rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+        goto done;
+    }
+    memcpy(copyPath, path, length);
+    memcpy(&copyPath[length], VACUUM_SUFFIX, sizeof(VACUUM_SUFFIX));
+    const int fd = mkstemp(copyPath);
     if (fd < 0) {
-        puts(strerror(errno));
-        return 1;
-    }
-    for (int i = 0; i < 64; ++i) {
-        uint64_t len = 1UL << i;
-        printf("Mapping %zu bytes of memory ... ", len);
-        uint8_t* m = mmap(NULL, len, PROT_READ | PROT_WRITE,
-                 MAP_PRIVATE, fd, 0);
-        if (m == MAP_FAILED) {
-            printf("failed (%s).\n", strerror(errno));
+        err = errorFromErrno();
+        goto done;
+    }
+    struct stat st;
+    FILE *copy = NULL;
+    if (fstat(fileno(file), &st) != 0 || fchmod(fd, st.st_mode & 07777) != 0
+        || (copy = fdopen(fd, "w+b")) == NULL) {
+        err = errorFromErrno();
+        close(fd);
+        unlink(copyPath);
+        goto done;
+    }
+    HeapResult target = openFile(copy, true);
+    if (!target.ok) {
+        err = target.as.error;
+        unlink(copyPath);
+        goto done;
+    }
+    err = vacuumStore(source.as.heap.internal, target.as.heap.internal,
+        revisions, count);
+    if (rvm_getErrorKind(err) == RVM_ERROR_NONE && fsync(fd) != 0) {
+        err = errorFromErrno();
+    }
+    heapFree(&target.as.heap);
+    if (rvm_getErrorKind(err) == RVM_ERROR_NONE
+        && (rename(copyPath, path) != 0 || syncDirectoryOf(path) != 0)) {
+        err = errorFromErrno();
+    }
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        unlink(copyPath);
+    }
+
+done:
+    free(copyPath);
+    heapFree(&source.as.heap);
+    return err;
+}
+
+HeapResult openFile(FILE *file, bool isOwner) {
+    Error err;
+
+    Store *s = calloc(1, sizeof(Store));
+    if (s == NULL) {
+        err = rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+        goto fail;
+    }
+    initLock(s);
+    if ((s->readers = calloc(READER_SLOTS, sizeof(uint64_t))) == NULL
+        || (s->flushLatencies = calloc(RVM_HEAP_LATENCY_BUCKETS,
+                sizeof(uint64_t))) == NULL) {
+        err = rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+        goto fail;
+    }
+    s->grow = growFile;
+    s->allocPrivate = allocFilePrivate;
+    s->file = file;
+    s->isOwner = isOwner;
+
+    if (fflush(file) != 0 || (s->fd = fileno(file)) < 0) {
+        err = errorFromErrno();
+        goto fail;
+    }
+    const int mode = fcntl(s->fd, F_GETFL);
+    if (mode < 0) {
+        err = errorFromErrno();
+        goto fail;
+    }
+    s->isWritable = (mode & O_ACCMODE) == O_RDWR;
+
+    struct stat st;
+    if (fstat(s->fd, &st) != 0) {
+        err = errorFromErrno();
+        goto fail;
+    }
+    if (st.st_size == 0) {
+        err = initFile(s);
+        if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+            goto fail;
+        }
+    } else {
+        if ((uint64_t)st.st_size < sizeof(Header)) {
+            err = rvm_asError(RVM_ERROR_CORRUPT, NULL);
+            goto fail;
+        }
+        err = mapFile(s, (uint64_t)st.st_size);
+        if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+            goto fail;
+        }
+        Header *header = (Header *)s->memory;
+        if (header->magic != HEADER_MAGIC
+            || header->version < HEADER_VERSION_MINIMUM
+            || header->version > HEADER_VERSION) {
+            err = rvm_asError(RVM_ERROR_CORRUPT, NULL);
+            goto fail;
+        }
+        // Older files are upgraded before anything is written to them, which
+        // keeps older readers from misreading immediate words.
+        if (header->version != HEADER_VERSION && s->isWritable) {
+            header->version = HEADER_VERSION;
+            if (flushRange(s->memory, 0, sizeof(Header)) != 0) {
+                err = errorFromErrno();
+                goto fail;
+            }
+        }
+        err = openLog(s, s->capacity & ~(uint64_t)(RVM_CELL_ALIGNMENT - 1));
+        if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+            goto fail;
+        }
+        // Any revisions not covered by a checkpoint are flushed again, which
+        // causes the next flush to write a checkpoint covering them.
+        s->durable = s->checkpoint != RVM_NODE_INDEX_NONE
+            ? ((const Checkpoint *)&s->memory[s->checkpoint])->revision
+            : 0;
+        s->durableTop = s->top;
+        s->pending = s->durable;
+    }
+
+    return (HeapResult){ .ok = true, .as.heap = heapOf(s) };
+
+fail:
+    if (s != NULL) {
+        unmapFile(s);
+        for (PoolBlock *b = s->pool, *next; b != NULL; b = next) {
+            next = b->next;
+            free(b);
+        }
+        free(s->roots);
+        reclaimRoots(s, true);
+        free(s->readers);
+        free(s->flushLatencies);
+        freeLock(s);
+    }
+    free(s);
+    if (isOwner) {
+        fclose(file);
+    }
+    return (HeapResult){ .ok = false, .as.error = err };
+}
+
+Error initFile(Store *s) {
+    assert(s != NULL);
+
+    if (!s->isWritable) {
+        return rvm_asError(RVM_ERROR_IO, NULL);
+    }
+    if (ftruncate(s->fd, FILE_CAPACITY_INITIAL) != 0) {
+        return errorFromErrno();
+    }
+    const Error err = mapFile(s, FILE_CAPACITY_INITIAL);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        return err;
+    }
+    initHeader(s);
+
+    return reserveRevision(s, 0);
+}
+
+/// Maps file of given length into memory.
+///
+/// A large range of virtual addresses is first reserved, and the file is
+/// mapped at its beginning. As long as the file fits in the reservation, it
+/// can then be grown by extending the mapping in place, which means that
+/// pointers into heap memory remain valid. If no range can be reserved, the
+/// file is mapped wherever the system sees fit.
+///
+/// The mapping length is rounded up to a multiple of the page size, while the
+/// capacity is set to the given length. Memory between the two must not be
+/// accessed before the file is extended.
+Error mapFile(Store *s, uint64_t length) {
+    const uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    const int prot = PROT_READ | (s->isWritable ? PROT_WRITE : 0);
+    s->length = (length + page - 1) & ~(page - 1);
+    s->capacity = length;
+
+    if (s->length <= FILE_RESERVATION_LENGTH) {
+        const uint64_t reservationLength = FILE_RESERVATION_LENGTH
+            + HUGE_PAGE_LENGTH;
+        uint8_t *reservation = mmap(NULL, reservationLength, PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (reservation != MAP_FAILED) {
+            uint8_t *memory = (uint8_t *)(((uintptr_t)reservation
+                + HUGE_PAGE_LENGTH - 1) & ~(uintptr_t)(HUGE_PAGE_LENGTH - 1));
+            if (mmap(memory, s->length, prot, MAP_SHARED | MAP_FIXED, s->fd, 0)
+                != MAP_FAILED) {
+                s->reservation = reservation;
+                s->reservationLength = reservationLength;
+                s->memory = memory;
+                adviseHugePages(s->memory, s->length);
+                return rvm_asError(RVM_ERROR_NONE, NULL);
+            }
+            munmap(reservation, reservationLength);
+        }
+    }
+
+    s->memory = mmap(NULL, s->length, prot, MAP_SHARED, s->fd, 0);
+    if (s->memory == MAP_FAILED) {
+        s->memory = NULL;
+        return errorFromErrno();
+    }
+    adviseHugePages(s->memory, s->length);
+
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+/// Unmaps file heap memory, including any replaced mappings.
+void unmapFile(Store *s) {
+    if (s->memory != NULL && !isReserved(s, s->memory)) {
+        munmap(s->memory, s->length);
+    }
+    if (s->reservation != NULL) {
+        munmap(s->reservation, s->reservationLength);
+    }
+    for (Mapping *m = s->mappings, *next; m != NULL; m = next) {
+        next = m->next;
+        munmap(m->memory, m->length);
+        free(m);
+    }
+    s->memory = NULL;
+    s->mappings = NULL;
+}
+
+/// Grows file heap to hold at least `minimum` bytes.
+///
+/// As file heaps are truncated when synchronized, there may be room enough in
+/// the current mapping, in which case the file is only extended to fill it.
+/// Otherwise the file is extended by doubling its size until it reaches
+/// FILE_CHUNK_LENGTH, after which it is extended in chunks of that size.
+///
+/// If the extended file fits in the reserved range, its mapping is extended in
+/// place. Otherwise a new mapping is created, and the old one is kept until
+/// the heap is freed.
+Error growFile(Store *s, uint64_t minimum) {
+    assert(s != NULL);
+
+    if (!s->isWritable) {
+        return rvm_asError(RVM_ERROR_IO, NULL);
+    }
+    if (minimum <= s->length) {
+        if (ftruncate(s->fd, (off_t)s->length) != 0) {
+            return errorFromErrno();
+        }
+        s->capacity = s->length;
+        return rvm_asError(RVM_ERROR_NONE, NULL);
+    }
+    uint64_t length = s->length;
+    while (length < minimum && length < FILE_CHUNK_LENGTH) {
+        length *= 2;
+    }
+    if (length < minimum) {
+        length = (minimum + FILE_CHUNK_LENGTH - 1)
+            & ~(uint64_t)(FILE_CHUNK_LENGTH - 1);
+    }
+
+    if (isReserved(s, s->memory) && (uint64_t)(s->memory - s->reservation)
+            + length <= s->reservationLength) {
+        if (ftruncate(s->fd, (off_t)length) != 0) {
+            return errorFromErrno();
+        }
+        if (mmap(&s->memory[s->length], length - s->length,
+                PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, s->fd,
+                (off_t)s->length)
+            == MAP_FAILED) {
+            return errorFromErrno();
+        }
+        adviseHugePages(&s->memory[s->length], length - s->length);
+        s->length = length;
+        s->capacity = length;
+        return rvm_asError(RVM_ERROR_NONE, NULL);
+    }
+
+    Mapping *mapping = malloc(sizeof(Mapping));
+    if (mapping == NULL) {
+        return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+    }
+    if (ftruncate(s->fd, (off_t)length) != 0) {
+        free(mapping);
+        return errorFromErrno();
+    }
+    uint8_t *memory = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED,
+        s->fd, 0);
+    if (memory == MAP_FAILED) {
+        free(mapping);
+        return errorFromErrno();
+    }
+    adviseHugePages(memory, length);
+    if (isReserved(s, s->memory)) {
+        // The old mapping is unmapped with the reservation.
+        free(mapping);
+    } else {
+        *mapping = (Mapping){
+            .next = s->mappings,
+            .memory = s->memory,
+            .length = s->length,
+        };
+        s->mappings = mapping;
+    }
+    __atomic_store_n(&s->memory, memory, __ATOMIC_RELEASE);
+    s->length = length;
+    s->capacity = length;
+
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+/// Determines whether given memory is within the reserved range of a file
+/// heap.
+bool isReserved(Store *s, uint8_t *memory) {
+    return s->reservation != NULL && memory >= s->reservation
+        && memory < s->reservation + s->reservationLength;
+}
+
+/// Asks for given memory to be backed by huge pages, if supported.
+///
+/// This reduces TLB pressure when traversing large heaps. Only advice is
+/// given, as huge pages cannot be requested explicitly for regular files.
+void adviseHugePages(uint8_t *memory, uint64_t length) {
+#ifdef MADV_HUGEPAGE
+    madvise(memory, length, MADV_HUGEPAGE);
+#else
+    (void)memory;
+    (void)length;
+#endif
+}
+
+/// Prepares cell at `offset` of file heap memory for being loaded.
+///
+/// Loading the nodes of a cold file heap is otherwise bound by one page fault
+/// per node. If the cell lies outside of the range read ahead last, the
+/// system is asked to start reading the READAHEAD_LENGTH bytes at the cell,
+/// which lets the reading of the pages of later nodes overlap with the
+/// loading of earlier ones. The cell is also prefetched into CPU cache, in
+/// case its page already is in memory.
+void prefetchCell(Store *s, const uint8_t *memory, uint64_t top,
+    uint64_t offset) {
+    if (offset >= top) {
+        return;
+    }
+#ifdef MADV_WILLNEED
+    if (offset < __atomic_load_n(&s->readAheadBegin, __ATOMIC_RELAXED)
+        || offset >= __atomic_load_n(&s->readAheadEnd, __ATOMIC_RELAXED)) {
+        const uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+        const uint64_t begin = offset & ~(page - 1);
+        uint64_t end = top < begin + READAHEAD_LENGTH
+            ? top
+            : begin + READAHEAD_LENGTH;
+        end = (end + page - 1) & ~(page - 1);
+        __atomic_store_n(&s->readAheadBegin, begin, __ATOMIC_RELAXED);
+        __atomic_store_n(&s->readAheadEnd, end, __ATOMIC_RELAXED);
+        madvise((void *)&memory[begin], end - begin, MADV_WILLNEED);
+    }
+#else
+    (void)s;
+#endif
+#ifdef __GNUC__
+    __builtin_prefetch(&memory[offset]);
+#endif
+}
+
+/// Allocates private memory from the current pool block, or from a new block
+/// if the current one is full.
+///
+/// Memory is claimed from the current block by atomically bumping its length,
+/// which allows for readers to allocate without blocking each other. Adding
+/// a new block requires `poolLock`.
+void *allocFilePrivate(Store *s, size_t size) {
+    assert(s != NULL);
+    assert(size > 0);
+
+    const size_t words = (size + 7) / 8;
+    for (;;) {
+        PoolBlock *block = __atomic_load_n(&s->pool, __ATOMIC_ACQUIRE);
+        if (block != NULL) {
+            size_t length = __atomic_load_n(&block->length, __ATOMIC_RELAXED);
+            while (block->capacity - length >= words) {
+                if (__atomic_compare_exchange_n(&block->length, &length,
+                        length + words, true, __ATOMIC_RELAXED,
+                        __ATOMIC_RELAXED)) {
+                    return &block->words[length];
+                }
+            }
+        }
+
+        pthread_mutex_lock(&s->poolLock);
+        if (s->pool == block) {
+            const size_t capacity = words > POOL_BLOCK_CAPACITY / 8
+                ? words
+                : POOL_BLOCK_CAPACITY / 8;
+            PoolBlock *next = malloc(sizeof(PoolBlock) + capacity * 8);
+            if (next == NULL) {
+                pthread_mutex_unlock(&s->poolLock);
+                return NULL;
+            }
+            next->next = block;
+            next->length = 0;
+            next->capacity = capacity;
+            __atomic_store_n(&s->pool, next, __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&s->poolLock);
+    }
+}
+
+Error growBuffer(Store *s, uint64_t minimum) {
+    (void)s;
+    (void)minimum;
+
+    return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+}
+
+/// Allocates memory downwards from the end of the buffer, towards the top of
+/// the cells allocated upwards from its beginning.
+void *allocBufferPrivate(Store *s, size_t size) {
+    assert(s != NULL);
+    assert(size > 0);
+
+    void *memory = NULL;
+    pthread_mutex_lock(&s->poolLock);
+    if (size <= s->capacity - s->allocated
+        && rvm_alignCellSize(size) <= s->capacity - s->allocated) {
+        s->capacity -= rvm_alignCellSize(size);
+        memory = &s->memory[s->capacity];
+    }
+    pthread_mutex_unlock(&s->poolLock);
+
+    return memory;
+}
+
+/// Claims `size` bytes of scratch memory of buffer heap right after the cells
+/// allocated by the writer, which keeps it from being handed out as private
+/// memory. Successive claims are contiguous, which lets scratch memory be
+/// grown in place. Only the writer claims scratch memory, and it must release
+/// it via releaseScratch(), in reverse order, before allocating cells again.
+void *claimScratch(Store *s, size_t size) {
+    void *memory = NULL;
+    pthread_mutex_lock(&s->poolLock);
+    if (size <= s->capacity - s->allocated) {
+        memory = &s->memory[s->allocated];
+        s->allocated += size;
+    }
+    pthread_mutex_unlock(&s->poolLock);
+
+    return memory;
+}
+
+/// Releases `size` bytes of scratch memory claimed via claimScratch().
+void releaseScratch(Store *s, size_t size) {
+    pthread_mutex_lock(&s->poolLock);
+    s->allocated -= size;
+    pthread_mutex_unlock(&s->poolLock);
+}
+
+/// Announces the start of a read, returning the reader slot used.
+///
+/// Slots are searched starting from a position derived from the identity of
+/// the calling thread, which makes it likely that the first slot tried is
+/// free.
+unsigned enterEpoch(Store *s) {
+    if (s->readers == NULL) {
+        return READER_SLOTS;
+    }
+    const pthread_t self = pthread_self();
+    unsigned hash = 0;
+    for (size_t i = 0; i < sizeof(self); ++i) {
+        hash = hash * 31 + ((const unsigned char *)&self)[i];
+    }
+    for (unsigned i = hash % READER_SLOTS;; i = (i + 1) % READER_SLOTS) {
+        uint64_t expected = 0;
+        const uint64_t epoch = __atomic_load_n(&s->epoch, __ATOMIC_SEQ_CST);
+        if (__atomic_compare_exchange_n(&s->readers[i], &expected, epoch,
+                false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            return i;
+        }
+        if (i == (hash + READER_SLOTS - 1) % READER_SLOTS) {
+            sched_yield();
+        }
+    }
+}
+
+/// Announces the end of a read started via enterEpoch().
+void exitEpoch(Store *s, unsigned slot) {
+    if (slot == READER_SLOTS) {
+        return;
+    }
+    __atomic_store_n(&s->readers[slot], 0, __ATOMIC_RELEASE);
+}
+
+/// Allocates revision table with room for given amount of revisions.
+uint64_t *allocRoots(Store *s, uint64_t capacity) {
+    if (capacity > SIZE_MAX / sizeof(uint64_t)) {
+        return NULL;
+    }
+    const size_t size = (size_t)capacity * sizeof(uint64_t);
+    return s->file != NULL ? malloc(size) : s->allocPrivate(s, size);
+}
+
+/// Retires revision table no longer in use by the writer.
+///
+/// The current epoch is advanced after the table is retired, which means that
+/// any reader starting after this call cannot be using it.
+void retireRoots(Store *s, uint64_t *roots) {
+    if (s->file == NULL || roots == NULL) {
+        return;
+    }
+    Retired *retired = malloc(sizeof(Retired));
+    if (retired == NULL) {
+        // Leaking the table is the only safe alternative.
+        return;
+    }
+    *retired = (Retired){
+        .next = s->retired,
+        .roots = roots,
+        .epoch = __atomic_fetch_add(&s->epoch, 1, __ATOMIC_SEQ_CST),
+    };
+    s->retired = retired;
+    reclaimRoots(s, false);
+}
+
+/// Frees retired revision tables no active reader can be using, or all
+/// retired tables if `isForced`.
+void reclaimRoots(Store *s, bool isForced) {
+    uint64_t oldest = UINT64_MAX;
+    for (unsigned i = 0; i < READER_SLOTS && !isForced; ++i) {
+        const uint64_t epoch = __atomic_load_n(&s->readers[i],
+            __ATOMIC_SEQ_CST);
+        if (epoch != 0 && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+    for (Retired **r = &s->retired; *r != NULL;) {
+        Retired *retired = *r;
+        if (isForced || retired->epoch < oldest) {
+            *r = retired->next;
+            free(retired->roots);
+            free(retired);
         } else {
-            puts("succeeded.");
-            munmap(m, len);
+            r = &retired->next;
         }
     }
-    puts("Done.");
-    close(fd);
+}
+
+void initLock(Store *s) {
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->flushed, NULL);
+    pthread_cond_init(&s->requested, NULL);
+    pthread_mutex_init(&s->poolLock, NULL);
+    s->epoch = 1;
+}
+
+void freeLock(Store *s) {
+    pthread_mutex_destroy(&s->poolLock);
+    pthread_cond_destroy(&s->requested);
+    pthread_cond_destroy(&s->flushed);
+    pthread_mutex_destroy(&s->lock);
+}
+
+void initHeader(Store *s) {
+    *(Header *)s->memory = (Header){
+        .magic = HEADER_MAGIC,
+        .version = HEADER_VERSION,
+    };
+    resetLog(s);
+}
 
-    return 0;
+/// Makes log empty, without modifying heap memory.
+void resetLog(Store *s) {
+    s->top = sizeof(Header);
+    s->revision = 0;
+    s->record = RVM_NODE_INDEX_NONE;
+    s->checkpoint = RVM_NODE_INDEX_NONE;
+    s->checksum = CHECKSUM_INITIAL;
 }
 
+/// Opens heap log ending at `end`, filling revision table.
+///
+/// Any zero words at the end of the log are first skipped, as those are left
+/// by files being extended without being filled. If the log then ends with a
+/// valid checkpoint, it is read and opening is complete. Otherwise, the latest
+/// valid checkpoint is located, either via the record the log ends with, or
+/// by searching backwards, after which any commits following it are verified.
+Error openLog(Store *s, uint64_t end) {
+    const uint64_t *words = (const uint64_t *)s->memory;
+    while (end > sizeof(Header) && words[end / 8 - 1] == 0) {
+        end -= 8;
+    }
+    resetLog(s);
+
+    uint64_t checkpoint = RVM_NODE_INDEX_NONE;
+    if (end >= sizeof(Header) + sizeof(Checkpoint)
+        && isCheckpointAt(s, end - sizeof(Checkpoint))) {
+        checkpoint = end - sizeof(Checkpoint);
+    } else {
+        if (end >= sizeof(Header) + sizeof(Record)
+            && words[end / 8 - 1] == RECORD_MAGIC) {
+            const Record *r = (const Record *)&s->memory[end - sizeof(Record)];
+            if (r->checkpoint < end - sizeof(Record)
+                && r->checkpoint % RVM_CELL_ALIGNMENT == 0
+                && isCheckpointAt(s, r->checkpoint)) {
+                checkpoint = r->checkpoint;
+            }
+        }
+        for (uint64_t offset = end; checkpoint == RVM_NODE_INDEX_NONE
+             && offset >= sizeof(Header) + sizeof(Checkpoint);
+             offset -= 8) {
+            if (words[offset / 8 - 1] == CHECKPOINT_MAGIC
+                && isCheckpointAt(s, offset - sizeof(Checkpoint))) {
+                checkpoint = offset - sizeof(Checkpoint);
+            }
+        }
+    }
+
+    if (checkpoint != RVM_NODE_INDEX_NONE) {
+        const Error err = readCheckpoints(s, checkpoint);
+        if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+            return err;
+        }
+    } else {
+        const Error err = reserveRevision(s, 0);
+        if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+            return err;
+        }
+    }
+    readCommits(s, end);
+
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+/// Fills revision table with the roots of given checkpoint and the
+/// checkpoints preceding it.
+Error readCheckpoints(Store *s, uint64_t offset) {
+    const Checkpoint *latest = (const Checkpoint *)&s->memory[offset];
+    Error err = reserveRevision(s, latest->revision);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        return err;
+    }
+    s->roots[0] = RVM_NODE_INDEX_NONE;
+
+    uint64_t revision = latest->revision;
+    for (uint64_t o = offset; o != RVM_NODE_INDEX_NONE;) {
+        const Checkpoint *c = (const Checkpoint *)&s->memory[o];
+        if (c->revision != revision || c->count > revision
+            || c->previous >= o || c->previous % RVM_CELL_ALIGNMENT != 0
+            || (c->previous != RVM_NODE_INDEX_NONE
+                && !isCheckpointAt(s, c->previous))) {
+            return rvm_asError(RVM_ERROR_CORRUPT, NULL);
+        }
+        memcpy(&s->roots[revision - c->count + 1],
+            &s->memory[o - c->count * 8], c->count * 8);
+        revision -= c->count;
+        o = c->previous;
+    }
+    if (revision != 0) {
+        return rvm_asError(RVM_ERROR_CORRUPT, NULL);
+    }
+
+    s->top = offset + sizeof(Checkpoint);
+    s->revision = latest->revision;
+    s->record = latest->record;
+    s->checkpoint = offset;
+    s->checksum = CHECKSUM_INITIAL;
+
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+/// Reads any valid commits between `top` and `end`.
+///
+/// The segment is traversed word by word while updating its checksum. Each
+/// time the traversal passes a word that could be the end of a record, the
+/// record is verified. Any words after the last valid record are discarded.
+///
+/// Checkpoints directly following the last valid record are also read, which
+/// is only the case for logs appended by applying deltas, as heaps are
+/// otherwise opened at their last checkpoint.
+void readCommits(Store *s, uint64_t end) {
+    const uint64_t *words = (const uint64_t *)s->memory;
+    uint64_t checksum = s->checksum;
+    const uint64_t fields = sizeof(Record) - 16;
+
+    for (uint64_t offset = s->top; offset + 16 <= end; offset += 8) {
+        const uint64_t word = words[offset / 8];
+        if (words[offset / 8 + 1] == CHECKPOINT_MAGIC
+            && offset >= sizeof(Checkpoint) - 16) {
+            const uint64_t at = offset - (sizeof(Checkpoint) - 16);
+            const Checkpoint *c = (const Checkpoint *)&s->memory[at];
+            if (at >= s->top && isCheckpointAt(s, at)
+                && at - c->count * 8 == s->top && c->revision == s->revision
+                && c->record == s->record) {
+                s->checkpoint = at;
+                s->checksum = CHECKSUM_INITIAL;
+                __atomic_store_n(&s->top, at + sizeof(Checkpoint),
+                    __ATOMIC_RELEASE);
+                checksum = CHECKSUM_INITIAL;
+                offset = s->top - 8;
+                continue;
+            }
+        }
+        if (offset >= s->top + fields && word == checksum
+            && words[offset / 8 + 1] == RECORD_MAGIC) {
+            const uint64_t at = offset - fields;
+            const Record *r = (const Record *)&s->memory[at];
+            if (r->revision != s->revision + 1 || r->root >= at
+                || r->previous != s->record || r->checkpoint != s->checkpoint
+                || rvm_getErrorKind(reserveRevision(s, r->revision))
+                    != RVM_ERROR_NONE) {
+                break;
+            }
+            s->roots[r->revision] = r->root;
+            s->record = at;
+            s->checksum = checksumOf(s->memory, offset, at + sizeof(Record),
+                checksum);
+            __atomic_store_n(&s->top, at + sizeof(Record), __ATOMIC_RELEASE);
+            __atomic_store_n(&s->revision, r->revision, __ATOMIC_RELEASE);
+        }
+        checksum = checksumOf(s->memory, offset, offset + 8, checksum);
+    }
+}
+
+/// Determines whether a valid checkpoint trailer is located at given offset.
+bool isCheckpointAt(Store *s, uint64_t offset) {
+    const Checkpoint *c = (const Checkpoint *)&s->memory[offset];
+    if (c->magic != CHECKPOINT_MAGIC || c->count > offset / 8
+        || offset - c->count * 8 < sizeof(Header) || c->record >= offset) {
+        return false;
+    }
+    const uint64_t begin = offset - c->count * 8;
+    const uint64_t checksum = checksumOf(s->memory, begin,
+        offset + sizeof(Checkpoint) - 16, CHECKSUM_INITIAL);
+    return c->checksum == checksum;
+}
+
+/// Writes record of new revision with given root at `top`.
+Error writeRecord(Store *s, uint64_t *top, uint64_t root) {
+    uint64_t offset;
+    const Error err = allocCell(s, sizeof(Record), top, &offset);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        return err;
+    }
+    Record *record = (Record *)&s->memory[offset];
+    *record = (Record){
+        .revision = s->revision + 1,
+        .root = root,
+        .previous = s->record,
+        .checkpoint = s->checkpoint,
+        .magic = RECORD_MAGIC,
+    };
+    record->checksum = checksumOf(s->memory, s->top,
+        offset + sizeof(Record) - 16, s->checksum);
+
+    s->roots[record->revision] = root;
+    s->checksum = checksumOf(s->memory, offset + sizeof(Record) - 16, *top,
+        record->checksum);
+    s->record = offset;
+    __atomic_store_n(&s->top, *top, __ATOMIC_RELEASE);
+    __atomic_store_n(&s->revision, record->revision, __ATOMIC_RELEASE);
+
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+/// Writes checkpoint covering all revisions not covered by any checkpoint.
+///
+/// To keep the amount of checkpoints read when opening a heap low, previous
+/// checkpoints are merged into the new one as long as they do not cover more
+/// revisions than the new one.
+Error writeCheckpoint(Store *s) {
+    uint64_t previous = s->checkpoint;
+    uint64_t first = previous != RVM_NODE_INDEX_NONE
+        ? ((const Checkpoint *)&s->memory[previous])->revision + 1
+        : 1;
+    if (first > s->revision) {
+        return rvm_asError(RVM_ERROR_NONE, NULL);
+    }
+    while (previous != RVM_NODE_INDEX_NONE) {
+        const Checkpoint *c = (const Checkpoint *)&s->memory[previous];
+        if (c->count > s->revision + 1 - first) {
+            break;
+        }
+        first -= c->count;
+        previous = c->previous;
+    }
+    const uint64_t count = s->revision + 1 - first;
+
+    uint64_t top = s->top;
+    uint64_t begin;
+    const Error err = allocCell(s, count * 8 + sizeof(Checkpoint), &top,
+        &begin);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        return err;
+    }
+    memcpy(&s->memory[begin], &s->roots[first], count * 8);
+
+    const uint64_t offset = begin + count * 8;
+    Checkpoint *checkpoint = (Checkpoint *)&s->memory[offset];
+    *checkpoint = (Checkpoint){
+        .revision = s->revision,
+        .count = count,
+        .previous = previous,
+        .record = s->record,
+        .magic = CHECKPOINT_MAGIC,
+    };
+    checkpoint->checksum = checksumOf(s->memory, begin,
+        offset + sizeof(Checkpoint) - 16, CHECKSUM_INITIAL);
+
+    __atomic_store_n(&s->top, top, __ATOMIC_RELEASE);
+    s->checkpoint = offset;
+    s->checksum = CHECKSUM_INITIAL;
+
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+/// Ensures the revision table can hold given revision.
+///
+/// Tables are grown by replacing them with tables twice as large. Replaced
+/// tables of file heaps are retired, while those of buffer heaps are
+/// abandoned, which wastes at most as much memory as is used by the current
+/// table.
+Error reserveRevision(Store *s, uint64_t revision) {
+    if (revision < s->rootsCapacity) {
+        return rvm_asError(RVM_ERROR_NONE, NULL);
+    }
+    uint64_t capacity = s->rootsCapacity > 0
+        ? s->rootsCapacity
+        : REVISIONS_CAPACITY_INITIAL;
+    while (capacity <= revision) {
+        capacity *= 2;
+    }
+    uint64_t *roots = allocRoots(s, capacity);
+    if (roots == NULL) {
+        return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+    }
+    if (s->rootsCapacity > 0) {
+        memcpy(roots, s->roots, s->rootsCapacity * sizeof(uint64_t));
+    } else {
+        roots[0] = RVM_NODE_INDEX_NONE;
+    }
+    uint64_t *const previous = s->roots;
+    __atomic_store_n(&s->roots, roots, __ATOMIC_RELEASE);
+    s->rootsCapacity = capacity;
+    retireRoots(s, previous);
+
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+/// Updates checksum with the words from `begin` to `end`.
+///
+/// The checksum is a variant of FNV-1a that consumes a full word per round.
+uint64_t checksumOf(const uint8_t *memory, uint64_t begin, uint64_t end,
+    uint64_t checksum) {
+    const uint64_t *words = (const uint64_t *)memory;
+    for (uint64_t i = begin / 8; i < end / 8; ++i) {
+        checksum = (checksum ^ words[i]) * 0x00000100000001b3;
+    }
+    return checksum;
+}
+
+/// Flushes heap memory until given revision is committed to disk.
+///
+/// Must be called with the store lock held, which is released while waiting
+/// for the disk. Concurrent callers are grouped together, which means that at
+/// most one thread flushes at any given time, while all other threads wait
+/// for it to complete. If the revisions a waiting thread requires turn out to
+/// not be covered, it starts another flush covering every revision created
+/// since the last one started.
+///
+/// A checkpoint is only written if no commits were made while the flush was
+/// in progress, as the flush must never allow for a checkpoint to reach the
+/// disk before the commits it covers.
+Error flushStore(Store *s, uint64_t revision) {
+    if (s->file == NULL || !s->isWritable) {
+        return rvm_asError(RVM_ERROR_NONE, NULL);
+    }
+    Error err = rvm_asError(RVM_ERROR_NONE, NULL);
+    while (s->durable < revision) {
+        if (s->isFlushing) {
+            pthread_cond_wait(&s->flushed, &s->lock);
+            continue;
+        }
+        s->isFlushing = true;
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        uint8_t *memory = s->memory;
+        const uint64_t begin = s->durableTop;
+        const uint64_t end = s->top;
+        const uint64_t target = s->revision;
+        pthread_mutex_unlock(&s->lock);
+        int status = flushRange(memory, begin, end);
+        pthread_mutex_lock(&s->lock);
+        if (status != 0) {
+            err = errorFromErrno();
+            goto done;
+        }
+        s->durable = target;
+        s->durableTop = end;
+        if (s->top != end) {
+            goto done;
+        }
+
+        err = writeCheckpoint(s);
+        if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+            goto done;
+        }
+        memory = s->memory;
+        const uint64_t top = s->top;
+        pthread_mutex_unlock(&s->lock);
+        status = flushRange(memory, end, top);
+        pthread_mutex_lock(&s->lock);
+        if (status != 0) {
+            err = errorFromErrno();
+            goto done;
+        }
+        s->durableTop = top;
+        if (s->top == top && s->capacity != top) {
+            if (ftruncate(s->fd, (off_t)top) != 0) {
+                err = errorFromErrno();
+                goto done;
+            }
+            s->capacity = top;
+        }
+        countFlush(s, &start);
+
+    done:
+        s->isFlushing = false;
+        pthread_cond_broadcast(&s->flushed);
+        if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+            break;
+        }
+    }
+    return err;
+}
+
+/// Counts completed flush that started at `start` in the flush latency
+/// histogram, whose buckets are powers of two microseconds.
+void countFlush(Store *s, const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const uint64_t micros = (uint64_t)(now.tv_sec - start->tv_sec) * 1000000
+        + (uint64_t)(now.tv_nsec / 1000) - (uint64_t)(start->tv_nsec / 1000);
+    size_t bucket = 0;
+    while (bucket < RVM_HEAP_LATENCY_BUCKETS - 1 && (micros >> bucket) != 0) {
+        bucket += 1;
+    }
+    s->flushLatencies[bucket] += 1;
+}
+
+/// Commits the bytes between `begin` and `end` of given memory mapping to
+/// disk.
+///
+/// \returns 0 if successful, or -1 if `errno` was set.
+int flushRange(uint8_t *memory, uint64_t begin, uint64_t end) {
+    if (begin >= end) {
+        return 0;
+    }
+    begin &= ~(uint64_t)(sysconf(_SC_PAGESIZE) - 1);
+    return msync(&memory[begin], end - begin, MS_SYNC);
+}
+
+/// Background flusher thread routine.
+///
+/// Flushes as soon as a flush is requested, or when `interval` milliseconds
+/// have passed since the last flush and there are revisions not yet committed
+/// to disk.
+void *runFlusher(void *argument) {
+    Store *s = argument;
+
+    pthread_mutex_lock(&s->lock);
+    while (!s->isStopping) {
+        if (s->pending > s->durable) {
+            Error err = flushStore(s, s->pending);
+            if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+                // Threads awaiting tickets flush by themselves, which is where
+                // errors are reported. Wait before trying again.
+                rvm_freeError(err);
+                s->pending = s->durable;
+            }
+            continue;
+        }
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += (time_t)(s->interval / 1000);
+        deadline.tv_nsec += (long)(s->interval % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000;
+        }
+        const int status = pthread_cond_timedwait(&s->requested, &s->lock,
+            &deadline);
+        if (status == ETIMEDOUT && s->revision > s->durable) {
+            s->pending = s->revision;
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    return NULL;
+}
+
+/// Stops background flusher, if running.
+///
+/// Must be called with the store lock held.
+Error stopFlusher(Store *s) {
+    if (!s->hasFlusher) {
+        return rvm_asError(RVM_ERROR_NONE, NULL);
+    }
+    s->isStopping = true;
+    pthread_cond_signal(&s->requested);
+    pthread_mutex_unlock(&s->lock);
+    const int status = pthread_join(s->flusher, NULL);
+    pthread_mutex_lock(&s->lock);
+    s->hasFlusher = false;
+    s->isStopping = false;
+    if (status != 0) {
+        return rvm_asError(RVM_ERROR_IO, NULL);
+    }
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+Heap heapOf(Store *s) {
+    return (Heap){
+        .length = s->top,
+        .revision = s->revision,
+        .internal = s,
+        .free = heapFree,
+        .get = heapGet,
+        .load = heapLoad,
+        .integersOf = heapIntegersOf,
+        .set = heapSet,
+        .useFunctions = heapUseFunctions,
+        .sync = heapSync,
+        .syncAsync = heapSyncAsync,
+        .await = heapAwait,
+        .flushEvery = heapFlushEvery,
+        .collect = heapCollect,
+        .hashCons = heapHashCons,
+        .writeDelta = heapWriteDelta,
+        .applyDelta = heapApplyDelta,
+        .stats = heapStats,
+    };
+}
+
+void heapFree(Heap *self) {
+    assert(self != NULL);
+
+    Store *s = self->internal;
+    pthread_mutex_lock(&s->lock);
+    rvm_freeError(stopFlusher(s));
+    pthread_mutex_unlock(&s->lock);
+    if (s->file == NULL) {
+        freeLock(s);
+        self->internal = NULL;
+        return;
+    }
+    if (s->isWritable) {
+        rvm_freeError(heapSync(self));
+    }
+    freeLock(s);
+    unmapFile(s);
+    for (PoolBlock *b = s->pool, *next; b != NULL; b = next) {
+        next = b->next;
+        free(b);
+    }
+    free(s->roots);
+    reclaimRoots(s, true);
+    free(s->readers);
+    free(s->flushLatencies);
+    if (s->isOwner) {
+        fclose(s->file);
+    }
+    free(s);
+    self->internal = NULL;
+}
+
+Error heapGet(Heap *self, rvm_Value *out, const uint64_t revision) {
+    assert(self != NULL);
+    assert(out != NULL);
+
+    Store *s = self->internal;
+    const unsigned slot = enterEpoch(s);
+    const bool isKnown = revision
+        <= __atomic_load_n(&s->revision, __ATOMIC_ACQUIRE);
+    const uint64_t root = isKnown
+        ? __atomic_load_n(&s->roots, __ATOMIC_ACQUIRE)[revision]
+        : RVM_NODE_INDEX_NONE;
+    exitEpoch(s, slot);
+    if (!isKnown || (root == RVM_NODE_INDEX_NONE && revision != 0)) {
+        return rvm_asError(RVM_ERROR_REVISION, NULL);
+    }
+    if (root == RVM_NODE_INDEX_NONE) {
+        *out = (Node){ .flags = RVM_NODE_UNDEFINED };
+    } else {
+        lazyNode(self, out, root, NULL);
+    }
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+Error heapLoad(const Heap *self, Node *node) {
+    assert(self != NULL);
+    assert(node != NULL);
+    assert(rvm_getNodeKind(node) == RVM_NODE_LAZY);
+    assert(node->as.lazy.heap == self);
+
+    return loadNode(self, node);
+}
+
+/// Resolves integers of packed array cell referred to by node, which is
+/// looked up the same way decodeCell() does.
+const int64_t *heapIntegersOf(const Heap *self, const Node *node,
+    size_t *length) {
+    assert(self != NULL);
+    assert(node != NULL);
+    assert(length != NULL);
+
+    const rvm_NodeKind kind = rvm_getNodeKind((Node *)node);
+    if (kind == RVM_NODE_LAZY ? node->as.lazy.heap != self
+                              : kind != RVM_NODE_ARRAY) {
+        return NULL;
+    }
+    Store *s = self->internal;
+    const uint64_t offset = rvm_getNodeIndex((Node *)node);
+    const uint64_t top = __atomic_load_n(&s->top, __ATOMIC_ACQUIRE);
+    const uint8_t *memory = __atomic_load_n(&s->memory, __ATOMIC_ACQUIRE);
+    if (offset < sizeof(Header) || offset + 8 > top) {
+        return NULL;
+    }
+    const uint64_t *cell = (const uint64_t *)&memory[offset];
+    const uint64_t count = rvm_getCellLength(cell[0]);
+    if (rvm_getCellKind(cell[0]) != RVM_NODE_ARRAY || !rvm_isCellPacked(cell[0])
+        || count > (top - offset) / 8 - 1) {
+        return NULL;
+    }
+    *length = (size_t)count;
+    return (const int64_t *)&cell[1];
+}
+
+/// Loads lazy node.
+///
+/// The store lock is not taken, as committed cells never change.
+///
+/// File heaps keep every node they load in a table, which is consulted before
+/// any cell is decoded. Children of kept nodes refer directly to any kept
+/// nodes of their cells, and otherwise to lazy nodes whose referrers are the
+/// fields referring to them. Once such a lazy node is loaded, its referrer is
+/// atomically made to refer to the kept node instead. Nodes visited once are
+/// therefore reached via plain pointers when visited again. As cells never
+/// refer to private memory, there is nothing to undo when heaps are synced.
+Error loadNode(const Heap *self, Node *node) {
+    Store *s = self->internal;
+    const uint64_t offset = rvm_getNodeIndex(node);
+    const Node **referrer = node->as.lazy.referrer;
+    __atomic_fetch_add(&s->loads, 1, __ATOMIC_RELAXED);
+    if (s->file == NULL) {
+        __atomic_fetch_add(&s->decodes, 1, __ATOMIC_RELAXED);
+        return decodeCell(self, offset, node);
+    }
+    const Node *loaded = findLoaded(s, offset);
+    if (loaded == NULL) {
+        __atomic_fetch_add(&s->decodes, 1, __ATOMIC_RELAXED);
+        Node *kept = allocNodes(s, 1);
+        if (kept == NULL) {
+            return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+        }
+        const Error err = decodeCell(self, offset, kept);
+        if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+            return err;
+        }
+        loaded = publishLoaded(s, offset, kept);
+    }
+    if (referrer != NULL) {
+        __atomic_store_n(referrer, loaded, __ATOMIC_RELEASE);
+    }
+    copyLoaded(node, loaded);
+
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+/// Decodes cell at `offset` into a node with lazy children.
+///
+/// Heap memory is looked up after the top of committed cells, as it is
+/// replaced before the top is advanced past the end of the memory it replaces.
+Error decodeCell(const Heap *self, uint64_t offset, Node *out) {
+    Store *s = self->internal;
+    const uint64_t top = __atomic_load_n(&s->top, __ATOMIC_ACQUIRE);
+    const uint8_t *memory = __atomic_load_n(&s->memory, __ATOMIC_ACQUIRE);
+    if (offset < sizeof(Header) || offset + 8 > top) {
+        return rvm_asError(RVM_ERROR_CORRUPT, NULL);
+    }
+    const uint64_t *cell = (const uint64_t *)&memory[offset];
+    const rvm_NodeKind kind = rvm_getCellKind(cell[0]);
+    const uint64_t length = rvm_getCellLength(cell[0]);
+    if ((cell[0] & RVM_CELL_HEADER_RESERVED) != 0 || length > top - offset) {
+        return rvm_asError(RVM_ERROR_CORRUPT, NULL);
+    }
+    const uint64_t size = rvm_getCellSize(kind, length);
+    const bool isPacked = rvm_isCellPacked(cell[0]);
+    if (size == 0 || size > top - offset
+        || (isPacked && kind != RVM_NODE_ARRAY)) {
+        return rvm_asError(RVM_ERROR_CORRUPT, NULL);
+    }
+
+    // Only nodes kept by file heaps may be referred to.
+    const bool isKept = s->file != NULL;
+    if (isKept && (kind == RVM_NODE_ARRAY || kind == RVM_NODE_LINK)) {
+        uint64_t first;
+        uint64_t last;
+        childSlotsOf(cell[0], &first, &last);
+        for (uint64_t i = first; i < last && i < PREFETCH_CHILDREN; ++i) {
+            if (cell[i] != RVM_NODE_INDEX_NONE
+                && !rvm_isCellImmediate(cell[i])) {
+                prefetchCell(s, memory, top, fromRelative(offset, cell[i]));
+            }
+        }
+    }
+    Node loaded = { .flags = offset | (uint64_t)kind };
+    switch (kind) {
+    case RVM_NODE_BYTES:
+    case RVM_NODE_SYMBOL:
+        loaded.as.bytes.length = (size_t)length;
+        loaded.as.bytes.bytes = (const uint8_t *)&cell[1];
+        break;
+
+    case RVM_NODE_NUMBER:
+        loaded.as.number.integer = (int64_t)cell[1];
+        break;
+
+    case RVM_NODE_CLOSURE: {
+        loaded.as.closure.function = functionOf(s, cell[1]);
+        if (loaded.as.closure.function == NULL) {
+            return rvm_asError(RVM_ERROR_CORRUPT, NULL);
+        }
+        const Node *child = NULL;
+        if (cell[2] != RVM_NODE_INDEX_NONE) {
+            Node *lazy = allocNodes(s, 1);
+            if (lazy == NULL) {
+                return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+            }
+            child = childNode(self, lazy, &cell[2], offset,
+                isKept ? &out->as.closure.node : NULL);
+            if (child == NULL) {
+                return rvm_asError(RVM_ERROR_CORRUPT, NULL);
+            }
+        }
+        loaded.as.closure.node = child;
+        break;
+    }
+
+    case RVM_NODE_ARRAY: {
+        Node *children = NULL;
+        if (length > 0 && (children = allocNodes(s, length)) == NULL) {
+            return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+        }
+        // Elements are stored by value, which is why they cannot be replaced
+        // once loaded.
+        for (uint64_t i = 0; i < length; ++i) {
+            if (isPacked) {
+                children[i] = (Node){
+                    .flags = RVM_NODE_NUMBER,
+                    .as.number.integer = (int64_t)cell[1 + i],
+                };
+            } else if (childNode(self, &children[i], &cell[1 + i], offset, NULL)
+                == NULL) {
+                return rvm_asError(RVM_ERROR_CORRUPT, NULL);
+            }
+        }
+        loaded.as.array.length = (size_t)length;
+        loaded.as.array.nodes = children;
+        break;
+    }
+
+    case RVM_NODE_LINK: {
+        // The links after the first of unrolled cells are created here, and
+        // are placed next to their heads. They have no cells of their own,
+        // which is why they lack indexes.
+        const uint64_t links = rvm_getCellLinks(cell[0]);
+        Node *children = allocNodes(s, (size_t)links * 2);
+        if (children == NULL) {
+            return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+        }
+        Node *link = &loaded;
+        Node *referring = out;
+        for (uint64_t i = 0; i < links; ++i) {
+            if (i > 0) {
+                children[i * 2 - 1] = (Node){ .flags = RVM_NODE_LINK };
+                link->as.link.tail = &children[i * 2 - 1];
+                link = referring = &children[i * 2 - 1];
+            }
+            if (cell[1 + i] != RVM_NODE_INDEX_NONE
+                && (link->as.link.head = childNode(self, &children[i * 2],
+                        &cell[1 + i], offset,
+                        isKept ? &referring->as.link.head : NULL))
+                    == NULL) {
+                return rvm_asError(RVM_ERROR_CORRUPT, NULL);
+            }
+        }
+        if (cell[1 + links] != RVM_NODE_INDEX_NONE
+            && (link->as.link.tail = childNode(self, &children[links * 2 - 1],
+                    &cell[1 + links], offset,
+                    isKept ? &referring->as.link.tail : NULL))
+                == NULL) {
+            return rvm_asError(RVM_ERROR_CORRUPT, NULL);
+        }
+        break;
+    }
+
+    default:
+        break;
+    }
+    *out = loaded;
+
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+/// Creates node of child referred to by `word` of cell at `parent` in `out`,
+/// returning a pointer to the created node.
+///
+/// If the node of the referred cell is kept, and `referrer` is given, a
+/// pointer to the kept node is returned instead. Without `referrer`, the kept
+/// node is copied. Immediate words are decoded right away.
+///
+/// \returns Pointer to node, or `NULL` if `word` is not a valid immediate
+///          word or offset.
+const Node *childNode(const Heap *self, Node *out, const uint64_t *word,
+    uint64_t parent, const Node **referrer) {
+    if (rvm_isCellImmediate(*word)) {
+        const rvm_NodeKind kind = rvm_getImmediateKind(*word);
+        const uint64_t length = rvm_getImmediateLength(*word);
+        if (kind == RVM_NODE_NUMBER) {
+            *out = (Node){
+                .flags = RVM_NODE_NUMBER,
+                .as.number.integer = rvm_getImmediateInteger(*word),
+            };
+        } else if (kind == RVM_NODE_BYTES
+            && length <= RVM_CELL_IMMEDIATE_LENGTH) {
+            *out = (Node){
+                .flags = kind,
+                .as.bytes = {
+                    (size_t)length,
+                    (const uint8_t *)word + RVM_CELL_IMMEDIATE_BYTES,
+                },
+            };
+        } else {
+            return NULL;
+        }
+        return out;
+    }
+    const uint64_t offset = fromRelative(parent, *word);
+    const Node *kept = findLoaded(self->internal, offset);
+    if (kept != NULL && referrer != NULL) {
+        return kept;
+    }
+    if (kept != NULL) {
+        copyLoaded(out, kept);
+    } else {
+        lazyNode(self, out, offset, referrer);
+    }
+    return out;
+}
+
+/// Looks up kept node of cell at `offset`.
+///
+/// \returns Kept node, or `NULL` if not kept.
+const Node *findLoaded(Store *s, uint64_t offset) {
+    const Swizzles *table = __atomic_load_n(&s->swizzles, __ATOMIC_ACQUIRE);
+    if (table == NULL || offset == RVM_NODE_INDEX_NONE) {
+        return NULL;
+    }
+    const uint64_t mask = table->capacity - 1;
+    for (uint64_t i = hashOffset(offset) & mask;; i = (i + 1) & mask) {
+        const uint64_t key = __atomic_load_n(&table->entries[i].offset,
+            __ATOMIC_ACQUIRE);
+        if (key == offset) {
+            return __atomic_load_n(&table->entries[i].node, __ATOMIC_ACQUIRE);
+        }
+        if (key == RVM_NODE_INDEX_NONE) {
+            return NULL;
+        }
+    }
+}
+
+/// Keeps loaded node of cell at `offset`.
+///
+/// If another thread kept a node for the same cell first, that node is
+/// returned instead of the given one. The given node is also returned if it
+/// could not be kept, which only means it will have to be loaded again.
+const Node *publishLoaded(Store *s, uint64_t offset, const Node *node) {
+    for (;;) {
+        Swizzles *table = __atomic_load_n(&s->swizzles, __ATOMIC_ACQUIRE);
+        // Claiming a place in the count ensures the table never fills up,
+        // even if some claims end up unused.
+        if (table == NULL || __atomic_fetch_add(&table->count, 1,
+                __ATOMIC_RELAXED) >= table->capacity / 2) {
+            if (growSwizzles(s, table) == NULL) {
+                return node;
+            }
+            continue;
+        }
+        const uint64_t mask = table->capacity - 1;
+        for (uint64_t i = hashOffset(offset) & mask;; i = (i + 1) & mask) {
+            Swizzle *entry = &table->entries[i];
+            uint64_t key = RVM_NODE_INDEX_NONE;
+            if (__atomic_compare_exchange_n(&entry->offset, &key, offset,
+                    false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                __atomic_store_n(&entry->node, node, __ATOMIC_RELEASE);
+                return node;
+            }
+            if (key == offset) {
+                const Node *kept = __atomic_load_n(&entry->node,
+                    __ATOMIC_ACQUIRE);
+                return kept != NULL ? kept : node;
+            }
+        }
+    }
+}
+
+/// Replaces given table of kept nodes with a copy twice as large, or creates
+/// the first table if `table` is `NULL`.
+///
+/// \returns Current table, or `NULL` if out of memory.
+Swizzles *growSwizzles(Store *s, Swizzles *table) {
+    const uint64_t capacity = table != NULL
+        ? table->capacity * 2
+        : SWIZZLES_CAPACITY_INITIAL;
+    if (capacity > (SIZE_MAX - sizeof(Swizzles)) / sizeof(Swizzle)) {
+        return NULL;
+    }
+    const size_t size = sizeof(Swizzles) + (size_t)capacity * sizeof(Swizzle);
+    Swizzles *next = s->allocPrivate(s, size);
+    if (next == NULL) {
+        return NULL;
+    }
+    memset(next, 0, size);
+    next->capacity = capacity;
+    for (uint64_t i = 0; table != NULL && i < table->capacity; ++i) {
+        const uint64_t offset = __atomic_load_n(&table->entries[i].offset,
+            __ATOMIC_ACQUIRE);
+        const Node *node = __atomic_load_n(&table->entries[i].node,
+            __ATOMIC_ACQUIRE);
+        if (offset == RVM_NODE_INDEX_NONE || node == NULL) {
+            continue;
+        }
+        uint64_t j = hashOffset(offset) & (capacity - 1);
+        while (next->entries[j].offset != RVM_NODE_INDEX_NONE) {
+            j = (j + 1) & (capacity - 1);
+        }
+        next->entries[j] = (Swizzle){ .offset = offset, .node = node };
+        next->count += 1;
+    }
+    if (!__atomic_compare_exchange_n(&s->swizzles, &table, next, false,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        // Another thread replaced the table first.
+        return table;
+    }
+    return next;
+}
+
+/// Hashes cell offset.
+uint64_t hashOffset(uint64_t offset) {
+    const uint64_t hash = (offset / RVM_CELL_ALIGNMENT) * 0x9e3779b97f4a7c15;
+    return hash ^ (hash >> 32);
+}
+
+/// Copies loaded node, which may be kept and therefore have its children
+/// replaced concurrently.
+void copyLoaded(Node *out, const Node *node) {
+    out->flags = node->flags;
+    switch ((rvm_NodeKind)(node->flags & RVM_NODE_FLAGS_KIND)) {
+    case RVM_NODE_CLOSURE:
+        out->as.closure.function = node->as.closure.function;
+        out->as.closure.node = __atomic_load_n(&node->as.closure.node,
+            __ATOMIC_ACQUIRE);
+        break;
+
+    case RVM_NODE_LINK:
+        out->as.link.head = __atomic_load_n(&node->as.link.head,
+            __ATOMIC_ACQUIRE);
+        out->as.link.tail = __atomic_load_n(&node->as.link.tail,
+            __ATOMIC_ACQUIRE);
+        break;
+
+    default:
+        out->as = node->as;
+        break;
+    }
+}
+
+Error heapSet(Heap *self, const rvm_Value value) {
+    assert(self != NULL);
+
+    Store *s = self->internal;
+    pthread_mutex_lock(&s->lock);
+    const Error err = setValue(self, value);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE && s->isHashConsing) {
+        forgetCells(&s->cells, s->top);
+    }
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE && s->isSymbolsIndexed) {
+        forgetCells(&s->symbols, s->top);
+    }
+    if (s->file == NULL) {
+        pthread_mutex_lock(&s->poolLock);
+        s->allocated = s->top;
+        pthread_mutex_unlock(&s->poolLock);
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    return err;
+}
+
+/// Stores value and commits it as a new revision. Must be called with the
+/// store lock held.
+///
+/// Nothing is committed if storing fails, in which case any cells allocated
+/// by the failed attempt are reused by the next one.
+Error setValue(Heap *self, const rvm_Value value) {
+    Store *s = self->internal;
+    Error err = reserveRevision(s, s->revision + 1);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        return err;
+    }
+    uint64_t top = s->top;
+    uint64_t root;
+    err = storeNode(self, self, &value, &top, &root);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        return err;
+    }
+    err = writeRecord(s, &top, root);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        return err;
+    }
+    self->length = s->top;
+    self->revision = s->revision;
+
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+Error heapUseFunctions(Heap *self, const rvm_Function *const *functions,
+    size_t count) {
+    assert(self != NULL);
+    assert(functions != NULL || count == 0);
+
+    // Identities are allocated while holding the lock, as collections free
+    // all private memory.
+    Store *s = self->internal;
+    Error err = rvm_asError(RVM_ERROR_NONE, NULL);
+    pthread_mutex_lock(&s->lock);
+    uint64_t *identities = NULL;
+    if (count > 0
+        && (identities = identifyFunctions(s, functions, count)) == NULL) {
+        err = rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+        goto done;
+    }
+    s->functions = functions;
+    s->functionIdentities = identities;
+    s->functionCount = count;
+
+done:
+    pthread_mutex_unlock(&s->lock);
+    return err;
+}
+
+/// Resolves registered function with given identity, or `NULL` if none.
+const rvm_Function *functionOf(const Store *s, uint64_t identity) {
+    for (size_t i = 0; i < s->functionCount; ++i) {
+        if (s->functionIdentities[i] == identity) {
+            return s->functions[i];
+        }
+    }
+    return NULL;
+}
+
+/// Allocates private memory holding the identities of given functions, as
+/// calculated by rvm_getCellFunction(), or returns `NULL` if out of memory.
+uint64_t *identifyFunctions(Store *s, const rvm_Function *const *functions,
+    size_t count) {
+    if (count > SIZE_MAX / sizeof(uint64_t)) {
+        return NULL;
+    }
+    uint64_t *identities = s->allocPrivate(s, count * sizeof(uint64_t));
+    if (identities != NULL) {
+        for (size_t i = 0; i < count; ++i) {
+            identities[i] = rvm_getCellFunction(functions[i]);
+        }
+    }
+    return identities;
+}
+
+/// Synchronizes heap file.
+///
+/// All commits are first flushed to disk, after which a checkpoint is written
+/// and flushed. The file is finally truncated to end right after the
+/// checkpoint, which allows for it to be found directly when the heap is
+/// opened again.
+Error heapSync(Heap *self) {
+    assert(self != NULL);
+
+    Store *s = self->internal;
+    pthread_mutex_lock(&s->lock);
+    const Error err = flushStore(s, s->revision);
+    self->length = s->top;
+    pthread_mutex_unlock(&s->lock);
+
+    return err;
+}
+
+Error heapSyncAsync(Heap *self, rvm_HeapTicket *out) {
+    assert(self != NULL);
+    assert(out != NULL);
+
+    Store *s = self->internal;
+    pthread_mutex_lock(&s->lock);
+    *out = s->revision;
+    if (s->pending < s->revision) {
+        s->pending = s->revision;
+        pthread_cond_signal(&s->requested);
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+Error heapAwait(Heap *self, rvm_HeapTicket ticket) {
+    assert(self != NULL);
+
+    Store *s = self->internal;
+    pthread_mutex_lock(&s->lock);
+    const Error err = s->durable < ticket
+        ? flushStore(s, ticket)
+        : rvm_asError(RVM_ERROR_NONE, NULL);
+    pthread_mutex_unlock(&s->lock);
+
+    return err;
+}
+
+Error heapFlushEvery(Heap *self, uint64_t milliseconds) {
+    assert(self != NULL);
+
+    Store *s = self->internal;
+    if (s->file == NULL || !s->isWritable) {
+        return rvm_asError(RVM_ERROR_NONE, NULL);
+    }
+    Error err = rvm_asError(RVM_ERROR_NONE, NULL);
+    pthread_mutex_lock(&s->lock);
+    if (milliseconds == 0) {
+        err = stopFlusher(s);
+    } else {
+        s->interval = milliseconds;
+        if (s->hasFlusher) {
+            pthread_cond_signal(&s->requested);
+        } else if (pthread_create(&s->flusher, NULL, runFlusher, s) == 0) {
+            s->hasFlusher = true;
+        } else {
+            err = rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    return err;
+}
+
+Error heapCollect(Heap *self, const uint64_t *revisions, size_t count) {
+    assert(self != NULL);
+    assert(revisions != NULL || count == 0);
+
+    Store *s = self->internal;
+    pthread_mutex_lock(&s->lock);
+    while (s->isFlushing) {
+        pthread_cond_wait(&s->flushed, &s->lock);
+    }
+    Error err = collectStore(s, revisions, count);
+    if (rvm_getErrorKind(err) == RVM_ERROR_NONE && s->isHashConsing) {
+        err = indexRevisions(self);
+    }
+    self->length = s->top;
+    pthread_mutex_unlock(&s->lock);
+
+    return err;
+}
+
+Error heapHashCons(Heap *self, bool isEnabled) {
+    assert(self != NULL);
+
+    Store *s = self->internal;
+    Error err = rvm_asError(RVM_ERROR_NONE, NULL);
+    pthread_mutex_lock(&s->lock);
+    if (isEnabled && !s->isHashConsing) {
+        // Symbols are interned via the hash-consing table while enabled,
+        // which leaves the symbol table incomplete.
+        s->symbols = (CellTable){ .entries = NULL };
+        s->isSymbolsIndexed = false;
+        s->isHashConsing = true;
+        err = indexRevisions(self);
+        isEnabled = rvm_getErrorKind(err) == RVM_ERROR_NONE;
+    }
+    if (!isEnabled) {
+        s->isHashConsing = false;
+        s->cells = (CellTable){ .entries = NULL };
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    return err;
+}
+
+Error heapWriteDelta(Heap *self, uint64_t base, uint64_t revision,
+    FILE *out) {
+    assert(self != NULL);
+    assert(out != NULL);
+
+    Store *s = self->internal;
+    Error err = rvm_asError(RVM_ERROR_NONE, NULL);
+    pthread_mutex_lock(&s->lock);
+    Delta delta = {
+        .magic = DELTA_MAGIC,
+        .version = DELTA_VERSION,
+        .base = base,
+        .revision = revision,
+    };
+    uint64_t end = s->top;
+    uint64_t anchor;
+    if (base > revision || revision > s->revision
+        || !findAnchor(s, base, &delta.begin, &delta.anchor)
+        || (revision < s->revision && !findAnchor(s, revision, &end, &anchor))) {
+        err = rvm_asError(RVM_ERROR_REVISION, NULL);
+        goto done;
+    }
+    delta.length = end - delta.begin;
+    const DeltaTrailer trailer = {
+        .checksum = checksumOf(s->memory, delta.begin, end, CHECKSUM_INITIAL),
+        .magic = DELTA_MAGIC,
+    };
+    if (fwrite(&delta, sizeof(Delta), 1, out) != 1
+        || fwrite(&s->memory[delta.begin], 1, delta.length, out)
+            != delta.length
+        || fwrite(&trailer, sizeof(DeltaTrailer), 1, out) != 1) {
+        err = errorFromErrno();
+    }
+
+done:
+    pthread_mutex_unlock(&s->lock);
+    return err;
+}
+
+Error heapApplyDelta(Heap *self, FILE *in) {
+    assert(self != NULL);
+    assert(in != NULL);
+
+    Delta delta;
+    if (fread(&delta, sizeof(Delta), 1, in) != 1) {
+        return ferror(in) ? errorFromErrno()
+                          : rvm_asError(RVM_ERROR_CORRUPT, NULL);
+    }
+    if (delta.magic != DELTA_MAGIC || delta.version != DELTA_VERSION
+        || delta.base > delta.revision || delta.begin < sizeof(Header)
+        || delta.begin % RVM_CELL_ALIGNMENT != 0
+        || delta.length % RVM_CELL_ALIGNMENT != 0
+        || delta.length > UINT64_MAX - delta.begin) {
+        return rvm_asError(RVM_ERROR_CORRUPT, NULL);
+    }
+
+    Store *s = self->internal;
+    pthread_mutex_lock(&s->lock);
+    while (s->isFlushing) {
+        pthread_cond_wait(&s->flushed, &s->lock);
+    }
+    const uint64_t base = s->revision;
+    Error err = applyDelta(self, &delta, in);
+    if (rvm_getErrorKind(err) == RVM_ERROR_NONE && s->isSymbolsIndexed
+        && s->top > delta.begin) {
+        const Error e = scanCells(s, delta.begin, indexSymbol, NULL);
+        if (rvm_getErrorKind(err) == RVM_ERROR_NONE) {
+            err = e;
+        } else {
+            rvm_freeError(e);
+        }
+    }
+    for (uint64_t r = base + 1; r <= s->revision && s->isHashConsing
+         && rvm_getErrorKind(err) == RVM_ERROR_NONE; ++r) {
+        if (s->roots[r] != RVM_NODE_INDEX_NONE) {
+            err = indexCell(self, s->roots[r]);
+        }
+    }
+    if (s->file == NULL) {
+        pthread_mutex_lock(&s->poolLock);
+        s->allocated = s->top;
+        pthread_mutex_unlock(&s->poolLock);
+    }
+    self->length = s->top;
+    self->revision = s->revision;
+    pthread_mutex_unlock(&s->lock);
+
+    return err;
+}
+
+/// Appends log segment of delta read from `in`, and reads the revisions it
+/// contains. Must be called with the store lock held.
+///
+/// The segment is read directly into heap memory beyond the top of its
+/// committed cells, which means that the memory used does not depend on the
+/// size of the delta. Nothing is committed until the whole segment has been
+/// read and its checksum verified. Should the segment replace a checkpoint,
+/// its trailer is first saved. If applying fails for any reason, the end
+/// of the log, including any replaced checkpoint, is restored, which leaves
+/// the heap at its base revision.
+///
+/// As the heap is grown to the length of the segment before it is read, that
+/// length is first checked against the limits of the heap, as well as against
+/// the bytes remaining in `in`, if it is a regular file.
+Error applyDelta(Heap *self, const Delta *delta, FILE *in) {
+    Store *s = self->internal;
+    uint64_t begin;
+    uint64_t anchor;
+    if (s->revision != delta->base || !findAnchor(s, s->revision, &begin,
+            &anchor) || begin != delta->begin || anchor != delta->anchor) {
+        return rvm_asError(RVM_ERROR_REVISION, NULL);
+    }
+    if (s->file != NULL && !s->isWritable) {
+        return rvm_asError(RVM_ERROR_IO, NULL);
+    }
+    if (delta->length > (s->file != NULL ? SIZE_MAX : s->capacity) - begin) {
+        return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+    }
+    if (isTruncated(in, delta->length + sizeof(DeltaTrailer))) {
+        return rvm_asError(RVM_ERROR_CORRUPT, NULL);
+    }
+    LogState state = {
+        .top = s->top,
+        .revision = s->revision,
+        .record = s->record,
+        .checkpoint = s->checkpoint,
+        .checksum = s->checksum,
+    };
+    if (s->top != begin) {
+        // Only a checkpoint written by this heap may follow the segment the
+        // delta continues. It is replaced by those of the delta, if any.
+        if (s->checkpoint == RVM_NODE_INDEX_NONE
+            || s->checkpoint + sizeof(Checkpoint) != s->top
+            || s->checkpoint - ((const Checkpoint *)&s->memory[s->checkpoint])
+                    ->count * 8 != begin) {
+            return rvm_asError(RVM_ERROR_REVISION, NULL);
+        }
+        state.replaced = *(const Checkpoint *)&s->memory[s->checkpoint];
+        rewindLog(s, begin);
+    }
+
+    uint64_t top = begin;
+    uint64_t offset;
+    Error err = allocCell(s, delta->length, &top, &offset);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        goto done;
+    }
+    uint64_t checksum = CHECKSUM_INITIAL;
+    for (uint64_t at = begin; at < top;) {
+        const size_t length = top - at < DELTA_CHUNK_LENGTH
+            ? (size_t)(top - at)
+            : DELTA_CHUNK_LENGTH;
+        if (fread(&s->memory[at], 1, length, in) != length) {
+            err = ferror(in) ? errorFromErrno()
+                             : rvm_asError(RVM_ERROR_CORRUPT, NULL);
+            goto done;
+        }
+        checksum = checksumOf(s->memory, at, at + length, checksum);
+        at += length;
+    }
+    DeltaTrailer trailer;
+    if (fread(&trailer, sizeof(DeltaTrailer), 1, in) != 1) {
+        err = ferror(in) ? errorFromErrno()
+                         : rvm_asError(RVM_ERROR_CORRUPT, NULL);
+        goto done;
+    }
+    if (trailer.magic != DELTA_MAGIC || trailer.checksum != checksum) {
+        err = rvm_asError(RVM_ERROR_CORRUPT, NULL);
+        goto done;
+    }
+
+    // An empty heap can take any log, including that of a collected heap,
+    // which begins with a checkpoint rather than records.
+    if (delta->base == 0) {
+        err = openLog(s, top);
+        if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+            goto done;
+        }
+    } else {
+        readCommits(s, top);
+    }
+    if (s->revision != delta->revision || s->top != top) {
+        err = rvm_asError(RVM_ERROR_CORRUPT, NULL);
+    }
+
+done:
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        restoreLog(s, &state, begin);
+    }
+    return err;
+}
+
+/// Determines whether fewer than `length` bytes remain to be read from `in`.
+/// Only regular files can be told to be truncated before being read.
+bool isTruncated(FILE *in, uint64_t length) {
+    struct stat st;
+    const int fd = fileno(in);
+    if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    const off_t at = ftello(in);
+    return at >= 0
+        && (at > st.st_size || (uint64_t)(st.st_size - at) < length);
+}
+
+/// Locates the end of the log of given revision.
+///
+/// The log of a revision ends with its record, unless the revision was
+/// created by a collection, in which case it ends with the checkpoint written
+/// by that collection. Records are searched for from the latest one
+/// backwards.
+///
+/// \returns `true` only if the end of the log of the revision is known.
+bool findAnchor(Store *s, uint64_t revision, uint64_t *begin,
+    uint64_t *anchor) {
+    if (revision == 0) {
+        *begin = sizeof(Header);
+        *anchor = 0;
+        return true;
+    }
+    uint64_t checkpoint = s->checkpoint;
+    for (uint64_t o = s->record; o != RVM_NODE_INDEX_NONE;) {
+        const Record *r = (const Record *)&s->memory[o];
+        if (r->revision <= revision) {
+            *begin = o + sizeof(Record);
+            *anchor = r->checksum;
+            return r->revision == revision;
+        }
+        checkpoint = r->checkpoint;
+        o = r->previous;
+    }
+    if (checkpoint == RVM_NODE_INDEX_NONE) {
+        return false;
+    }
+    const Checkpoint *c = (const Checkpoint *)&s->memory[checkpoint];
+    *begin = checkpoint + sizeof(Checkpoint);
+    *anchor = c->checksum;
+    return c->revision == revision;
+}
+
+/// Drops everything in the log after `begin`, which must be the end of the
+/// last record or checkpoint.
+void rewindLog(Store *s, uint64_t begin) {
+    if (s->record != RVM_NODE_INDEX_NONE
+        && s->record + sizeof(Record) == begin) {
+        const Record *r = (const Record *)&s->memory[s->record];
+        s->checkpoint = r->checkpoint;
+        s->checksum = checksumOf(s->memory, begin - 16, begin, r->checksum);
+    } else {
+        s->checkpoint = begin > sizeof(Header)
+            ? begin - sizeof(Checkpoint)
+            : RVM_NODE_INDEX_NONE;
+        s->checksum = CHECKSUM_INITIAL;
+    }
+    __atomic_store_n(&s->top, begin, __ATOMIC_RELEASE);
+    if (s->durableTop > begin) {
+        s->durableTop = begin;
+    }
+}
+
+/// Restores the end of the log to given state, rebuilding any checkpoint
+/// replaced after `begin` from its trailer and the revision table, whose
+/// entries up to the base revision are never changed by a delta. The durable
+/// top is left as is, as the replaced checkpoint may have reached the disk
+/// while modified.
+void restoreLog(Store *s, const LogState *state, uint64_t begin) {
+    if (state->top != begin) {
+        const Checkpoint *c = &state->replaced;
+        memcpy(&s->memory[begin], &s->roots[c->revision + 1 - c->count],
+            c->count * 8);
+        memcpy(&s->memory[begin + c->count * 8], c, sizeof(Checkpoint));
+    }
+    s->record = state->record;
+    s->checkpoint = state->checkpoint;
+    s->checksum = state->checksum;
+    __atomic_store_n(&s->revision, state->revision, __ATOMIC_RELEASE);
+    __atomic_store_n(&s->top, state->top, __ATOMIC_RELEASE);
+}
+
+Error heapStats(Heap *self, rvm_HeapStats *out) {
+    assert(self != NULL);
+    assert(out != NULL);
+
+    Store *s = self->internal;
+    *out = (rvm_HeapStats){ .revision = 0 };
+    pthread_mutex_lock(&s->lock);
+    out->revision = s->revision;
+    for (uint64_t r = 1; r <= s->revision; ++r) {
+        if (s->roots[r] != RVM_NODE_INDEX_NONE) {
+            out->revisions += 1;
+        }
+    }
+    out->length = s->top;
+    if (s->file != NULL && s->isWritable) {
+        out->unsynced = s->top - s->durableTop;
+    }
+    if (s->flushLatencies != NULL) {
+        memcpy(out->syncLatencies, s->flushLatencies,
+            sizeof(out->syncLatencies));
+    }
+    out->loads = __atomic_load_n(&s->loads, __ATOMIC_RELAXED);
+    out->decodes = __atomic_load_n(&s->decodes, __ATOMIC_RELAXED);
+    Error err = scanCells(s, sizeof(Header), countCell, out->total);
+    if (rvm_getErrorKind(err) == RVM_ERROR_NONE) {
+        err = countLive(s, out->live);
+    }
+    if (s->file != NULL) {
+        out->resident = countResident(s);
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    return err;
+}
+
+/// Visits all cells in heap memory at or after `begin`, which must be the
+/// end of a record or checkpoint, or the end of the heap header.
+///
+/// Cells fill the log between its records and checkpoints, which are visited
+/// from the latest one backwards by following the records and checkpoints
+/// they each refer to. The cells between each pair are then read in order.
+/// Checkpoints merged into later ones are no longer referred to by those, but
+/// are still found via the records following them.
+///
+/// \returns Error object, indicating any issues, including those returned by
+///          `visit`, which stop the scan.
+Error scanCells(Store *s, uint64_t begin,
+    Error (*visit)(Store *s, uint64_t offset, void *context), void *context) {
+    uint64_t record = s->record;
+    uint64_t checkpoint = s->checkpoint;
+    for (uint64_t end = s->top; end > begin && end > sizeof(Header);) {
+        if (record != RVM_NODE_INDEX_NONE
+            && record + sizeof(Record) == end) {
+            const Record *r = (const Record *)&s->memory[record];
+            end = record;
+            record = r->previous;
+            if (r->checkpoint != RVM_NODE_INDEX_NONE
+                && r->checkpoint > checkpoint) {
+                checkpoint = r->checkpoint;
+            }
+        } else if (checkpoint != RVM_NODE_INDEX_NONE
+            && checkpoint + sizeof(Checkpoint) == end) {
+            const Checkpoint *c = (const Checkpoint *)&s->memory[checkpoint];
+            end = checkpoint - c->count * 8;
+            checkpoint = c->previous;
+        } else {
+            return rvm_asError(RVM_ERROR_CORRUPT, NULL);
+        }
+        uint64_t first = sizeof(Header);
+        if (record != RVM_NODE_INDEX_NONE && record + sizeof(Record) > first) {
+            first = record + sizeof(Record);
+        }
+        if (checkpoint != RVM_NODE_INDEX_NONE
+            && checkpoint + sizeof(Checkpoint) > first) {
+            first = checkpoint + sizeof(Checkpoint);
+        }
+        for (uint64_t offset = first; offset < end;) {
+            const uint64_t header = *(const uint64_t *)&s->memory[offset];
+            const uint64_t size = rvm_getCellSize(rvm_getCellKind(header),
+                rvm_getCellLength(header));
+            if ((header & RVM_CELL_HEADER_RESERVED) != 0 || size == 0
+                || size > end - offset) {
+                return rvm_asError(RVM_ERROR_CORRUPT, NULL);
+            }
+            const Error err = visit(s, offset, context);
+            if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+                return err;
+            }
+            offset += size;
+        }
+        end = first;
+    }
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+/// Counts cell in array of rvm_HeapNodeStats indexed by kind.
+Error countCell(Store *s, uint64_t offset, void *context) {
+    rvm_HeapNodeStats *out = context;
+    const uint64_t header = *(const uint64_t *)&s->memory[offset];
+    const rvm_NodeKind kind = rvm_getCellKind(header);
+    out[kind].count += kind == RVM_NODE_LINK ? rvm_getCellLinks(header) : 1;
+    out[kind].bytes += rvm_getCellSize(kind, rvm_getCellLength(header));
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+/// Counts cells reachable from any revision, by kind.
+///
+/// Cells are marked in a bitmap with one bit per word of heap memory. Buffer
+/// heaps keep the bitmap in scratch memory.
+Error countLive(Store *s, rvm_HeapNodeStats *out) {
+    const size_t size = (size_t)(s->top / 512 + 1) * sizeof(uint64_t);
+    uint64_t *marks;
+    if (s->file != NULL) {
+        marks = calloc(1, size);
+    } else if ((marks = claimScratch(s, size)) != NULL) {
+        memset(marks, 0, size);
+    }
+    Error err = marks != NULL ? rvm_asError(RVM_ERROR_NONE, NULL)
+                              : rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+    for (uint64_t r = 1; marks != NULL && r <= s->revision
+         && rvm_getErrorKind(err) == RVM_ERROR_NONE; ++r) {
+        err = countReachable(s, s->roots[r], marks, out);
+    }
+    if (s->file != NULL) {
+        free(marks);
+    } else if (marks != NULL) {
+        releaseScratch(s, size);
+    }
+    return err;
+}
+
+/// Counts cells reachable from cell at `offset` that are not yet marked, and
+/// marks them.
+///
+/// Link tails and closure nodes are followed by iteration, while link heads
+/// and array elements are kept on a stack until the cells before them have
+/// been counted, which avoids recursion.
+Error countReachable(Store *s, uint64_t offset, uint64_t *marks,
+    rvm_HeapNodeStats *out) {
+    Pending pending = { .offsets = NULL };
+    Error err = rvm_asError(RVM_ERROR_NONE, NULL);
+    for (;;) {
+        while (offset != RVM_NODE_INDEX_NONE && !rvm_isCellImmediate(offset)) {
+            if (offset < sizeof(Header) || offset > s->top - 8
+                || offset % RVM_CELL_ALIGNMENT != 0) {
+                err = rvm_asError(RVM_ERROR_CORRUPT, NULL);
+                goto done;
+            }
+            const uint64_t bit = (uint64_t)1 << (offset / 8 % 64);
+            if ((marks[offset / 512] & bit) != 0) {
+                break;
+            }
+            marks[offset / 512] |= bit;
+            const uint64_t header = *(const uint64_t *)&s->memory[offset];
+            const rvm_NodeKind kind = rvm_getCellKind(header);
+            const uint64_t size = rvm_getCellSize(kind,
+                rvm_getCellLength(header));
+            if ((header & RVM_CELL_HEADER_RESERVED) != 0 || size == 0
+                || size > s->top - offset) {
+                err = rvm_asError(RVM_ERROR_CORRUPT, NULL);
+                goto done;
+            }
+            out[kind].count += kind == RVM_NODE_LINK
+                ? rvm_getCellLinks(header)
+                : 1;
+            out[kind].bytes += size;
+            const uint64_t *cell = (const uint64_t *)&s->memory[offset];
+            uint64_t first;
+            uint64_t last;
+            childSlotsOf(header, &first, &last);
+            if (kind == RVM_NODE_CLOSURE || kind == RVM_NODE_LINK) {
+                last -= 1;
+            }
+            for (uint64_t slot = first; slot < last; ++slot) {
+                if (cell[slot] != RVM_NODE_INDEX_NONE
+                    && !rvm_isCellImmediate(cell[slot])
+                    && !pushPending(s, &pending,
+                        fromRelative(offset, cell[slot]))) {
+                    err = rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+                    goto done;
+                }
+            }
+            offset = kind == RVM_NODE_CLOSURE || kind == RVM_NODE_LINK
+                ? fromRelative(offset, cell[last])
+                : RVM_NODE_INDEX_NONE;
+        }
+        if (pending.count == 0) {
+            break;
+        }
+        offset = pending.offsets[--pending.count];
+    }
+
+done:
+    freePending(s, &pending);
+    return err;
+}
+
+/// Pushes offset of cell pending traversal, doubling the capacity of the
+/// stack whenever full. Stacks of buffer heaps are grown in place, as nothing
+/// else claims scratch memory while they are in use.
+bool pushPending(Store *s, Pending *pending, uint64_t offset) {
+    if (pending->count == pending->capacity) {
+        const size_t capacity = pending->capacity > 0
+            ? pending->capacity * 2
+            : PENDING_CAPACITY_INITIAL;
+        uint64_t *offsets;
+        if (s->file != NULL) {
+            offsets = realloc(pending->offsets, capacity * sizeof(uint64_t));
+        } else {
+            offsets = claimScratch(s,
+                (capacity - pending->capacity) * sizeof(uint64_t));
+            if (offsets != NULL && pending->offsets != NULL) {
+                offsets = pending->offsets;
+            }
+        }
+        if (offsets == NULL) {
+            return false;
+        }
+        pending->offsets = offsets;
+        pending->capacity = capacity;
+    }
+    pending->offsets[pending->count++] = offset;
+    return true;
+}
+
+/// Releases memory of stack of cells pending traversal.
+void freePending(Store *s, Pending *pending) {
+    if (s->file != NULL) {
+        free(pending->offsets);
+    } else if (pending->capacity > 0) {
+        releaseScratch(s, pending->capacity * sizeof(uint64_t));
+    }
+}
+
+/// Counts bytes of heap memory currently resident in physical memory, or
+/// returns zero if residency cannot be determined.
+uint64_t countResident(Store *s) {
+    const uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    unsigned char pages[RESIDENCY_PAGES];
+    uint64_t resident = 0;
+    for (uint64_t at = 0; at < s->top; at += RESIDENCY_PAGES * page) {
+        const uint64_t length = s->top - at < RESIDENCY_PAGES * page
+            ? s->top - at
+            : RESIDENCY_PAGES * page;
+        if (mincore(&s->memory[at], (size_t)length, pages) != 0) {
+            return 0;
+        }
+        for (uint64_t i = 0; i * page < length; ++i) {
+            if ((pages[i] & 1) != 0) {
+                resident += length - i * page < page ? length - i * page : page;
+            }
+        }
+    }
+    return resident;
+}
+
+/// Copies all cells reachable from given revisions to a contiguous region.
+///
+/// This is a semi-space copying collector. Cells are copied in breadth-first
+/// order to the end of heap memory, which for lists means that each link ends
+/// up next to its head and the following link. When a cell is copied, its
+/// header is replaced with its new offset, which is how cells reachable via
+/// multiple paths are only copied once. To not modify cells on disk, the cells
+/// of file heaps are read from a private copy-on-write mapping of their files.
+///
+/// Once copied, the cells are made into a new log by writing a checkpoint
+/// after them. That log is finally moved to the beginning of heap memory,
+/// after which another checkpoint is written and the heap is truncated. For
+/// file heaps, the checkpoints are only written after the cells they cover
+/// are committed to disk, meaning that the file always ends with a valid
+/// checkpoint, even if collection is interrupted.
+///
+/// Buffer heaps cannot grow, and therefore only have room enough for all
+/// cells that could possibly survive if at least half of their memory is
+/// free. Collecting a buffer heap with less free memory than that fails with
+/// RVM_ERROR_NOMEMORY before any cell is copied.
+Error collectStore(Store *s, const uint64_t *revisions, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        if (revisions[i] > s->revision) {
+            return rvm_asError(RVM_ERROR_REVISION, NULL);
+        }
+    }
+    if (s->file != NULL && !s->isWritable) {
+        return rvm_asError(RVM_ERROR_IO, NULL);
+    }
+    const uint64_t end = s->top;
+    const uint64_t rootsSize = s->rootsCapacity * sizeof(uint64_t);
+    const uint64_t checkpointSize = s->revision * 8 + sizeof(Checkpoint);
+    if (s->file == NULL && (end - sizeof(Header)) + rvm_alignCellSize(rootsSize)
+            + checkpointSize > s->capacity - end) {
+        return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+    }
+
+    // Copying may grow the file, which is why the length of its private
+    // mapping is kept.
+    uint8_t *from = s->memory;
+    const uint64_t fromLength = s->length;
+    if (s->file != NULL) {
+        from = mmap(NULL, fromLength, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+            s->fd, 0);
+        if (from == MAP_FAILED) {
+            return errorFromErrno();
+        }
+    }
+    Error err = rvm_asError(RVM_ERROR_NONE, NULL);
+    uint64_t *const previousRoots = s->roots;
+    uint64_t *roots = allocRoots(s, s->rootsCapacity);
+    if (roots == NULL) {
+        err = rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+        goto done;
+    }
+    memset(roots, 0, (size_t)rootsSize);
+
+    uint64_t top = end;
+    err = copyReachable(s, s->roots, from, end, revisions, count, &top, roots);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        goto done;
+    }
+    if (s->file != NULL && flushRange(s->memory, end, top) != 0) {
+        err = errorFromErrno();
+        goto done;
+    }
+    err = commitCollection(s, roots, top);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        goto done;
+    }
+
+    // Move cells to beginning of heap memory. File heaps must remain intact
+    // if interrupted, which is why their cells are first copied past the
+    // checkpoint just written whenever moving them would overwrite it.
+    const uint64_t cells = top - end;
+    uint64_t begin = end;
+    if (s->file != NULL && sizeof(Header) + cells + checkpointSize > end) {
+        uint64_t past = s->top;
+        err = allocCell(s, cells, &past, &begin);
+        if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+            goto done;
+        }
+        memcpy(&s->memory[begin], &s->memory[end], cells);
+        moveRoots(s, roots, end, begin);
+        if (flushRange(s->memory, begin, past) != 0) {
+            err = errorFromErrno();
+            goto done;
+        }
+        err = commitCollection(s, roots, past);
+        if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+            goto done;
+        }
+    }
+    memmove(&s->memory[sizeof(Header)], &s->memory[begin], cells);
+    moveRoots(s, roots, begin, sizeof(Header));
+    if (s->file != NULL
+        && flushRange(s->memory, sizeof(Header), sizeof(Header) + cells)
+            != 0) {
+        err = errorFromErrno();
+        goto done;
+    }
+    err = commitCollection(s, roots, sizeof(Header) + cells);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        goto done;
+    }
+    reclaimPrivate(s);
+    s->cells = (CellTable){ .entries = NULL };
+    s->symbols = (CellTable){ .entries = NULL };
+    s->isSymbolsIndexed = false;
+
+    // The identities of functions were reclaimed with all other private
+    // memory. Should they not fit again, no functions are used anymore.
+    if (s->functionCount > 0) {
+        s->functionIdentities = identifyFunctions(s, s->functions,
+            s->functionCount);
+        if (s->functionIdentities == NULL) {
+            s->functions = NULL;
+            s->functionCount = 0;
+            err = rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+        }
+    }
+
+done:
+    if (s->roots != previousRoots) {
+        retireRoots(s, previousRoots);
+    } else if (s->file != NULL) {
+        free(roots);
+    }
+    if (s->file != NULL) {
+        munmap(from, fromLength);
+    }
+    return err;
+}
+
+/// Copies all cells reachable from given revisions of `s` to the empty file
+/// heap `t`, and makes them a log of as many revisions as `s` has.
+///
+/// The revisions not given are dropped, exactly as if `s` was collected. The
+/// cells of `s` are read from a private copy-on-write mapping of its file,
+/// which is therefore left untouched.
+Error vacuumStore(Store *s, Store *t, const uint64_t *revisions,
+    size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        if (revisions[i] > s->revision) {
+            return rvm_asError(RVM_ERROR_REVISION, NULL);
+        }
+    }
+    Error err = reserveRevision(t, s->revision);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        return err;
+    }
+    memset(t->roots, 0, (size_t)t->rootsCapacity * sizeof(uint64_t));
+
+    uint8_t *from = mmap(NULL, s->length, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+        s->fd, 0);
+    if (from == MAP_FAILED) {
+        return errorFromErrno();
+    }
+    uint64_t top = t->top;
+    err = copyReachable(t, s->roots, from, s->top, revisions, count, &top,
+        t->roots);
+    munmap(from, s->length);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        return err;
+    }
+    if (flushRange(t->memory, 0, top) != 0) {
+        return errorFromErrno();
+    }
+    t->revision = s->revision;
+
+    return commitCollection(t, t->roots, top);
+}
+
+/// Flushes directory containing given path to disk, which makes any renaming
+/// of the file at the path durable.
+int syncDirectoryOf(const char *path) {
+    const char *slash = strrchr(path, '/');
+    char *directory = slash != NULL
+        ? strndup(path, slash != path ? (size_t)(slash - path) : 1)
+        : strdup(".");
+    if (directory == NULL) {
+        return -1;
+    }
+    const int fd = open(directory, O_RDONLY);
+    free(directory);
+    if (fd < 0) {
+        return -1;
+    }
+    const int result = fsync(fd);
+    close(fd);
+
+    return result;
+}
+
+/// Copies all cells of `from` reachable from given revisions to `top` of
+/// `s`, setting the `roots` of those revisions to the offsets of the copies.
+///
+/// Cells are copied in breadth-first order, and the relative offsets of each
+/// copy are fixed once it is scanned. `from` is modified to keep track of the
+/// cells already copied, and can therefore not be heap memory in use.
+Error copyReachable(Store *s, const uint64_t *fromRoots, uint8_t *from,
+    uint64_t end, const uint64_t *revisions, size_t count, uint64_t *top,
+    uint64_t *roots) {
+    const uint64_t begin = *top;
+    for (size_t i = 0; i < count; ++i) {
+        const uint64_t root = fromRoots[revisions[i]];
+        if (root == RVM_NODE_INDEX_NONE) {
+            continue;
+        }
+        const Error err = copyCell(s, from, end, root, top,
+            &roots[revisions[i]]);
+        if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+            return err;
+        }
+    }
+    for (uint64_t scan = begin; scan < *top;) {
+        const uint64_t header = *(const uint64_t *)&s->memory[scan];
+        uint64_t first;
+        uint64_t last;
+        childSlotsOf(header, &first, &last);
+        for (uint64_t slot = first; slot < last; ++slot) {
+            const uint64_t target = ((uint64_t *)&s->memory[scan])[slot];
+            if (target == RVM_NODE_INDEX_NONE || rvm_isCellImmediate(target)) {
+                continue;
+            }
+            uint64_t offset;
+            const Error err = copyCell(s, from, end, target, top, &offset);
+            if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+                return err;
+            }
+            storeSlot(s, scan, slot, offset);
+        }
+        scan += rvm_getCellSize(rvm_getCellKind(header),
+            rvm_getCellLength(header));
+    }
+
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+/// Copies cell at `offset` of `from` to `top`, unless already copied.
+///
+/// The relative offsets of the copy are replaced with absolute offsets into
+/// `from`, which are updated when the copy is scanned.
+Error copyCell(Store *s, uint8_t *from, uint64_t end, uint64_t offset,
+    uint64_t *top, uint64_t *out) {
+    if (offset < sizeof(Header) || offset > end - 8
+        || offset % RVM_CELL_ALIGNMENT != 0) {
+        return rvm_asError(RVM_ERROR_CORRUPT, NULL);
+    }
+    uint64_t *cell = (uint64_t *)&from[offset];
+    if ((cell[0] & CELL_FORWARDED) != 0) {
+        *out = cell[0] >> RVM_CELL_HEADER_LENGTH_SHIFT;
+        return rvm_asError(RVM_ERROR_NONE, NULL);
+    }
+    const rvm_NodeKind kind = rvm_getCellKind(cell[0]);
+    const uint64_t length = rvm_getCellLength(cell[0]);
+    const uint64_t size = rvm_getCellSize(kind, length);
+    if ((cell[0] & RVM_CELL_HEADER_RESERVED) != 0 || length > end - offset
+        || size == 0 || size > end - offset) {
+        return rvm_asError(RVM_ERROR_CORRUPT, NULL);
+    }
+    uint64_t to;
+    const Error err = allocCell(s, size, top, &to);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        return err;
+    }
+    uint64_t *copy = (uint64_t *)&s->memory[to];
+    memcpy(copy, cell, size);
+    uint64_t first;
+    uint64_t last;
+    childSlotsOf(cell[0], &first, &last);
+    for (uint64_t i = first; i < last; ++i) {
+        copy[i] = fromRelative(offset, cell[i]);
+    }
+    cell[0] = (to << RVM_CELL_HEADER_LENGTH_SHIFT) | CELL_FORWARDED;
+    *out = to;
+
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+/// Adjusts root offsets of all revisions for their cells having been moved
+/// from `from` to `to`.
+void moveRoots(const Store *s, uint64_t *roots, uint64_t from, uint64_t to) {
+    for (uint64_t r = 1; r <= s->revision; ++r) {
+        if (roots[r] != RVM_NODE_INDEX_NONE) {
+            roots[r] = roots[r] - from + to;
+        }
+    }
+}
+
+/// Makes cells ending at `top` into a new log with given revision table, by
+/// writing a checkpoint after them.
+///
+/// File heaps are also flushed and truncated to end right after the
+/// checkpoint. The previous state of the heap is restored if the checkpoint
+/// cannot be written.
+Error commitCollection(Store *s, uint64_t *roots, uint64_t top) {
+    uint64_t *const previousRoots = s->roots;
+    const uint64_t previousTop = s->top;
+    const uint64_t previousRecord = s->record;
+    const uint64_t previousCheckpoint = s->checkpoint;
+    const uint64_t previousChecksum = s->checksum;
+    s->roots = roots;
+    s->top = top;
+    s->record = RVM_NODE_INDEX_NONE;
+    s->checkpoint = RVM_NODE_INDEX_NONE;
+    s->checksum = CHECKSUM_INITIAL;
+    Error err = writeCheckpoint(s);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        s->roots = previousRoots;
+        s->top = previousTop;
+        s->record = previousRecord;
+        s->checkpoint = previousCheckpoint;
+        s->checksum = previousChecksum;
+        return err;
+    }
+    if (s->file == NULL) {
+        return rvm_asError(RVM_ERROR_NONE, NULL);
+    }
+    if (flushRange(s->memory, top, s->top) != 0
+        || ftruncate(s->fd, (off_t)s->top) != 0) {
+        return errorFromErrno();
+    }
+    s->capacity = s->top;
+    s->durable = s->revision;
+    s->durableTop = s->top;
+
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+/// Releases all private memory except the revision table.
+///
+/// Only safe to call when there are no loaded nodes in use, such as right
+/// after a collection.
+void reclaimPrivate(Store *s) {
+    if (s->file == NULL) {
+        const size_t size = (size_t)s->rootsCapacity * sizeof(uint64_t);
+        s->capacity = (uint64_t)((uint8_t *)s - s->memory)
+            - rvm_alignCellSize(size);
+        s->allocated = s->top;
+        memmove(&s->memory[s->capacity], s->roots, size);
+        s->roots = (uint64_t *)&s->memory[s->capacity];
+        return;
+    }
+    for (PoolBlock *b = s->pool, *next; b != NULL; b = next) {
+        next = b->next;
+        free(b);
+    }
+    s->pool = NULL;
+    s->swizzles = NULL;
+}
+
+Error allocCell(Store *s, uint64_t size, uint64_t *top, uint64_t *out) {
+    assert(s != NULL);
+    assert(top != NULL);
+    assert(out != NULL);
+    assert(size % RVM_CELL_ALIGNMENT == 0);
+
+    if (s->file == NULL) {
+        // Readers may be allocating private memory from the same buffer.
+        pthread_mutex_lock(&s->poolLock);
+        const bool isFull = size > s->capacity - *top;
+        if (!isFull && *top + size > s->allocated) {
+            s->allocated = *top + size;
+        }
+        pthread_mutex_unlock(&s->poolLock);
+        if (isFull) {
+            return s->grow(s, *top + size);
+        }
+    } else if (size > s->capacity - *top) {
+        const Error err = s->grow(s, *top + size);
+        if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+            return err;
+        }
+    }
+    *out = *top;
+    *top += size;
+
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+/// Stores node and all nodes it refers to as cells.
+///
+/// Nodes that already are cells of this heap, which is the case for all lazy
+/// nodes referring to this heap, and for all nodes with indexes if `source`
+/// is this heap, are stored by reference rather than by copy. Nodes loaded
+/// from other heaps are stored by copy, with `source` being the heap they
+/// were loaded from, as their indexes and those of the nodes they refer to
+/// have no meaning in this heap. A value that replaces a single node of an
+/// existing value therefore only causes the nodes on the path from the root to
+/// that node to be stored.
+///
+/// Cells are allocated before the cells of their children, which means that
+/// each cell must be looked up again via its offset after any of its children
+/// have been stored, as storing may cause the heap memory to be remapped. Link
+/// tails and closure nodes are stored by iteration rather than recursion,
+/// allowing for long lists. While iterating, the tail slot of each cell holds
+/// the offset of the cell before it. Once the end of the chain is reached, the
+/// chain is walked backwards to fill in the tail slots, which is also when each
+/// cell of the chain is given to internCell(). Consecutive links without
+/// indexes share cells, up to LINK_UNROLL_MAX links per cell.
+Error storeNode(Heap *self, const Heap *source, const Node *node,
+    uint64_t *top, uint64_t *out) {
+    assert(self != NULL);
+    assert(top != NULL);
+    assert(out != NULL);
+
+    Store *s = self->internal;
+    uint64_t last = RVM_NODE_INDEX_NONE;
+    uint64_t target;
+    Error err = rvm_asError(RVM_ERROR_NONE, NULL);
+
+    for (;;) {
+        if (node == NULL) {
+            target = RVM_NODE_INDEX_NONE;
+            break;
+        }
+        if (last != RVM_NODE_INDEX_NONE && rvm_makeCellImmediate(node, &target)) {
+            break;
+        }
+        const rvm_NodeKind kind = rvm_getNodeKind((Node *)node);
+
+        if (kind != RVM_NODE_LAZY && source == self
+            && rvm_getNodeIndex((Node *)node) != RVM_NODE_INDEX_NONE) {
+            assert(isCellOf(s, node));
+            target = rvm_getNodeIndex((Node *)node);
+            break;
+        }
+        if (kind == RVM_NODE_LAZY) {
+            if (node->as.lazy.heap == self) {
+                target = rvm_getNodeIndex((Node *)node);
+            } else {
+                Node loaded = *node;
+                err = rvm_loadNode(&loaded);
+                if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+                    return err;
+                }
+                err = storeNode(self, node->as.lazy.heap, &loaded, top,
+                    &target);
+                if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+                    return err;
+                }
+            }
+            break;
+        }
+
+        uint64_t length = 0;
+        if (kind == RVM_NODE_BYTES || kind == RVM_NODE_SYMBOL) {
+            length = node->as.bytes.length;
+        } else if (kind == RVM_NODE_ARRAY) {
+            length = node->as.array.length;
+        } else if (kind == RVM_NODE_LINK) {
+            length = unrolledLengthOf(node);
+        }
+        uint64_t offset;
+        err = allocCell(s, rvm_getCellSize(kind, length), top, &offset);
+        if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+            return err;
+        }
+
+        uint64_t *cell = (uint64_t *)&s->memory[offset];
+        cell[0] = rvm_makeCellHeader(kind, length);
+        if (kind == RVM_NODE_ARRAY && isPackable(node)) {
+            cell[0] |= RVM_CELL_HEADER_PACKED;
+        }
+
+        switch (kind) {
+        case RVM_NODE_BYTES:
+        case RVM_NODE_SYMBOL:
+            if (length > 0) {
+                cell[(length + 7) / 8] = 0;
+                memcpy(&cell[1], node->as.bytes.bytes, length);
+            }
+            break;
+
+        case RVM_NODE_NUMBER:
+            cell[1] = (uint64_t)node->as.number.integer;
+            break;
+
+        case RVM_NODE_CLOSURE:
+            cell[1] = rvm_getCellFunction(node->as.closure.function);
+            storeSlot(s, offset, 2, last);
+            last = offset;
+            node = node->as.closure.node;
+            continue;
+
+        case RVM_NODE_ARRAY:
+            if (rvm_isCellPacked(cell[0])) {
+                for (uint64_t i = 0; i < length; ++i) {
+                    cell[1 + i] =
+                        (uint64_t)node->as.array.nodes[i].as.number.integer;
+                }
+                break;
+            }
+            for (uint64_t i = 0; i < length; ++i) {
+                uint64_t child;
+                err = storeChild(self, source, &node->as.array.nodes[i], top,
+                    &child);
+                if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+                    return err;
+                }
+                storeSlot(s, offset, 1 + i, child);
+            }
+            break;
+
+        case RVM_NODE_LINK: {
+            const uint64_t links = length > 0 ? length : 1;
+            for (uint64_t i = 0; i < links; ++i) {
+                if (i > 0) {
+                    node = node->as.link.tail;
+                }
+                uint64_t head;
+                err = storeChild(self, source, node->as.link.head, top,
+                    &head);
+                if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+                    return err;
+                }
+                storeSlot(s, offset, 1 + i, head);
+            }
+            storeSlot(s, offset, 1 + links, last);
+            last = offset;
+            node = node->as.link.tail;
+            continue;
+        }
+
+        default:
+            break;
+        }
+        err = internCell(s, offset, top, &target);
+        if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+            return err;
+        }
+        break;
+    }
+
+    while (last != RVM_NODE_INDEX_NONE) {
+        const uint64_t slot = tailSlotOf(*(uint64_t *)&s->memory[last]);
+        const uint64_t previous = fromRelative(last,
+            ((uint64_t *)&s->memory[last])[slot]);
+        storeSlot(s, last, slot, target);
+        err = internCell(s, last, top, &target);
+        if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+            return err;
+        }
+        last = previous;
+    }
+    *out = target;
+
+    return err;
+}
+
+/// Replaces cell at `offset` with an identical existing cell, if hash-consing
+/// is enabled and such a cell exists. Otherwise, the cell is added to the
+/// hash-consing table.
+///
+/// Symbols are always interned. While hash-consing is disabled, they are
+/// looked up in a table of their own, which is filled with all symbols in
+/// heap memory when first used.
+///
+/// Only the most recently allocated cell can be replaced, in which case it is
+/// released by moving `top` back to its offset. This is not a limitation, as a
+/// cell followed by other new cells is a cell referring to new cells, and no
+/// existing cell can be identical to it. As cells are given to this function
+/// after their children, the parents of replaced cells become candidates for
+/// replacement as well.
+///
+/// \param s      Store.
+/// \param offset Offset of new cell.
+/// \param top    Pointer to offset of first byte after new cells.
+/// \param out    Pointer to receiver of offset of cell to use.
+/// \returns      Error object, indicating any issues.
+Error internCell(Store *s, uint64_t offset, uint64_t *top, uint64_t *out) {
+    *out = offset;
+    CellTable *table = &s->cells;
+    if (!s->isHashConsing) {
+        const uint64_t header = *(const uint64_t *)&s->memory[offset];
+        if (rvm_getCellKind(header) != RVM_NODE_SYMBOL) {
+            return rvm_asError(RVM_ERROR_NONE, NULL);
+        }
+        if (!s->isSymbolsIndexed) {
+            const Error err = scanCells(s, sizeof(Header), indexSymbol, NULL);
+            if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+                s->symbols = (CellTable){ .entries = NULL };
+                return err;
+            }
+            s->isSymbolsIndexed = true;
+        }
+        table = &s->symbols;
+    }
+    uint64_t existing;
+    const Error err = insertCell(s, table, offset, &existing);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        return err;
+    }
+    if (existing != offset) {
+        assert(offset + rvm_getCellSize(
+            rvm_getCellKind(*(const uint64_t *)&s->memory[offset]),
+            rvm_getCellLength(*(const uint64_t *)&s->memory[offset])) == *top);
+        *top = offset;
+        *out = existing;
+    }
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+/// Inserts cell into given table, unless an identical cell already is in the
+/// table.
+///
+/// The table uses open addressing with linear probing, and is replaced with
+/// one twice as large when half full. Replaced tables are abandoned, just as
+/// revision tables.
+///
+/// \param s      Store.
+/// \param table  Hash-consing or symbol table.
+/// \param offset Offset of cell to insert.
+/// \param out    Pointer to receiver of offset of identical cell in table,
+///               which is `offset` if inserted.
+/// \returns      Error object, indicating any issues.
+Error insertCell(Store *s, CellTable *table, uint64_t offset, uint64_t *out) {
+    if ((table->count + 1) * 2 > table->capacity) {
+        const uint64_t capacity = table->capacity > 0
+            ? table->capacity * 2
+            : CELLS_CAPACITY_INITIAL;
+        if (capacity > SIZE_MAX / sizeof(CellEntry)) {
+            return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+        }
+        CellEntry *cells = s->allocPrivate(s, capacity * sizeof(CellEntry));
+        if (cells == NULL) {
+            return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+        }
+        memset(cells, 0, capacity * sizeof(CellEntry));
+        for (uint64_t i = 0; i < table->capacity; ++i) {
+            const CellEntry entry = table->entries[i];
+            if (entry.offset == RVM_NODE_INDEX_NONE) {
+                continue;
+            }
+            uint64_t j = entry.hash & (capacity - 1);
+            while (cells[j].offset != RVM_NODE_INDEX_NONE) {
+                j = (j + 1) & (capacity - 1);
+            }
+            cells[j] = entry;
+        }
+        table->entries = cells;
+        table->capacity = capacity;
+    }
+
+    const uint64_t hash = hashCell(s, offset);
+    uint64_t i = hash & (table->capacity - 1);
+    for (;; i = (i + 1) & (table->capacity - 1)) {
+        const CellEntry entry = table->entries[i];
+        if (entry.offset == RVM_NODE_INDEX_NONE) {
+            table->entries[i] = (CellEntry){ .offset = offset, .hash = hash };
+            table->count += 1;
+            *out = offset;
+            break;
+        }
+        if (entry.offset == offset
+            || (entry.hash == hash && equalCells(s, entry.offset, offset))) {
+            *out = entry.offset;
+            break;
+        }
+    }
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+/// Removes all cells at or after `top` from given table.
+///
+/// Used to forget the cells of a failed commit, which are overwritten by the
+/// next one. Entries are removed by backward shift deletion, which moves any
+/// later entries of the same probe sequence into the freed slots.
+void forgetCells(CellTable *table, uint64_t top) {
+    const uint64_t mask = table->capacity - 1;
+    for (uint64_t i = 0; i < table->capacity; ++i) {
+        while (table->entries[i].offset >= top) {
+            uint64_t hole = i;
+            for (uint64_t j = (i + 1) & mask;; j = (j + 1) & mask) {
+                if (table->entries[j].offset == RVM_NODE_INDEX_NONE) {
+                    break;
+                }
+                const uint64_t home = table->entries[j].hash & mask;
+                const bool isInPlace = hole <= j
+                    ? hole < home && home <= j
+                    : hole < home || home <= j;
+                if (!isInPlace) {
+                    table->entries[hole] = table->entries[j];
+                    hole = j;
+                }
+            }
+            table->entries[hole] = (CellEntry){ .offset = RVM_NODE_INDEX_NONE };
+            table->count -= 1;
+        }
+    }
+}
+
+/// Inserts cell into symbol table if it is a symbol. Symbols identical to a
+/// symbol already in the table, which heaps written before symbols were
+/// interned may contain, are left out.
+Error indexSymbol(Store *s, uint64_t offset, void *context) {
+    (void)context;
+    const uint64_t header = *(const uint64_t *)&s->memory[offset];
+    if (rvm_getCellKind(header) != RVM_NODE_SYMBOL) {
+        return rvm_asError(RVM_ERROR_NONE, NULL);
+    }
+    uint64_t existing;
+    return insertCell(s, &s->symbols, offset, &existing);
+}
+
+/// Inserts the cells reachable from all revisions into the hash-consing
+/// table.
+///
+/// Cells already in the table, or identical to cells in the table, are not
+/// traversed, as the cells they refer to must already have been inserted.
+Error indexRevisions(Heap *self) {
+    Store *s = self->internal;
+    for (uint64_t r = 1; r <= s->revision; ++r) {
+        if (s->roots[r] == RVM_NODE_INDEX_NONE) {
+            continue;
+        }
+        const Error err = indexCell(self, s->roots[r]);
+        if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+            return err;
+        }
+    }
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+/// Inserts cell at `offset`, and all cells it refers to, into the hash-consing
+/// table.
+///
+/// Link tails and closure nodes are traversed by iteration, while link heads
+/// and array elements are kept on a stack until the cells before them have
+/// been inserted.
+Error indexCell(Heap *self, uint64_t offset) {
+    Store *s = self->internal;
+    Pending pending = { .offsets = NULL };
+    Error err = rvm_asError(RVM_ERROR_NONE, NULL);
+    for (;;) {
+        while (offset != RVM_NODE_INDEX_NONE && !rvm_isCellImmediate(offset)) {
+            if (offset < sizeof(Header) || offset > s->top - 8) {
+                err = rvm_asError(RVM_ERROR_CORRUPT, NULL);
+                goto done;
+            }
+            const uint64_t header = *(const uint64_t *)&s->memory[offset];
+            const rvm_NodeKind kind = rvm_getCellKind(header);
+            const uint64_t size = rvm_getCellSize(kind,
+                rvm_getCellLength(header));
+            if ((header & RVM_CELL_HEADER_RESERVED) != 0 || size == 0
+                || size > s->top - offset) {
+                err = rvm_asError(RVM_ERROR_CORRUPT, NULL);
+                goto done;
+            }
+            uint64_t existing;
+            err = insertCell(s, &s->cells, offset, &existing);
+            if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+                goto done;
+            }
+            if (existing != offset) {
+                break;
+            }
+            const uint64_t *cell = (const uint64_t *)&s->memory[offset];
+            uint64_t first;
+            uint64_t last;
+            childSlotsOf(header, &first, &last);
+            if (kind == RVM_NODE_CLOSURE || kind == RVM_NODE_LINK) {
+                last -= 1;
+            }
+            for (uint64_t slot = first; slot < last; ++slot) {
+                if (cell[slot] != RVM_NODE_INDEX_NONE
+                    && !rvm_isCellImmediate(cell[slot])
+                    && !pushPending(s, &pending,
+                        fromRelative(offset, cell[slot]))) {
+                    err = rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+                    goto done;
+                }
+            }
+            offset = kind == RVM_NODE_CLOSURE || kind == RVM_NODE_LINK
+                ? fromRelative(offset, cell[last])
+                : RVM_NODE_INDEX_NONE;
+        }
+        if (pending.count == 0) {
+            break;
+        }
+        offset = pending.offsets[--pending.count];
+    }
+
+done:
+    freePending(s, &pending);
+    return err;
+}
+
+/// Calculates hash of cell contents.
+///
+/// Child offsets are hashed as absolute offsets, as identical cells at
+/// different offsets have different relative offsets.
+uint64_t hashCell(Store *s, uint64_t offset) {
+    const uint64_t *cell = (const uint64_t *)&s->memory[offset];
+    const uint64_t size = rvm_getCellSize(rvm_getCellKind(cell[0]),
+        rvm_getCellLength(cell[0]));
+    uint64_t first;
+    uint64_t last;
+    childSlotsOf(cell[0], &first, &last);
+
+    uint64_t hash = CHECKSUM_INITIAL;
+    for (uint64_t i = 0; i < size / 8; ++i) {
+        const uint64_t word = i >= first && i < last
+            ? fromRelative(offset, cell[i])
+            : cell[i];
+        hash = (hash ^ word) * 0x00000100000001b3;
+    }
+    return hash ^ (hash >> 29);
+}
+
+/// Determines whether the cells at `a` and `b` have identical contents.
+bool equalCells(Store *s, uint64_t a, uint64_t b) {
+    const uint64_t *x = (const uint64_t *)&s->memory[a];
+    const uint64_t *y = (const uint64_t *)&s->memory[b];
+    if (x[0] != y[0]) {
+        return false;
+    }
+    const uint64_t size = rvm_getCellSize(rvm_getCellKind(x[0]),
+        rvm_getCellLength(x[0]));
+    uint64_t first;
+    uint64_t last;
+    childSlotsOf(x[0], &first, &last);
+    for (uint64_t i = 1; i < size / 8; ++i) {
+        if (i >= first && i < last
+                ? fromRelative(a, x[i]) != fromRelative(b, y[i])
+                : x[i] != y[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// Resolves range of words holding child offsets in cell with given header.
+///
+/// \param header Cell header.
+/// \param first  Pointer to receiver of index of first child offset word.
+/// \param last   Pointer to receiver of index of word after last child offset
+///               word, which is equal to `first` if there are no children.
+void childSlotsOf(uint64_t header, uint64_t *first, uint64_t *last) {
+    switch (rvm_getCellKind(header)) {
+    case RVM_NODE_CLOSURE:
+        *first = 2;
+        *last = 3;
+        break;
+
+    case RVM_NODE_ARRAY:
+        *first = 1;
+        *last = rvm_isCellPacked(header) ? 1 : 1 + rvm_getCellLength(header);
+        break;
+
+    case RVM_NODE_LINK:
+        *first = 1;
+        *last = 2 + rvm_getCellLinks(header);
+        break;
+
+    default:
+        *first = 1;
+        *last = 1;
+        break;
+    }
+}
+
+/// Resolves index of the word holding the tail offset of a link cell, or the
+/// node offset of a closure cell, with given header.
+uint64_t tailSlotOf(uint64_t header) {
+    uint64_t first;
+    uint64_t last;
+    childSlotsOf(header, &first, &last);
+    return last - 1;
+}
+
+/// Determines amount of links to store in the link cell of given link, which
+/// is zero unless it is followed by other links not yet stored.
+uint64_t unrolledLengthOf(const Node *link) {
+    uint64_t length = 1;
+    for (const Node *tail = link->as.link.tail;
+         length < LINK_UNROLL_MAX && tail != NULL
+         && rvm_getNodeKind((Node *)tail) == RVM_NODE_LINK
+         && rvm_getNodeIndex((Node *)tail) == RVM_NODE_INDEX_NONE;
+         tail = tail->as.link.tail) {
+        length += 1;
+    }
+    return length > 1 ? length : 0;
+}
+
+/// Determines whether given array can be stored packed, which is the case if
+/// it has elements and they are all numbers.
+bool isPackable(const Node *array) {
+    for (size_t i = 0; i < array->as.array.length; ++i) {
+        if (rvm_getNodeKind((Node *)&array->as.array.nodes[i])
+            != RVM_NODE_NUMBER) {
+            return false;
+        }
+    }
+    return array->as.array.length > 0;
+}
+
+/// Stores child node, either as an immediate word or as a cell.
+///
+/// \see storeNode
+Error storeChild(Heap *self, const Heap *source, const Node *node,
+    uint64_t *top, uint64_t *out) {
+    if (node != NULL && rvm_makeCellImmediate(node, out)) {
+        return rvm_asError(RVM_ERROR_NONE, NULL);
+    }
+    return storeNode(self, source, node, top, out);
+}
+
+Node *allocNodes(Store *s, size_t count) {
+    assert(s != NULL);
+    assert(count > 0);
+
+    if (count > SIZE_MAX / sizeof(Node)) {
+        return NULL;
+    }
+    return s->allocPrivate(s, count * sizeof(Node));
+}
+
+#ifndef NDEBUG
+/// Determines whether given indexed node could be a cell of this heap.
+bool isCellOf(Store *s, const Node *node) {
+    const uint64_t offset = rvm_getNodeIndex((Node *)node);
+    if (offset < sizeof(Header) || offset >= s->top) {
+        return false;
+    }
+    const uint64_t header = *(const uint64_t *)&s->memory[offset];
+    return rvm_getCellKind(header) == rvm_getNodeKind((Node *)node);
+}
+#endif
+
+/// Writes target offset or immediate word to given slot of parent cell.
+void storeSlot(Store *s, uint64_t parent, uint64_t slot, uint64_t target) {
+    ((uint64_t *)&s->memory[parent])[slot] = target == RVM_NODE_INDEX_NONE
+            || rvm_isCellImmediate(target)
+        ? target
+        : toRelative(parent, target);
+}
+
+void lazyNode(const Heap *self, Node *node, uint64_t offset,
+    const Node **referrer) {
+    assert(node != NULL);
+
+    *node = (Node){
+        .flags = offset | RVM_NODE_LAZY,
+        .as.lazy = { self, referrer },
+    };
+}
+
+/// Turns absolute target offset into an offset relative to given cell offset.
+uint64_t toRelative(uint64_t offset, uint64_t target) {
+    return target - offset;
+}
+
+/// Turns offset relative to given cell offset into an absolute offset.
+///
+/// Relative offsets of zero are never produced by toRelative(), as no cell
+/// refers to itself, and are therefore used to represent `NULL` pointers.
+/// Immediate words are returned as they are.
+uint64_t fromRelative(uint64_t offset, uint64_t relative) {
+    return relative == RVM_NODE_INDEX_NONE || rvm_isCellImmediate(relative)
+        ? relative
+        : offset + relative;
+}
+
+Error errorFromErrno(void) {
+    return rvm_asError(errno == ENOMEM ? RVM_ERROR_NOMEMORY : RVM_ERROR_IO,
+        NULL);
+}
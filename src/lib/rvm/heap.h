@@ -5,6 +5,7 @@
 ///
 /// \file
 
+#include <assert.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -12,15 +13,101 @@
 #include "error.h"
 #include "value.h"
 
+/// Amount of buckets in heap synchronization latency histograms.
+#define RVM_HEAP_LATENCY_BUCKETS 24
+
+/// Amount of rvm_NodeKind values, and of entries in per-kind statistics.
+#define RVM_HEAP_NODE_KINDS (RVM_NODE_FLAGS_KIND + 1)
+
 typedef struct rvm_Heap rvm_Heap;
+typedef struct rvm_HeapNodeStats rvm_HeapNodeStats;
 typedef struct rvm_HeapResult rvm_HeapResult;
+typedef struct rvm_HeapStats rvm_HeapStats;
+
+/// Identifies a requested heap synchronization.
+///
+/// \see rvm_Heap
+typedef uint64_t rvm_HeapTicket;
 
 /// Represents a block of contiguous memory containing rvm_Value objects and
 /// associated data.
 ///
+/// ## Lazy Nodes
+///
+/// Values are never read from a heap in their entirety. Rather, the root node
+/// of each value received via `get` is of kind RVM_NODE_LAZY, and refers to the
+/// heap it came from. Such a node is turned into a regular node by providing it
+/// to rvm_loadNode(), after which any child nodes it has are also lazy. Only the
+/// parts of a heap actually visited are therefore ever read, which means that
+/// the cost of opening a heap is independent of its size.
+///
+/// Small numbers and short byte sequences are stored within the nodes
+/// referring to them, rather than as nodes of their own. Such child nodes are
+/// loaded along with their parents, and are never lazy. Loaded byte sequences
+/// and symbols refer directly to heap memory, whether stored within their
+/// parents or not.
+///
+/// ## Symbols
+///
+/// Symbols are interned, meaning that each distinct symbol is stored only
+/// once in each heap. Symbols loaded from the same heap are therefore equal
+/// exactly when their indexes are. The symbols of a heap are looked up the
+/// first time a symbol is stored after the heap is created or opened, which
+/// takes time proportional to the size of the heap.
+///
+/// Lazy nodes hold a pointer to the rvm_Heap structure that created them, which
+/// must therefore not be moved or freed while those nodes are in use.
+///
+/// File heaps keep the nodes they load, and make the kept nodes refer directly
+/// to each other as their children are loaded. Nodes visited before are
+/// therefore mostly reached by following pointers rather than by loading them
+/// again. As the child pointers of kept nodes may change at any time, nodes
+/// received from a file heap must not be modified, except for lazy nodes being
+/// loaded by a single thread.
+///
+/// Chains of links stored by the same call to `set` are unrolled, meaning
+/// that several consecutive links are stored together along with their heads.
+/// Loading the first link of such a chain also loads the links stored with it,
+/// which lack indexes, as they are not stored on their own.
+///
+/// Loading a link or array from a file heap also asks for the cells of its
+/// first children to be read from disk ahead of time, which lets traversals
+/// of cold heaps overlap their disk reads.
+///
+/// ## Closures
+///
+/// Closures are stored with the name and arity of their functions rather than
+/// with function pointers, which are only valid within a single process.
+/// Loading a closure therefore requires its function to be registered via
+/// `useFunctions`, or RVM_ERROR_CORRUPT is caused.
+///
+/// ## Durability
+///
+/// Heap memory is an append-only log. Each call to `set` appends the nodes it
+/// stores and a checksummed revision record, while each call to `sync` appends
+/// a checkpoint of all revisions. Nothing is ever overwritten. If the process
+/// using a file heap is interrupted, no revision synchronized before that
+/// point can be lost. When the heap is opened again, any revisions created
+/// after its last checkpoint are verified, and those found to be incomplete are
+/// discarded.
+///
+/// ## Concurrency
+///
+/// Heaps may be used by multiple threads at once, as long as no thread frees a
+/// heap while it is being used by another. Synchronization is group committed,
+/// meaning that any threads synchronizing at the same time share a single disk
+/// flush. Synchronization may also be requested without waiting for it via
+/// `syncAsync`, or be left to a background thread started via `flushEvery`.
+///
+/// Heaps have a single writer at a time, but reading never waits for it.
+/// Calls to `get` and `load` see either all or nothing of each revision
+/// committed by `set`, and may run concurrently with `set` and `sync`. As
+/// collecting a heap moves its nodes, `collect` must not run concurrently
+/// with any other use of the heap.
+///
 /// ## Destruction
 ///
-/// Once no longer used, heaps must be freed using pvm_freeHeap().
+/// Once no longer used, heaps must be freed using rvm_freeHeap().
 ///
 /// \see rvm_bufferAsHeap()
 /// \see rvm_fileAsHeap()
@@ -42,22 +129,284 @@ struct rvm_Heap {
     /// \see rvm_freeHeap()
     void (*free)(rvm_Heap *self);
 
+    /// Gets heap value associated with given revision.
+    ///
+    /// The received value is lazy, unless the revision is empty, in which case
+    /// it is of kind RVM_NODE_UNDEFINED. Revision 0 is always empty. Getting
+    /// the value of a revision takes constant time, regardless of its age.
+    /// Requesting a revision newer than the current one, or one dropped by
+    /// `collect`, causes RVM_ERROR_REVISION.
+    ///
+    /// \param self     This heap.
+    /// \param out      Pointer to value receiver.
+    /// \param revision Target heap revision.
+    /// \returns        Error object, indicating any issues.
     rvm_Error (*get)(rvm_Heap *self, rvm_Value *out, const uint64_t revision);
 
+    /// Loads lazy node originating from this heap.
+    ///
+    /// The node is replaced by the node it refers to. Its index is preserved,
+    /// while any nodes it refers to are made lazy.
+    ///
+    /// \param self This heap.
+    /// \param node Pointer to lazy node to load.
+    /// \returns    Error object, indicating any issues.
+    ///
+    /// \see rvm_loadNode()
+    rvm_Error (*load)(const rvm_Heap *self, rvm_Node *node);
+
+    /// Resolves elements of packed array originating from this heap.
+    ///
+    /// Arrays whose elements are all numbers are stored packed, as contiguous
+    /// integers. Those integers can be given directly to the kernels of
+    /// integers.h, without loading the array or any of its elements first.
+    ///
+    /// \param self   This heap.
+    /// \param node   Pointer to lazy or loaded array node from this heap.
+    /// \param length Pointer to receiver of amount of integers.
+    /// \returns      Pointer to integers in heap memory, or `NULL` if node is
+    ///               not a packed array of this heap.
+    const int64_t *(*integersOf)(const rvm_Heap *self, const rvm_Node *node,
+        size_t *length);
+
     /// Sets heap value, creating a new revision.
     ///
+    /// Every revision created remains available via `get`. Revisions share
+    /// any nodes they have in common, as nodes that already belong to the heap
+    /// are never stored again. To create a revision that differs from a
+    /// previous one by a single node, it is therefore enough to replace that
+    /// node and each node on the path from it to the root with new nodes. No
+    /// other nodes are copied.
+    ///
+    /// Any indexed nodes in the given value are assumed to belong to this
+    /// heap. Indexed nodes from other heaps must be unloaded lazy nodes, or
+    /// have their indexes cleared before being provided to this function.
+    ///
     /// \param self  This heap.
     /// \param value Value to set.
     rvm_Error (*set)(rvm_Heap *self, const rvm_Value value);
 
+    /// Registers functions that loaded closures may refer to.
+    ///
+    /// Replaces any functions registered earlier. The functions are looked up
+    /// by name and arity whenever a closure is loaded, and must therefore
+    /// outlive the heap, as must the array referring to them. Must not be
+    /// called while other threads use the heap.
+    ///
+    /// \param self      This heap.
+    /// \param functions Pointer to functions, unless `count` is 0.
+    /// \param count     Amount of functions.
+    /// \returns         Error object, indicating any issues.
+    rvm_Error (*useFunctions)(rvm_Heap *self,
+        const rvm_Function *const *functions, size_t count);
+
     /// Synchronizes heap contents.
     ///
     /// When the function returns, any prior heap changes are guaranteed to be
     /// committed to any underlying medium. Note that the calling thread is
     /// suspended until the operation completes.
     ///
+    /// A checkpoint is written if any revisions were created since the last
+    /// synchronization, which allows for the heap to be opened again without
+    /// verifying them. The checkpoint is skipped if other threads create
+    /// revisions while the disk is being flushed, in which case a later
+    /// synchronization writes it.
+    ///
     /// \param self This heap.
     rvm_Error (*sync)(rvm_Heap *self);
+
+    /// Requests heap contents to be synchronized, without waiting for it.
+    ///
+    /// The received ticket is completed when all revisions created before
+    /// this call are committed to any underlying medium. If a background
+    /// flusher is running, it starts synchronizing right away.
+    ///
+    /// \param self This heap.
+    /// \param out  Pointer to ticket receiver.
+    /// \returns    Error object, indicating any issues.
+    ///
+    /// \see await
+    /// \see flushEvery
+    rvm_Error (*syncAsync)(rvm_Heap *self, rvm_HeapTicket *out);
+
+    /// Waits for synchronization ticket to complete.
+    ///
+    /// If no other thread is currently synchronizing the heap, the calling
+    /// thread does so itself, which means that tickets complete even if no
+    /// background flusher is running.
+    ///
+    /// \param self   This heap.
+    /// \param ticket Ticket received via `syncAsync`.
+    /// \returns      Error object, indicating any issues.
+    rvm_Error (*await)(rvm_Heap *self, rvm_HeapTicket ticket);
+
+    /// Starts, reconfigures or stops background flusher thread.
+    ///
+    /// While running, the flusher synchronizes the heap whenever requested via
+    /// `syncAsync`, as well as every `milliseconds` while there are revisions
+    /// not yet synchronized. Providing 0 stops the flusher, which is also
+    /// stopped when the heap is freed. Heaps not backed by writable files
+    /// have no use for flushers, and never start them.
+    ///
+    /// \param self         This heap.
+    /// \param milliseconds Maximum time between flushes, or 0.
+    /// \returns            Error object, indicating any issues.
+    rvm_Error (*flushEvery)(rvm_Heap *self, uint64_t milliseconds);
+
+    /// Reclaims memory of all nodes not reachable from given revisions.
+    ///
+    /// Every other revision is dropped, after which getting it causes
+    /// RVM_ERROR_REVISION. The nodes of the given revisions are compacted, such
+    /// that they are stored contiguously in the order they are traversed.
+    /// Revision numbers are preserved.
+    ///
+    /// As nodes are moved, all nodes received from this heap before collection
+    /// become invalid, including lazy nodes.
+    ///
+    /// Collection requires free memory to copy reachable nodes into. File
+    /// heaps are temporarily grown, while buffer heaps must have at least as
+    /// much free memory as they use, or collection fails with
+    /// RVM_ERROR_NOMEMORY. File heaps remain intact if collection is
+    /// interrupted. Registered functions remain registered, unless there is
+    /// no memory left for them after collection, in which case
+    /// RVM_ERROR_NOMEMORY is caused and no functions are registered.
+    ///
+    /// \param self      This heap.
+    /// \param revisions Array of revisions to keep.
+    /// \param count     Number of revisions in `revisions`.
+    /// \returns         Error object, indicating any issues.
+    rvm_Error (*collect)(rvm_Heap *self, const uint64_t *revisions,
+        size_t count);
+
+    /// Enables or disables hash-consing.
+    ///
+    /// While enabled, storing a node identical to a node already in the heap
+    /// stores a reference to the existing node rather than a copy. Nodes are
+    /// identical if they are of the same kind, have identical contents and
+    /// refer to identical nodes. As a consequence, two nodes stored while
+    /// hash-consing is enabled can be compared for equality by comparing their
+    /// indexes, as long as neither refers to a node stored while it was not.
+    /// Small numbers and short byte sequences are stored within the nodes
+    /// referring to them, and therefore lack indexes of their own.
+    ///
+    /// When enabled, all nodes reachable from any revision are looked up and
+    /// added to a table kept in private heap memory, which is discarded when
+    /// disabled. Nodes already in the heap that are identical to each other
+    /// remain separate.
+    ///
+    /// \param self      This heap.
+    /// \param isEnabled Whether to enable hash-consing.
+    /// \returns         Error object, indicating any issues.
+    rvm_Error (*hashCons)(rvm_Heap *self, bool isEnabled);
+
+    /// Writes delta taking a replica of this heap from one revision to another.
+    ///
+    /// A delta is a copy of the part of the heap log added between its two
+    /// revisions, framed by a header and a checksum. Its size is therefore
+    /// proportional to the nodes set in between rather than to the size of
+    /// the heap. Deltas are written in a single pass, and may be sent through
+    /// pipes and sockets.
+    ///
+    /// Providing `base` 0 writes the whole log up to `revision`, which can be
+    /// applied to any empty heap. As collection rewrites the log, no delta
+    /// can span a collection, and replicas of a collected heap must start over
+    /// from revision 0.
+    ///
+    /// \param self     This heap.
+    /// \param base     Revision the delta applies to.
+    /// \param revision Revision the delta leads to.
+    /// \param out      Stream to write delta to.
+    /// \returns        Error object, indicating any issues.
+    ///
+    /// \see applyDelta
+    rvm_Error (*writeDelta)(rvm_Heap *self, uint64_t base, uint64_t revision,
+        FILE *out);
+
+    /// Reads and applies delta written by `writeDelta`.
+    ///
+    /// This heap must be a replica of the heap that wrote the delta at its
+    /// base revision, meaning that it is either empty or has been created by
+    /// applying deltas of that heap only. Otherwise, RVM_ERROR_REVISION is
+    /// caused. Deltas damaged in transit cause RVM_ERROR_CORRUPT, as do
+    /// deltas read from files too short to hold them, which are rejected
+    /// before the heap is grown. Deltas too large for this heap to hold cause
+    /// RVM_ERROR_NOMEMORY. Whenever applying fails, the heap is left at its
+    /// base revision.
+    ///
+    /// Applied revisions are not synchronized until `sync` is called.
+    ///
+    /// \param self This heap.
+    /// \param in   Stream to read delta from.
+    /// \returns    Error object, indicating any issues.
+    rvm_Error (*applyDelta)(rvm_Heap *self, FILE *in);
+
+    /// Collects statistics about heap contents and use.
+    ///
+    /// Node counts are collected by visiting every node in the heap, which
+    /// takes time proportional to its size. Small numbers and short byte
+    /// sequences stored within the nodes referring to them are not counted.
+    /// The heap cannot be modified while this is done. Buffer heaps need one
+    /// bit of free memory per 8 bytes of used memory, or RVM_ERROR_NOMEMORY is
+    /// caused.
+    ///
+    /// \param self This heap.
+    /// \param out  Pointer to statistics receiver.
+    /// \returns    Error object, indicating any issues.
+    rvm_Error (*stats)(rvm_Heap *self, rvm_HeapStats *out);
+};
+
+/// Amount of nodes of some kind, and the bytes their cells occupy.
+///
+/// \see rvm_HeapStats
+struct rvm_HeapNodeStats {
+    /// Amount of nodes.
+    uint64_t count;
+
+    /// Bytes of heap memory used by nodes, including cell headers.
+    uint64_t bytes;
+};
+
+/// Statistics about the contents and use of a heap.
+///
+/// \see rvm_Heap
+struct rvm_HeapStats {
+    /// Nodes reachable from any revision, indexed by rvm_NodeKind.
+    rvm_HeapNodeStats live[RVM_HEAP_NODE_KINDS];
+
+    /// All nodes in heap memory, indexed by rvm_NodeKind. Nodes not reachable
+    /// from any revision are reclaimed by `collect`.
+    rvm_HeapNodeStats total[RVM_HEAP_NODE_KINDS];
+
+    /// Latest revision.
+    uint64_t revision;
+
+    /// Amount of revisions that have not been dropped by `collect`.
+    uint64_t revisions;
+
+    /// Bytes of heap memory used, including revision records and checkpoints.
+    uint64_t length;
+
+    /// Bytes of heap memory used since last completed synchronization. Always
+    /// 0 for heaps not backed by writable files.
+    uint64_t unsynced;
+
+    /// Amount of completed disk flushes, by duration. Bucket 0 counts flushes
+    /// taking less than 1 microsecond, while each following bucket `i` counts
+    /// those taking at least `2^(i-1)` and less than `2^i` microseconds. The
+    /// last bucket also counts all longer flushes.
+    uint64_t syncLatencies[RVM_HEAP_LATENCY_BUCKETS];
+
+    /// Amount of lazy nodes loaded.
+    uint64_t loads;
+
+    /// Amount of loads that read cells from heap memory, rather than using
+    /// nodes kept from earlier loads. Only these may cause page faults.
+    uint64_t decodes;
+
+    /// Bytes of heap memory currently resident in physical memory. Reading
+    /// any other bytes of file heaps causes major page faults. Always 0 for
+    /// buffer heaps.
+    uint64_t resident;
 };
 
 /// Carries result of an attempt to create a new heap.
@@ -84,6 +433,15 @@ struct rvm_HeapResult {
 /// released when the heap is freed. As the buffer is not owned, no attempt
 /// will be made to resize it if more space would be required.
 ///
+/// Nodes are allocated from the beginning of the buffer by bumping a pointer,
+/// while all other heap data, including nodes loaded via rvm_loadNode(), is
+/// allocated from its end. Memory only needed while an operation runs, such as
+/// the stacks used to traverse nodes, is taken from between the two ends and
+/// given back once the operation is done. No other memory is ever allocated
+/// by the heap. Once the two ends meet, any operation requiring more memory
+/// fails with RVM_ERROR_NOMEMORY, leaving the heap as it was before the
+/// operation.
+///
 /// \param buffer Target memory buffer.
 /// \param length Length of memory buffer, in bytes.
 /// \returns      Error object, indicating any issues.
@@ -97,7 +455,15 @@ rvm_HeapResult rvm_bufferAsHeap(uint8_t *buffer, const size_t length);
 /// Ownership is not taken of the given file, meaning it will not be closed
 /// when the heap is freed.
 ///
-/// \param heap Pointer to uninitialized heap structure to initialize.
+/// The file is memory mapped rather than read, and is expected to either be
+/// empty or to contain a heap created by this function earlier. If the file
+/// was not opened for both reading and writing, the heap cannot be modified.
+///
+/// A large range of virtual memory is reserved for the mapping, which allows
+/// for it to grow in place as the file is extended. Pointers into heap memory,
+/// such as those of loaded byte sequences, therefore remain valid as the heap
+/// grows. Where supported, the mapping is also backed by huge pages.
+///
 /// \param file File to use.
 /// \returns    Error object, indicating any issues.
 ///
@@ -105,25 +471,61 @@ rvm_HeapResult rvm_bufferAsHeap(uint8_t *buffer, const size_t length);
 /// \see rvm_freeHeap()
 rvm_HeapResult rvm_fileAsHeap(FILE *file);
 
-/// Initializes heap using file at provided path.
+/// Initializes heap using provided file.
 ///
 /// Takes ownership of the given file, meaning it will be closed when the heap
-/// is freed.
+/// is freed, or if heap initialization fails.
 ///
-/// \param heap Pointer to uninitialized heap structure to initialize.
-/// \param path Path to file to open.
+/// \param file File to use.
 /// \returns    Error object, indicating any issues.
 ///
 /// \see rvm_Heap
+/// \see rvm_fileAsHeap()
 /// \see rvm_freeHeap()
 rvm_HeapResult rvm_fileIntoHeap(FILE *file);
 
-/// Gets heap value associated with given revision.
+/// Vacuums heap file at given path, keeping only given revisions.
+///
+/// All nodes reachable from the given revisions are copied to a new file, in
+/// which they are stored contiguously in the order they are traversed. The new
+/// file is created in the same directory, and atomically replaces the file at
+/// `path` once fully written to disk. Every other revision is dropped, exactly
+/// as if the heap was collected, which means that revision numbers are
+/// preserved. The heap file is left untouched if vacuuming fails.
 ///
-/// \param self     This heap.
-/// \param out      Pointer to value receiver.
-/// \param revision Target heap revision.
-/// \returns        Error object, indicating any issues.
+/// Unlike collection, vacuuming never grows the original file, which makes it
+/// suitable for heaps with mostly unreachable nodes. The file must not be in
+/// use by any heap while being vacuumed.
+///
+/// \param path      Path to heap file.
+/// \param revisions Array of revisions to keep.
+/// \param count     Number of revisions in `revisions`.
+/// \returns         Error object, indicating any issues.
+///
+/// \see rvm_Heap
+rvm_Error rvm_vacuumHeapFile(const char *path, const uint64_t *revisions,
+    size_t count);
+
+/// Loads given node, if it is lazy.
+///
+/// Nodes that are not lazy are left untouched.
+///
+/// \param node Pointer to node to load.
+/// \returns    Error object, indicating any issues.
+///
+/// \see rvm_Heap
+static inline rvm_Error rvm_loadNode(rvm_Node *node) {
+    assert(node != NULL);
+
+    if (rvm_getNodeKind(node) != RVM_NODE_LAZY) {
+        return rvm_asError(RVM_ERROR_NONE, NULL);
+    }
+    const rvm_Heap *heap = node->as.lazy.heap;
+    assert(heap != NULL);
+    assert(heap->load != NULL);
+
+    return heap->load(heap, node);
+}
 
 
 /// Destroys given heap, freeing up any resources held.
@@ -0,0 +1,394 @@
+#include "integers.h"
+#include <stdbool.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define HAS_AVX2 1
+#include <immintrin.h>
+#else
+#define HAS_AVX2 0
+#endif
+
+/// Set of integer kernels.
+typedef struct Kernels {
+    rvm_IntegerKernels id;
+    int64_t (*sum)(const int64_t *values, size_t length);
+    int64_t (*min)(const int64_t *values, size_t length);
+    int64_t (*max)(const int64_t *values, size_t length);
+    void (*add)(int64_t *out, const int64_t *a, const int64_t *b,
+        size_t length);
+    void (*subtract)(int64_t *out, const int64_t *a, const int64_t *b,
+        size_t length);
+    size_t (*filter)(int64_t *out, const int64_t *values, size_t length,
+        rvm_IntegerComparison comparison, int64_t operand);
+    size_t (*find)(const int64_t *values, size_t length, int64_t value);
+} Kernels;
+
+static const Kernels *getKernels(void);
+static bool compare(int64_t value, rvm_IntegerComparison comparison,
+    int64_t operand);
+
+static int64_t sumScalar(const int64_t *values, size_t length);
+static int64_t minScalar(const int64_t *values, size_t length);
+static int64_t maxScalar(const int64_t *values, size_t length);
+static void addScalar(int64_t *out, const int64_t *a, const int64_t *b,
+    size_t length);
+static void subtractScalar(int64_t *out, const int64_t *a, const int64_t *b,
+    size_t length);
+static size_t filterScalar(int64_t *out, const int64_t *values, size_t length,
+    rvm_IntegerComparison comparison, int64_t operand);
+static size_t findScalar(const int64_t *values, size_t length, int64_t value);
+
+static const Kernels scalarKernels = {
+    .id = RVM_INTEGER_KERNELS_SCALAR,
+    .sum = sumScalar,
+    .min = minScalar,
+    .max = maxScalar,
+    .add = addScalar,
+    .subtract = subtractScalar,
+    .filter = filterScalar,
+    .find = findScalar,
+};
+
+#if HAS_AVX2
+static int64_t sumAvx2(const int64_t *values, size_t length);
+static int64_t minAvx2(const int64_t *values, size_t length);
+static int64_t maxAvx2(const int64_t *values, size_t length);
+static void addAvx2(int64_t *out, const int64_t *a, const int64_t *b,
+    size_t length);
+static void subtractAvx2(int64_t *out, const int64_t *a, const int64_t *b,
+    size_t length);
+static size_t filterAvx2(int64_t *out, const int64_t *values, size_t length,
+    rvm_IntegerComparison comparison, int64_t operand);
+static size_t findAvx2(const int64_t *values, size_t length, int64_t value);
+
+static const Kernels avx2Kernels = {
+    .id = RVM_INTEGER_KERNELS_AVX2,
+    .sum = sumAvx2,
+    .min = minAvx2,
+    .max = maxAvx2,
+    .add = addAvx2,
+    .subtract = subtractAvx2,
+    .filter = filterAvx2,
+    .find = findAvx2,
+};
+#endif
+
+/// Currently selected kernels, or `NULL` if none have been selected yet.
+static const Kernels *selected = NULL;
+
+rvm_IntegerKernels rvm_selectIntegerKernels(rvm_IntegerKernels kernels) {
+    const Kernels *k = &scalarKernels;
+#if HAS_AVX2
+    if (kernels == RVM_INTEGER_KERNELS_AVX2 && __builtin_cpu_supports("avx2")) {
+        k = &avx2Kernels;
+    }
+#else
+    (void)kernels;
+#endif
+    __atomic_store_n(&selected, k, __ATOMIC_RELEASE);
+    return k->id;
+}
+
+int64_t rvm_sumIntegers(const int64_t *values, size_t length) {
+    return getKernels()->sum(values, length);
+}
+
+int64_t rvm_minIntegers(const int64_t *values, size_t length) {
+    return getKernels()->min(values, length);
+}
+
+int64_t rvm_maxIntegers(const int64_t *values, size_t length) {
+    return getKernels()->max(values, length);
+}
+
+void rvm_addIntegers(int64_t *out, const int64_t *a, const int64_t *b,
+    size_t length) {
+    getKernels()->add(out, a, b, length);
+}
+
+void rvm_subtractIntegers(int64_t *out, const int64_t *a, const int64_t *b,
+    size_t length) {
+    getKernels()->subtract(out, a, b, length);
+}
+
+void rvm_multiplyIntegers(int64_t *out, const int64_t *a, const int64_t *b,
+    size_t length) {
+    // AVX2 has no 64-bit multiplication, which leaves it to the compiler.
+    for (size_t i = 0; i < length; ++i) {
+        out[i] = (int64_t)((uint64_t)a[i] * (uint64_t)b[i]);
+    }
+}
+
+size_t rvm_filterIntegers(int64_t *out, const int64_t *values, size_t length,
+    rvm_IntegerComparison comparison, int64_t operand) {
+    return getKernels()->filter(out, values, length, comparison, operand);
+}
+
+size_t rvm_findInteger(const int64_t *values, size_t length, int64_t value) {
+    return getKernels()->find(values, length, value);
+}
+
+/// Resolves selected kernels, selecting the best supported ones if none have
+/// been selected yet. Racing selections all select the same kernels.
+const Kernels *getKernels(void) {
+    const Kernels *k = __atomic_load_n(&selected, __ATOMIC_ACQUIRE);
+    if (k == NULL) {
+        rvm_selectIntegerKernels(RVM_INTEGER_KERNELS_AVX2);
+        k = __atomic_load_n(&selected, __ATOMIC_ACQUIRE);
+    }
+    return k;
+}
+
+/// Determines whether `value` compares as given with `operand`.
+bool compare(int64_t value, rvm_IntegerComparison comparison, int64_t operand) {
+    switch (comparison) {
+    case RVM_INTEGER_LESS:
+        return value < operand;
+
+    case RVM_INTEGER_LESS_OR_EQUAL:
+        return value <= operand;
+
+    case RVM_INTEGER_EQUAL:
+        return value == operand;
+
+    case RVM_INTEGER_NOT_EQUAL:
+        return value != operand;
+
+    case RVM_INTEGER_GREATER_OR_EQUAL:
+        return value >= operand;
+
+    case RVM_INTEGER_GREATER:
+        return value > operand;
+
+    default:
+        return false;
+    }
+}
+
+int64_t sumScalar(const int64_t *values, size_t length) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < length; ++i) {
+        sum += (uint64_t)values[i];
+    }
+    return (int64_t)sum;
+}
+
+int64_t minScalar(const int64_t *values, size_t length) {
+    int64_t min = INT64_MAX;
+    for (size_t i = 0; i < length; ++i) {
+        if (values[i] < min) {
+            min = values[i];
+        }
+    }
+    return min;
+}
+
+int64_t maxScalar(const int64_t *values, size_t length) {
+    int64_t max = INT64_MIN;
+    for (size_t i = 0; i < length; ++i) {
+        if (values[i] > max) {
+            max = values[i];
+        }
+    }
+    return max;
+}
+
+void addScalar(int64_t *out, const int64_t *a, const int64_t *b,
+    size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        out[i] = (int64_t)((uint64_t)a[i] + (uint64_t)b[i]);
+    }
+}
+
+void subtractScalar(int64_t *out, const int64_t *a, const int64_t *b,
+    size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        out[i] = (int64_t)((uint64_t)a[i] - (uint64_t)b[i]);
+    }
+}
+
+size_t filterScalar(int64_t *out, const int64_t *values, size_t length,
+    rvm_IntegerComparison comparison, int64_t operand) {
+    size_t count = 0;
+    for (size_t i = 0; i < length; ++i) {
+        if (compare(values[i], comparison, operand)) {
+            out[count++] = values[i];
+        }
+    }
+    return count;
+}
+
+size_t findScalar(const int64_t *values, size_t length, int64_t value) {
+    for (size_t i = 0; i < length; ++i) {
+        if (values[i] == value) {
+            return i;
+        }
+    }
+    return length;
+}
+
+#if HAS_AVX2
+
+/// Amount of integers in each AVX2 vector.
+#define AVX2_LANES 4
+
+/// Loads AVX2 vector from unaligned memory.
+#define AVX2_LOAD(p) _mm256_loadu_si256((const __m256i *)(const void *)(p))
+
+/// Stores AVX2 vector to unaligned memory.
+#define AVX2_STORE(p, v) _mm256_storeu_si256((__m256i *)(void *)(p), (v))
+
+__attribute__((target("avx2")))
+int64_t sumAvx2(const int64_t *values, size_t length) {
+    __m256i sums = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + AVX2_LANES <= length; i += AVX2_LANES) {
+        sums = _mm256_add_epi64(sums, AVX2_LOAD(&values[i]));
+    }
+    int64_t lanes[AVX2_LANES];
+    AVX2_STORE(lanes, sums);
+    uint64_t sum = (uint64_t)sumScalar(&values[i], length - i);
+    for (size_t j = 0; j < AVX2_LANES; ++j) {
+        sum += (uint64_t)lanes[j];
+    }
+    return (int64_t)sum;
+}
+
+__attribute__((target("avx2")))
+int64_t minAvx2(const int64_t *values, size_t length) {
+    __m256i mins = _mm256_set1_epi64x(INT64_MAX);
+    size_t i = 0;
+    for (; i + AVX2_LANES <= length; i += AVX2_LANES) {
+        const __m256i v = AVX2_LOAD(&values[i]);
+        mins = _mm256_blendv_epi8(mins, v, _mm256_cmpgt_epi64(mins, v));
+    }
+    int64_t lanes[AVX2_LANES];
+    AVX2_STORE(lanes, mins);
+    int64_t min = minScalar(&values[i], length - i);
+    for (size_t j = 0; j < AVX2_LANES; ++j) {
+        if (lanes[j] < min) {
+            min = lanes[j];
+        }
+    }
+    return min;
+}
+
+__attribute__((target("avx2")))
+int64_t maxAvx2(const int64_t *values, size_t length) {
+    __m256i maxs = _mm256_set1_epi64x(INT64_MIN);
+    size_t i = 0;
+    for (; i + AVX2_LANES <= length; i += AVX2_LANES) {
+        const __m256i v = AVX2_LOAD(&values[i]);
+        maxs = _mm256_blendv_epi8(maxs, v, _mm256_cmpgt_epi64(v, maxs));
+    }
+    int64_t lanes[AVX2_LANES];
+    AVX2_STORE(lanes, maxs);
+    int64_t max = maxScalar(&values[i], length - i);
+    for (size_t j = 0; j < AVX2_LANES; ++j) {
+        if (lanes[j] > max) {
+            max = lanes[j];
+        }
+    }
+    return max;
+}
+
+__attribute__((target("avx2")))
+void addAvx2(int64_t *out, const int64_t *a, const int64_t *b, size_t length) {
+    size_t i = 0;
+    for (; i + AVX2_LANES <= length; i += AVX2_LANES) {
+        AVX2_STORE(&out[i], _mm256_add_epi64(AVX2_LOAD(&a[i]),
+            AVX2_LOAD(&b[i])));
+    }
+    addScalar(&out[i], &a[i], &b[i], length - i);
+}
+
+__attribute__((target("avx2")))
+void subtractAvx2(int64_t *out, const int64_t *a, const int64_t *b,
+    size_t length) {
+    size_t i = 0;
+    for (; i + AVX2_LANES <= length; i += AVX2_LANES) {
+        AVX2_STORE(&out[i], _mm256_sub_epi64(AVX2_LOAD(&a[i]),
+            AVX2_LOAD(&b[i])));
+    }
+    subtractScalar(&out[i], &a[i], &b[i], length - i);
+}
+
+__attribute__((target("avx2")))
+size_t filterAvx2(int64_t *out, const int64_t *values, size_t length,
+    rvm_IntegerComparison comparison, int64_t operand) {
+    // AVX2 only compares for equality and greater than, so the remaining
+    // comparisons are expressed by swapping operands and inverting masks.
+    bool isSwapped = false;
+    bool isEquality = false;
+    int invert = 0;
+    switch (comparison) {
+    case RVM_INTEGER_LESS:
+        isSwapped = true;
+        break;
+
+    case RVM_INTEGER_LESS_OR_EQUAL:
+        invert = 0xf;
+        break;
+
+    case RVM_INTEGER_EQUAL:
+        isEquality = true;
+        break;
+
+    case RVM_INTEGER_NOT_EQUAL:
+        isEquality = true;
+        invert = 0xf;
+        break;
+
+    case RVM_INTEGER_GREATER_OR_EQUAL:
+        isSwapped = true;
+        invert = 0xf;
+        break;
+
+    case RVM_INTEGER_GREATER:
+        break;
+
+    default:
+        return 0;
+    }
+    const __m256i operands = _mm256_set1_epi64x(operand);
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + AVX2_LANES <= length; i += AVX2_LANES) {
+        const __m256i v = AVX2_LOAD(&values[i]);
+        const __m256i matches = isEquality ? _mm256_cmpeq_epi64(v, operands)
+            : isSwapped ? _mm256_cmpgt_epi64(operands, v)
+            : _mm256_cmpgt_epi64(v, operands);
+        int mask = _mm256_movemask_pd(_mm256_castsi256_pd(matches)) ^ invert;
+        if (mask == 0xf && count == i) {
+            // Integers already in place need not be copied again.
+            if (out != values) {
+                AVX2_STORE(&out[count], v);
+            }
+            count += AVX2_LANES;
+            continue;
+        }
+        while (mask != 0) {
+            out[count++] = values[i + (size_t)__builtin_ctz((unsigned)mask)];
+            mask &= mask - 1;
+        }
+    }
+    return count + filterScalar(&out[count], &values[i], length - i,
+        comparison, operand);
+}
+
+__attribute__((target("avx2")))
+size_t findAvx2(const int64_t *values, size_t length, int64_t value) {
+    const __m256i targets = _mm256_set1_epi64x(value);
+    size_t i = 0;
+    for (; i + AVX2_LANES <= length; i += AVX2_LANES) {
+        const __m256i matches = _mm256_cmpeq_epi64(AVX2_LOAD(&values[i]),
+            targets);
+        const int mask = _mm256_movemask_pd(_mm256_castsi256_pd(matches));
+        if (mask != 0) {
+            return i + (size_t)__builtin_ctz((unsigned)mask);
+        }
+    }
+    return i + findScalar(&values[i], length - i, value);
+}
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef LIB_RVM_INTEGERS_H
+#define LIB_RVM_INTEGERS_H
+
+/// RVM integer vector kernels.
+///
+/// Each kernel operates on contiguous sequences of `int64_t`, such as those of
+/// packed integer arrays stored in heaps. Kernels are provided both as plain C
+/// and, where supported, as AVX2 code, which is selected at runtime the first
+/// time any kernel is used if the processor supports it. All arithmetic wraps
+/// around on overflow, regardless of kernel set.
+///
+/// \file
+/// \see rvm_Heap
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Identifies a set of integer kernels.
+typedef enum rvm_IntegerKernels {
+    /// Plain C kernels, which are always available.
+    RVM_INTEGER_KERNELS_SCALAR = 0,
+
+    /// Kernels using AVX2 instructions, which are only available on x86-64
+    /// processors supporting them.
+    RVM_INTEGER_KERNELS_AVX2 = 1,
+} rvm_IntegerKernels;
+
+/// Identifies a comparison of integers with an operand.
+typedef enum rvm_IntegerComparison {
+    RVM_INTEGER_LESS = 0,
+    RVM_INTEGER_LESS_OR_EQUAL = 1,
+    RVM_INTEGER_EQUAL = 2,
+    RVM_INTEGER_NOT_EQUAL = 3,
+    RVM_INTEGER_GREATER_OR_EQUAL = 4,
+    RVM_INTEGER_GREATER = 5,
+} rvm_IntegerComparison;
+
+/// Selects set of kernels to use from now on.
+///
+/// Kernels not supported by the running processor are never selected, in
+/// which case plain C kernels are selected instead. Mainly useful for testing
+/// and benchmarking, as the best supported kernels are selected by default.
+///
+/// \param kernels Kernels to select.
+/// \returns       Kernels actually selected.
+rvm_IntegerKernels rvm_selectIntegerKernels(rvm_IntegerKernels kernels);
+
+/// Calculates sum of `length` integers.
+int64_t rvm_sumIntegers(const int64_t *values, size_t length);
+
+/// Finds smallest of `length` integers, or INT64_MAX if `length` is 0.
+int64_t rvm_minIntegers(const int64_t *values, size_t length);
+
+/// Finds largest of `length` integers, or INT64_MIN if `length` is 0.
+int64_t rvm_maxIntegers(const int64_t *values, size_t length);
+
+/// Adds `length` integers of `b` to those of `a`, writing the sums to `out`,
+/// which may be either `a` or `b`.
+void rvm_addIntegers(int64_t *out, const int64_t *a, const int64_t *b,
+    size_t length);
+
+/// Subtracts `length` integers of `b` from those of `a`, writing the
+/// differences to `out`, which may be either `a` or `b`.
+void rvm_subtractIntegers(int64_t *out, const int64_t *a, const int64_t *b,
+    size_t length);
+
+/// Multiplies `length` integers of `a` with those of `b`, writing the
+/// products to `out`, which may be either `a` or `b`.
+void rvm_multiplyIntegers(int64_t *out, const int64_t *a, const int64_t *b,
+    size_t length);
+
+/// Copies those of `length` integers that compare as given with `operand` to
+/// `out`, in order.
+///
+/// \param out        Receiver of up to `length` integers, which may be
+///                   `values`.
+/// \param values     Integers to filter.
+/// \param length     Amount of integers in `values`.
+/// \param comparison Comparison each integer must satisfy.
+/// \param operand    Right-hand side of each comparison.
+/// \returns          Amount of integers written to `out`.
+size_t rvm_filterIntegers(int64_t *out, const int64_t *values, size_t length,
+    rvm_IntegerComparison comparison, int64_t operand);
+
+/// Finds first of `length` integers equal to `value`.
+///
+/// \returns Index of integer, or `length` if not found.
+size_t rvm_findInteger(const int64_t *values, size_t length, int64_t value);
+
+#endif
@@ -0,0 +1,671 @@
+#include "memo.h"
+#include <assert.h>
+#include <pthread.h>
+#include <string.h>
+#include "hash.h"
+#include "heap.h"
+
+/// Initial amount of memo buckets. Must be a power of two.
+#define BUCKETS_INITIAL 64
+
+/// Initial amount of slots, items and visits of copiers. Must be a power of
+/// two.
+#define COPIER_CAPACITY_INITIAL 64
+
+/// Index of absent nodes.
+#define INDEX_NONE SIZE_MAX
+
+typedef rvm_Error Error;
+typedef rvm_Function Function;
+typedef rvm_Node Node;
+
+typedef struct Entry Entry;
+
+/// Cached function call.
+///
+/// Each entry is stored in a single block of memory, followed by copies of
+/// its argument and result nodes, and then of their bytes.
+struct Entry {
+    /// Next entry in the same bucket, if any.
+    Entry *next;
+
+    /// Entry used after this one, if any.
+    Entry *newer;
+
+    /// Entry used before this one, if any.
+    Entry *older;
+
+    /// Called function.
+    const Function *function;
+
+    /// Hash of function and argument.
+    uint64_t hash;
+
+    /// Size of entry memory, in bytes.
+    size_t size;
+
+    /// Copy of node given to function, if any.
+    Node *argument;
+
+    /// Copy of node returned by function.
+    Node *result;
+};
+
+struct rvm_Memo {
+    /// Protects all other fields.
+    pthread_mutex_t lock;
+
+    /// Entries, by hash.
+    Entry **buckets;
+
+    /// Amount of buckets. Always a power of two.
+    size_t bucketCount;
+
+    /// Most recently used entry, if any.
+    Entry *newest;
+
+    /// Least recently used entry, if any.
+    Entry *oldest;
+
+    /// Maximum total size of entries, in bytes.
+    size_t capacity;
+
+    /// Usage statistics.
+    rvm_MemoStats stats;
+};
+
+/// Identifies node, by heap and index if lazy, or by address otherwise.
+typedef struct Key {
+    const void *address;
+    uint64_t index;
+} Key;
+
+/// Index of copy of node, which is unused if its address is `NULL`.
+typedef struct Slot {
+    Key key;
+    size_t index;
+} Slot;
+
+/// Node to copy.
+typedef struct Item {
+    /// Loaded copy of node.
+    Node loaded;
+
+    /// Index of copy of node.
+    size_t index;
+
+    /// Index of copies of array elements, if node is an array.
+    size_t elements;
+} Item;
+
+/// Node to load and turn into an item.
+typedef struct Visit {
+    const Node *node;
+    size_t index;
+} Visit;
+
+/// Plan of copying graphs of nodes into a single block of memory.
+///
+/// Each node is given an index in the block when first reached, which makes
+/// nodes referred to many times copied only once. Array elements are given
+/// contiguous indexes, which are also used by any other references to them,
+/// unless those references are reached first. Nodes remaining to be visited
+/// are kept on an explicit stack, allowing for long and deep graphs.
+typedef struct Copier {
+    /// Indexes of copies, by node.
+    Slot *slots;
+
+    /// Amount of slots that fit in `slots`. Always zero or a power of two.
+    size_t slotCapacity;
+
+    /// Amount of used slots.
+    size_t slotCount;
+
+    /// Nodes to copy.
+    Item *items;
+
+    /// Amount of items.
+    size_t itemCount;
+
+    /// Amount of items that fit in `items`.
+    size_t itemCapacity;
+
+    /// Stack of nodes remaining to be visited.
+    Visit *visits;
+
+    /// Amount of visits on stack.
+    size_t visitCount;
+
+    /// Amount of visits that fit in `visits`.
+    size_t visitCapacity;
+
+    /// Amount of nodes to copy, including array elements.
+    size_t nodes;
+
+    /// Amount of bytes to copy.
+    size_t bytes;
+} Copier;
+
+static Error hashOf(const Function *function, const Node *argument,
+    rvm_HashCache *cache, uint64_t *out);
+static Error find(rvm_Memo *memo, const Function *function, uint64_t hash,
+    const Node *argument, Entry **out);
+static void touch(rvm_Memo *memo, Entry *entry);
+static void evict(rvm_Memo *memo);
+static void detach(rvm_Memo *memo, Entry *entry);
+static void growBuckets(rvm_Memo *memo);
+static Error plan(Copier *copier, const Node *node, size_t *out);
+static bool visit(Copier *copier, const Node *node, size_t *out);
+static void copy(const Copier *copier, Node *nodes, uint8_t *bytes);
+static Node *translate(const Copier *copier, Node *nodes, const Node *node);
+static void freeCopier(Copier *copier);
+static Key keyOf(const Node *node);
+static size_t positionOf(const Copier *copier, Key key);
+static bool lookup(const Copier *copier, Key key, size_t *out);
+static bool insert(Copier *copier, Key key, size_t index);
+static bool reserve(void **items, size_t *capacity, size_t count,
+    size_t size);
+
+rvm_MemoResult rvm_newMemo(size_t capacity) {
+    rvm_Memo *memo = malloc(sizeof(rvm_Memo));
+    Entry **buckets = calloc(BUCKETS_INITIAL, sizeof(Entry *));
+    if (memo == NULL || buckets == NULL) {
+        free(memo);
+        free(buckets);
+        return (rvm_MemoResult){
+            .ok = false, .as.error = rvm_asError(RVM_ERROR_NOMEMORY, NULL),
+        };
+    }
+    *memo = (rvm_Memo){
+        .buckets = buckets,
+        .bucketCount = BUCKETS_INITIAL,
+        .capacity = capacity,
+    };
+    pthread_mutex_init(&memo->lock, NULL);
+
+    return (rvm_MemoResult){ .ok = true, .as.memo = memo };
+}
+
+rvm_Error rvm_getMemoized(rvm_Memo *memo, const rvm_Function *function,
+    const rvm_Node *argument, rvm_HashCache *cache, rvm_Node **out,
+    size_t *size) {
+    assert(memo != NULL);
+    assert(function != NULL);
+    assert(out != NULL);
+
+    uint64_t hash;
+    Error err = hashOf(function, argument, cache, &hash);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        return err;
+    }
+
+    pthread_mutex_lock(&memo->lock);
+    Copier copier = {0};
+    Entry *entry;
+    err = find(memo, function, hash, argument, &entry);
+    *out = NULL;
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        goto done;
+    }
+    if (entry == NULL) {
+        memo->stats.misses += 1;
+        goto done;
+    }
+    size_t root;
+    err = plan(&copier, entry->result, &root);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        goto done;
+    }
+    const size_t length = copier.nodes * sizeof(Node) + copier.bytes;
+    Node *nodes = malloc(length);
+    if (nodes == NULL) {
+        err = rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+        goto done;
+    }
+    copy(&copier, nodes, (uint8_t *)&nodes[copier.nodes]);
+    assert(root == 0);
+    *out = nodes;
+    if (size != NULL) {
+        *size = length;
+    }
+    touch(memo, entry);
+    memo->stats.hits += 1;
+
+done:
+    pthread_mutex_unlock(&memo->lock);
+    freeCopier(&copier);
+    return err;
+}
+
+rvm_Error rvm_setMemoized(rvm_Memo *memo, const rvm_Function *function,
+    const rvm_Node *argument, const rvm_Node *result, rvm_HashCache *cache) {
+    assert(memo != NULL);
+    assert(function != NULL);
+    assert(result != NULL);
+
+    uint64_t hash;
+    Error err = hashOf(function, argument, cache, &hash);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        return err;
+    }
+    Copier copier = {0};
+    size_t a;
+    size_t r;
+    if (rvm_getErrorKind(err = plan(&copier, argument, &a)) != RVM_ERROR_NONE
+        || rvm_getErrorKind(err = plan(&copier, result, &r))
+            != RVM_ERROR_NONE) {
+        freeCopier(&copier);
+        return err;
+    }
+    const size_t size = sizeof(Entry) + copier.nodes * sizeof(Node)
+        + copier.bytes;
+    if (size > memo->capacity) {
+        freeCopier(&copier);
+        return rvm_asError(RVM_ERROR_NONE, NULL);
+    }
+    Entry *entry = malloc(size);
+    if (entry == NULL) {
+        freeCopier(&copier);
+        return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+    }
+    Node *nodes = (Node *)&entry[1];
+    copy(&copier, nodes, (uint8_t *)&nodes[copier.nodes]);
+    freeCopier(&copier);
+    entry->argument = a != INDEX_NONE ? &nodes[a] : NULL;
+    entry->result = &nodes[r];
+    entry->function = function;
+    entry->hash = hash;
+    entry->size = size;
+
+    pthread_mutex_lock(&memo->lock);
+    Entry *existing;
+    err = find(memo, function, hash, argument, &existing);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE || existing != NULL) {
+        free(entry);
+        goto done;
+    }
+    while (memo->stats.size + size > memo->capacity) {
+        evict(memo);
+    }
+    if (memo->stats.count >= memo->bucketCount) {
+        growBuckets(memo);
+    }
+    Entry **bucket = &memo->buckets[hash & (memo->bucketCount - 1)];
+    entry->next = *bucket;
+    *bucket = entry;
+    entry->newer = NULL;
+    entry->older = memo->newest;
+    if (memo->newest != NULL) {
+        memo->newest->newer = entry;
+    } else {
+        memo->oldest = entry;
+    }
+    memo->newest = entry;
+    memo->stats.count += 1;
+    memo->stats.size += size;
+
+done:
+    pthread_mutex_unlock(&memo->lock);
+    return err;
+}
+
+rvm_MemoStats rvm_getMemoStats(rvm_Memo *memo) {
+    assert(memo != NULL);
+
+    pthread_mutex_lock(&memo->lock);
+    const rvm_MemoStats stats = memo->stats;
+    pthread_mutex_unlock(&memo->lock);
+
+    return stats;
+}
+
+void rvm_freeMemo(rvm_Memo *memo) {
+    if (memo == NULL) {
+        return;
+    }
+    for (Entry *entry = memo->oldest; entry != NULL;) {
+        Entry *newer = entry->newer;
+        free(entry);
+        entry = newer;
+    }
+    pthread_mutex_destroy(&memo->lock);
+    free(memo->buckets);
+    free(memo);
+}
+
+/// Calculates hash of calling function with given node.
+Error hashOf(const Function *function, const Node *argument,
+    rvm_HashCache *cache, uint64_t *out) {
+    uint64_t hash;
+    const Error err = rvm_hashNode(argument, cache, &hash);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        return err;
+    }
+    hash = (hash ^ (uint64_t)(uintptr_t)function) * 0x9e3779b97f4a7c15;
+    *out = hash ^ (hash >> 29);
+
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+/// Looks up entry of call, setting `out` to `NULL` if there is none.
+///
+/// Must only be called while holding the memo lock.
+Error find(rvm_Memo *memo, const Function *function, uint64_t hash,
+    const Node *argument, Entry **out) {
+    // Entries may be freed and their memory reused once the lock is released,
+    // which is why their hashes are only cached while looking up.
+    rvm_HashCache cache = {0};
+    Error err = rvm_asError(RVM_ERROR_NONE, NULL);
+    Entry *entry = memo->buckets[hash & (memo->bucketCount - 1)];
+    for (; entry != NULL; entry = entry->next) {
+        if (entry->hash != hash || entry->function != function) {
+            continue;
+        }
+        bool equal;
+        err = rvm_equalNodes(entry->argument, argument, &cache, &equal);
+        if (rvm_getErrorKind(err) != RVM_ERROR_NONE || equal) {
+            break;
+        }
+    }
+    rvm_freeHashCache(&cache);
+    *out = entry;
+
+    return err;
+}
+
+/// Makes entry the most recently used one.
+void touch(rvm_Memo *memo, Entry *entry) {
+    if (entry == memo->newest) {
+        return;
+    }
+    entry->newer->older = entry->older;
+    if (entry->older != NULL) {
+        entry->older->newer = entry->newer;
+    } else {
+        memo->oldest = entry->newer;
+    }
+    entry->newer = NULL;
+    entry->older = memo->newest;
+    memo->newest->newer = entry;
+    memo->newest = entry;
+}
+
+/// Frees least recently used entry.
+void evict(rvm_Memo *memo) {
+    Entry *entry = memo->oldest;
+    assert(entry != NULL);
+
+    detach(memo, entry);
+    memo->stats.evictions += 1;
+    free(entry);
+}
+
+/// Removes entry from its bucket and from the usage order.
+void detach(rvm_Memo *memo, Entry *entry) {
+    Entry **link = &memo->buckets[entry->hash & (memo->bucketCount - 1)];
+    while (*link != entry) {
+        link = &(*link)->next;
+    }
+    *link = entry->next;
+
+    if (entry->newer != NULL) {
+        entry->newer->older = entry->older;
+    } else {
+        memo->newest = entry->older;
+    }
+    if (entry->older != NULL) {
+        entry->older->newer = entry->newer;
+    } else {
+        memo->oldest = entry->newer;
+    }
+    memo->stats.count -= 1;
+    memo->stats.size -= entry->size;
+}
+
+/// Doubles amount of buckets, unless out of memory.
+void growBuckets(rvm_Memo *memo) {
+    const size_t count = memo->bucketCount * 2;
+    Entry **buckets = calloc(count, sizeof(Entry *));
+    if (buckets == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < memo->bucketCount; ++i) {
+        for (Entry *entry = memo->buckets[i]; entry != NULL;) {
+            Entry *next = entry->next;
+            Entry **bucket = &buckets[entry->hash & (count - 1)];
+            entry->next = *bucket;
+            *bucket = entry;
+            entry = next;
+        }
+    }
+    free(memo->buckets);
+    memo->buckets = buckets;
+    memo->bucketCount = count;
+}
+
+/// Plans copying of node and all nodes it refers to, setting `out` to the
+/// index of its copy, or to INDEX_NONE if `node` is `NULL`. Nodes already
+/// planned by earlier calls are not copied again.
+Error plan(Copier *copier, const Node *node, size_t *out) {
+    if (!visit(copier, node, out)) {
+        return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+    }
+    while (copier->visitCount > 0) {
+        const Visit next = copier->visits[--copier->visitCount];
+        Item item = { *next.node, next.index, 0 };
+        const Error err = rvm_loadNode(&item.loaded);
+        if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+            return err;
+        }
+        const rvm_NodeKind kind = rvm_getNodeKind(&item.loaded);
+        item.loaded.flags = kind;
+
+        size_t index;
+        bool ok = true;
+        switch (kind) {
+        case RVM_NODE_BYTES:
+        case RVM_NODE_SYMBOL:
+            copier->bytes += item.loaded.as.bytes.length;
+            break;
+
+        case RVM_NODE_CLOSURE:
+            ok = visit(copier, item.loaded.as.closure.node, &index);
+            break;
+
+        case RVM_NODE_ARRAY:
+            item.elements = copier->nodes;
+            copier->nodes += item.loaded.as.array.length;
+            for (size_t i = 0; ok && i < item.loaded.as.array.length; ++i) {
+                const Node *element = &item.loaded.as.array.nodes[i];
+                const Key key = keyOf(element);
+                ok = (lookup(copier, key, &index)
+                         || insert(copier, key, item.elements + i))
+                    && reserve((void **)&copier->visits,
+                        &copier->visitCapacity, copier->visitCount,
+                        sizeof(Visit));
+                if (ok) {
+                    copier->visits[copier->visitCount++] = (Visit){
+                        element, item.elements + i,
+                    };
+                }
+            }
+            break;
+
+        case RVM_NODE_LINK:
+            ok = visit(copier, item.loaded.as.link.head, &index)
+                && visit(copier, item.loaded.as.link.tail, &index);
+            break;
+
+        default:
+            break;
+        }
+        if (!ok || !reserve((void **)&copier->items, &copier->itemCapacity,
+                copier->itemCount, sizeof(Item))) {
+            return rvm_asError(RVM_ERROR_NOMEMORY, NULL);
+        }
+        copier->items[copier->itemCount++] = item;
+    }
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+/// Resolves index of copy of node, giving the node a new index and pushing
+/// it to the stack of nodes to visit unless it has one already.
+bool visit(Copier *copier, const Node *node, size_t *out) {
+    if (node == NULL) {
+        *out = INDEX_NONE;
+        return true;
+    }
+    const Key key = keyOf(node);
+    if (lookup(copier, key, out)) {
+        return true;
+    }
+    *out = copier->nodes;
+    if (!insert(copier, key, *out)
+        || !reserve((void **)&copier->visits, &copier->visitCapacity,
+            copier->visitCount, sizeof(Visit))) {
+        return false;
+    }
+    copier->nodes += 1;
+    copier->visits[copier->visitCount++] = (Visit){ node, *out };
+    return true;
+}
+
+/// Copies planned nodes into `nodes`, and their bytes into `bytes`.
+void copy(const Copier *copier, Node *nodes, uint8_t *bytes) {
+    for (size_t i = 0; i < copier->itemCount; ++i) {
+        const Item *item = &copier->items[i];
+        Node node = item->loaded;
+
+        switch (rvm_getNodeKind(&node)) {
+        case RVM_NODE_BYTES:
+        case RVM_NODE_SYMBOL:
+            if (node.as.bytes.length > 0) {
+                memcpy(bytes, node.as.bytes.bytes, node.as.bytes.length);
+            }
+            node.as.bytes.bytes = bytes;
+            bytes += node.as.bytes.length;
+            break;
+
+        case RVM_NODE_CLOSURE:
+            node.as.closure.node = translate(copier, nodes,
+                node.as.closure.node);
+            break;
+
+        case RVM_NODE_ARRAY:
+            node.as.array.nodes = &nodes[item->elements];
+            break;
+
+        case RVM_NODE_LINK:
+            node.as.link.head = translate(copier, nodes, node.as.link.head);
+            node.as.link.tail = translate(copier, nodes, node.as.link.tail);
+            break;
+
+        default:
+            break;
+        }
+        nodes[item->index] = node;
+    }
+}
+
+/// Resolves copy of planned node, or `NULL` if `node` is `NULL`.
+Node *translate(const Copier *copier, Node *nodes, const Node *node) {
+    if (node == NULL) {
+        return NULL;
+    }
+    size_t index = 0;
+    const bool found = lookup(copier, keyOf(node), &index);
+    assert(found);
+    (void)found;
+
+    return &nodes[index];
+}
+
+void freeCopier(Copier *copier) {
+    free(copier->slots);
+    free(copier->items);
+    free(copier->visits);
+}
+
+Key keyOf(const Node *node) {
+    if (rvm_getNodeKind((Node *)node) == RVM_NODE_LAZY) {
+        return (Key){ node->as.lazy.heap, rvm_getNodeIndex((Node *)node) };
+    }
+    return (Key){ node, 0 };
+}
+
+/// Calculates slot position of key.
+size_t positionOf(const Copier *copier, Key key) {
+    uint64_t hash = ((uint64_t)(uintptr_t)key.address ^ key.index)
+        * 0x9e3779b97f4a7c15;
+    hash ^= hash >> 29;
+    return (size_t)hash & (copier->slotCapacity - 1);
+}
+
+bool lookup(const Copier *copier, Key key, size_t *out) {
+    if (copier->slotCapacity == 0) {
+        return false;
+    }
+    const size_t mask = copier->slotCapacity - 1;
+    for (size_t i = positionOf(copier, key);; i = (i + 1) & mask) {
+        const Slot *slot = &copier->slots[i];
+        if (slot->key.address == NULL) {
+            return false;
+        }
+        if (slot->key.address == key.address && slot->key.index == key.index) {
+            *out = slot->index;
+            return true;
+        }
+    }
+}
+
+/// Adds index of key, which must not have one already. Slots are doubled
+/// whenever more than three quarters of them are used.
+bool insert(Copier *copier, Key key, size_t index) {
+    if ((copier->slotCount + 1) * 4 > copier->slotCapacity * 3) {
+        const size_t capacity = copier->slotCapacity > 0
+            ? copier->slotCapacity * 2
+            : COPIER_CAPACITY_INITIAL;
+        Slot *slots = calloc(capacity, sizeof(Slot));
+        if (slots == NULL) {
+            return false;
+        }
+        Copier grown = *copier;
+        grown.slots = slots;
+        grown.slotCapacity = capacity;
+        grown.slotCount = 0;
+        for (size_t i = 0; i < copier->slotCapacity; ++i) {
+            const Slot *slot = &copier->slots[i];
+            if (slot->key.address != NULL) {
+                insert(&grown, slot->key, slot->index);
+            }
+        }
+        free(copier->slots);
+        *copier = grown;
+    }
+    const size_t mask = copier->slotCapacity - 1;
+    size_t i = positionOf(copier, key);
+    while (copier->slots[i].key.address != NULL) {
+        i = (i + 1) & mask;
+    }
+    copier->slots[i] = (Slot){ key, index };
+    copier->slotCount += 1;
+    return true;
+}
+
+/// Makes room for at least one more item in array of `count` items of given
+/// size, doubling its capacity if full.
+bool reserve(void **items, size_t *capacity, size_t count, size_t size) {
+    if (count < *capacity) {
+        return true;
+    }
+    const size_t grown = *capacity > 0
+        ? *capacity * 2
+        : COPIER_CAPACITY_INITIAL;
+    void *memory = realloc(*items, grown * size);
+    if (memory == NULL) {
+        return false;
+    }
+    *items = memory;
+    *capacity = grown;
+    return true;
+}
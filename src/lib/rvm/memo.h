@@ -0,0 +1,131 @@
+#ifndef LIB_RVM_MEMO_H
+#define LIB_RVM_MEMO_H
+
+/// RVM function result cache type and utilities.
+///
+/// \file
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "error.h"
+#include "function.h"
+#include "hash.h"
+#include "node.h"
+
+typedef struct rvm_Memo rvm_Memo;
+typedef struct rvm_MemoResult rvm_MemoResult;
+typedef struct rvm_MemoStats rvm_MemoStats;
+
+/// A bounded cache of the results of pure rvm_Function calls.
+///
+/// Results are cached by function and by the structural hash of the node
+/// each function was given, which means that calls given equal trees share
+/// results, wherever those trees are stored.
+///
+/// ## Ownership
+///
+/// Memos keep their own copies of the nodes given to and returned by cached
+/// calls, which means that those nodes may be freed or modified once given to
+/// rvm_setMemoized(). Lazy nodes are loaded before being copied. Every result
+/// received from rvm_getMemoized() is a copy of the cached result, which is
+/// stored in a single block of memory that must be given to free() once no
+/// longer used. Nodes referred to more than once are copied only once, which
+/// means that copies share nodes wherever the nodes they copy do. Nodes given
+/// to a memo must not refer to themselves, as their hashes would never be
+/// calculated.
+///
+/// ## Eviction
+///
+/// The total size of the copies kept by a memo is bounded by the capacity
+/// given when the memo is created. When caching a result would exceed that
+/// capacity, the least recently used results are evicted until it fits.
+/// Results larger than the capacity are never cached.
+///
+/// ## Concurrency
+///
+/// Memos may be used by multiple threads at once.
+///
+/// \see rvm_newMemo()
+/// \see RVM_FUNCTION_FLAGS_MEMOIZE
+struct rvm_Memo;
+
+/// The result of creating an rvm_Memo.
+struct rvm_MemoResult {
+    /// Indicates whether creation was successful.
+    bool ok;
+
+    union {
+        /// If creation was unsuccessful, carries indication of cause.
+        rvm_Error error;
+
+        /// If creation was successful, carries created memo.
+        rvm_Memo *memo;
+    } as;
+};
+
+/// Statistics describing how an rvm_Memo has been used since created.
+struct rvm_MemoStats {
+    /// Amount of cached results found by rvm_getMemoized().
+    uint64_t hits;
+
+    /// Amount of results not found by rvm_getMemoized().
+    uint64_t misses;
+
+    /// Amount of cached results evicted to make room for others.
+    uint64_t evictions;
+
+    /// Amount of currently cached results.
+    size_t count;
+
+    /// Total size of currently cached copies, in bytes.
+    size_t size;
+};
+
+/// Creates memo able to keep at most `capacity` bytes of cached copies.
+///
+/// \param capacity Memo capacity, in bytes.
+/// \returns        Created memo, or error object indicating any issues.
+rvm_MemoResult rvm_newMemo(size_t capacity);
+
+/// Looks up result of calling function with given node.
+///
+/// \param memo     Memo.
+/// \param function Called function.
+/// \param argument Pointer to node given to function, or `NULL`.
+/// \param cache    Pointer to cache of hashes of argument nodes, or `NULL`.
+/// \param out      Pointer to receiver of copy of cached result, or of `NULL`
+///                 if no result is cached. The copy must be given to free()
+///                 once no longer used.
+/// \param size     Pointer to receiver of size of copy, in bytes, or `NULL`.
+/// \returns        Error object, indicating any issues.
+///
+/// \see rvm_HashCache
+rvm_Error rvm_getMemoized(rvm_Memo *memo, const rvm_Function *function,
+    const rvm_Node *argument, rvm_HashCache *cache, rvm_Node **out,
+    size_t *size);
+
+/// Caches result of calling function with given node.
+///
+/// Results of calls already cached are left as they are.
+///
+/// \param memo     Memo.
+/// \param function Called function.
+/// \param argument Pointer to node given to function, or `NULL`.
+/// \param result   Pointer to node returned by function.
+/// \param cache    Pointer to cache of hashes of argument nodes, or `NULL`.
+/// \returns        Error object, indicating any issues.
+///
+/// \see rvm_HashCache
+rvm_Error rvm_setMemoized(rvm_Memo *memo, const rvm_Function *function,
+    const rvm_Node *argument, const rvm_Node *result, rvm_HashCache *cache);
+
+/// Resolves usage statistics of given memo.
+rvm_MemoStats rvm_getMemoStats(rvm_Memo *memo);
+
+/// Frees given memo and all results it caches.
+///
+/// \param memo Memo, or `NULL`.
+void rvm_freeMemo(rvm_Memo *memo);
+
+#endif
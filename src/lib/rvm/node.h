@@ -20,7 +20,7 @@
 /// Indicates that some rvm_Node lacks an index.
 #define RVM_NODE_INDEX_NONE 0
 
-typedef struct rvm_Heap rvm_Heap;
+struct rvm_Heap;
 
 typedef struct rvm_NodeArray rvm_NodeArray;
 typedef struct rvm_NodeBytes rvm_NodeBytes;
@@ -63,7 +63,11 @@ struct rvm_NodeClosure {
 /// An rvm_Node yet to be loaded.
 struct rvm_NodeLazy {
     /// Reference to heap containing node not yet loaded.
-    const rvm_Heap *heap;
+    const struct rvm_Heap *heap;
+
+    /// Pointer to the field of a node kept by `heap` that refers to this node,
+    /// if any. The field is made to refer to the loaded node once loaded.
+    const rvm_Node **referrer;
 };
 
 /// A link joining two rvm_Node objects.
@@ -0,0 +1,501 @@
+#include "rope.h"
+#include <assert.h>
+#include <string.h>
+
+/// Size of chunks created for appended elements, in bytes, unless more
+/// elements than fit are appended at once.
+#define CHUNK_LENGTH 4096
+
+typedef rvm_Rope Rope;
+
+/// Shared and reference counted memory holding rope elements.
+///
+/// Elements are only ever written to the free space after `used`, which is
+/// claimed atomically before being written. Elements before `used` therefore
+/// never change.
+typedef struct Chunk {
+    /// Amount of references to chunk.
+    uint64_t refs;
+
+    /// Amount of elements that fit in chunk.
+    size_t capacity;
+
+    /// Amount of elements written to chunk.
+    size_t used;
+
+    /// Elements, aligned for any element type used by nodes.
+    uint64_t elements[];
+} Chunk;
+
+struct rvm_Rope {
+    /// Amount of references to rope.
+    uint64_t refs;
+
+    /// Amount of elements in rope.
+    size_t length;
+
+    /// Size of each element, in bytes.
+    size_t width;
+
+    /// Height of rope, which is zero for leaves.
+    size_t height;
+
+    union {
+        /// Range of chunk elements of leaf, which has no chunk if empty.
+        struct {
+            Chunk *chunk;
+            size_t offset;
+        } leaf;
+
+        /// Subtrees of branch, none of which are empty.
+        struct {
+            Rope *left;
+            Rope *right;
+        } branch;
+    } as;
+};
+
+static Chunk *newChunk(size_t width, size_t capacity);
+static uint8_t *elementOf(const Chunk *chunk, size_t width, size_t index);
+static Rope *newLeaf(size_t width, Chunk *chunk, size_t offset, size_t length);
+static Rope *newBranch(Rope *left, Rope *right);
+static Rope *branchOwned(Rope *left, Rope *right);
+static Rope *retain(Rope *rope);
+static void release(Rope *rope);
+static Rope *join(Rope *left, Rope *right);
+static Rope *joinRight(Rope *left, Rope *right);
+static Rope *joinLeft(Rope *left, Rope *right);
+static Rope *balance(Rope *left, Rope *right);
+static Rope *take(Rope *rope, size_t count);
+static Rope *drop(Rope *rope, size_t count);
+static bool claim(const Rope *rope, size_t count, uint8_t **out);
+static Rope *grow(Rope *rope, size_t count);
+static void copyElements(const Rope *rope, uint8_t *out);
+static rvm_RopeResult resultOf(Rope *rope);
+
+rvm_RopeResult rvm_newRope(size_t width, const void *elements, size_t length) {
+    assert(width > 0);
+    assert(elements != NULL || length == 0);
+
+    if (length == 0) {
+        return resultOf(newLeaf(width, NULL, 0, 0));
+    }
+    Chunk *chunk = newChunk(width, length);
+    if (chunk == NULL) {
+        return resultOf(NULL);
+    }
+    memcpy(chunk->elements, elements, length * width);
+    chunk->used = length;
+    Rope *rope = newLeaf(width, chunk, 0, length);
+    if (rope == NULL) {
+        free(chunk);
+    }
+    return resultOf(rope);
+}
+
+size_t rvm_getRopeLength(const rvm_Rope *rope) {
+    assert(rope != NULL);
+
+    return rope->length;
+}
+
+size_t rvm_getRopeWidth(const rvm_Rope *rope) {
+    assert(rope != NULL);
+
+    return rope->width;
+}
+
+const void *rvm_getRopeElement(const rvm_Rope *rope, size_t index) {
+    assert(rope != NULL);
+    assert(index < rope->length);
+
+    while (rope->height > 0) {
+        if (index < rope->as.branch.left->length) {
+            rope = rope->as.branch.left;
+        } else {
+            index -= rope->as.branch.left->length;
+            rope = rope->as.branch.right;
+        }
+    }
+    return elementOf(rope->as.leaf.chunk, rope->width,
+        rope->as.leaf.offset + index);
+}
+
+void rvm_copyRope(const rvm_Rope *rope, void *out) {
+    assert(rope != NULL);
+    assert(out != NULL || rope->length == 0);
+
+    copyElements(rope, out);
+}
+
+rvm_RopeResult rvm_concatRopes(const rvm_Rope *a, const rvm_Rope *b) {
+    assert(a != NULL);
+    assert(b != NULL);
+    assert(a->width == b->width);
+
+    return resultOf(join((Rope *)a, (Rope *)b));
+}
+
+rvm_RopeResult rvm_sliceRope(const rvm_Rope *rope, size_t begin, size_t end) {
+    assert(rope != NULL);
+    assert(begin <= end);
+    assert(end <= rope->length);
+
+    Rope *tail = drop((Rope *)rope, begin);
+    if (tail == NULL) {
+        return resultOf(NULL);
+    }
+    Rope *slice = take(tail, end - begin);
+    release(tail);
+    return resultOf(slice);
+}
+
+rvm_RopeResult rvm_updateRope(const rvm_Rope *rope, size_t index,
+    const void *element) {
+    assert(rope != NULL);
+    assert(index < rope->length);
+    assert(element != NULL);
+
+    const rvm_RopeResult middle = rvm_newRope(rope->width, element, 1);
+    if (!middle.ok) {
+        return middle;
+    }
+    Rope *left = take((Rope *)rope, index);
+    Rope *right = drop((Rope *)rope, index + 1);
+    Rope *joined = NULL;
+    Rope *updated = NULL;
+    if (left != NULL && right != NULL
+        && (joined = join(left, middle.as.rope)) != NULL) {
+        updated = join(joined, right);
+    }
+    release(joined);
+    release(right);
+    release(left);
+    release(middle.as.rope);
+    return resultOf(updated);
+}
+
+rvm_RopeResult rvm_appendToRope(const rvm_Rope *rope, const void *elements,
+    size_t count) {
+    assert(rope != NULL);
+    assert(elements != NULL || count == 0);
+
+    if (count == 0) {
+        return resultOf(retain((Rope *)rope));
+    }
+    uint8_t *room;
+    if (claim(rope, count, &room)) {
+        memcpy(room, elements, count * rope->width);
+        return resultOf(grow((Rope *)rope, count));
+    }
+
+    // Chunks of appended elements have room for more, so that appending to
+    // the resulting rope can use claim() rather than creating new leaves.
+    size_t capacity = CHUNK_LENGTH / rope->width;
+    if (capacity < count) {
+        capacity = count;
+    }
+    Chunk *chunk = newChunk(rope->width, capacity);
+    if (chunk == NULL) {
+        return resultOf(NULL);
+    }
+    memcpy(chunk->elements, elements, count * rope->width);
+    chunk->used = count;
+    Rope *leaf = newLeaf(rope->width, chunk, 0, count);
+    if (leaf == NULL) {
+        free(chunk);
+        return resultOf(NULL);
+    }
+    Rope *appended = join((Rope *)rope, leaf);
+    release(leaf);
+    return resultOf(appended);
+}
+
+void rvm_freeRope(rvm_Rope *rope) {
+    release(rope);
+}
+
+/// Allocates chunk with room for `capacity` elements and no references.
+Chunk *newChunk(size_t width, size_t capacity) {
+    if (capacity > (SIZE_MAX - sizeof(Chunk)) / width) {
+        return NULL;
+    }
+    Chunk *chunk = malloc(sizeof(Chunk) + capacity * width);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    *chunk = (Chunk){ .refs = 0, .capacity = capacity, .used = 0 };
+    return chunk;
+}
+
+uint8_t *elementOf(const Chunk *chunk, size_t width, size_t index) {
+    return (uint8_t *)chunk->elements + index * width;
+}
+
+/// Creates leaf referring to given chunk elements, retaining the chunk.
+Rope *newLeaf(size_t width, Chunk *chunk, size_t offset, size_t length) {
+    Rope *leaf = malloc(sizeof(Rope));
+    if (leaf == NULL) {
+        return NULL;
+    }
+    *leaf = (Rope){
+        .refs = 1,
+        .length = length,
+        .width = width,
+        .height = 0,
+        .as.leaf = { chunk, offset },
+    };
+    if (chunk != NULL) {
+        __atomic_fetch_add(&chunk->refs, 1, __ATOMIC_RELAXED);
+    }
+    return leaf;
+}
+
+/// Creates branch of given non-empty subtrees, retaining both.
+Rope *newBranch(Rope *left, Rope *right) {
+    Rope *branch = malloc(sizeof(Rope));
+    if (branch == NULL) {
+        return NULL;
+    }
+    *branch = (Rope){
+        .refs = 1,
+        .length = left->length + right->length,
+        .width = left->width,
+        .height = 1
+            + (left->height > right->height ? left->height : right->height),
+        .as.branch = { retain(left), retain(right) },
+    };
+    return branch;
+}
+
+/// Creates branch of given subtrees, taking over their references. If either
+/// subtree is `NULL`, the other is released and `NULL` returned.
+Rope *branchOwned(Rope *left, Rope *right) {
+    Rope *branch = left != NULL && right != NULL
+        ? newBranch(left, right)
+        : NULL;
+    release(left);
+    release(right);
+    return branch;
+}
+
+Rope *retain(Rope *rope) {
+    __atomic_fetch_add(&rope->refs, 1, __ATOMIC_RELAXED);
+    return rope;
+}
+
+/// Releases reference to rope, freeing it and releasing its subtrees or
+/// chunk if no references remain.
+void release(Rope *rope) {
+    while (rope != NULL
+        && __atomic_sub_fetch(&rope->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        Rope *next = NULL;
+        if (rope->height > 0) {
+            release(rope->as.branch.left);
+            next = rope->as.branch.right;
+        } else if (rope->as.leaf.chunk != NULL
+            && __atomic_sub_fetch(&rope->as.leaf.chunk->refs, 1,
+                   __ATOMIC_ACQ_REL) == 0) {
+            free(rope->as.leaf.chunk);
+        }
+        free(rope);
+        rope = next;
+    }
+}
+
+/// Joins two ropes into a balanced rope.
+///
+/// Joining is done as for AVL trees, by descending along the inner edge of
+/// the taller rope until reaching a subtree about as tall as the other rope,
+/// and then rebalancing on the way back up. Adjacent ranges of the same chunk
+/// are joined into single leaves.
+///
+/// \returns New reference, or `NULL` if out of memory.
+Rope *join(Rope *left, Rope *right) {
+    if (left->length == 0) {
+        return retain(right);
+    }
+    if (right->length == 0) {
+        return retain(left);
+    }
+    if (left->height == 0 && right->height == 0
+        && left->as.leaf.chunk == right->as.leaf.chunk
+        && left->as.leaf.offset + left->length == right->as.leaf.offset) {
+        return newLeaf(left->width, left->as.leaf.chunk, left->as.leaf.offset,
+            left->length + right->length);
+    }
+    if (left->height > right->height + 1) {
+        return joinRight(left, right);
+    }
+    if (right->height > left->height + 1) {
+        return joinLeft(left, right);
+    }
+    return newBranch(left, right);
+}
+
+/// Joins `right` into the right edge of `left`, which is at least two levels
+/// taller.
+Rope *joinRight(Rope *left, Rope *right) {
+    Rope *inner = left->as.branch.right;
+    Rope *joined = inner->height <= right->height + 1
+        ? newBranch(inner, right)
+        : joinRight(inner, right);
+    if (joined == NULL) {
+        return NULL;
+    }
+    Rope *balanced = balance(left->as.branch.left, joined);
+    release(joined);
+    return balanced;
+}
+
+/// Joins `left` into the left edge of `right`, which is at least two levels
+/// taller.
+Rope *joinLeft(Rope *left, Rope *right) {
+    Rope *inner = right->as.branch.left;
+    Rope *joined = inner->height <= left->height + 1
+        ? newBranch(left, inner)
+        : joinLeft(left, inner);
+    if (joined == NULL) {
+        return NULL;
+    }
+    Rope *balanced = balance(joined, right->as.branch.right);
+    release(joined);
+    return balanced;
+}
+
+/// Creates branch of given subtrees, whose heights may differ by up to two,
+/// rotating them as needed to make the branch balanced.
+Rope *balance(Rope *left, Rope *right) {
+    if (left->height > right->height + 1) {
+        Rope *outer = left->as.branch.left;
+        Rope *inner = left->as.branch.right;
+        if (outer->height >= inner->height) {
+            return branchOwned(retain(outer), newBranch(inner, right));
+        }
+        return branchOwned(newBranch(outer, inner->as.branch.left),
+            newBranch(inner->as.branch.right, right));
+    }
+    if (right->height > left->height + 1) {
+        Rope *inner = right->as.branch.left;
+        Rope *outer = right->as.branch.right;
+        if (outer->height >= inner->height) {
+            return branchOwned(newBranch(left, inner), retain(outer));
+        }
+        return branchOwned(newBranch(left, inner->as.branch.left),
+            newBranch(inner->as.branch.right, outer));
+    }
+    return newBranch(left, right);
+}
+
+/// Creates rope of the first `count` elements of given rope.
+Rope *take(Rope *rope, size_t count) {
+    if (count >= rope->length) {
+        return retain(rope);
+    }
+    if (count == 0) {
+        return newLeaf(rope->width, NULL, 0, 0);
+    }
+    if (rope->height == 0) {
+        return newLeaf(rope->width, rope->as.leaf.chunk, rope->as.leaf.offset,
+            count);
+    }
+    Rope *left = rope->as.branch.left;
+    if (count <= left->length) {
+        return take(left, count);
+    }
+    Rope *right = take(rope->as.branch.right, count - left->length);
+    if (right == NULL) {
+        return NULL;
+    }
+    Rope *joined = join(left, right);
+    release(right);
+    return joined;
+}
+
+/// Creates rope of all but the first `count` elements of given rope.
+Rope *drop(Rope *rope, size_t count) {
+    if (count == 0) {
+        return retain(rope);
+    }
+    if (count >= rope->length) {
+        return newLeaf(rope->width, NULL, 0, 0);
+    }
+    if (rope->height == 0) {
+        return newLeaf(rope->width, rope->as.leaf.chunk,
+            rope->as.leaf.offset + count, rope->length - count);
+    }
+    Rope *right = rope->as.branch.right;
+    Rope *left = rope->as.branch.left;
+    if (count >= left->length) {
+        return drop(right, count - left->length);
+    }
+    left = drop(left, count);
+    if (left == NULL) {
+        return NULL;
+    }
+    Rope *joined = join(left, right);
+    release(left);
+    return joined;
+}
+
+/// Claims room for `count` elements right after the last element of rope in
+/// its last chunk, which succeeds only if no other rope has claimed it first.
+///
+/// \returns `true` only if room was claimed, in which case `out` receives a
+///          pointer to it.
+bool claim(const Rope *rope, size_t count, uint8_t **out) {
+    while (rope->height > 0) {
+        rope = rope->as.branch.right;
+    }
+    Chunk *chunk = rope->as.leaf.chunk;
+    if (chunk == NULL) {
+        return false;
+    }
+    size_t end = rope->as.leaf.offset + rope->length;
+    if (count > chunk->capacity - end
+        || !__atomic_compare_exchange_n(&chunk->used, &end, end + count, false,
+            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        return false;
+    }
+    *out = elementOf(chunk, rope->width, end);
+    return true;
+}
+
+/// Creates rope identical to given rope, except for its last leaf being
+/// extended by `count` elements. As heights do not change, neither does
+/// balance.
+Rope *grow(Rope *rope, size_t count) {
+    if (rope->height == 0) {
+        return newLeaf(rope->width, rope->as.leaf.chunk, rope->as.leaf.offset,
+            rope->length + count);
+    }
+    Rope *right = grow(rope->as.branch.right, count);
+    if (right == NULL) {
+        return NULL;
+    }
+    Rope *grown = newBranch(rope->as.branch.left, right);
+    release(right);
+    return grown;
+}
+
+void copyElements(const Rope *rope, uint8_t *out) {
+    while (rope->height > 0) {
+        copyElements(rope->as.branch.left, out);
+        out += rope->as.branch.left->length * rope->width;
+        rope = rope->as.branch.right;
+    }
+    if (rope->length > 0) {
+        memcpy(out, elementOf(rope->as.leaf.chunk, rope->width,
+            rope->as.leaf.offset), rope->length * rope->width);
+    }
+}
+
+rvm_RopeResult resultOf(Rope *rope) {
+    if (rope == NULL) {
+        return (rvm_RopeResult){
+            .ok = false,
+            .as.error = rvm_asError(RVM_ERROR_NOMEMORY, NULL),
+        };
+    }
+    return (rvm_RopeResult){ .ok = true, .as.rope = rope };
+}
@@ -0,0 +1,134 @@
+#ifndef LIB_RVM_ROPE_H
+#define LIB_RVM_ROPE_H
+
+/// RVM persistent sequence type and utilities.
+///
+/// \file
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "error.h"
+#include "node.h"
+
+typedef struct rvm_Rope rvm_Rope;
+typedef struct rvm_RopeResult rvm_RopeResult;
+
+/// An immutable sequence of fixed-size elements, such as the nodes of an
+/// rvm_NodeArray or the bytes of an rvm_NodeBytes.
+///
+/// ## Structure
+///
+/// Ropes are height-balanced binary trees whose leaves refer to ranges of
+/// shared chunks of elements. Concatenating, slicing and updating ropes
+/// creates new ropes sharing all chunks and most tree nodes with the ropes
+/// they were created from, which takes time proportional to the logarithm of
+/// their lengths. Appending to a rope writes the new elements to free space
+/// after its last chunk range when no other rope has already done so, which
+/// makes appending repeatedly to the same rope take amortized logarithmic
+/// time, rather than the linear time of copying flat sequences.
+///
+/// Elements are copied as they are, which means that the children of nodes,
+/// and any other memory elements refer to, are never owned by ropes.
+///
+/// ## Concurrency
+///
+/// Ropes are never modified once created, and may therefore be used by
+/// multiple threads at once.
+///
+/// ## Destruction
+///
+/// Each rope received from a function declared here is a reference that must
+/// be given to rvm_freeRope() once no longer used. Ropes given as arguments to
+/// those functions are never consumed. Ropes must not be freed while used by
+/// other threads.
+///
+/// \see rvm_newArrayRope()
+/// \see rvm_newBytesRope()
+struct rvm_Rope;
+
+/// The result of creating an rvm_Rope.
+struct rvm_RopeResult {
+    /// Indicates whether creation was successful.
+    bool ok;
+
+    union {
+        /// If creation was unsuccessful, carries indication of cause.
+        rvm_Error error;
+
+        /// If creation was successful, carries created rope.
+        rvm_Rope *rope;
+    } as;
+};
+
+/// Creates rope containing copies of given elements.
+///
+/// \param width    Size of each element, in bytes. Must not be zero.
+/// \param elements Pointer to first element, unless `length` is zero.
+/// \param length   Amount of elements.
+/// \returns        Created rope, or error object indicating any issues.
+rvm_RopeResult rvm_newRope(size_t width, const void *elements, size_t length);
+
+/// Creates rope containing copies of the nodes of given array.
+static inline rvm_RopeResult rvm_newArrayRope(rvm_NodeArray array) {
+    return rvm_newRope(sizeof(rvm_Node), array.nodes, array.length);
+}
+
+/// Creates rope containing copies of given bytes.
+static inline rvm_RopeResult rvm_newBytesRope(rvm_NodeBytes bytes) {
+    return rvm_newRope(1, bytes.bytes, bytes.length);
+}
+
+/// Resolves amount of elements in given rope.
+size_t rvm_getRopeLength(const rvm_Rope *rope);
+
+/// Resolves size of each element in given rope, in bytes.
+size_t rvm_getRopeWidth(const rvm_Rope *rope);
+
+/// Resolves element at given index of rope.
+///
+/// \param rope  Rope.
+/// \param index Element index. Must be smaller than the rope length.
+/// \returns     Pointer to element, valid for as long as the rope is.
+const void *rvm_getRopeElement(const rvm_Rope *rope, size_t index);
+
+/// Copies all elements of given rope to `out`, in order.
+///
+/// \param rope Rope.
+/// \param out  Receiver of as many bytes as the rope length times its width.
+void rvm_copyRope(const rvm_Rope *rope, void *out);
+
+/// Creates rope containing the elements of `a` followed by those of `b`.
+///
+/// Both ropes must have the same element width.
+rvm_RopeResult rvm_concatRopes(const rvm_Rope *a, const rvm_Rope *b);
+
+/// Creates rope containing the elements of rope between `begin`, inclusive,
+/// and `end`, exclusive.
+///
+/// \param rope  Rope.
+/// \param begin Index of first element. Must not be larger than `end`.
+/// \param end   Index after last element. Must not be larger than the rope
+///              length.
+rvm_RopeResult rvm_sliceRope(const rvm_Rope *rope, size_t begin, size_t end);
+
+/// Creates rope identical to given rope, except for the element at `index`,
+/// which is replaced with a copy of `element`.
+rvm_RopeResult rvm_updateRope(const rvm_Rope *rope, size_t index,
+    const void *element);
+
+/// Creates rope containing the elements of rope followed by copies of given
+/// elements.
+///
+/// \param rope     Rope.
+/// \param elements Pointer to first element, unless `count` is zero.
+/// \param count    Amount of elements.
+rvm_RopeResult rvm_appendToRope(const rvm_Rope *rope, const void *elements,
+    size_t count);
+
+/// Releases given rope reference, freeing the rope once no other ropes or
+/// references use it.
+///
+/// \param rope Rope, or `NULL`.
+void rvm_freeRope(rvm_Rope *rope);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef LIB_RVM_VALUE_H
+#define LIB_RVM_VALUE_H
+
+/// RVM value type.
+///
+/// \file
+
+#include "node.h"
+
+/// An RVM value.
+///
+/// A value is a tree of rvm_Node objects, represented by its root node.
+typedef rvm_Node rvm_Value;
+
+#endif
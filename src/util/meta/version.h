@@ -0,0 +1,28 @@
+#ifndef UTIL_META_VERSION_H
+#define UTIL_META_VERSION_H
+
+/// Project version information.
+///
+/// This file is generated from a shell script. Do not edit directly.
+///
+/// \file
+
+/// Project version, as C string on the form `MAJOR.MINOR.PATCH`.
+#define META_VERSION ""
+
+/// Project major version, as integer.
+#define META_VERSION_MAJOR 
+
+/// Project minor version, as integer.
+#define META_VERSION_MINOR 
+
+/// Project patch version, as integer.
+#define META_VERSION_PATCH 
+
+/// Project version hash, as C string.
+#define META_VERSION_HASH "9770259"
+
+/// Project version creation time, as seconds since 1970-01-01 00:00:00.
+#define META_VERSION_UNIXTIME 1792178825
+
+#endif
@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <string.h>
+#include "../../../src/lib/rvm/codec.h"
+#include "../../../src/lib/rvm/hash.h"
+#include "../../../src/lib/rvm/heap.h"
+#include "unit.h"
+
+static rvm_Node identity(rvm_Node *node) {
+    return *node;
+}
+
+static const rvm_Function IDENTITY = { "identity", 1, identity, 0 };
+
+static const rvm_Function *const FUNCTIONS[] = { &IDENTITY };
+
+static rvm_Node number(int64_t integer) {
+    return (rvm_Node){
+        .flags = RVM_NODE_NUMBER, .as.number.integer = integer,
+    };
+}
+
+static rvm_Node bytes(const char *string) {
+    return (rvm_Node){
+        .flags = RVM_NODE_BYTES,
+        .as.bytes = { strlen(string), (const uint8_t *)string },
+    };
+}
+
+static rvm_Node symbol(const char *string) {
+    return (rvm_Node){
+        .flags = RVM_NODE_SYMBOL,
+        .as.bytes = { strlen(string), (const uint8_t *)string },
+    };
+}
+
+static rvm_Node link(const rvm_Node *head, const rvm_Node *tail) {
+    return (rvm_Node){
+        .flags = RVM_NODE_LINK, .as.link = { head, tail },
+    };
+}
+
+// Encodes node into memory allocated with malloc(), or returns `NULL`.
+static uint8_t *encode(const rvm_Node *node, size_t *length) {
+    FILE *file = tmpfile();
+    if (file == NULL) {
+        return NULL;
+    }
+    uint8_t *buffer = NULL;
+    long size;
+    if (rvm_getErrorKind(rvm_encodeNode(node, file)) != RVM_ERROR_NONE
+        || (size = ftell(file)) < 0 || fseek(file, 0, SEEK_SET) != 0
+        || (buffer = malloc((size_t)size)) == NULL
+        || fread(buffer, 1, (size_t)size, file) != (size_t)size) {
+        free(buffer);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+    *length = (size_t)size;
+    return buffer;
+}
+
+void shouldDecodeEncodedTrees(unit_T *t) {
+    rvm_Node elements[4] = {
+        number(-1),
+        number(INT64_MIN),
+        symbol("name"),
+        { .flags = RVM_NODE_UNDEFINED },
+    };
+    const rvm_Node array = {
+        .flags = RVM_NODE_ARRAY, .as.array = { 4, elements },
+    };
+    const rvm_Node text = bytes("Encoded bytes.");
+    const rvm_Node closure = {
+        .flags = RVM_NODE_CLOSURE, .as.closure = { &IDENTITY, &text },
+    };
+    const rvm_Node empty = { .flags = RVM_NODE_ARRAY };
+    const rvm_Node l3 = link(&empty, NULL);
+    const rvm_Node l2 = link(&closure, &l3);
+    const rvm_Node l1 = link(&array, &l2);
+
+    size_t length;
+    uint8_t *encoded = encode(&l1, &length);
+    UNIT_ASSERT(t, encoded != NULL);
+    UNIT_ASSERT(t, memcmp(encoded, "RVMN", 4) == 0);
+
+    rvm_Node *decoded;
+    bool equal;
+    UNIT_ASSERT_OK(t, rvm_decodeNode(encoded, length, FUNCTIONS, 1, &decoded));
+    UNIT_ASSERT_OK(t, rvm_equalNodes(&l1, decoded, NULL, &equal));
+    UNIT_ASSERT(t, equal);
+
+    // Decoded bytes refer to the encoded bytes.
+    const rvm_Node *bytesOf = decoded->as.link.tail->as.link.head
+        ->as.closure.node;
+    UNIT_ASSERT(t, bytesOf->as.bytes.bytes > encoded);
+    UNIT_ASSERT(t, bytesOf->as.bytes.bytes < &encoded[length]);
+    free(decoded);
+
+    // Absent nodes are decoded as such.
+    free(encoded);
+    encoded = encode(NULL, &length);
+    UNIT_ASSERT(t, encoded != NULL);
+    UNIT_ASSERT_OK(t, rvm_decodeNode(encoded, length, NULL, 0, &decoded));
+    UNIT_ASSERT(t, decoded == NULL);
+    free(encoded);
+}
+
+void shouldEncodeSharedNodesOnce(unit_T *t) {
+    const rvm_Node text = bytes("A byte sequence shared by several links.");
+    const rvm_Node l3 = link(&text, NULL);
+    const rvm_Node l2 = link(&text, &l3);
+    const rvm_Node l1 = link(&text, &l2);
+
+    size_t length;
+    uint8_t *encoded = encode(&l1, &length);
+    UNIT_ASSERT(t, encoded != NULL);
+    UNIT_ASSERT(t, length < 2 * text.as.bytes.length);
+
+    rvm_Node *decoded;
+    UNIT_ASSERT_OK(t, rvm_decodeNode(encoded, length, NULL, 0, &decoded));
+    const rvm_Node *head = decoded->as.link.head;
+    UNIT_ASSERT_EQU(t, RVM_NODE_BYTES, rvm_getNodeKind((rvm_Node *)head));
+    UNIT_ASSERT(t, head == decoded->as.link.tail->as.link.head);
+    UNIT_ASSERT(t, head == decoded->as.link.tail->as.link.tail->as.link.head);
+    free(decoded);
+    free(encoded);
+
+    // Nodes referring to themselves are decoded as such.
+    rvm_Node cycle = link(&text, NULL);
+    cycle.as.link.tail = &cycle;
+    encoded = encode(&cycle, &length);
+    UNIT_ASSERT(t, encoded != NULL);
+    UNIT_ASSERT_OK(t, rvm_decodeNode(encoded, length, NULL, 0, &decoded));
+    UNIT_ASSERT(t, decoded == decoded->as.link.tail);
+    free(decoded);
+    free(encoded);
+}
+
+void shouldEncodeLongListsOfLazyNodes(unit_T *t) {
+    const size_t count = 100000;
+    rvm_Node *nodes = malloc(2 * count * sizeof(rvm_Node));
+    UNIT_ASSERT(t, nodes != NULL);
+    for (size_t i = 0; i < count; ++i) {
+        nodes[count + i] = number((int64_t)i * 1000);
+        nodes[i] = link(&nodes[count + i],
+            i + 1 < count ? &nodes[i + 1] : NULL);
+    }
+
+    FILE *file = tmpfile();
+    UNIT_ASSERT(t, file != NULL);
+    rvm_HeapResult result = rvm_fileIntoHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+    UNIT_ASSERT_OK(t, heap.set(&heap, nodes[0]));
+    rvm_Node root;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &root, heap.revision));
+
+    size_t length;
+    uint8_t *encoded = encode(&root, &length);
+    UNIT_ASSERT(t, encoded != NULL);
+    rvm_Node *decoded;
+    bool equal;
+    UNIT_ASSERT_OK(t, rvm_decodeNode(encoded, length, NULL, 0, &decoded));
+    UNIT_ASSERT_OK(t, rvm_equalNodes(nodes, decoded, NULL, &equal));
+    UNIT_ASSERT(t, equal);
+    free(decoded);
+    free(encoded);
+
+    rvm_freeHeap(&heap);
+    free(nodes);
+}
+
+void shouldRejectCorruptEncodings(unit_T *t) {
+    const rvm_Node text = bytes("Text.");
+    const rvm_Node closure = {
+        .flags = RVM_NODE_CLOSURE, .as.closure = { &IDENTITY, &text },
+    };
+    const rvm_Node list = link(&closure, NULL);
+
+    size_t length;
+    uint8_t *encoded = encode(&list, &length);
+    UNIT_ASSERT(t, encoded != NULL);
+    rvm_Node *decoded;
+    for (size_t i = 0; i < length; ++i) {
+        const rvm_Error err = rvm_decodeNode(encoded, i, FUNCTIONS, 1,
+            &decoded);
+        UNIT_ASSERTF(t, rvm_getErrorKind(err) == RVM_ERROR_CORRUPT,
+            "prefix of %d bytes decoded", (int)i)
+    }
+    const rvm_Error err = rvm_decodeNode(encoded, length, NULL, 0, &decoded);
+    UNIT_ASSERT_EQU(t, RVM_ERROR_CORRUPT, rvm_getErrorKind(err));
+
+    // References must refer to nodes already decoded.
+    const uint8_t reference[] = { 'R', 'V', 'M', 'N', 1, 0x06, 0x08, 0x01 };
+    UNIT_ASSERT_EQU(t, RVM_ERROR_CORRUPT, rvm_getErrorKind(rvm_decodeNode(
+        reference, sizeof(reference), NULL, 0, &decoded)));
+    free(encoded);
+}
+
+void rvm_codec(unit_S *s) {
+    unit_test(s, shouldDecodeEncodedTrees);
+    unit_test(s, shouldEncodeSharedNodesOnce);
+    unit_test(s, shouldEncodeLongListsOfLazyNodes);
+    unit_test(s, shouldRejectCorruptEncodings);
+}
@@ -0,0 +1,446 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../../src/lib/rvm/evaluate.h"
+#include "../../../src/lib/rvm/hash.h"
+#include "../../../src/lib/rvm/heap.h"
+#include "unit.h"
+
+// Amount of times any test function has been called.
+static size_t calls;
+
+static rvm_Node number(int64_t integer) {
+    return (rvm_Node){
+        .flags = RVM_NODE_NUMBER, .as.number.integer = integer,
+    };
+}
+
+static rvm_Node link(const rvm_Node *head, const rvm_Node *tail) {
+    return (rvm_Node){
+        .flags = RVM_NODE_LINK, .as.link = { head, tail },
+    };
+}
+
+static rvm_Node closure(const rvm_Function *function, const rvm_Node *node) {
+    return (rvm_Node){
+        .flags = RVM_NODE_CLOSURE, .as.closure = { function, node },
+    };
+}
+
+// Adds the numbers of a list of two numbers.
+static rvm_Node add(rvm_Node *node) {
+    calls += 1;
+    return number(node->as.link.head->as.number.integer
+        + node->as.link.tail->as.link.head->as.number.integer);
+}
+
+static rvm_Node increment(rvm_Node *node) {
+    calls += 1;
+    return number(node->as.number.integer + 1);
+}
+
+// Creates a list of the numbers from 1 up to given number, allocating
+// garbage between each link.
+static rvm_Node range(rvm_Node *node) {
+    calls += 1;
+    const rvm_Node *tail = NULL;
+    for (int64_t i = node->as.number.integer; i > 0; --i) {
+        rvm_Node *nodes = rvm_allocate(2 * sizeof(rvm_Node));
+        uint8_t *garbage = rvm_allocate(100);
+        if (nodes == NULL || garbage == NULL) {
+            break;
+        }
+        memset(garbage, 0xAA, 100);
+        nodes[0] = number(i);
+        nodes[1] = link(&nodes[0], tail);
+        tail = &nodes[1];
+    }
+    return link(NULL, tail);
+}
+
+// Creates an array holding two references to the same bytes node.
+static rvm_Node pair(rvm_Node *node) {
+    calls += 1;
+    (void)node;
+    uint8_t *bytes = rvm_allocate(5);
+    rvm_Node *nodes = rvm_allocate(2 * sizeof(rvm_Node));
+    if (bytes == NULL || nodes == NULL) {
+        return number(0);
+    }
+    memcpy(bytes, "hello", 5);
+    nodes[0] = (rvm_Node){
+        .flags = RVM_NODE_BYTES, .as.bytes = { 5, bytes },
+    };
+    nodes[1] = link(&nodes[0], NULL);
+    return link(&nodes[0], &nodes[1]);
+}
+
+static const rvm_Function ADD = { "add", 1, add, 0 };
+
+static const rvm_Function RANGE = { "range", 1, range, 0 };
+
+static const rvm_Function PAIR = { "pair", 0, pair, 0 };
+
+static const rvm_Function INCREMENT = { "increment", 1, increment, 0 };
+
+static const rvm_Function PURE_INCREMENT = {
+    "pureIncrement", 1, increment, RVM_FUNCTION_FLAGS_MEMOIZE,
+};
+
+void shouldApplyClosures(unit_T *t) {
+    // (increment (increment 1)) followed by (add 2 3).
+    rvm_Node one = number(1);
+    rvm_Node inner = closure(&INCREMENT, &one);
+    rvm_Node outer = closure(&INCREMENT, &inner);
+    rvm_Node two = number(2);
+    rvm_Node three = number(3);
+    rvm_Node l3 = link(&three, NULL);
+    rvm_Node l2 = link(&two, &l3);
+    rvm_Node sum = closure(&ADD, &l2);
+    rvm_Node tail = link(&sum, NULL);
+    rvm_Node value = link(&outer, &tail);
+
+    rvm_Result result = rvm_evaluate(&value);
+    UNIT_ASSERT_OK(t, result.error);
+    UNIT_ASSERT_EQU(t, RVM_NODE_LINK, rvm_getNodeKind(&result.value));
+    rvm_Node *head = (rvm_Node *)result.value.as.link.head;
+    UNIT_ASSERT_EQU(t, RVM_NODE_NUMBER, rvm_getNodeKind(head));
+    UNIT_ASSERT_EQI(t, 3, head->as.number.integer);
+    rvm_Node *next = (rvm_Node *)result.value.as.link.tail->as.link.head;
+    UNIT_ASSERT_EQU(t, RVM_NODE_NUMBER, rvm_getNodeKind(next));
+    UNIT_ASSERT_EQI(t, 5, next->as.number.integer);
+
+    // Given nodes are left as they were.
+    UNIT_ASSERT_EQU(t, RVM_NODE_CLOSURE, rvm_getNodeKind(&outer));
+    UNIT_ASSERT(t, value.as.link.head == &outer);
+    UNIT_ASSERT_EQU(t, RVM_NODE_CLOSURE, rvm_getNodeKind(&sum));
+    rvm_freeResult(&result);
+}
+
+void shouldApplySharedClosuresOnce(unit_T *t) {
+    // Each closure adds two references to the closure before it, which would
+    // make for 2^40 calls if closures were applied every time reached.
+    rvm_Node nodes[40][3];
+    rvm_Node one = number(1);
+    const rvm_Node *previous = &one;
+    for (size_t i = 0; i < 40; ++i) {
+        nodes[i][0] = link(previous, NULL);
+        nodes[i][1] = link(previous, &nodes[i][0]);
+        nodes[i][2] = closure(&ADD, &nodes[i][1]);
+        previous = &nodes[i][2];
+    }
+
+    calls = 0;
+    rvm_Result result = rvm_evaluate(&nodes[39][2]);
+    UNIT_ASSERT_OK(t, result.error);
+    UNIT_ASSERT_EQU(t, 40, calls);
+    UNIT_ASSERT_EQI(t, (int64_t)1 << 40, result.value.as.number.integer);
+    rvm_freeResult(&result);
+}
+
+void shouldFailToApplyClosuresDependingOnThemselves(unit_T *t) {
+    rvm_Node one = number(1);
+    rvm_Node tail = link(&one, NULL);
+    rvm_Node list = link(NULL, &tail);
+    rvm_Node sum = closure(&ADD, &list);
+    list.as.link.head = &sum;
+    rvm_Node value = closure(&INCREMENT, &sum);
+
+    calls = 0;
+    rvm_Result result = rvm_evaluate(&value);
+    UNIT_ASSERT_EQU(t, RVM_ERROR_CYCLE, rvm_getErrorKind(result.error));
+    UNIT_ASSERT_EQU(t, 0, calls);
+
+    // The closures are left as they were.
+    UNIT_ASSERT_EQU(t, RVM_NODE_CLOSURE, rvm_getNodeKind(&value));
+    UNIT_ASSERT(t, value.as.closure.function == &INCREMENT);
+    UNIT_ASSERT(t, sum.as.closure.function == &ADD);
+    rvm_freeResult(&result);
+}
+
+void shouldReuseResultsOfMemoizedFunctions(unit_T *t) {
+    const rvm_MemoStats before = rvm_getEvaluateMemoStats();
+    rvm_Node a = number(41);
+    rvm_Node b = number(41);
+    rvm_Node x = closure(&PURE_INCREMENT, &a);
+    rvm_Node y = closure(&PURE_INCREMENT, &b);
+
+    calls = 0;
+    rvm_Result first = rvm_evaluate(&x);
+    UNIT_ASSERT_OK(t, first.error);
+    rvm_Result second = rvm_evaluate(&y);
+    UNIT_ASSERT_OK(t, second.error);
+    UNIT_ASSERT_EQU(t, 1, calls);
+    UNIT_ASSERT_EQI(t, 42, first.value.as.number.integer);
+    UNIT_ASSERT_EQI(t, 42, second.value.as.number.integer);
+
+    const rvm_MemoStats after = rvm_getEvaluateMemoStats();
+    UNIT_ASSERT_EQU(t, before.hits + 1, after.hits);
+    UNIT_ASSERT_EQU(t, before.misses + 1, after.misses);
+    rvm_freeResult(&first);
+    rvm_freeResult(&second);
+}
+
+void shouldKeepManyMemoizedResults(unit_T *t) {
+    // Each result reused is held by a region chunk of its own.
+    const size_t length = 10000;
+    rvm_Node *nodes = malloc(3 * length * sizeof(rvm_Node));
+    UNIT_ASSERT(t, nodes != NULL);
+    for (size_t i = 0; i < length; ++i) {
+        rvm_Node *n = &nodes[3 * i];
+        n[0] = number(-(int64_t)i);
+        n[1] = closure(&PURE_INCREMENT, &n[0]);
+        n[2] = link(&n[1], i + 1 < length ? &n[5] : NULL);
+    }
+
+    rvm_Result first = rvm_evaluate(&nodes[2]);
+    UNIT_ASSERT_OK(t, first.error);
+    calls = 0;
+    rvm_Result second = rvm_evaluate(&nodes[2]);
+    UNIT_ASSERT_OK(t, second.error);
+    UNIT_ASSERT_EQU(t, 0, calls);
+    size_t i = 0;
+    for (const rvm_Node *node = &second.value; node != NULL;
+         node = node->as.link.tail, ++i) {
+        const int64_t expected = 1 - (int64_t)i;
+        UNIT_ASSERTF(t, node->as.link.head->as.number.integer == expected,
+            "link %zu is %" PRId64, i, node->as.link.head->as.number.integer)
+    }
+    UNIT_ASSERT_EQU(t, length, i);
+    rvm_freeResult(&first);
+    rvm_freeResult(&second);
+    free(nodes);
+}
+
+void shouldLoadLazyNodes(unit_T *t) {
+    FILE *file = tmpfile();
+    UNIT_ASSERT(t, file != NULL);
+    rvm_HeapResult heapResult = rvm_fileIntoHeap(file);
+    UNIT_ASSERT(t, heapResult.ok);
+    rvm_Heap heap = heapResult.as.heap;
+
+    rvm_Node numbers[2] = { number(1), number(1234567890123) };
+    const rvm_Node array = {
+        .flags = RVM_NODE_ARRAY, .as.array = { 2, numbers },
+    };
+    const rvm_Node tail = link(&array, NULL);
+    const rvm_Node stored = link(&numbers[1], &tail);
+    UNIT_ASSERT_OK(t, heap.set(&heap, stored));
+
+    rvm_Node value;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &value, heap.revision));
+    rvm_Result result = rvm_evaluate(&value);
+    UNIT_ASSERT_OK(t, result.error);
+    UNIT_ASSERT_EQU(t, RVM_NODE_LAZY, rvm_getNodeKind(&value));
+    UNIT_ASSERT_EQU(t, RVM_NODE_LINK, rvm_getNodeKind(&result.value));
+    rvm_Node *head = (rvm_Node *)result.value.as.link.head;
+    UNIT_ASSERT_EQU(t, RVM_NODE_NUMBER, rvm_getNodeKind(head));
+    rvm_Node *next = (rvm_Node *)result.value.as.link.tail;
+    UNIT_ASSERT_EQU(t, RVM_NODE_LINK, rvm_getNodeKind(next));
+
+    bool equal;
+    UNIT_ASSERT_OK(t, rvm_equalNodes(&result.value, &stored, NULL, &equal));
+    UNIT_ASSERT(t, equal);
+    rvm_freeResult(&result);
+    rvm_freeHeap(&heap);
+}
+
+void shouldKeepNodesAllocatedByFunctions(unit_T *t) {
+    rvm_Node count = number(10000);
+    rvm_Node value = closure(&RANGE, &count);
+
+    rvm_Result result = rvm_evaluate(&value);
+    UNIT_ASSERT_OK(t, result.error);
+    UNIT_ASSERT_EQU(t, RVM_NODE_LINK, rvm_getNodeKind(&result.value));
+    int64_t expected = 1;
+    for (const rvm_Node *node = result.value.as.link.tail; node != NULL;
+         node = node->as.link.tail) {
+        UNIT_ASSERT_EQI(t, expected, node->as.link.head->as.number.integer);
+        expected += 1;
+    }
+    UNIT_ASSERT_EQI(t, 10001, expected);
+    rvm_freeResult(&result);
+}
+
+void shouldKeepNodesSharedByFunctionsShared(unit_T *t) {
+    rvm_Node value = closure(&PAIR, NULL);
+
+    rvm_Result result = rvm_evaluate(&value);
+    UNIT_ASSERT_OK(t, result.error);
+    UNIT_ASSERT_EQU(t, RVM_NODE_LINK, rvm_getNodeKind(&result.value));
+    const rvm_Node *head = result.value.as.link.head;
+    UNIT_ASSERT(t, head == result.value.as.link.tail->as.link.head);
+    UNIT_ASSERT_EQU(t, RVM_NODE_BYTES, rvm_getNodeKind((rvm_Node *)head));
+    UNIT_ASSERT_EQU(t, 5, head->as.bytes.length);
+    UNIT_ASSERT(t, memcmp(head->as.bytes.bytes, "hello", 5) == 0);
+    rvm_freeResult(&result);
+}
+
+void shouldEvaluateLongLists(unit_T *t) {
+    // Every link has a closure as head, and every 1000th closure is nested
+    // within the one before it.
+    const size_t length = 1000000;
+    rvm_Node *nodes = malloc(3 * length * sizeof(rvm_Node));
+    UNIT_ASSERT(t, nodes != NULL);
+    for (size_t i = 0; i < length; ++i) {
+        rvm_Node *n = &nodes[3 * i];
+        n[0] = number((int64_t)i);
+        n[1] = closure(&INCREMENT, i % 1000 == 0 ? &n[0] : &n[-2]);
+        n[2] = link(&n[1], i + 1 < length ? &n[5] : NULL);
+    }
+
+    calls = 0;
+    rvm_Result result = rvm_evaluate(&nodes[2]);
+    UNIT_ASSERT_OK(t, result.error);
+    UNIT_ASSERT_EQU(t, length, calls);
+    size_t i = 0;
+    for (const rvm_Node *node = &result.value; node != NULL;
+         node = node->as.link.tail, ++i) {
+        const int64_t expected = (int64_t)i + 1;
+        UNIT_ASSERTF(t, node->as.link.head->as.number.integer == expected,
+            "link %zu is %" PRId64, i, node->as.link.head->as.number.integer)
+    }
+    UNIT_ASSERT_EQU(t, length, i);
+    rvm_freeResult(&result);
+    free(nodes);
+}
+
+void shouldEvaluateDeeplyNestedClosures(unit_T *t) {
+    const size_t depth = 1000000;
+    rvm_Node *nodes = malloc((depth + 1) * sizeof(rvm_Node));
+    UNIT_ASSERT(t, nodes != NULL);
+    nodes[0] = number(0);
+    for (size_t i = 1; i <= depth; ++i) {
+        nodes[i] = closure(&INCREMENT, &nodes[i - 1]);
+    }
+
+    calls = 0;
+    rvm_Result result = rvm_evaluate(&nodes[depth]);
+    UNIT_ASSERT_OK(t, result.error);
+    UNIT_ASSERT_EQU(t, depth, calls);
+    UNIT_ASSERT_EQI(t, (int64_t)depth, result.value.as.number.integer);
+    rvm_freeResult(&result);
+    free(nodes);
+}
+
+void shouldLeaveDeeplyNestedClosuresOnFailure(unit_T *t) {
+    const size_t depth = 100000;
+    rvm_Node *nodes = malloc(depth * sizeof(rvm_Node));
+    UNIT_ASSERT(t, nodes != NULL);
+    for (size_t i = 0; i < depth; ++i) {
+        nodes[i] = closure(&INCREMENT, &nodes[(i + depth - 1) % depth]);
+    }
+
+    calls = 0;
+    rvm_Result result = rvm_evaluate(&nodes[depth - 1]);
+    UNIT_ASSERT_EQU(t, RVM_ERROR_CYCLE, rvm_getErrorKind(result.error));
+    UNIT_ASSERT_EQU(t, 0, calls);
+    for (size_t i = 0; i < depth; ++i) {
+        UNIT_ASSERT(t, nodes[i].as.closure.function == &INCREMENT);
+    }
+    rvm_freeResult(&result);
+    free(nodes);
+}
+
+void shouldEvaluateHeapValuesRepeatedly(unit_T *t) {
+    FILE *file = tmpfile();
+    UNIT_ASSERT(t, file != NULL);
+    rvm_HeapResult heapResult = rvm_fileIntoHeap(file);
+    UNIT_ASSERT(t, heapResult.ok);
+    rvm_Heap heap = heapResult.as.heap;
+    const rvm_Function *functions[1] = { &INCREMENT };
+    UNIT_ASSERT_OK(t, heap.useFunctions(&heap, functions, 1));
+
+    rvm_Node elements[2] = { number(1), number(0) };
+    elements[1] = closure(&INCREMENT, &elements[0]);
+    const rvm_Node array = {
+        .flags = RVM_NODE_ARRAY, .as.array = { 2, elements },
+    };
+    UNIT_ASSERT_OK(t, heap.set(&heap, array));
+
+    // Nodes held by the heap are not modified, which is why the closure is
+    // applied again by each evaluation, and remains a closure in between.
+    calls = 0;
+    for (int i = 0; i < 2; ++i) {
+        rvm_Node value;
+        UNIT_ASSERT_OK(t, heap.get(&heap, &value, heap.revision));
+        rvm_Result result = rvm_evaluate(&value);
+        UNIT_ASSERT_OK(t, result.error);
+        UNIT_ASSERT_EQU(t, RVM_NODE_ARRAY, rvm_getNodeKind(&result.value));
+        const rvm_Node *nodes = result.value.as.array.nodes;
+        UNIT_ASSERT_EQI(t, 1, nodes[0].as.number.integer);
+        UNIT_ASSERT_EQU(t, RVM_NODE_NUMBER,
+            rvm_getNodeKind((rvm_Node *)&nodes[1]));
+        UNIT_ASSERT_EQI(t, 2, nodes[1].as.number.integer);
+        rvm_freeResult(&result);
+
+        UNIT_ASSERT_OK(t, heap.get(&heap, &value, heap.revision));
+        UNIT_ASSERT_OK(t, rvm_loadNode(&value));
+        const rvm_Node *stored = value.as.array.nodes;
+        rvm_Node element = stored[1];
+        UNIT_ASSERT_OK(t, rvm_loadNode(&element));
+        UNIT_ASSERT_EQU(t, RVM_NODE_CLOSURE, rvm_getNodeKind(&element));
+    }
+    UNIT_ASSERT_EQU(t, 2, calls);
+    rvm_freeHeap(&heap);
+}
+
+void shouldApplySharedHeapClosuresOnce(unit_T *t) {
+    // Each closure adds two references to the closure before it, which are
+    // stored once, but loading each of them gives a different lazy node.
+    rvm_Node nodes[16][3];
+    rvm_Node one = number(1);
+    const rvm_Node *previous = &one;
+    for (size_t i = 0; i < 16; ++i) {
+        nodes[i][0] = link(previous, NULL);
+        nodes[i][1] = link(previous, &nodes[i][0]);
+        nodes[i][2] = closure(&ADD, &nodes[i][1]);
+        previous = &nodes[i][2];
+    }
+
+    static uint64_t buffer[8192];
+    rvm_HeapResult results[2] = {
+        rvm_bufferAsHeap((uint8_t *)buffer, sizeof(buffer)),
+        rvm_fileIntoHeap(tmpfile()),
+    };
+    const rvm_Function *functions[1] = { &ADD };
+    for (size_t i = 0; i < 2; ++i) {
+        UNIT_ASSERT(t, results[i].ok);
+        rvm_Heap heap = results[i].as.heap;
+        UNIT_ASSERT_OK(t, heap.useFunctions(&heap, functions, 1));
+        UNIT_ASSERT_OK(t, heap.hashCons(&heap, true));
+        UNIT_ASSERT_OK(t, heap.set(&heap, nodes[15][2]));
+
+        rvm_Node value;
+        UNIT_ASSERT_OK(t, heap.get(&heap, &value, heap.revision));
+        calls = 0;
+        rvm_Result result = rvm_evaluate(&value);
+        UNIT_ASSERT_OK(t, result.error);
+        UNIT_ASSERT_EQU(t, 16, calls);
+        UNIT_ASSERT_EQI(t, (int64_t)1 << 16, result.value.as.number.integer);
+        rvm_freeResult(&result);
+        rvm_freeHeap(&heap);
+    }
+}
+
+void shouldNotAllocateOutsideEvaluations(unit_T *t) {
+    UNIT_ASSERT(t, rvm_allocate(16) == NULL);
+}
+
+void rvm_evaluation(unit_S *s) {
+    unit_test(s, shouldApplyClosures);
+    unit_test(s, shouldApplySharedClosuresOnce);
+    unit_test(s, shouldFailToApplyClosuresDependingOnThemselves);
+    unit_test(s, shouldReuseResultsOfMemoizedFunctions);
+    unit_test(s, shouldKeepManyMemoizedResults);
+    unit_test(s, shouldLoadLazyNodes);
+    unit_test(s, shouldKeepNodesAllocatedByFunctions);
+    unit_test(s, shouldKeepNodesSharedByFunctionsShared);
+    unit_test(s, shouldEvaluateLongLists);
+    unit_test(s, shouldEvaluateDeeplyNestedClosures);
+    unit_test(s, shouldLeaveDeeplyNestedClosuresOnFailure);
+    unit_test(s, shouldEvaluateHeapValuesRepeatedly);
+    unit_test(s, shouldApplySharedHeapClosuresOnce);
+    unit_test(s, shouldNotAllocateOutsideEvaluations);
+}
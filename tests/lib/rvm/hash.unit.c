@@ -0,0 +1,264 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../../src/lib/rvm/hash.h"
+#include "../../../src/lib/rvm/heap.h"
+#include "unit.h"
+
+static rvm_Node number(int64_t integer) {
+    return (rvm_Node){
+        .flags = RVM_NODE_NUMBER, .as.number.integer = integer,
+    };
+}
+
+static rvm_Node bytes(const char *string) {
+    return (rvm_Node){
+        .flags = RVM_NODE_BYTES,
+        .as.bytes = { strlen(string), (const uint8_t *)string },
+    };
+}
+
+static rvm_Node symbol(const char *string) {
+    return (rvm_Node){
+        .flags = RVM_NODE_SYMBOL,
+        .as.bytes = { strlen(string), (const uint8_t *)string },
+    };
+}
+
+static rvm_Node link(const rvm_Node *head, const rvm_Node *tail) {
+    return (rvm_Node){
+        .flags = RVM_NODE_LINK, .as.link = { head, tail },
+    };
+}
+
+static rvm_Node array(rvm_Node *nodes, size_t length) {
+    return (rvm_Node){
+        .flags = RVM_NODE_ARRAY, .as.array = { length, nodes },
+    };
+}
+
+void shouldHashAndCompareEqualTreesAlike(unit_T *t) {
+    char text[] = "A byte sequence longer than a word.";
+    rvm_Node a[3] = { number(1), bytes("A byte sequence longer than a word."),
+        symbol("x") };
+    rvm_Node b[3] = { number(1), bytes(text), symbol("x") };
+    const rvm_Node x = array(a, 3);
+    const rvm_Node y = array(b, 3);
+    const rvm_Node p = link(&x, NULL);
+    const rvm_Node q = link(&y, NULL);
+
+    uint64_t hp;
+    uint64_t hq;
+    bool equal;
+    UNIT_ASSERT_OK(t, rvm_hashNode(&p, NULL, &hp));
+    UNIT_ASSERT_OK(t, rvm_hashNode(&q, NULL, &hq));
+    UNIT_ASSERT_EQU(t, hp, hq);
+    UNIT_ASSERT_OK(t, rvm_equalNodes(&p, &q, NULL, &equal));
+    UNIT_ASSERT(t, equal);
+
+    // Differences anywhere in the trees make them unequal.
+    text[34] = '!';
+    UNIT_ASSERT_OK(t, rvm_hashNode(&q, NULL, &hq));
+    UNIT_ASSERT(t, hp != hq);
+    UNIT_ASSERT_OK(t, rvm_equalNodes(&p, &q, NULL, &equal));
+    UNIT_ASSERT(t, !equal);
+    text[34] = '.';
+
+    b[2] = bytes("x");
+    UNIT_ASSERT_OK(t, rvm_equalNodes(&p, &q, NULL, &equal));
+    UNIT_ASSERT(t, !equal);
+    b[2] = symbol("x");
+
+    const rvm_Node r = link(&y, &x);
+    UNIT_ASSERT_OK(t, rvm_equalNodes(&p, &r, NULL, &equal));
+    UNIT_ASSERT(t, !equal);
+    UNIT_ASSERT_OK(t, rvm_equalNodes(&p, NULL, NULL, &equal));
+    UNIT_ASSERT(t, !equal);
+    UNIT_ASSERT_OK(t, rvm_equalNodes(NULL, NULL, NULL, &equal));
+    UNIT_ASSERT(t, equal);
+}
+
+void shouldCompareLongListsWithCache(unit_T *t) {
+    const size_t length = 100000;
+    rvm_Node *heads = malloc(length * sizeof(rvm_Node));
+    rvm_Node *a = malloc(length * sizeof(rvm_Node));
+    rvm_Node *b = malloc(length * sizeof(rvm_Node));
+    UNIT_ASSERT(t, heads != NULL && a != NULL && b != NULL);
+    for (size_t i = 0; i < length; ++i) {
+        heads[i] = number((int64_t)i);
+        a[i] = link(&heads[i], i + 1 < length ? &a[i + 1] : NULL);
+        b[i] = link(&heads[i], i + 1 < length ? &b[i + 1] : NULL);
+    }
+
+    rvm_HashCache cache = {0};
+    bool equal;
+    UNIT_ASSERT_OK(t, rvm_equalNodes(a, b, &cache, &equal));
+    UNIT_ASSERT(t, equal);
+    UNIT_ASSERT_EQU(t, 3 * length, cache.count);
+
+    // Cached hashes tell apart lists differing only near their ends.
+    rvm_clearHashCache(&cache);
+    UNIT_ASSERT_EQU(t, 0, cache.count);
+    const rvm_Node last = number(-1);
+    b[length - 1].as.link.head = &last;
+    UNIT_ASSERT_OK(t, rvm_equalNodes(a, b, &cache, &equal));
+    UNIT_ASSERT(t, !equal);
+    UNIT_ASSERT_OK(t, rvm_equalNodes(&a[1], &b[1], &cache, &equal));
+    UNIT_ASSERT(t, !equal);
+    UNIT_ASSERT_OK(t, rvm_equalNodes(a, b, NULL, &equal));
+    UNIT_ASSERT(t, !equal);
+
+    rvm_freeHashCache(&cache);
+    free(heads);
+    free(a);
+    free(b);
+}
+
+static rvm_Node identity(rvm_Node *node) {
+    return *node;
+}
+
+static const rvm_Function IDENTITY = { "identity", 1, identity, 0 };
+
+// Nests closures and single-element arrays alternately, with a number
+// innermost.
+static rvm_Node *nest(rvm_Node *nodes, size_t depth, int64_t integer) {
+    nodes[0] = number(integer);
+    for (size_t i = 1; i <= depth; ++i) {
+        nodes[i] = i % 2 == 0
+            ? array(&nodes[i - 1], 1)
+            : (rvm_Node){
+                  .flags = RVM_NODE_CLOSURE,
+                  .as.closure = { &IDENTITY, &nodes[i - 1] },
+              };
+    }
+    return &nodes[depth];
+}
+
+void shouldHashAndCompareDeeplyNestedNodes(unit_T *t) {
+    const size_t depth = 1000000;
+    rvm_Node *a = malloc((depth + 1) * sizeof(rvm_Node));
+    rvm_Node *b = malloc((depth + 1) * sizeof(rvm_Node));
+    UNIT_ASSERT(t, a != NULL && b != NULL);
+    const rvm_Node *x = nest(a, depth, 1);
+    const rvm_Node *y = nest(b, depth, 1);
+
+    uint64_t hx;
+    uint64_t hy;
+    bool equal;
+    UNIT_ASSERT_OK(t, rvm_hashNode(x, NULL, &hx));
+    UNIT_ASSERT_OK(t, rvm_hashNode(y, NULL, &hy));
+    UNIT_ASSERT_EQU(t, hx, hy);
+    UNIT_ASSERT_OK(t, rvm_equalNodes(x, y, NULL, &equal));
+    UNIT_ASSERT(t, equal);
+
+    b[0] = number(2);
+    UNIT_ASSERT_OK(t, rvm_hashNode(y, NULL, &hy));
+    UNIT_ASSERT(t, hx != hy);
+    UNIT_ASSERT_OK(t, rvm_equalNodes(x, y, NULL, &equal));
+    UNIT_ASSERT(t, !equal);
+
+    free(a);
+    free(b);
+}
+
+void shouldCompareSharedNodesOnce(unit_T *t) {
+    // Each link refers to the one before it twice, which would make for 2^100
+    // comparisons if shared nodes were compared once per reference.
+    rvm_Node a[101];
+    rvm_Node b[101];
+    a[0] = number(1);
+    b[0] = number(1);
+    for (size_t i = 1; i < 101; ++i) {
+        a[i] = link(&a[i - 1], &a[i - 1]);
+        b[i] = link(&b[i - 1], &b[i - 1]);
+    }
+
+    rvm_HashCache cache = {0};
+    bool equal;
+    UNIT_ASSERT_OK(t, rvm_equalNodes(&a[100], &b[100], NULL, &equal));
+    UNIT_ASSERT(t, equal);
+    UNIT_ASSERT_OK(t, rvm_equalNodes(&a[100], &b[100], &cache, &equal));
+    UNIT_ASSERT(t, equal);
+
+    b[0] = number(2);
+    rvm_clearHashCache(&cache);
+    UNIT_ASSERT_OK(t, rvm_equalNodes(&a[100], &b[100], NULL, &equal));
+    UNIT_ASSERT(t, !equal);
+    UNIT_ASSERT_OK(t, rvm_equalNodes(&a[100], &b[100], &cache, &equal));
+    UNIT_ASSERT(t, !equal);
+    rvm_freeHashCache(&cache);
+}
+
+void shouldHashSharedNodesOnce(unit_T *t) {
+    // As when comparing, hashing shared nodes once per reference would take
+    // 2^100 steps.
+    rvm_Node a[101];
+    a[0] = number(1);
+    for (size_t i = 1; i < 101; ++i) {
+        a[i] = link(&a[i - 1], &a[i - 1]);
+    }
+
+    rvm_HashCache cache = {0};
+    uint64_t uncached;
+    uint64_t cached;
+    UNIT_ASSERT_OK(t, rvm_hashNode(&a[100], NULL, &uncached));
+    UNIT_ASSERT_OK(t, rvm_hashNode(&a[100], &cache, &cached));
+    UNIT_ASSERT_EQU(t, cached, uncached);
+
+    a[0] = number(2);
+    UNIT_ASSERT_OK(t, rvm_hashNode(&a[100], NULL, &uncached));
+    UNIT_ASSERT(t, uncached != cached);
+    rvm_freeHashCache(&cache);
+}
+
+void shouldCompareLazyNodesWithLoadedNodes(unit_T *t) {
+    FILE *file = tmpfile();
+    UNIT_ASSERT(t, file != NULL);
+
+    rvm_HeapResult result = rvm_fileIntoHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+
+    rvm_Node elements[2] = { bytes("Stored."), number(42) };
+    const rvm_Node stored = array(elements, 2);
+    const rvm_Node name = symbol("name");
+    const rvm_Node tail = link(&stored, NULL);
+    const rvm_Node value = link(&name, &tail);
+    UNIT_ASSERT_OK(t, heap.set(&heap, value));
+
+    rvm_Node root;
+    rvm_Node again;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &root, heap.revision));
+    UNIT_ASSERT_OK(t, heap.get(&heap, &again, heap.revision));
+    UNIT_ASSERT_EQU(t, RVM_NODE_LAZY, rvm_getNodeKind(&root));
+
+    rvm_HashCache cache = {0};
+    uint64_t lazy;
+    uint64_t loaded;
+    bool equal;
+    UNIT_ASSERT_OK(t, rvm_hashNode(&root, &cache, &lazy));
+    UNIT_ASSERT_OK(t, rvm_hashNode(&value, &cache, &loaded));
+    UNIT_ASSERT_EQU(t, loaded, lazy);
+    UNIT_ASSERT_OK(t, rvm_equalNodes(&root, &value, &cache, &equal));
+    UNIT_ASSERT(t, equal);
+    UNIT_ASSERT_OK(t, rvm_equalNodes(&root, &again, NULL, &equal));
+    UNIT_ASSERT(t, equal);
+
+    elements[1] = number(43);
+    rvm_clearHashCache(&cache);
+    UNIT_ASSERT_OK(t, rvm_equalNodes(&root, &value, &cache, &equal));
+    UNIT_ASSERT(t, !equal);
+
+    rvm_freeHashCache(&cache);
+    rvm_freeHeap(&heap);
+}
+
+void rvm_hash(unit_S *s) {
+    unit_test(s, shouldHashAndCompareEqualTreesAlike);
+    unit_test(s, shouldCompareLongListsWithCache);
+    unit_test(s, shouldHashAndCompareDeeplyNestedNodes);
+    unit_test(s, shouldCompareSharedNodesOnce);
+    unit_test(s, shouldHashSharedNodesOnce);
+    unit_test(s, shouldCompareLazyNodesWithLoadedNodes);
+}
@@ -0,0 +1,1671 @@
+#define _DEFAULT_SOURCE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "../../../src/lib/rvm/cell.h"
+#include "../../../src/lib/rvm/heap.h"
+#include "../../../src/lib/rvm/integers.h"
+#include "unit.h"
+
+static rvm_Node number(int64_t integer) {
+    return (rvm_Node){
+        .flags = RVM_NODE_NUMBER, .as.number.integer = integer,
+    };
+}
+
+static rvm_Node bytes(const char *string) {
+    return (rvm_Node){
+        .flags = RVM_NODE_BYTES,
+        .as.bytes = { strlen(string), (const uint8_t *)string },
+    };
+}
+
+static rvm_Node symbol(const char *string) {
+    return (rvm_Node){
+        .flags = RVM_NODE_SYMBOL,
+        .as.bytes = { strlen(string), (const uint8_t *)string },
+    };
+}
+
+static rvm_Node link(const rvm_Node *head, const rvm_Node *tail) {
+    return (rvm_Node){
+        .flags = RVM_NODE_LINK, .as.link = { head, tail },
+    };
+}
+
+// Copies the first `length` bytes of `file` into a new temporary file, which
+// is what would remain on disk if the process writing to `file` crashed at
+// an unfortunate moment.
+static FILE *copyPrefix(FILE *file, size_t length) {
+    FILE *copy = tmpfile();
+    if (copy == NULL || fseek(file, 0, SEEK_SET) != 0) {
+        return NULL;
+    }
+    uint8_t buffer[4096];
+    while (length > 0) {
+        const size_t n = fread(buffer, 1,
+            length < sizeof(buffer) ? length : sizeof(buffer), file);
+        if (n == 0 || fwrite(buffer, 1, n, copy) != n) {
+            fclose(copy);
+            return NULL;
+        }
+        length -= n;
+    }
+    return fflush(copy) == 0 ? copy : NULL;
+}
+
+void shouldStoreAndLoadValueInFileHeap(unit_T *t) {
+    FILE *file = tmpfile();
+    UNIT_ASSERT(t, file != NULL);
+
+    rvm_HeapResult result = rvm_fileIntoHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+    UNIT_ASSERT_EQU(t, 0, heap.revision);
+
+    const rvm_Node elements[] = { number(-42), bytes("Hello, heap!") };
+    const rvm_Node array = {
+        .flags = RVM_NODE_ARRAY, .as.array = { 2, elements },
+    };
+    const rvm_Node tail = link(&elements[0], NULL);
+    const rvm_Node value = link(&array, &tail);
+    UNIT_ASSERT_OK(t, heap.set(&heap, value));
+    UNIT_ASSERT_EQU(t, 1, heap.revision);
+
+    rvm_Node root;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &root, 1));
+    UNIT_ASSERT_EQU(t, RVM_NODE_LAZY, rvm_getNodeKind(&root));
+    UNIT_ASSERT_OK(t, rvm_loadNode(&root));
+    UNIT_ASSERT_EQU(t, RVM_NODE_LINK, rvm_getNodeKind(&root));
+    UNIT_ASSERT(t, rvm_getNodeIndex(&root) != RVM_NODE_INDEX_NONE);
+
+    rvm_Node *head = (rvm_Node *)root.as.link.head;
+    UNIT_ASSERT_OK(t, rvm_loadNode(head));
+    UNIT_ASSERT_EQU(t, RVM_NODE_ARRAY, rvm_getNodeKind(head));
+    UNIT_ASSERT_EQU(t, 2, head->as.array.length);
+
+    rvm_Node *n = (rvm_Node *)&head->as.array.nodes[0];
+    UNIT_ASSERT_OK(t, rvm_loadNode(n));
+    UNIT_ASSERT_EQI(t, -42, n->as.number.integer);
+
+    rvm_Node *b = (rvm_Node *)&head->as.array.nodes[1];
+    UNIT_ASSERT_OK(t, rvm_loadNode(b));
+    UNIT_ASSERT_EQU(t, 12, b->as.bytes.length);
+    UNIT_ASSERT(t, memcmp(b->as.bytes.bytes, "Hello, heap!", 12) == 0);
+
+    rvm_Node *rest = (rvm_Node *)root.as.link.tail;
+    UNIT_ASSERT_OK(t, rvm_loadNode(rest));
+    UNIT_ASSERT_EQU(t, RVM_NODE_LINK, rvm_getNodeKind(rest));
+    UNIT_ASSERT(t, rest->as.link.tail == NULL);
+
+    rvm_freeHeap(&heap);
+}
+
+void shouldReopenFileHeap(unit_T *t) {
+    FILE *file = tmpfile();
+    UNIT_ASSERT(t, file != NULL);
+
+    rvm_HeapResult result = rvm_fileAsHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+    const rvm_Node value = bytes("Persisted.");
+    UNIT_ASSERT_OK(t, heap.set(&heap, value));
+    rvm_freeHeap(&heap);
+
+    result = rvm_fileIntoHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    heap = result.as.heap;
+    UNIT_ASSERT_EQU(t, 1, heap.revision);
+
+    rvm_Node root;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &root, heap.revision));
+    UNIT_ASSERT_OK(t, rvm_loadNode(&root));
+    UNIT_ASSERT_EQU(t, RVM_NODE_BYTES, rvm_getNodeKind(&root));
+    UNIT_ASSERT(t, memcmp(root.as.bytes.bytes, "Persisted.", 10) == 0);
+
+    rvm_freeHeap(&heap);
+}
+
+static rvm_Node negate(rvm_Node *node) {
+    return number(-node->as.number.integer);
+}
+
+static const rvm_Function NEGATE = { "negate", 1, negate, 0 };
+
+void shouldStoreClosuresByFunctionNameAndArity(unit_T *t) {
+    FILE *file = tmpfile();
+    UNIT_ASSERT(t, file != NULL);
+
+    rvm_HeapResult result = rvm_fileAsHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+    const rvm_Node five = number(5);
+    const rvm_Node value = {
+        .flags = RVM_NODE_CLOSURE, .as.closure = { &NEGATE, &five },
+    };
+    UNIT_ASSERT_OK(t, heap.set(&heap, value));
+    rvm_freeHeap(&heap);
+
+    result = rvm_fileIntoHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    heap = result.as.heap;
+    rvm_Node root;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &root, heap.revision));
+    rvm_Node unresolved = root;
+    UNIT_ASSERT_EQU(t, RVM_ERROR_CORRUPT,
+        rvm_getErrorKind(rvm_loadNode(&unresolved)));
+
+    // Functions are matched by name and arity rather than by address.
+    const rvm_Function other = { "negate", 2, negate, 0 };
+    const rvm_Function same = { "negate", 1, negate, 0 };
+    const rvm_Function *functions[2] = { &other, &same };
+    UNIT_ASSERT_OK(t, heap.useFunctions(&heap, functions, 2));
+    UNIT_ASSERT_OK(t, rvm_loadNode(&root));
+    UNIT_ASSERT_EQU(t, RVM_NODE_CLOSURE, rvm_getNodeKind(&root));
+    UNIT_ASSERT(t, root.as.closure.function == &same);
+    UNIT_ASSERT_EQI(t, 5, root.as.closure.node->as.number.integer);
+
+    rvm_freeHeap(&heap);
+}
+
+void shouldLoadClosuresAfterCollection(unit_T *t) {
+    uint64_t buffer[1024];
+    rvm_HeapResult results[2] = {
+        rvm_fileIntoHeap(tmpfile()),
+        rvm_bufferAsHeap((uint8_t *)buffer, sizeof(buffer)),
+    };
+    const rvm_Function *functions[1] = { &NEGATE };
+    for (size_t i = 0; i < 2; ++i) {
+        UNIT_ASSERT(t, results[i].ok);
+        rvm_Heap heap = results[i].as.heap;
+        UNIT_ASSERT_OK(t, heap.useFunctions(&heap, functions, 1));
+        const rvm_Node five = number(5);
+        const rvm_Node value = {
+            .flags = RVM_NODE_CLOSURE, .as.closure = { &NEGATE, &five },
+        };
+        UNIT_ASSERT_OK(t, heap.set(&heap, value));
+
+        // Collection frees private memory, which the loaded nodes reuse.
+        const uint64_t revisions[] = { heap.revision };
+        UNIT_ASSERT_OK(t, heap.collect(&heap, revisions, 1));
+        rvm_Node root;
+        UNIT_ASSERT_OK(t, heap.get(&heap, &root, heap.revision));
+        UNIT_ASSERT_OK(t, rvm_loadNode(&root));
+        UNIT_ASSERT_EQU(t, RVM_NODE_CLOSURE, rvm_getNodeKind(&root));
+        UNIT_ASSERT(t, root.as.closure.function == &NEGATE);
+        UNIT_ASSERT_EQI(t, 5, root.as.closure.node->as.number.integer);
+        rvm_freeHeap(&heap);
+    }
+}
+
+void shouldStoreLongListInFileHeap(unit_T *t) {
+    FILE *file = tmpfile();
+    UNIT_ASSERT(t, file != NULL);
+
+    rvm_HeapResult result = rvm_fileIntoHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+
+    const size_t length = 100000;
+    rvm_Node *nodes = calloc(length * 2, sizeof(rvm_Node));
+    UNIT_ASSERT(t, nodes != NULL);
+    for (size_t i = 0; i < length; ++i) {
+        nodes[i * 2] = number((int64_t)i);
+        nodes[i * 2 + 1] = link(&nodes[i * 2],
+            i + 1 < length ? &nodes[i * 2 + 3] : NULL);
+    }
+    UNIT_ASSERT_OK(t, heap.set(&heap, nodes[1]));
+    free(nodes);
+
+    rvm_Node root;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &root, heap.revision));
+    rvm_Node *node = &root;
+    for (size_t i = 0; i < length; ++i) {
+        UNIT_ASSERT_OK(t, rvm_loadNode(node));
+        rvm_Node *head = (rvm_Node *)node->as.link.head;
+        UNIT_ASSERT_OK(t, rvm_loadNode(head));
+        UNIT_ASSERT_EQI(t, i, head->as.number.integer);
+        node = (rvm_Node *)node->as.link.tail;
+    }
+    UNIT_ASSERT(t, node == NULL);
+
+    rvm_freeHeap(&heap);
+}
+
+void shouldRejectCorruptFileHeap(unit_T *t) {
+    FILE *file = tmpfile();
+    UNIT_ASSERT(t, file != NULL);
+    UNIT_ASSERT(t, fputs("This is not a heap file at all.", file) >= 0);
+
+    const rvm_HeapResult result = rvm_fileIntoHeap(file);
+    UNIT_ASSERT(t, !result.ok);
+    UNIT_ASSERT_EQU(t, RVM_ERROR_CORRUPT, rvm_getErrorKind(result.as.error));
+}
+
+void shouldStoreAndLoadValueInBufferHeap(unit_T *t) {
+    uint64_t buffer[512];
+    rvm_HeapResult result = rvm_bufferAsHeap((uint8_t *)buffer, sizeof(buffer));
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+
+    const rvm_Node head = bytes("Bump!");
+    const rvm_Node tail = number(7);
+    const rvm_Node value = link(&head, &tail);
+    UNIT_ASSERT_OK(t, heap.set(&heap, value));
+
+    rvm_Node root;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &root, heap.revision));
+    UNIT_ASSERT_OK(t, rvm_loadNode(&root));
+    UNIT_ASSERT_EQU(t, RVM_NODE_LINK, rvm_getNodeKind(&root));
+    UNIT_ASSERT(t, (uint8_t *)root.as.link.head >= (uint8_t *)buffer);
+    UNIT_ASSERT(t, (uint8_t *)root.as.link.head < (uint8_t *)&buffer[512]);
+
+    rvm_Node *h = (rvm_Node *)root.as.link.head;
+    UNIT_ASSERT_OK(t, rvm_loadNode(h));
+    UNIT_ASSERT_EQU(t, 5, h->as.bytes.length);
+    UNIT_ASSERT(t, memcmp(h->as.bytes.bytes, "Bump!", 5) == 0);
+
+    rvm_Node *n = (rvm_Node *)root.as.link.tail;
+    UNIT_ASSERT_OK(t, rvm_loadNode(n));
+    UNIT_ASSERT_EQI(t, 7, n->as.number.integer);
+
+    // Storing a link to an already stored node only stores the new link and
+    // a revision record.
+    const uint64_t length = heap.length;
+    rvm_Node lazy;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &lazy, heap.revision));
+    const rvm_Node again = link(&lazy, NULL);
+    UNIT_ASSERT_OK(t, heap.set(&heap, again));
+    UNIT_ASSERT_EQU(t, length + 24 + 48, heap.length);
+
+    rvm_freeHeap(&heap);
+}
+
+void shouldFailWhenBufferHeapIsFull(unit_T *t) {
+    uint64_t buffer[96];
+    rvm_HeapResult result = rvm_bufferAsHeap((uint8_t *)buffer, sizeof(buffer));
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+
+    const rvm_Node small = bytes("Fits.");
+    UNIT_ASSERT_OK(t, heap.set(&heap, small));
+    const uint64_t length = heap.length;
+
+    const char *string = "This string is far too long to fit in the buffer "
+                         "heap, which only has a few hundred bytes to spare "
+                         "after its header and private data are accounted "
+                         "for, and should therefore be rejected.";
+    const rvm_Node large = bytes(string);
+    const rvm_Error err = heap.set(&heap, large);
+    UNIT_ASSERT_EQU(t, RVM_ERROR_NOMEMORY, rvm_getErrorKind(err));
+    UNIT_ASSERT_EQU(t, 1, heap.revision);
+    UNIT_ASSERT_EQU(t, length, heap.length);
+
+    rvm_Node root;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &root, heap.revision));
+    UNIT_ASSERT_OK(t, rvm_loadNode(&root));
+    UNIT_ASSERT(t, memcmp(root.as.bytes.bytes, "Fits.", 5) == 0);
+
+    rvm_freeHeap(&heap);
+}
+
+void shouldRejectTooSmallBuffer(unit_T *t) {
+    uint8_t buffer[16];
+    const rvm_HeapResult result = rvm_bufferAsHeap(buffer, sizeof(buffer));
+    UNIT_ASSERT(t, !result.ok);
+    UNIT_ASSERT_EQU(t, RVM_ERROR_NOMEMORY, rvm_getErrorKind(result.as.error));
+}
+
+void shouldStoreSmallNodesAsImmediateWords(unit_T *t) {
+    uint64_t buffer[512];
+    rvm_HeapResult result = rvm_bufferAsHeap((uint8_t *)buffer, sizeof(buffer));
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+
+    const int64_t integers[] = {
+        0, -5, RVM_CELL_IMMEDIATE_MIN, RVM_CELL_IMMEDIATE_MAX,
+        RVM_CELL_IMMEDIATE_MAX + 1, INT64_MIN,
+    };
+    const char *strings[] = { "", "1234567", "12345678" };
+    rvm_Node elements[9];
+    for (size_t i = 0; i < 6; ++i) {
+        elements[i] = number(integers[i]);
+    }
+    for (size_t i = 0; i < 3; ++i) {
+        elements[6 + i] = bytes(strings[i]);
+    }
+    elements[7] = symbol(strings[1]);
+    const rvm_Node array = {
+        .flags = RVM_NODE_ARRAY, .as.array = { 9, elements },
+    };
+    const uint64_t length = heap.length;
+    UNIT_ASSERT_OK(t, heap.set(&heap, array));
+    // Array, two large numbers, long bytes, symbol and record.
+    UNIT_ASSERT_EQU(t, length + 80 + 16 + 16 + 16 + 16 + 48, heap.length);
+
+    rvm_Node root;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &root, 1));
+    UNIT_ASSERT_OK(t, rvm_loadNode(&root));
+    UNIT_ASSERT_EQU(t, 9, root.as.array.length);
+    for (size_t i = 0; i < 9; ++i) {
+        rvm_Node element = root.as.array.nodes[i];
+        UNIT_ASSERT_OK(t, rvm_loadNode(&element));
+        UNIT_ASSERT_EQU(t, rvm_getNodeKind(&elements[i]),
+            rvm_getNodeKind(&element));
+        if (i < 6) {
+            UNIT_ASSERT_EQI(t, integers[i], element.as.number.integer);
+        } else {
+            UNIT_ASSERT_EQU(t, strlen(strings[i - 6]), element.as.bytes.length);
+            UNIT_ASSERT(t, memcmp(strings[i - 6], element.as.bytes.bytes,
+                element.as.bytes.length) == 0);
+        }
+    }
+
+    // Loaded immediate nodes are stored as immediate words again.
+    const uint64_t before = heap.length;
+    const rvm_Node copy = link(&root.as.array.nodes[1], NULL);
+    UNIT_ASSERT_OK(t, heap.set(&heap, copy));
+    UNIT_ASSERT_EQU(t, before + 24 + 48, heap.length);
+    rvm_freeHeap(&heap);
+}
+
+void shouldStoreLinkChainsUnrolled(unit_T *t) {
+    FILE *file = tmpfile();
+    UNIT_ASSERT(t, file != NULL);
+    rvm_HeapResult result = rvm_fileAsHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+
+    rvm_Node heads[20];
+    rvm_Node links[20];
+    for (size_t i = 20; i-- > 0;) {
+        heads[i] = number((int64_t)i);
+        links[i] = link(&heads[i], i < 19 ? &links[i + 1] : NULL);
+    }
+    const uint64_t length = heap.length;
+    UNIT_ASSERT_OK(t, heap.set(&heap, links[0]));
+    // Two cells of eight links, one of four, and record.
+    UNIT_ASSERT_EQU(t, length + 80 + 80 + 48 + 48, heap.length);
+    UNIT_ASSERT_OK(t, heap.sync(&heap));
+    rvm_freeHeap(&heap);
+
+    result = rvm_fileAsHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    heap = result.as.heap;
+    rvm_HeapStats stats;
+    UNIT_ASSERT_OK(t, heap.stats(&heap, &stats));
+    UNIT_ASSERT_EQU(t, 20, stats.total[RVM_NODE_LINK].count);
+
+    rvm_Node root;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &root, 1));
+    rvm_Node *node = &root;
+    const rvm_Node *suffix = NULL;
+    for (int64_t i = 0; i < 20; ++i) {
+        UNIT_ASSERT_OK(t, rvm_loadNode(node));
+        UNIT_ASSERT_EQU(t, RVM_NODE_LINK, rvm_getNodeKind(node));
+        UNIT_ASSERT_EQU(t, i % 8 == 0,
+            rvm_getNodeIndex(node) != RVM_NODE_INDEX_NONE);
+        UNIT_ASSERT_EQI(t, i, node->as.link.head->as.number.integer);
+        if (i == 3) {
+            suffix = node;
+        }
+        node = (rvm_Node *)node->as.link.tail;
+    }
+    UNIT_ASSERT(t, node == NULL);
+
+    // Links stored within cells of other links are stored again by copy,
+    // up to the next cell.
+    const uint64_t before = heap.length;
+    UNIT_ASSERT_OK(t, heap.set(&heap, *suffix));
+    UNIT_ASSERT_EQU(t, before + 8 + 5 * 8 + 8 + 48, heap.length);
+    UNIT_ASSERT_OK(t, heap.get(&heap, &root, 2));
+    UNIT_ASSERT_OK(t, rvm_loadNode(&root));
+    UNIT_ASSERT_EQI(t, 3, root.as.link.head->as.number.integer);
+    rvm_freeHeap(&heap);
+    fclose(file);
+}
+
+void shouldStoreArraysOfNumbersPacked(unit_T *t) {
+    FILE *file = tmpfile();
+    UNIT_ASSERT(t, file != NULL);
+    rvm_HeapResult result = rvm_fileAsHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+
+    const int64_t integers[] = { 3, -1, INT64_MIN, 7, INT64_MAX, 0 };
+    rvm_Node elements[6];
+    for (size_t i = 0; i < 6; ++i) {
+        elements[i] = number(integers[i]);
+    }
+    const rvm_Node array = {
+        .flags = RVM_NODE_ARRAY, .as.array = { 6, elements },
+    };
+    const uint64_t length = heap.length;
+    UNIT_ASSERT_OK(t, heap.set(&heap, array));
+    // No cells are needed for the large numbers.
+    UNIT_ASSERT_EQU(t, length + 56 + 48, heap.length);
+
+    elements[5] = bytes("mixed");
+    UNIT_ASSERT_OK(t, heap.set(&heap, array));
+    UNIT_ASSERT_OK(t, heap.sync(&heap));
+    rvm_freeHeap(&heap);
+
+    result = rvm_fileAsHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    heap = result.as.heap;
+    rvm_Node root;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &root, 1));
+    size_t count = 0;
+    const int64_t *packed = heap.integersOf(&heap, &root, &count);
+    UNIT_ASSERT(t, packed != NULL);
+    UNIT_ASSERT_EQU(t, 6, count);
+    UNIT_ASSERT_EQI(t, INT64_MIN, rvm_minIntegers(packed, count));
+    UNIT_ASSERT_EQU(t, 4, rvm_findInteger(packed, count, INT64_MAX));
+
+    UNIT_ASSERT_OK(t, rvm_loadNode(&root));
+    UNIT_ASSERT(t, heap.integersOf(&heap, &root, &count) == packed);
+    UNIT_ASSERT_EQU(t, 6, root.as.array.length);
+    for (size_t i = 0; i < 6; ++i) {
+        UNIT_ASSERT_EQU(t, RVM_NODE_NUMBER,
+            rvm_getNodeKind((rvm_Node *)&root.as.array.nodes[i]));
+        UNIT_ASSERT_EQI(t, integers[i],
+            root.as.array.nodes[i].as.number.integer);
+    }
+
+    // Arrays with other elements are not packed.
+    UNIT_ASSERT_OK(t, heap.get(&heap, &root, 2));
+    UNIT_ASSERT(t, heap.integersOf(&heap, &root, &count) == NULL);
+    UNIT_ASSERT_OK(t, rvm_loadNode(&root));
+    UNIT_ASSERT(t, heap.integersOf(&heap, &root, &count) == NULL);
+    UNIT_ASSERT(t, heap.integersOf(&heap, &root.as.array.nodes[0], &count)
+        == NULL);
+    rvm_freeHeap(&heap);
+    fclose(file);
+}
+
+void shouldInternSymbolsOfFileHeap(unit_T *t) {
+    FILE *file = tmpfile();
+    UNIT_ASSERT(t, file != NULL);
+    rvm_HeapResult result = rvm_fileAsHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+
+    const rvm_Node a = symbol("name");
+    const rvm_Node b = symbol("name");
+    const rvm_Node c = symbol("other");
+    const rvm_Node tail = link(&b, &c);
+    UNIT_ASSERT_OK(t, heap.set(&heap, link(&a, &tail)));
+    rvm_HeapStats stats;
+    UNIT_ASSERT_OK(t, heap.stats(&heap, &stats));
+    UNIT_ASSERT_EQU(t, 2, stats.total[RVM_NODE_SYMBOL].count);
+    rvm_freeHeap(&heap);
+
+    // Symbols stored before the heap was opened are found again.
+    result = rvm_fileAsHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    heap = result.as.heap;
+    UNIT_ASSERT_OK(t, heap.set(&heap, link(&c, &a)));
+    UNIT_ASSERT_OK(t, heap.stats(&heap, &stats));
+    UNIT_ASSERT_EQU(t, 2, stats.total[RVM_NODE_SYMBOL].count);
+
+    rvm_Node first;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &first, 1));
+    UNIT_ASSERT_OK(t, rvm_loadNode(&first));
+    rvm_Node second;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &second, 2));
+    UNIT_ASSERT_OK(t, rvm_loadNode(&second));
+    rvm_Node name = *first.as.link.head;
+    UNIT_ASSERT_OK(t, rvm_loadNode(&name));
+    rvm_Node same = *second.as.link.tail;
+    UNIT_ASSERT_OK(t, rvm_loadNode(&same));
+    UNIT_ASSERT_EQU(t, RVM_NODE_SYMBOL, rvm_getNodeKind(&same));
+    UNIT_ASSERT_EQU(t, rvm_getNodeIndex(&name), rvm_getNodeIndex(&same));
+
+    rvm_freeHeap(&heap);
+    fclose(file);
+}
+
+void shouldKeepRevisionsSharingNodes(unit_T *t) {
+    FILE *file = tmpfile();
+    UNIT_ASSERT(t, file != NULL);
+
+    rvm_HeapResult result = rvm_fileAsHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+
+    const rvm_Node elements[] = { number(1), number(2), number(3) };
+    const rvm_Node array = {
+        .flags = RVM_NODE_ARRAY, .as.array = { 3, elements },
+    };
+    const rvm_Node first = link(&array, NULL);
+    UNIT_ASSERT_OK(t, heap.set(&heap, first));
+
+    // Replace the tail of revision 1, while keeping its head.
+    rvm_Node root;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &root, 1));
+    UNIT_ASSERT_OK(t, rvm_loadNode(&root));
+    const uint64_t length = heap.length;
+    const rvm_Node tail = number(4);
+    const rvm_Node second = link(root.as.link.head, &tail);
+    UNIT_ASSERT_OK(t, heap.set(&heap, second));
+    UNIT_ASSERT_EQU(t, 2, heap.revision);
+
+    // Only the new link and revision record are stored, as the number is
+    // small enough to be stored within the link.
+    UNIT_ASSERT_EQU(t, length + 24 + 48, heap.length);
+    rvm_freeHeap(&heap);
+
+    result = rvm_fileIntoHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    heap = result.as.heap;
+
+    rvm_Node old;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &old, 1));
+    UNIT_ASSERT_OK(t, rvm_loadNode(&old));
+    UNIT_ASSERT(t, old.as.link.tail == NULL);
+
+    rvm_Node new;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &new, 2));
+    UNIT_ASSERT_OK(t, rvm_loadNode(&new));
+    UNIT_ASSERT_EQU(t, rvm_getNodeIndex((rvm_Node *)old.as.link.head),
+        rvm_getNodeIndex((rvm_Node *)new.as.link.head));
+    rvm_Node *n = (rvm_Node *)new.as.link.tail;
+    UNIT_ASSERT_OK(t, rvm_loadNode(n));
+    UNIT_ASSERT_EQI(t, 4, n->as.number.integer);
+
+    rvm_Node empty;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &empty, 0));
+    UNIT_ASSERT_EQU(t, RVM_NODE_UNDEFINED, rvm_getNodeKind(&empty));
+
+    const rvm_Error err = heap.get(&heap, &empty, 3);
+    UNIT_ASSERT_EQU(t, RVM_ERROR_REVISION, rvm_getErrorKind(err));
+
+    rvm_freeHeap(&heap);
+}
+
+void shouldRecoverCommitsAfterLastCheckpoint(unit_T *t) {
+    FILE *file = tmpfile();
+    UNIT_ASSERT(t, file != NULL);
+
+    rvm_HeapResult result = rvm_fileIntoHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+    const rvm_Node first = bytes("Synchronized.");
+    UNIT_ASSERT_OK(t, heap.set(&heap, first));
+    UNIT_ASSERT_OK(t, heap.sync(&heap));
+    const rvm_Node second = bytes("Committed, but never synchronized.");
+    UNIT_ASSERT_OK(t, heap.set(&heap, second));
+
+    // The whole file, including any unused space after the last commit.
+    FILE *whole = copyPrefix(file, 65536);
+    UNIT_ASSERT(t, whole != NULL);
+    // The file with the last eight bytes of the last commit missing.
+    FILE *torn = copyPrefix(file, heap.length - 8);
+    UNIT_ASSERT(t, torn != NULL);
+    rvm_freeHeap(&heap);
+
+    result = rvm_fileIntoHeap(whole);
+    UNIT_ASSERT(t, result.ok);
+    heap = result.as.heap;
+    UNIT_ASSERT_EQU(t, 2, heap.revision);
+    rvm_Node root;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &root, 2));
+    UNIT_ASSERT_OK(t, rvm_loadNode(&root));
+    UNIT_ASSERT_EQU(t, 34, root.as.bytes.length);
+    rvm_freeHeap(&heap);
+
+    result = rvm_fileIntoHeap(torn);
+    UNIT_ASSERT(t, result.ok);
+    heap = result.as.heap;
+    UNIT_ASSERT_EQU(t, 1, heap.revision);
+    UNIT_ASSERT_OK(t, heap.get(&heap, &root, 1));
+    UNIT_ASSERT_OK(t, rvm_loadNode(&root));
+    UNIT_ASSERT(t, memcmp(root.as.bytes.bytes, "Synchronized.", 13) == 0);
+
+    // The torn commit is overwritten by the next one.
+    const rvm_Node third = number(3);
+    UNIT_ASSERT_OK(t, heap.set(&heap, third));
+    UNIT_ASSERT_EQU(t, 2, heap.revision);
+    rvm_freeHeap(&heap);
+}
+
+void shouldReopenFileHeapWithManyCheckpoints(unit_T *t) {
+    FILE *file = tmpfile();
+    UNIT_ASSERT(t, file != NULL);
+
+    rvm_HeapResult result = rvm_fileAsHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+    for (int64_t i = 1; i <= 100; ++i) {
+        const rvm_Node value = number(i);
+        UNIT_ASSERT_OK(t, heap.set(&heap, value));
+        if (i % 3 == 0) {
+            UNIT_ASSERT_OK(t, heap.sync(&heap));
+        }
+    }
+    rvm_freeHeap(&heap);
+
+    // Anything appended after the last checkpoint is ignored.
+    UNIT_ASSERT(t, fseek(file, 0, SEEK_END) == 0);
+    UNIT_ASSERT(t, fputs("Garbage.", file) >= 0);
+    UNIT_ASSERT(t, fflush(file) == 0);
+
+    result = rvm_fileIntoHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    heap = result.as.heap;
+    UNIT_ASSERT_EQU(t, 100, heap.revision);
+    for (uint64_t i = 1; i <= 100; ++i) {
+        rvm_Node root;
+        UNIT_ASSERT_OK(t, heap.get(&heap, &root, i));
+        UNIT_ASSERT_OK(t, rvm_loadNode(&root));
+        UNIT_ASSERT_EQI(t, i, root.as.number.integer);
+    }
+    rvm_freeHeap(&heap);
+}
+
+static void *setAndSync(void *argument) {
+    rvm_Heap *heap = argument;
+    for (int64_t i = 0; i < 50; ++i) {
+        const rvm_Node value = number(i);
+        rvm_Error err = heap->set(heap, value);
+        if (rvm_getErrorKind(err) == RVM_ERROR_NONE) {
+            err = heap->sync(heap);
+        }
+        if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+            return argument;
+        }
+    }
+    return NULL;
+}
+
+void shouldSyncFileHeapFromManyThreads(unit_T *t) {
+    FILE *file = tmpfile();
+    UNIT_ASSERT(t, file != NULL);
+
+    rvm_HeapResult result = rvm_fileAsHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+
+    pthread_t threads[4];
+    for (size_t i = 0; i < 4; ++i) {
+        UNIT_ASSERT(t, pthread_create(&threads[i], NULL, setAndSync, &heap) == 0);
+    }
+    for (size_t i = 0; i < 4; ++i) {
+        void *failed;
+        UNIT_ASSERT(t, pthread_join(threads[i], &failed) == 0);
+        UNIT_ASSERT(t, failed == NULL);
+    }
+    UNIT_ASSERT_EQU(t, 200, heap.revision);
+    rvm_freeHeap(&heap);
+
+    result = rvm_fileIntoHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    heap = result.as.heap;
+    UNIT_ASSERT_EQU(t, 200, heap.revision);
+    rvm_freeHeap(&heap);
+}
+
+void shouldAwaitAsyncSyncOfFileHeap(unit_T *t) {
+    FILE *file = tmpfile();
+    UNIT_ASSERT(t, file != NULL);
+
+    rvm_HeapResult result = rvm_fileAsHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+
+    // Without a flusher, the awaiting thread synchronizes.
+    const rvm_Node first = number(1);
+    UNIT_ASSERT_OK(t, heap.set(&heap, first));
+    rvm_HeapTicket ticket;
+    UNIT_ASSERT_OK(t, heap.syncAsync(&heap, &ticket));
+    UNIT_ASSERT_EQU(t, 1, ticket);
+    UNIT_ASSERT_OK(t, heap.await(&heap, ticket));
+
+    // With a flusher, it may already be done.
+    UNIT_ASSERT_OK(t, heap.flushEvery(&heap, 10));
+    for (int64_t i = 2; i <= 20; ++i) {
+        const rvm_Node value = number(i);
+        UNIT_ASSERT_OK(t, heap.set(&heap, value));
+        UNIT_ASSERT_OK(t, heap.syncAsync(&heap, &ticket));
+    }
+    UNIT_ASSERT_OK(t, heap.await(&heap, ticket));
+    UNIT_ASSERT_OK(t, heap.flushEvery(&heap, 0));
+
+    // The last revision is covered by a checkpoint, and the file is
+    // truncated right after it.
+    UNIT_ASSERT_OK(t, heap.sync(&heap));
+    const uint64_t length = heap.length;
+    rvm_freeHeap(&heap);
+    UNIT_ASSERT(t, fseek(file, 0, SEEK_END) == 0);
+    UNIT_ASSERT_EQU(t, length, (uint64_t)ftell(file));
+
+    result = rvm_fileIntoHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    heap = result.as.heap;
+    UNIT_ASSERT_EQU(t, 20, heap.revision);
+    rvm_freeHeap(&heap);
+}
+
+static void *getAndLoad(void *argument) {
+    rvm_Heap *heap = argument;
+    for (uint64_t i = 1; i <= 400; ++i) {
+        rvm_Node root;
+        rvm_Error err;
+        while (rvm_getErrorKind(err = heap->get(heap, &root, i))
+            == RVM_ERROR_REVISION) {
+            rvm_freeError(err);
+        }
+        if (rvm_getErrorKind(err) != RVM_ERROR_NONE
+            || rvm_getErrorKind(rvm_loadNode(&root)) != RVM_ERROR_NONE
+            || rvm_getNodeKind(&root) != RVM_NODE_LINK) {
+            return argument;
+        }
+        rvm_Node head = *root.as.link.head;
+        if (rvm_getErrorKind(rvm_loadNode(&head)) != RVM_ERROR_NONE
+            || head.as.number.integer != (int64_t)i) {
+            return argument;
+        }
+    }
+    return NULL;
+}
+
+void shouldGetAndLoadWhileFileHeapIsSet(unit_T *t) {
+    FILE *file = tmpfile();
+    UNIT_ASSERT(t, file != NULL);
+
+    rvm_HeapResult result = rvm_fileIntoHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+
+    pthread_t threads[4];
+    for (size_t i = 0; i < 4; ++i) {
+        UNIT_ASSERT(t, pthread_create(&threads[i], NULL, getAndLoad, &heap) == 0);
+    }
+
+    // Each revision grows both the file and the revision table now and then.
+    static char padding[4096];
+    memset(padding, 'x', sizeof(padding) - 1);
+    const rvm_Node tail = bytes(padding);
+    for (int64_t i = 1; i <= 400; ++i) {
+        const rvm_Node head = number(i);
+        const rvm_Node value = link(&head, &tail);
+        UNIT_ASSERT_OK(t, heap.set(&heap, value));
+    }
+    for (size_t i = 0; i < 4; ++i) {
+        void *failed;
+        UNIT_ASSERT(t, pthread_join(threads[i], &failed) == 0);
+        UNIT_ASSERT(t, failed == NULL);
+    }
+    rvm_freeHeap(&heap);
+}
+
+void shouldReferToLoadedNodesOfFileHeap(unit_T *t) {
+    FILE *file = tmpfile();
+    UNIT_ASSERT(t, file != NULL);
+
+    rvm_HeapResult result = rvm_fileIntoHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+
+    // The links are stored separately, as links stored at once share cells.
+    const rvm_Node n0 = number(0);
+    const rvm_Node n1 = number(1);
+    const rvm_Node l1 = link(&n1, NULL);
+    UNIT_ASSERT_OK(t, heap.set(&heap, l1));
+    rvm_Node stored;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &stored, 1));
+    const rvm_Node l0 = link(&n0, &stored);
+    UNIT_ASSERT_OK(t, heap.set(&heap, l0));
+
+    // The first traversal loads every node.
+    rvm_Node root;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &root, 2));
+    UNIT_ASSERT_OK(t, rvm_loadNode(&root));
+    rvm_Node tail = *root.as.link.tail;
+    UNIT_ASSERT_EQU(t, RVM_NODE_LAZY, rvm_getNodeKind(&tail));
+    UNIT_ASSERT_OK(t, rvm_loadNode(&tail));
+    rvm_Node head = *tail.as.link.head;
+    UNIT_ASSERT_OK(t, rvm_loadNode(&head));
+    UNIT_ASSERT_EQI(t, 1, head.as.number.integer);
+
+    // The second finds them already loaded.
+    UNIT_ASSERT_OK(t, heap.get(&heap, &root, 2));
+    UNIT_ASSERT_OK(t, rvm_loadNode(&root));
+    const rvm_Node *again = root.as.link.tail;
+    UNIT_ASSERT_EQU(t, RVM_NODE_LINK, rvm_getNodeKind((rvm_Node *)again));
+    again = again->as.link.head;
+    UNIT_ASSERT_EQU(t, RVM_NODE_NUMBER, rvm_getNodeKind((rvm_Node *)again));
+    UNIT_ASSERT_EQI(t, 1, again->as.number.integer);
+
+    rvm_freeHeap(&heap);
+}
+
+// Stores a list of two bytes nodes in two revisions, such that the cells of
+// lists of bytes nodes of equal lengths are at the same offsets.
+static rvm_Error setPair(rvm_Heap *heap, const char *first,
+    const char *second) {
+    const rvm_Node b1 = bytes(second);
+    rvm_Error err = heap->set(heap, link(&b1, NULL));
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        return err;
+    }
+    rvm_Node stored;
+    err = heap->get(heap, &stored, heap->revision);
+    if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+        return err;
+    }
+    const rvm_Node b0 = bytes(first);
+    return heap->set(heap, link(&b0, &stored));
+}
+
+void shouldSetLazyNodesOfOtherHeaps(unit_T *t) {
+    rvm_HeapResult result = rvm_fileIntoHeap(tmpfile());
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap a = result.as.heap;
+    result = rvm_fileIntoHeap(tmpfile());
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap b = result.as.heap;
+    UNIT_ASSERT_OK(t, setPair(&a, "First of A.", "Second of A."));
+    UNIT_ASSERT_OK(t, setPair(&b, "First of B.", "Second of B."));
+
+    // Loading every node of A first makes the nodes refer to loaded nodes
+    // with indexes of A, which have no meaning in B.
+    rvm_Node root;
+    UNIT_ASSERT_OK(t, a.get(&a, &root, a.revision));
+    rvm_Node loaded = root;
+    UNIT_ASSERT_OK(t, rvm_loadNode(&loaded));
+    rvm_Node tail = *loaded.as.link.tail;
+    UNIT_ASSERT_OK(t, rvm_loadNode(&tail));
+    UNIT_ASSERT_OK(t, b.set(&b, root));
+
+    const char *expected[2] = { "First of A.", "Second of A." };
+    UNIT_ASSERT_OK(t, b.get(&b, &root, b.revision));
+    const rvm_Node *node = &root;
+    for (size_t i = 0; i < 2; ++i) {
+        rvm_Node link = *node;
+        UNIT_ASSERT_OK(t, rvm_loadNode(&link));
+        rvm_Node head = *link.as.link.head;
+        UNIT_ASSERT_OK(t, rvm_loadNode(&head));
+        UNIT_ASSERT_EQU(t, strlen(expected[i]), head.as.bytes.length);
+        UNIT_ASSERT(t, memcmp(head.as.bytes.bytes, expected[i],
+            head.as.bytes.length) == 0);
+        node = link.as.link.tail;
+    }
+    UNIT_ASSERT(t, node == NULL);
+
+    rvm_freeHeap(&a);
+    rvm_freeHeap(&b);
+}
+
+void shouldVacuumHeapFile(unit_T *t) {
+    char path[] = "/tmp/rvm-heap-XXXXXX";
+    const int fd = mkstemp(path);
+    UNIT_ASSERT(t, fd >= 0);
+    FILE *file = fdopen(fd, "w+b");
+    UNIT_ASSERT(t, file != NULL);
+
+    rvm_HeapResult result = rvm_fileIntoHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+    char string[1024];
+    memset(string, 'x', sizeof(string) - 1);
+    string[sizeof(string) - 1] = '\0';
+    const rvm_Node large = bytes(string);
+    for (int64_t i = 1; i <= 100; ++i) {
+        const rvm_Node n = number(i);
+        const rvm_Node value = link(&n, &large);
+        UNIT_ASSERT_OK(t, heap.set(&heap, value));
+    }
+    rvm_freeHeap(&heap);
+    struct stat before;
+    UNIT_ASSERT(t, stat(path, &before) == 0);
+
+    const uint64_t revisions[] = { 50, 100 };
+    UNIT_ASSERT_OK(t, rvm_vacuumHeapFile(path, revisions, 2));
+    struct stat after;
+    UNIT_ASSERT(t, stat(path, &after) == 0);
+    UNIT_ASSERT(t, after.st_size * 10 < before.st_size);
+
+    file = fopen(path, "rb");
+    UNIT_ASSERT(t, file != NULL);
+    result = rvm_fileIntoHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    heap = result.as.heap;
+    UNIT_ASSERT_EQU(t, 100, heap.revision);
+    rvm_Node root;
+    const rvm_Error err = heap.get(&heap, &root, 99);
+    UNIT_ASSERT_EQU(t, RVM_ERROR_REVISION, rvm_getErrorKind(err));
+    for (size_t i = 0; i < 2; ++i) {
+        UNIT_ASSERT_OK(t, heap.get(&heap, &root, revisions[i]));
+        UNIT_ASSERT_OK(t, rvm_loadNode(&root));
+        rvm_Node head = *root.as.link.head;
+        UNIT_ASSERT_OK(t, rvm_loadNode(&head));
+        UNIT_ASSERT_EQI(t, revisions[i], head.as.number.integer);
+    }
+    rvm_freeHeap(&heap);
+    remove(path);
+}
+
+void shouldApplyDeltasOfFileHeap(unit_T *t) {
+    rvm_HeapResult result = rvm_fileIntoHeap(tmpfile());
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap sender = result.as.heap;
+    result = rvm_fileIntoHeap(tmpfile());
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap receiver = result.as.heap;
+    FILE *stream = tmpfile();
+    UNIT_ASSERT(t, stream != NULL);
+
+    for (int64_t i = 1; i <= 20; ++i) {
+        const rvm_Node n = number(i);
+        const rvm_Node value = link(&n, NULL);
+        UNIT_ASSERT_OK(t, sender.set(&sender, value));
+        if (i == 5) {
+            UNIT_ASSERT_OK(t, sender.sync(&sender));
+        }
+    }
+    UNIT_ASSERT_OK(t, sender.writeDelta(&sender, 0, 10, stream));
+    rewind(stream);
+    UNIT_ASSERT_OK(t, receiver.applyDelta(&receiver, stream));
+    UNIT_ASSERT_EQU(t, 10, receiver.revision);
+    UNIT_ASSERT_OK(t, receiver.sync(&receiver));
+
+    // The checkpoint written by the receiver is replaced by the delta.
+    rewind(stream);
+    UNIT_ASSERT_OK(t, sender.sync(&sender));
+    UNIT_ASSERT_OK(t, sender.writeDelta(&sender, 10, 20, stream));
+    rewind(stream);
+    UNIT_ASSERT_OK(t, receiver.applyDelta(&receiver, stream));
+    UNIT_ASSERT_EQU(t, 20, receiver.revision);
+    UNIT_ASSERT_EQU(t, sender.length, receiver.length);
+    for (uint64_t i = 1; i <= 20; ++i) {
+        rvm_Node root;
+        UNIT_ASSERT_OK(t, receiver.get(&receiver, &root, i));
+        UNIT_ASSERT_OK(t, rvm_loadNode(&root));
+        rvm_Node head = *root.as.link.head;
+        UNIT_ASSERT_OK(t, rvm_loadNode(&head));
+        UNIT_ASSERT_EQI(t, i, head.as.number.integer);
+    }
+
+    rewind(stream);
+    UNIT_ASSERT_OK(t, sender.writeDelta(&sender, 15, 20, stream));
+    rewind(stream);
+    rvm_Error err = receiver.applyDelta(&receiver, stream);
+    UNIT_ASSERT_EQU(t, RVM_ERROR_REVISION, rvm_getErrorKind(err));
+
+    // Damaged deltas are rejected without changing the receiver.
+    const rvm_Node n = number(21);
+    UNIT_ASSERT_OK(t, sender.set(&sender, n));
+    rewind(stream);
+    UNIT_ASSERT_OK(t, sender.writeDelta(&sender, 20, 21, stream));
+    fseek(stream, -24, SEEK_CUR);
+    fputc(0xff, stream);
+    rewind(stream);
+    err = receiver.applyDelta(&receiver, stream);
+    UNIT_ASSERT_EQU(t, RVM_ERROR_CORRUPT, rvm_getErrorKind(err));
+    UNIT_ASSERT_EQU(t, 20, receiver.revision);
+
+    fclose(stream);
+    rvm_freeHeap(&receiver);
+    rvm_freeHeap(&sender);
+}
+
+void shouldKeepFileHeapIntactWhenDeltaFails(unit_T *t) {
+    rvm_HeapResult result = rvm_fileIntoHeap(tmpfile());
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap sender = result.as.heap;
+    result = rvm_fileIntoHeap(tmpfile());
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap receiver = result.as.heap;
+    FILE *stream = tmpfile();
+    UNIT_ASSERT(t, stream != NULL);
+
+    for (int64_t i = 1; i <= 10; ++i) {
+        const rvm_Node n = number(i);
+        const rvm_Node value = link(&n, NULL);
+        UNIT_ASSERT_OK(t, sender.set(&sender, value));
+    }
+    UNIT_ASSERT_OK(t, sender.writeDelta(&sender, 0, 5, stream));
+    rewind(stream);
+    UNIT_ASSERT_OK(t, receiver.applyDelta(&receiver, stream));
+    UNIT_ASSERT_OK(t, receiver.sync(&receiver));
+    const uint64_t length = receiver.length;
+
+    // The truncated delta would replace the checkpoint of the receiver.
+    rewind(stream);
+    UNIT_ASSERT_OK(t, sender.writeDelta(&sender, 5, 10, stream));
+    const long size = ftell(stream);
+    FILE *truncated = copyPrefix(stream, (size_t)size - 64);
+    UNIT_ASSERT(t, truncated != NULL);
+    rewind(truncated);
+    rvm_Error err = receiver.applyDelta(&receiver, truncated);
+    UNIT_ASSERT_EQU(t, RVM_ERROR_CORRUPT, rvm_getErrorKind(err));
+    fclose(truncated);
+
+    // Claiming more revisions than the delta holds fails only once those it
+    // does hold have been read.
+    const uint64_t revision = 11;
+    UNIT_ASSERT(t, fseek(stream, 24, SEEK_SET) == 0);
+    UNIT_ASSERT(t, fwrite(&revision, sizeof(revision), 1, stream) == 1);
+    rewind(stream);
+    err = receiver.applyDelta(&receiver, stream);
+    UNIT_ASSERT_EQU(t, RVM_ERROR_CORRUPT, rvm_getErrorKind(err));
+
+    UNIT_ASSERT_EQU(t, 5, receiver.revision);
+    UNIT_ASSERT_EQU(t, length, receiver.length);
+    rvm_Node root;
+    err = receiver.get(&receiver, &root, 6);
+    UNIT_ASSERT_EQU(t, RVM_ERROR_REVISION, rvm_getErrorKind(err));
+    UNIT_ASSERT_OK(t, receiver.get(&receiver, &root, 5));
+    UNIT_ASSERT_OK(t, rvm_loadNode(&root));
+    rvm_Node head = *root.as.link.head;
+    UNIT_ASSERT_OK(t, rvm_loadNode(&head));
+    UNIT_ASSERT_EQI(t, 5, head.as.number.integer);
+
+    // The checkpoint is intact, which lets the heap be synchronized, and
+    // still take the undamaged delta.
+    UNIT_ASSERT_OK(t, receiver.sync(&receiver));
+    rewind(stream);
+    UNIT_ASSERT_OK(t, sender.writeDelta(&sender, 5, 10, stream));
+    rewind(stream);
+    UNIT_ASSERT_OK(t, receiver.applyDelta(&receiver, stream));
+    UNIT_ASSERT_EQU(t, 10, receiver.revision);
+
+    fclose(stream);
+    rvm_freeHeap(&receiver);
+    rvm_freeHeap(&sender);
+}
+
+void shouldRejectTruncatedDeltaBeforeGrowing(unit_T *t) {
+    rvm_HeapResult result = rvm_fileIntoHeap(tmpfile());
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap sender = result.as.heap;
+    FILE *file = tmpfile();
+    UNIT_ASSERT(t, file != NULL);
+    result = rvm_fileIntoHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap receiver = result.as.heap;
+    static uint64_t buffer[1024];
+    result = rvm_bufferAsHeap((uint8_t *)buffer, sizeof(buffer));
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap replica = result.as.heap;
+    FILE *stream = tmpfile();
+    UNIT_ASSERT(t, stream != NULL);
+
+    for (int64_t i = 1; i <= 10; ++i) {
+        const rvm_Node n = number(i);
+        UNIT_ASSERT_OK(t, sender.set(&sender, n));
+    }
+    UNIT_ASSERT_OK(t, sender.writeDelta(&sender, 0, 10, stream));
+    struct stat before;
+    UNIT_ASSERT(t, fstat(fileno(file), &before) == 0);
+
+    // The header claims far more bytes than follow it.
+    const uint64_t length = (uint64_t)1 << 40;
+    UNIT_ASSERT(t, fseek(stream, 48, SEEK_SET) == 0);
+    UNIT_ASSERT(t, fwrite(&length, sizeof(length), 1, stream) == 1);
+    rewind(stream);
+    rvm_Error err = receiver.applyDelta(&receiver, stream);
+    UNIT_ASSERT_EQU(t, RVM_ERROR_CORRUPT, rvm_getErrorKind(err));
+    struct stat after;
+    UNIT_ASSERT(t, fstat(fileno(file), &after) == 0);
+    UNIT_ASSERT_EQU(t, before.st_size, after.st_size);
+    UNIT_ASSERT_EQU(t, 0, receiver.revision);
+
+    // Buffer heaps reject the delta as too large before reading it.
+    rewind(stream);
+    err = replica.applyDelta(&replica, stream);
+    UNIT_ASSERT_EQU(t, RVM_ERROR_NOMEMORY, rvm_getErrorKind(err));
+    UNIT_ASSERT_EQU(t, 0, replica.revision);
+
+    rewind(stream);
+    UNIT_ASSERT_OK(t, sender.writeDelta(&sender, 0, 10, stream));
+    rewind(stream);
+    UNIT_ASSERT_OK(t, receiver.applyDelta(&receiver, stream));
+    UNIT_ASSERT_EQU(t, 10, receiver.revision);
+    rewind(stream);
+    UNIT_ASSERT_OK(t, replica.applyDelta(&replica, stream));
+    UNIT_ASSERT_EQU(t, 10, replica.revision);
+
+    fclose(stream);
+    rvm_freeHeap(&replica);
+    rvm_freeHeap(&receiver);
+    rvm_freeHeap(&sender);
+}
+
+void shouldCollectStatsOfFileHeap(unit_T *t) {
+    rvm_HeapResult result = rvm_fileIntoHeap(tmpfile());
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+
+    const rvm_Node n = number(1);
+    const rvm_Node b = bytes("Hello, statistics!");
+    UNIT_ASSERT_OK(t, heap.set(&heap, link(&n, &b)));
+    UNIT_ASSERT_OK(t, heap.set(&heap, number(2)));
+    rvm_HeapStats stats;
+    UNIT_ASSERT_OK(t, heap.stats(&heap, &stats));
+    UNIT_ASSERT_EQU(t, 2, stats.revision);
+    UNIT_ASSERT_EQU(t, 2, stats.revisions);
+    UNIT_ASSERT_EQU(t, heap.length, stats.length);
+    UNIT_ASSERT(t, stats.unsynced > 0);
+    UNIT_ASSERT_EQU(t, 1, stats.total[RVM_NODE_LINK].count);
+    UNIT_ASSERT_EQU(t, 24, stats.total[RVM_NODE_LINK].bytes);
+    UNIT_ASSERT_EQU(t, 1, stats.total[RVM_NODE_NUMBER].count);
+    UNIT_ASSERT_EQU(t, 1, stats.total[RVM_NODE_BYTES].count);
+    for (size_t i = 0; i < RVM_HEAP_NODE_KINDS; ++i) {
+        UNIT_ASSERT_EQU(t, stats.total[i].count, stats.live[i].count);
+        UNIT_ASSERT_EQU(t, stats.total[i].bytes, stats.live[i].bytes);
+    }
+
+    UNIT_ASSERT_OK(t, heap.sync(&heap));
+    for (int i = 0; i < 2; ++i) {
+        rvm_Node root;
+        UNIT_ASSERT_OK(t, heap.get(&heap, &root, 1));
+        UNIT_ASSERT_OK(t, rvm_loadNode(&root));
+    }
+    UNIT_ASSERT_OK(t, heap.stats(&heap, &stats));
+    UNIT_ASSERT_EQU(t, 0, stats.unsynced);
+    uint64_t flushes = 0;
+    for (size_t i = 0; i < RVM_HEAP_LATENCY_BUCKETS; ++i) {
+        flushes += stats.syncLatencies[i];
+    }
+    UNIT_ASSERT_EQU(t, 1, flushes);
+    UNIT_ASSERT_EQU(t, 2, stats.loads);
+    UNIT_ASSERT_EQU(t, 1, stats.decodes);
+    UNIT_ASSERT(t, stats.resident > 0 && stats.resident <= stats.length);
+
+    const uint64_t revisions[] = { 2 };
+    UNIT_ASSERT_OK(t, heap.collect(&heap, revisions, 1));
+    UNIT_ASSERT_OK(t, heap.stats(&heap, &stats));
+    UNIT_ASSERT_EQU(t, 1, stats.revisions);
+    UNIT_ASSERT_EQU(t, 0, stats.total[RVM_NODE_LINK].count);
+    UNIT_ASSERT_EQU(t, 1, stats.total[RVM_NODE_NUMBER].count);
+    UNIT_ASSERT_EQU(t, 1, stats.live[RVM_NODE_NUMBER].count);
+    rvm_freeHeap(&heap);
+}
+
+void shouldCollectStatsOfFileHeapWithMergedCheckpoints(unit_T *t) {
+    rvm_HeapResult result = rvm_fileIntoHeap(tmpfile());
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+
+    // Each checkpoint is merged into the next, which leaves the earlier ones
+    // between the cells without being referred to by any later checkpoint.
+    for (int64_t i = 0; i < 3; ++i) {
+        const rvm_Node b = bytes("Hello, statistics!");
+        UNIT_ASSERT_OK(t, heap.set(&heap, b));
+        UNIT_ASSERT_OK(t, heap.sync(&heap));
+    }
+    rvm_HeapStats stats;
+    UNIT_ASSERT_OK(t, heap.stats(&heap, &stats));
+    UNIT_ASSERT_EQU(t, 3, stats.total[RVM_NODE_BYTES].count);
+    UNIT_ASSERT_EQU(t, 3, stats.live[RVM_NODE_BYTES].count);
+    UNIT_ASSERT_OK(t, heap.set(&heap, symbol("name")));
+    rvm_freeHeap(&heap);
+}
+
+// Sets as many revisions as `depth`, each of which is a link whose head is
+// the value of the revision before it.
+static rvm_Error nestRevisions(rvm_Heap *heap, size_t depth) {
+    rvm_Node previous = number(0);
+    for (size_t i = 0; i < depth; ++i) {
+        rvm_Error err = heap->set(heap, link(&previous, NULL));
+        if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+            return err;
+        }
+        err = heap->get(heap, &previous, heap->revision);
+        if (rvm_getErrorKind(err) != RVM_ERROR_NONE) {
+            return err;
+        }
+    }
+    return rvm_asError(RVM_ERROR_NONE, NULL);
+}
+
+void shouldCollectStatsOfDeeplyNestedFileHeap(unit_T *t) {
+    rvm_HeapResult result = rvm_fileIntoHeap(tmpfile());
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+
+    // Only the last revision is kept, which makes every link reachable from
+    // a single root.
+    const size_t depth = 200000;
+    UNIT_ASSERT_OK(t, nestRevisions(&heap, depth));
+    const uint64_t revisions[] = { depth };
+    UNIT_ASSERT_OK(t, heap.collect(&heap, revisions, 1));
+    rvm_HeapStats stats;
+    UNIT_ASSERT_OK(t, heap.stats(&heap, &stats));
+    UNIT_ASSERT_EQU(t, depth, stats.live[RVM_NODE_LINK].count);
+    UNIT_ASSERT_EQU(t, depth, stats.total[RVM_NODE_LINK].count);
+    rvm_freeHeap(&heap);
+}
+
+void shouldCollectStatsOfBufferHeap(unit_T *t) {
+    uint64_t buffer[1024];
+    rvm_HeapResult result = rvm_bufferAsHeap((uint8_t *)buffer, sizeof(buffer));
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+    UNIT_ASSERT_OK(t, heap.hashCons(&heap, true));
+
+    // Identical nodes are stored once, and are counted once.
+    const rvm_Node a = number(INT64_MAX);
+    const rvm_Node b = number(INT64_MAX);
+    UNIT_ASSERT_OK(t, heap.set(&heap, link(&a, &b)));
+    UNIT_ASSERT_OK(t, heap.set(&heap, link(&a, &b)));
+    rvm_HeapStats stats;
+    UNIT_ASSERT_OK(t, heap.stats(&heap, &stats));
+    UNIT_ASSERT_EQU(t, 2, stats.revisions);
+    UNIT_ASSERT_EQU(t, 1, stats.total[RVM_NODE_LINK].count);
+    UNIT_ASSERT_EQU(t, 1, stats.total[RVM_NODE_NUMBER].count);
+    UNIT_ASSERT_EQU(t, 1, stats.live[RVM_NODE_LINK].count);
+    UNIT_ASSERT_EQU(t, 1, stats.live[RVM_NODE_NUMBER].count);
+    UNIT_ASSERT_EQU(t, 0, stats.unsynced);
+    UNIT_ASSERT_EQU(t, 0, stats.resident);
+    rvm_freeHeap(&heap);
+}
+
+void shouldCollectStatsOfLongListInBufferHeap(unit_T *t) {
+    static uint64_t buffer[65536];
+    rvm_HeapResult result = rvm_bufferAsHeap((uint8_t *)buffer, sizeof(buffer));
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+
+    // Every head is pending while the links are traversed, which takes more
+    // than the initial stack.
+    const size_t count = 2000;
+    static rvm_Node heads[2000];
+    static rvm_Node links[2000];
+    for (size_t i = 0; i < count; ++i) {
+        heads[i] = number(INT64_MAX - (int64_t)i);
+        links[i] = link(&heads[i], i + 1 < count ? &links[i + 1] : NULL);
+    }
+    UNIT_ASSERT_OK(t, heap.set(&heap, links[0]));
+
+    // The stack is taken from the buffer and given back, which leaves room
+    // for as many nodes as before.
+    rvm_HeapStats stats;
+    UNIT_ASSERT_OK(t, heap.stats(&heap, &stats));
+    UNIT_ASSERT_EQU(t, count, stats.live[RVM_NODE_NUMBER].count);
+    UNIT_ASSERT_OK(t, heap.stats(&heap, &stats));
+    UNIT_ASSERT_EQU(t, count, stats.live[RVM_NODE_NUMBER].count);
+    UNIT_ASSERT_OK(t, heap.hashCons(&heap, true));
+    UNIT_ASSERT_OK(t, heap.set(&heap, links[0]));
+    UNIT_ASSERT_EQU(t, 2, heap.revision);
+    rvm_freeHeap(&heap);
+}
+
+void shouldCollectBufferHeap(unit_T *t) {
+    uint64_t buffer[1024];
+    rvm_HeapResult result = rvm_bufferAsHeap((uint8_t *)buffer, sizeof(buffer));
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+
+    for (int64_t i = 1; i <= 20; ++i) {
+        const rvm_Node value = number(i);
+        UNIT_ASSERT_OK(t, heap.set(&heap, value));
+    }
+    const uint64_t length = heap.length;
+    const uint64_t revisions[] = { 10, 20 };
+    UNIT_ASSERT_OK(t, heap.collect(&heap, revisions, 2));
+    UNIT_ASSERT(t, heap.length < length);
+    UNIT_ASSERT_EQU(t, 20, heap.revision);
+
+    rvm_Node root;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &root, 10));
+    UNIT_ASSERT_OK(t, rvm_loadNode(&root));
+    UNIT_ASSERT_EQI(t, 10, root.as.number.integer);
+    UNIT_ASSERT_OK(t, heap.get(&heap, &root, 20));
+    UNIT_ASSERT_OK(t, rvm_loadNode(&root));
+    UNIT_ASSERT_EQI(t, 20, root.as.number.integer);
+    const rvm_Error err = heap.get(&heap, &root, 15);
+    UNIT_ASSERT_EQU(t, RVM_ERROR_REVISION, rvm_getErrorKind(err));
+
+    const rvm_Node value = number(21);
+    UNIT_ASSERT_OK(t, heap.set(&heap, value));
+    UNIT_ASSERT_EQU(t, 21, heap.revision);
+
+    rvm_freeHeap(&heap);
+}
+
+void shouldCollectFileHeapInTraversalOrder(unit_T *t) {
+    FILE *file = tmpfile();
+    UNIT_ASSERT(t, file != NULL);
+
+    rvm_HeapResult result = rvm_fileAsHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+
+    // Build a list by prepending one element per revision, which stores its
+    // links in the opposite order of traversal.
+    const rvm_Node empty = bytes("");
+    UNIT_ASSERT_OK(t, heap.set(&heap, empty));
+    for (int64_t i = 0; i < 100; ++i) {
+        rvm_Node tail;
+        UNIT_ASSERT_OK(t, heap.get(&heap, &tail, heap.revision));
+        const rvm_Node head = number(i);
+        const rvm_Node value = link(&head, &tail);
+        UNIT_ASSERT_OK(t, heap.set(&heap, value));
+    }
+    UNIT_ASSERT_OK(t, heap.sync(&heap));
+    const uint64_t length = heap.length;
+
+    const uint64_t revisions[] = { heap.revision };
+    UNIT_ASSERT_OK(t, heap.collect(&heap, revisions, 1));
+    UNIT_ASSERT(t, heap.length < length);
+    rvm_freeHeap(&heap);
+
+    UNIT_ASSERT(t, fseek(file, 0, SEEK_END) == 0);
+    UNIT_ASSERT(t, (uint64_t)ftell(file) < length);
+
+    result = rvm_fileIntoHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    heap = result.as.heap;
+    UNIT_ASSERT_EQU(t, 101, heap.revision);
+
+    rvm_Node root;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &root, heap.revision));
+    rvm_Node *node = &root;
+    uint64_t previous = 0;
+    for (int64_t i = 99; i >= 0; --i) {
+        UNIT_ASSERT_OK(t, rvm_loadNode(node));
+        UNIT_ASSERT_EQU(t, RVM_NODE_LINK, rvm_getNodeKind(node));
+        UNIT_ASSERT(t, rvm_getNodeIndex(node) > previous);
+        previous = rvm_getNodeIndex(node);
+        rvm_Node *head = (rvm_Node *)node->as.link.head;
+        UNIT_ASSERT_OK(t, rvm_loadNode(head));
+        UNIT_ASSERT_EQI(t, i, head->as.number.integer);
+        node = (rvm_Node *)node->as.link.tail;
+    }
+    UNIT_ASSERT_OK(t, rvm_loadNode(node));
+    UNIT_ASSERT_EQU(t, RVM_NODE_BYTES, rvm_getNodeKind(node));
+
+    rvm_Node dropped;
+    const rvm_Error err = heap.get(&heap, &dropped, 1);
+    UNIT_ASSERT_EQU(t, RVM_ERROR_REVISION, rvm_getErrorKind(err));
+
+    rvm_freeHeap(&heap);
+}
+
+void shouldCollectFileHeapGrownByCollection(unit_T *t) {
+    rvm_HeapResult result = rvm_fileIntoHeap(tmpfile());
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+
+    // The copies of the cells do not fit in the file, which is grown while
+    // the cells are read from a mapping of its earlier length.
+    const int64_t count = 50000;
+    rvm_Node tail = { .flags = RVM_NODE_UNDEFINED };
+    for (int64_t i = 0; i < count; ++i) {
+        const rvm_Node head = number(i);
+        const rvm_Node value = link(&head, i > 0 ? &tail : NULL);
+        UNIT_ASSERT_OK(t, heap.set(&heap, value));
+        UNIT_ASSERT_OK(t, heap.get(&heap, &tail, heap.revision));
+    }
+    const uint64_t revisions[] = { heap.revision };
+    UNIT_ASSERT_OK(t, heap.collect(&heap, revisions, 1));
+
+    rvm_Node root;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &root, heap.revision));
+    const rvm_Node *node = &root;
+    for (int64_t i = count - 1; i >= 0; --i) {
+        rvm_Node loaded = *node;
+        UNIT_ASSERT_OK(t, rvm_loadNode(&loaded));
+        rvm_Node head = *loaded.as.link.head;
+        UNIT_ASSERT_OK(t, rvm_loadNode(&head));
+        UNIT_ASSERTF(t, head.as.number.integer == i, "i = %d", (int)i)
+        node = loaded.as.link.tail;
+        UNIT_ASSERT(t, (node == NULL) == (i == 0));
+    }
+    rvm_HeapStats stats;
+    UNIT_ASSERT_OK(t, heap.stats(&heap, &stats));
+    UNIT_ASSERT_EQU(t, count, stats.live[RVM_NODE_LINK].count);
+
+    rvm_freeHeap(&heap);
+}
+
+void shouldCompactFileHeapWithMostCellsLive(unit_T *t) {
+    FILE *file = tmpfile();
+    UNIT_ASSERT(t, file != NULL);
+
+    rvm_HeapResult result = rvm_fileAsHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+
+    // A single revision holds nearly all cells, whose copies therefore do
+    // not fit between the header and the cells being copied.
+    const size_t length = 10000;
+    rvm_Node *nodes = calloc(length * 2, sizeof(rvm_Node));
+    UNIT_ASSERT(t, nodes != NULL);
+    for (size_t i = 0; i < length; ++i) {
+        nodes[i * 2] = number(INT64_MAX - (int64_t)i);
+        nodes[i * 2 + 1] = link(&nodes[i * 2],
+            i + 1 < length ? &nodes[i * 2 + 3] : NULL);
+    }
+    UNIT_ASSERT_OK(t, heap.set(&heap, nodes[1]));
+    free(nodes);
+    const uint64_t revisions[] = { heap.revision };
+    UNIT_ASSERT_OK(t, heap.collect(&heap, revisions, 1));
+    const uint64_t compacted = heap.length;
+    UNIT_ASSERT_OK(t, heap.collect(&heap, revisions, 1));
+    UNIT_ASSERT_EQU(t, compacted, heap.length);
+
+    rvm_HeapStats stats;
+    UNIT_ASSERT_OK(t, heap.stats(&heap, &stats));
+    UNIT_ASSERT_EQU(t, length, stats.live[RVM_NODE_NUMBER].count);
+    UNIT_ASSERT_EQU(t, length, stats.total[RVM_NODE_NUMBER].count);
+    UNIT_ASSERT_OK(t, heap.set(&heap, symbol("name")));
+    UNIT_ASSERT_OK(t, heap.sync(&heap));
+    rvm_freeHeap(&heap);
+
+    // The compacted heap is opened again as it was left.
+    result = rvm_fileIntoHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    heap = result.as.heap;
+    UNIT_ASSERT_OK(t, heap.stats(&heap, &stats));
+    UNIT_ASSERT_EQU(t, length, stats.live[RVM_NODE_NUMBER].count);
+    UNIT_ASSERT_EQU(t, 1, stats.live[RVM_NODE_SYMBOL].count);
+    rvm_freeHeap(&heap);
+}
+
+void shouldHashConsNodesInBufferHeap(unit_T *t) {
+    uint64_t buffer[1024];
+    rvm_HeapResult result = rvm_bufferAsHeap((uint8_t *)buffer, sizeof(buffer));
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+    UNIT_ASSERT_OK(t, heap.hashCons(&heap, true));
+
+    // Two identical lists, which are stored once.
+    const rvm_Node a = bytes("Same."), b = bytes("Same.");
+    const rvm_Node a2 = link(&a, NULL), b2 = link(&b, NULL);
+    const rvm_Node a1 = link(&a, &a2), b1 = link(&b, &b2);
+    const rvm_Node elements[] = { a1, b1 };
+    const rvm_Node array = {
+        .flags = RVM_NODE_ARRAY, .as.array = { 2, elements },
+    };
+    uint64_t length = heap.length;
+    UNIT_ASSERT_OK(t, heap.set(&heap, array));
+    // Array, link cell holding both links and record, with the bytes stored
+    // within the link cell.
+    UNIT_ASSERT_EQU(t, length + 24 + 32 + 48, heap.length);
+
+    rvm_Node root;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &root, heap.revision));
+    UNIT_ASSERT_OK(t, rvm_loadNode(&root));
+    UNIT_ASSERT_EQU(t, rvm_getNodeIndex((rvm_Node *)&root.as.array.nodes[0]),
+        rvm_getNodeIndex((rvm_Node *)&root.as.array.nodes[1]));
+
+    // Storing the same value again only stores a record.
+    length = heap.length;
+    UNIT_ASSERT_OK(t, heap.set(&heap, array));
+    UNIT_ASSERT_EQU(t, length + 48, heap.length);
+    rvm_Node again;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &again, heap.revision));
+    UNIT_ASSERT_EQU(t, rvm_getNodeIndex(&root), rvm_getNodeIndex(&again));
+
+    rvm_freeHeap(&heap);
+}
+
+void shouldForgetNodesOfFailedSetWhenHashConsing(unit_T *t) {
+    uint64_t buffer[144];
+    rvm_HeapResult result = rvm_bufferAsHeap((uint8_t *)buffer, sizeof(buffer));
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+    UNIT_ASSERT_OK(t, heap.hashCons(&heap, true));
+
+    // The number fits, but not the bytes. The number is too large to be
+    // stored within the link.
+    char string[512];
+    memset(string, 'x', sizeof(string) - 1);
+    string[sizeof(string) - 1] = '\0';
+    const rvm_Node n = number(INT64_MAX);
+    const rvm_Node b = bytes(string);
+    const rvm_Node failing = link(&n, &b);
+    const rvm_Error err = heap.set(&heap, failing);
+    UNIT_ASSERT_EQU(t, RVM_ERROR_NOMEMORY, rvm_getErrorKind(err));
+
+    const rvm_Node value = link(NULL, &n);
+    UNIT_ASSERT_OK(t, heap.set(&heap, value));
+    rvm_Node root;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &root, heap.revision));
+    UNIT_ASSERT_OK(t, rvm_loadNode(&root));
+    rvm_Node *tail = (rvm_Node *)root.as.link.tail;
+    UNIT_ASSERT_OK(t, rvm_loadNode(tail));
+    UNIT_ASSERT_EQU(t, RVM_NODE_NUMBER, rvm_getNodeKind(tail));
+    UNIT_ASSERT_EQI(t, INT64_MAX, tail->as.number.integer);
+
+    rvm_freeHeap(&heap);
+}
+
+void shouldHashConsDeeplyNestedFileHeap(unit_T *t) {
+    rvm_HeapResult result = rvm_fileIntoHeap(tmpfile());
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+
+    // Only the last revision is kept, which makes every link reachable from
+    // a single root, including the innermost one.
+    const size_t depth = 200000;
+    UNIT_ASSERT_OK(t, nestRevisions(&heap, depth));
+    const uint64_t revisions[] = { depth };
+    UNIT_ASSERT_OK(t, heap.collect(&heap, revisions, 1));
+    UNIT_ASSERT_OK(t, heap.hashCons(&heap, true));
+
+    const uint64_t before = heap.length;
+    const rvm_Node zero = number(0);
+    UNIT_ASSERT_OK(t, heap.set(&heap, link(&zero, NULL)));
+    UNIT_ASSERT_EQU(t, before + 48, heap.length);
+    rvm_freeHeap(&heap);
+}
+
+void shouldHashConsNodesOfReopenedFileHeap(unit_T *t) {
+    FILE *file = tmpfile();
+    UNIT_ASSERT(t, file != NULL);
+
+    rvm_HeapResult result = rvm_fileAsHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+
+    const size_t length = 10000;
+    rvm_Node *nodes = calloc(length * 2, sizeof(rvm_Node));
+    UNIT_ASSERT(t, nodes != NULL);
+    for (size_t i = 0; i < length; ++i) {
+        nodes[i * 2] = number((int64_t)i);
+        nodes[i * 2 + 1] = link(&nodes[i * 2],
+            i + 1 < length ? &nodes[i * 2 + 3] : NULL);
+    }
+    UNIT_ASSERT_OK(t, heap.set(&heap, nodes[1]));
+    rvm_freeHeap(&heap);
+
+    result = rvm_fileAsHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    heap = result.as.heap;
+    UNIT_ASSERT_OK(t, heap.hashCons(&heap, true));
+    const uint64_t before = heap.length;
+    UNIT_ASSERT_OK(t, heap.set(&heap, nodes[1]));
+    UNIT_ASSERT_EQU(t, before + 48, heap.length);
+    free(nodes);
+
+    rvm_Node first, second;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &first, 1));
+    UNIT_ASSERT_OK(t, heap.get(&heap, &second, 2));
+    UNIT_ASSERT_EQU(t, rvm_getNodeIndex(&first), rvm_getNodeIndex(&second));
+
+    rvm_freeHeap(&heap);
+}
+
+void shouldGrowFileHeapInPlace(unit_T *t) {
+    FILE *file = tmpfile();
+    UNIT_ASSERT(t, file != NULL);
+
+    rvm_HeapResult result = rvm_fileIntoHeap(file);
+    UNIT_ASSERT(t, result.ok);
+    rvm_Heap heap = result.as.heap;
+
+    const rvm_Node first = bytes("Stays put.");
+    UNIT_ASSERT_OK(t, heap.set(&heap, first));
+    rvm_Node root;
+    UNIT_ASSERT_OK(t, heap.get(&heap, &root, 1));
+    UNIT_ASSERT_OK(t, rvm_loadNode(&root));
+    const uint8_t *pointer = root.as.bytes.bytes;
+
+    // Grows the file to many times its initial size.
+    const size_t length = 4 * 1024 * 1024;
+    uint8_t *data = calloc(length, 1);
+    UNIT_ASSERT(t, data != NULL);
+    const rvm_Node large = {
+        .flags = RVM_NODE_BYTES, .as.bytes = { length, data },
+    };
+    UNIT_ASSERT_OK(t, heap.set(&heap, large));
+    free(data);
+    UNIT_ASSERT(t, heap.length > length);
+
+    UNIT_ASSERT(t, memcmp(pointer, "Stays put.", 10) == 0);
+    UNIT_ASSERT_OK(t, heap.get(&heap, &root, 1));
+    UNIT_ASSERT_OK(t, rvm_loadNode(&root));
+    UNIT_ASSERT(t, pointer == root.as.bytes.bytes);
+
+    rvm_freeHeap(&heap);
+}
+
+void rvm_heap(unit_S *s) {
+    unit_test(s, shouldStoreAndLoadValueInBufferHeap);
+    unit_test(s, shouldFailWhenBufferHeapIsFull);
+    unit_test(s, shouldRejectTooSmallBuffer);
+    unit_test(s, shouldStoreAndLoadValueInFileHeap);
+    unit_test(s, shouldReopenFileHeap);
+    unit_test(s, shouldStoreClosuresByFunctionNameAndArity);
+    unit_test(s, shouldLoadClosuresAfterCollection);
+    unit_test(s, shouldStoreLongListInFileHeap);
+    unit_test(s, shouldRejectCorruptFileHeap);
+    unit_test(s, shouldStoreSmallNodesAsImmediateWords);
+    unit_test(s, shouldStoreLinkChainsUnrolled);
+    unit_test(s, shouldStoreArraysOfNumbersPacked);
+    unit_test(s, shouldInternSymbolsOfFileHeap);
+    unit_test(s, shouldKeepRevisionsSharingNodes);
+    unit_test(s, shouldRecoverCommitsAfterLastCheckpoint);
+    unit_test(s, shouldReopenFileHeapWithManyCheckpoints);
+    unit_test(s, shouldSyncFileHeapFromManyThreads);
+    unit_test(s, shouldAwaitAsyncSyncOfFileHeap);
+    unit_test(s, shouldGetAndLoadWhileFileHeapIsSet);
+    unit_test(s, shouldReferToLoadedNodesOfFileHeap);
+    unit_test(s, shouldSetLazyNodesOfOtherHeaps);
+    unit_test(s, shouldVacuumHeapFile);
+    unit_test(s, shouldApplyDeltasOfFileHeap);
+    unit_test(s, shouldKeepFileHeapIntactWhenDeltaFails);
+    unit_test(s, shouldRejectTruncatedDeltaBeforeGrowing);
+    unit_test(s, shouldCollectStatsOfFileHeap);
+    unit_test(s, shouldCollectStatsOfFileHeapWithMergedCheckpoints);
+    unit_test(s, shouldCollectStatsOfDeeplyNestedFileHeap);
+    unit_test(s, shouldCollectStatsOfBufferHeap);
+    unit_test(s, shouldCollectStatsOfLongListInBufferHeap);
+    unit_test(s, shouldCollectBufferHeap);
+    unit_test(s, shouldCollectFileHeapInTraversalOrder);
+    unit_test(s, shouldCollectFileHeapGrownByCollection);
+    unit_test(s, shouldCompactFileHeapWithMostCellsLive);
+    unit_test(s, shouldHashConsNodesInBufferHeap);
+    unit_test(s, shouldForgetNodesOfFailedSetWhenHashConsing);
+    unit_test(s, shouldHashConsNodesOfReopenedFileHeap);
+    unit_test(s, shouldHashConsDeeplyNestedFileHeap);
+    unit_test(s, shouldGrowFileHeapInPlace);
+}
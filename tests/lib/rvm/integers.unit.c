@@ -0,0 +1,149 @@
+#include <stdbool.h>
+#include "../../../src/lib/rvm/integers.h"
+#include "../../../src/util/unit/unit.h"
+
+#define LENGTH 37
+
+/// Fills buffer with integers including both extremes and repetitions.
+static void fill(int64_t *out, size_t length, uint64_t seed) {
+    for (size_t i = 0; i < length; ++i) {
+        seed = seed * 6364136223846793005 + 1442695040888963407;
+        out[i] = (int64_t)(seed >> 1) % 1000 - 500;
+    }
+    if (length > 7) {
+        out[3] = INT64_MAX;
+        out[7] = INT64_MIN;
+    }
+}
+
+void shouldSumAndBoundIntegers(unit_T *t) {
+    int64_t values[LENGTH];
+    fill(values, LENGTH, 1);
+    for (int k = RVM_INTEGER_KERNELS_SCALAR; k <= RVM_INTEGER_KERNELS_AVX2;
+        ++k) {
+        rvm_selectIntegerKernels((rvm_IntegerKernels)k);
+        for (size_t length = 0; length <= LENGTH; ++length) {
+            uint64_t sum = 0;
+            int64_t min = INT64_MAX;
+            int64_t max = INT64_MIN;
+            for (size_t i = 0; i < length; ++i) {
+                sum += (uint64_t)values[i];
+                min = values[i] < min ? values[i] : min;
+                max = values[i] > max ? values[i] : max;
+            }
+            UNIT_ASSERT_EQI(t, (int64_t)sum, rvm_sumIntegers(values, length));
+            UNIT_ASSERT_EQI(t, min, rvm_minIntegers(values, length));
+            UNIT_ASSERT_EQI(t, max, rvm_maxIntegers(values, length));
+        }
+    }
+    rvm_selectIntegerKernels(RVM_INTEGER_KERNELS_AVX2);
+}
+
+void shouldAddSubtractAndMultiplyIntegers(unit_T *t) {
+    int64_t a[LENGTH];
+    int64_t b[LENGTH];
+    int64_t out[LENGTH];
+    fill(a, LENGTH, 2);
+    fill(b, LENGTH, 3);
+    for (int k = RVM_INTEGER_KERNELS_SCALAR; k <= RVM_INTEGER_KERNELS_AVX2;
+        ++k) {
+        rvm_selectIntegerKernels((rvm_IntegerKernels)k);
+        rvm_addIntegers(out, a, b, LENGTH);
+        for (size_t i = 0; i < LENGTH; ++i) {
+            UNIT_ASSERT_EQI(t, (int64_t)((uint64_t)a[i] + (uint64_t)b[i]),
+                out[i]);
+        }
+        rvm_subtractIntegers(out, a, b, LENGTH);
+        for (size_t i = 0; i < LENGTH; ++i) {
+            UNIT_ASSERT_EQI(t, (int64_t)((uint64_t)a[i] - (uint64_t)b[i]),
+                out[i]);
+        }
+        rvm_multiplyIntegers(out, a, b, LENGTH);
+        for (size_t i = 0; i < LENGTH; ++i) {
+            UNIT_ASSERT_EQI(t, (int64_t)((uint64_t)a[i] * (uint64_t)b[i]),
+                out[i]);
+        }
+
+        // Should allow for results to replace operands.
+        int64_t c[LENGTH];
+        fill(c, LENGTH, 2);
+        rvm_addIntegers(c, c, b, LENGTH);
+        rvm_subtractIntegers(c, c, b, LENGTH);
+        for (size_t i = 0; i < LENGTH; ++i) {
+            UNIT_ASSERT_EQI(t, a[i], c[i]);
+        }
+    }
+    rvm_selectIntegerKernels(RVM_INTEGER_KERNELS_AVX2);
+}
+
+void shouldFilterIntegers(unit_T *t) {
+    int64_t values[LENGTH];
+    int64_t out[LENGTH];
+    fill(values, LENGTH, 4);
+    values[20] = values[21] = values[22] = values[23] = 0;
+    for (int k = RVM_INTEGER_KERNELS_SCALAR; k <= RVM_INTEGER_KERNELS_AVX2;
+        ++k) {
+        rvm_selectIntegerKernels((rvm_IntegerKernels)k);
+        for (int c = RVM_INTEGER_LESS; c <= RVM_INTEGER_GREATER; ++c) {
+            const size_t count = rvm_filterIntegers(out, values, LENGTH,
+                (rvm_IntegerComparison)c, 0);
+            size_t expected = 0;
+            for (size_t i = 0; i < LENGTH; ++i) {
+                const int64_t v = values[i];
+                const bool isMatch = c == RVM_INTEGER_LESS ? v < 0
+                    : c == RVM_INTEGER_LESS_OR_EQUAL       ? v <= 0
+                    : c == RVM_INTEGER_EQUAL               ? v == 0
+                    : c == RVM_INTEGER_NOT_EQUAL           ? v != 0
+                    : c == RVM_INTEGER_GREATER_OR_EQUAL    ? v >= 0
+                                                           : v > 0;
+                if (isMatch) {
+                    UNIT_ASSERT(t, expected < count);
+                    UNIT_ASSERT_EQI(t, v, out[expected]);
+                    expected += 1;
+                }
+            }
+            UNIT_ASSERT_EQU(t, expected, count);
+        }
+
+        // Should allow for integers to be filtered in place.
+        int64_t in[LENGTH];
+        fill(in, LENGTH, 5);
+        const size_t count = rvm_filterIntegers(out, in, LENGTH,
+            RVM_INTEGER_GREATER_OR_EQUAL, -100);
+        UNIT_ASSERT_EQU(t, count, rvm_filterIntegers(in, in, LENGTH,
+            RVM_INTEGER_GREATER_OR_EQUAL, -100));
+        for (size_t i = 0; i < count; ++i) {
+            UNIT_ASSERT_EQI(t, out[i], in[i]);
+        }
+    }
+    rvm_selectIntegerKernels(RVM_INTEGER_KERNELS_AVX2);
+}
+
+void shouldFindIntegers(unit_T *t) {
+    int64_t values[LENGTH];
+    for (size_t i = 0; i < LENGTH; ++i) {
+        values[i] = (int64_t)i * 3;
+    }
+    values[30] = 9;
+    for (int k = RVM_INTEGER_KERNELS_SCALAR; k <= RVM_INTEGER_KERNELS_AVX2;
+        ++k) {
+        rvm_selectIntegerKernels((rvm_IntegerKernels)k);
+        for (size_t i = 0; i < LENGTH; ++i) {
+            if (i != 30) {
+                UNIT_ASSERT_EQU(t, i, rvm_findInteger(values, LENGTH,
+                    (int64_t)i * 3));
+            }
+        }
+        UNIT_ASSERT_EQU(t, 3, rvm_findInteger(values, LENGTH, 9));
+        UNIT_ASSERT_EQU(t, LENGTH, rvm_findInteger(values, LENGTH, 1));
+        UNIT_ASSERT_EQU(t, 0, rvm_findInteger(values, 0, 0));
+    }
+    rvm_selectIntegerKernels(RVM_INTEGER_KERNELS_AVX2);
+}
+
+void rvm_integers(unit_S *s) {
+    unit_test(s, shouldSumAndBoundIntegers);
+    unit_test(s, shouldAddSubtractAndMultiplyIntegers);
+    unit_test(s, shouldFilterIntegers);
+    unit_test(s, shouldFindIntegers);
+}
@@ -0,0 +1,232 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../../../src/lib/rvm/memo.h"
+#include "unit.h"
+
+static rvm_Node identity(rvm_Node *node) {
+    return *node;
+}
+
+static const rvm_Function IDENTITY = {
+    "identity", 1, identity, RVM_FUNCTION_FLAGS_MEMOIZE,
+};
+
+static const rvm_Function SAME = {
+    "same", 1, identity, RVM_FUNCTION_FLAGS_MEMOIZE,
+};
+
+static rvm_Node number(int64_t integer) {
+    return (rvm_Node){
+        .flags = RVM_NODE_NUMBER, .as.number.integer = integer,
+    };
+}
+
+static rvm_Node bytes(const char *string) {
+    return (rvm_Node){
+        .flags = RVM_NODE_BYTES,
+        .as.bytes = { strlen(string), (const uint8_t *)string },
+    };
+}
+
+static rvm_Node link(const rvm_Node *head, const rvm_Node *tail) {
+    return (rvm_Node){
+        .flags = RVM_NODE_LINK, .as.link = { head, tail },
+    };
+}
+
+void shouldFindResultsOfCallsWithEqualArguments(unit_T *t) {
+    rvm_MemoResult result = rvm_newMemo(4096);
+    UNIT_ASSERT(t, result.ok);
+    rvm_Memo *memo = result.as.memo;
+
+    char text[] = "Argument.";
+    rvm_Node head = bytes(text);
+    rvm_Node second = number(2);
+    rvm_Node tail = link(&second, NULL);
+    rvm_Node argument = link(&head, &tail);
+    rvm_Node elements[2] = { bytes("Result."), number(42) };
+    const rvm_Node returned = {
+        .flags = RVM_NODE_ARRAY, .as.array = { 2, elements },
+    };
+
+    rvm_Node *found;
+    UNIT_ASSERT_OK(t,
+        rvm_getMemoized(memo, &IDENTITY, &argument, NULL, &found, NULL));
+    UNIT_ASSERT(t, found == NULL);
+    UNIT_ASSERT_OK(t,
+        rvm_setMemoized(memo, &IDENTITY, &argument, &returned, NULL));
+
+    // Cached nodes are copies, which is why these changes do not matter.
+    text[0] = 'X';
+    elements[1] = number(0);
+
+    const rvm_Node other = bytes("Argument.");
+    const rvm_Node otherTail = link(&second, NULL);
+    const rvm_Node equal = link(&other, &otherTail);
+    size_t size;
+    UNIT_ASSERT_OK(t,
+        rvm_getMemoized(memo, &IDENTITY, &equal, NULL, &found, &size));
+    UNIT_ASSERT(t, found != NULL);
+    UNIT_ASSERT_EQU(t, 3 * sizeof(rvm_Node) + 7, size);
+    UNIT_ASSERT_EQU(t, RVM_NODE_ARRAY, rvm_getNodeKind(found));
+    UNIT_ASSERT_EQU(t, 2, found->as.array.length);
+    UNIT_ASSERT(t, memcmp(found->as.array.nodes[0].as.bytes.bytes,
+        "Result.", 7) == 0);
+    UNIT_ASSERT_EQI(t, 42, found->as.array.nodes[1].as.number.integer);
+    free(found);
+
+    // Neither other functions nor other arguments are matched.
+    UNIT_ASSERT_OK(t, rvm_getMemoized(memo, &SAME, &equal, NULL, &found, NULL));
+    UNIT_ASSERT(t, found == NULL);
+    UNIT_ASSERT_OK(t,
+        rvm_getMemoized(memo, &IDENTITY, &argument, NULL, &found, NULL));
+    UNIT_ASSERT(t, found == NULL);
+    UNIT_ASSERT_OK(t,
+        rvm_getMemoized(memo, &IDENTITY, NULL, NULL, &found, NULL));
+    UNIT_ASSERT(t, found == NULL);
+
+    const rvm_MemoStats stats = rvm_getMemoStats(memo);
+    UNIT_ASSERT_EQU(t, 1, stats.hits);
+    UNIT_ASSERT_EQU(t, 4, stats.misses);
+    UNIT_ASSERT_EQU(t, 0, stats.evictions);
+    UNIT_ASSERT_EQU(t, 1, stats.count);
+
+    rvm_freeMemo(memo);
+}
+
+void shouldEvictLeastRecentlyUsedResults(unit_T *t) {
+    rvm_MemoResult result = rvm_newMemo(8 * 1024);
+    UNIT_ASSERT(t, result.ok);
+    rvm_Memo *memo = result.as.memo;
+
+    rvm_Node n0 = number(0);
+    UNIT_ASSERT_OK(t, rvm_setMemoized(memo, &IDENTITY, &n0, &n0, NULL));
+    const size_t entry = rvm_getMemoStats(memo).size;
+    UNIT_ASSERT(t, entry > 2 * sizeof(rvm_Node));
+    rvm_freeMemo(memo);
+
+    result = rvm_newMemo(3 * entry);
+    UNIT_ASSERT(t, result.ok);
+    memo = result.as.memo;
+    rvm_Node *found;
+    for (int64_t i = 0; i < 3; ++i) {
+        const rvm_Node n = number(i);
+        UNIT_ASSERT_OK(t, rvm_setMemoized(memo, &IDENTITY, &n, &n, NULL));
+    }
+    // Using the first result makes the second one least recently used.
+    UNIT_ASSERT_OK(t,
+        rvm_getMemoized(memo, &IDENTITY, &n0, NULL, &found, NULL));
+    UNIT_ASSERT(t, found != NULL);
+    free(found);
+
+    const rvm_Node n3 = number(3);
+    UNIT_ASSERT_OK(t, rvm_setMemoized(memo, &IDENTITY, &n3, &n3, NULL));
+    for (int64_t i = 0; i < 4; ++i) {
+        const rvm_Node n = number(i);
+        UNIT_ASSERT_OK(t,
+            rvm_getMemoized(memo, &IDENTITY, &n, NULL, &found, NULL));
+        UNIT_ASSERTF(t, (found == NULL) == (i == 1), "i = %d", (int)i)
+        if (found != NULL) {
+            UNIT_ASSERT_EQI(t, i, found->as.number.integer);
+            free(found);
+        }
+    }
+
+    const rvm_MemoStats stats = rvm_getMemoStats(memo);
+    UNIT_ASSERT_EQU(t, 4, stats.hits);
+    UNIT_ASSERT_EQU(t, 1, stats.misses);
+    UNIT_ASSERT_EQU(t, 1, stats.evictions);
+    UNIT_ASSERT_EQU(t, 3, stats.count);
+    UNIT_ASSERT_EQU(t, 3 * entry, stats.size);
+
+    // Results that could never fit are not cached at all.
+    rvm_Node *nodes = malloc(64 * sizeof(rvm_Node));
+    UNIT_ASSERT(t, nodes != NULL);
+    for (size_t i = 0; i < 64; ++i) {
+        nodes[i] = number((int64_t)i);
+    }
+    const rvm_Node large = {
+        .flags = RVM_NODE_ARRAY, .as.array = { 64, nodes },
+    };
+    UNIT_ASSERT_OK(t, rvm_setMemoized(memo, &IDENTITY, &large, &large, NULL));
+    UNIT_ASSERT_EQU(t, 3, rvm_getMemoStats(memo).count);
+    free(nodes);
+
+    rvm_freeMemo(memo);
+}
+
+void shouldCopySharedNodesOnce(unit_T *t) {
+    rvm_MemoResult result = rvm_newMemo(1024 * 1024);
+    UNIT_ASSERT(t, result.ok);
+    rvm_Memo *memo = result.as.memo;
+
+    // Each link refers to the one before it twice, which would make for 2^100
+    // copies if shared nodes were copied once per reference.
+    rvm_Node nodes[101];
+    nodes[0] = number(1);
+    for (size_t i = 1; i < 101; ++i) {
+        nodes[i] = link(&nodes[i - 1], &nodes[i - 1]);
+    }
+    rvm_HashCache cache = {0};
+    UNIT_ASSERT_OK(t,
+        rvm_setMemoized(memo, &IDENTITY, &nodes[100], &nodes[100], &cache));
+    UNIT_ASSERT_EQU(t, 1, rvm_getMemoStats(memo).count);
+
+    rvm_Node *found;
+    size_t size;
+    UNIT_ASSERT_OK(t,
+        rvm_getMemoized(memo, &IDENTITY, &nodes[100], &cache, &found, &size));
+    UNIT_ASSERT(t, found != NULL);
+    UNIT_ASSERT_EQU(t, 101 * sizeof(rvm_Node), size);
+    const rvm_Node *node = found;
+    for (size_t i = 100; i > 0; --i) {
+        UNIT_ASSERT_EQU(t, RVM_NODE_LINK, rvm_getNodeKind((rvm_Node *)node));
+        UNIT_ASSERT(t, node->as.link.head == node->as.link.tail);
+        node = node->as.link.head;
+    }
+    UNIT_ASSERT_EQI(t, 1, node->as.number.integer);
+    free(found);
+    rvm_freeHashCache(&cache);
+    rvm_freeMemo(memo);
+}
+
+void shouldCopyDeeplyNestedNodes(unit_T *t) {
+    rvm_MemoResult result = rvm_newMemo(64 * 1024 * 1024);
+    UNIT_ASSERT(t, result.ok);
+    rvm_Memo *memo = result.as.memo;
+
+    const size_t depth = 1000000;
+    rvm_Node *nodes = malloc((depth + 1) * sizeof(rvm_Node));
+    UNIT_ASSERT(t, nodes != NULL);
+    nodes[0] = number(7);
+    for (size_t i = 1; i <= depth; ++i) {
+        nodes[i] = i % 2 == 0
+            ? link(&nodes[i - 1], NULL)
+            : (rvm_Node){
+                  .flags = RVM_NODE_ARRAY, .as.array = { 1, &nodes[i - 1] },
+              };
+    }
+    const rvm_Node argument = number(0);
+    UNIT_ASSERT_OK(t,
+        rvm_setMemoized(memo, &IDENTITY, &argument, &nodes[depth], NULL));
+
+    rvm_Node *found;
+    UNIT_ASSERT_OK(t,
+        rvm_getMemoized(memo, &IDENTITY, &argument, NULL, &found, NULL));
+    UNIT_ASSERT(t, found != NULL);
+    const rvm_Node *node = found;
+    for (size_t i = depth; i > 0; --i) {
+        node = i % 2 == 0 ? node->as.link.head : node->as.array.nodes;
+    }
+    UNIT_ASSERT_EQI(t, 7, node->as.number.integer);
+    free(found);
+    free(nodes);
+    rvm_freeMemo(memo);
+}
+
+void rvm_memo(unit_S *s) {
+    unit_test(s, shouldFindResultsOfCallsWithEqualArguments);
+    unit_test(s, shouldEvictLeastRecentlyUsedResults);
+    unit_test(s, shouldCopySharedNodesOnce);
+    unit_test(s, shouldCopyDeeplyNestedNodes);
+}
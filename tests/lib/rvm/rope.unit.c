@@ -0,0 +1,180 @@
+#include <string.h>
+#include "../../../src/lib/rvm/rope.h"
+#include "../../../src/util/unit/unit.h"
+
+#define UNIT_ASSERT_ROPE(t, expression, out)                         \
+    do {                                                             \
+        const rvm_RopeResult r0 = (expression);                      \
+        UNIT_ASSERTF(t, r0.ok, #expression " failed with error kind %d", \
+            rvm_getErrorKind(r0.as.error))                           \
+        (out) = r0.as.rope;                                          \
+    } while (0)
+
+/// Determines whether rope contains exactly the given bytes.
+static bool equalsBytes(const rvm_Rope *rope, const char *string) {
+    const size_t length = strlen(string);
+    if (rvm_getRopeLength(rope) != length) {
+        return false;
+    }
+    char buffer[256];
+    rvm_copyRope(rope, buffer);
+    for (size_t i = 0; i < length; ++i) {
+        if (*(const char *)rvm_getRopeElement(rope, i) != string[i]) {
+            return false;
+        }
+    }
+    return memcmp(buffer, string, length) == 0;
+}
+
+void shouldConcatAndSliceRopes(unit_T *t) {
+    rvm_Rope *a;
+    rvm_Rope *b;
+    rvm_Rope *ab;
+    rvm_Rope *slice;
+    rvm_Rope *empty;
+    UNIT_ASSERT_ROPE(t, rvm_newRope(1, "Hello", 5), a);
+    UNIT_ASSERT_ROPE(t, rvm_newRope(1, ", World!", 8), b);
+    UNIT_ASSERT_ROPE(t, rvm_concatRopes(a, b), ab);
+    UNIT_ASSERT(t, equalsBytes(ab, "Hello, World!"));
+
+    UNIT_ASSERT_ROPE(t, rvm_sliceRope(ab, 3, 9), slice);
+    UNIT_ASSERT(t, equalsBytes(slice, "lo, Wo"));
+    rvm_freeRope(ab);
+    rvm_freeRope(a);
+    rvm_freeRope(b);
+
+    // Slices keep shared elements alive.
+    UNIT_ASSERT(t, equalsBytes(slice, "lo, Wo"));
+    UNIT_ASSERT_ROPE(t, rvm_sliceRope(slice, 2, 2), empty);
+    UNIT_ASSERT_EQU(t, 0, rvm_getRopeLength(empty));
+    UNIT_ASSERT_ROPE(t, rvm_concatRopes(empty, slice), ab);
+    UNIT_ASSERT(t, equalsBytes(ab, "lo, Wo"));
+    rvm_freeRope(ab);
+    rvm_freeRope(empty);
+    rvm_freeRope(slice);
+}
+
+void shouldUpdateRopesPersistently(unit_T *t) {
+    rvm_Node nodes[3];
+    for (size_t i = 0; i < 3; ++i) {
+        nodes[i] = (rvm_Node){
+            .flags = RVM_NODE_NUMBER, .as.number.integer = (int64_t)i,
+        };
+    }
+    rvm_Rope *rope;
+    rvm_Rope *updated;
+    UNIT_ASSERT_ROPE(t, rvm_newArrayRope((rvm_NodeArray){ 3, nodes }), rope);
+    UNIT_ASSERT_EQU(t, sizeof(rvm_Node), rvm_getRopeWidth(rope));
+
+    const rvm_Node element = {
+        .flags = RVM_NODE_NUMBER, .as.number.integer = 42,
+    };
+    UNIT_ASSERT_ROPE(t, rvm_updateRope(rope, 1, &element), updated);
+    UNIT_ASSERT_EQU(t, 3, rvm_getRopeLength(updated));
+    rvm_Node copy[3];
+    rvm_copyRope(updated, copy);
+    UNIT_ASSERT_EQI(t, 0, copy[0].as.number.integer);
+    UNIT_ASSERT_EQI(t, 42, copy[1].as.number.integer);
+    UNIT_ASSERT_EQI(t, 2, copy[2].as.number.integer);
+
+    // The original rope is left as it was.
+    const rvm_Node *original = rvm_getRopeElement(rope, 1);
+    UNIT_ASSERT_EQI(t, 1, original->as.number.integer);
+    rvm_freeRope(updated);
+    rvm_freeRope(rope);
+}
+
+void shouldAppendToRopesInLoop(unit_T *t) {
+    rvm_Rope *rope;
+    UNIT_ASSERT_ROPE(t, rvm_newRope(sizeof(uint32_t), NULL, 0), rope);
+    for (uint32_t i = 0; i < 100000; ++i) {
+        rvm_Rope *appended;
+        UNIT_ASSERT_ROPE(t, rvm_appendToRope(rope, &i, 1), appended);
+        rvm_freeRope(rope);
+        rope = appended;
+    }
+    UNIT_ASSERT_EQU(t, 100000, rvm_getRopeLength(rope));
+    for (uint32_t i = 0; i < 100000; i += 997) {
+        UNIT_ASSERT_EQU(t, i,
+            *(const uint32_t *)rvm_getRopeElement(rope, i));
+    }
+
+    // Appending twice to the same rope gives two independent ropes.
+    rvm_Rope *a;
+    rvm_Rope *b;
+    const uint32_t x = 1;
+    const uint32_t y = 2;
+    UNIT_ASSERT_ROPE(t, rvm_appendToRope(rope, &x, 1), a);
+    UNIT_ASSERT_ROPE(t, rvm_appendToRope(rope, &y, 1), b);
+    UNIT_ASSERT_EQU(t, 100000, rvm_getRopeLength(rope));
+    UNIT_ASSERT_EQU(t, 1, *(const uint32_t *)rvm_getRopeElement(a, 100000));
+    UNIT_ASSERT_EQU(t, 2, *(const uint32_t *)rvm_getRopeElement(b, 100000));
+    rvm_freeRope(a);
+    rvm_freeRope(b);
+    rvm_freeRope(rope);
+}
+
+void shouldKeepRopesEqualToFlatSequences(unit_T *t) {
+    char flat[256] = "";
+    rvm_Rope *rope;
+    UNIT_ASSERT_ROPE(t, rvm_newRope(1, NULL, 0), rope);
+    uint64_t seed = 7;
+    for (size_t step = 0; step < 2000; ++step) {
+        seed = seed * 6364136223846793005 + 1442695040888963407;
+        const size_t length = strlen(flat);
+        const size_t a = (size_t)(seed >> 33) % (length + 1);
+        const size_t b = (size_t)(seed >> 45) % (length + 1);
+        const size_t begin = a < b ? a : b;
+        const size_t end = a < b ? b : a;
+        rvm_Rope *next;
+        rvm_Rope *part;
+        switch ((seed >> 60) % 4) {
+        case 0:
+            if (length > 200) {
+                continue;
+            }
+            UNIT_ASSERT_ROPE(t, rvm_appendToRope(rope, "abc", 3), next);
+            strcat(flat, "abc");
+            break;
+
+        case 1:
+            UNIT_ASSERT_ROPE(t, rvm_sliceRope(rope, begin, end), next);
+            memmove(flat, &flat[begin], end - begin);
+            flat[end - begin] = '\0';
+            break;
+
+        case 2:
+            if (length == 0 || length > 120) {
+                continue;
+            }
+            // Concatenates rope with a slice of itself.
+            UNIT_ASSERT_ROPE(t, rvm_sliceRope(rope, begin, end), part);
+            UNIT_ASSERT_ROPE(t, rvm_concatRopes(rope, part), next);
+            rvm_freeRope(part);
+            memcpy(&flat[length], &flat[begin], end - begin);
+            flat[length + end - begin] = '\0';
+            break;
+
+        default: {
+            if (length == 0) {
+                continue;
+            }
+            const size_t index = begin < length ? begin : 0;
+            UNIT_ASSERT_ROPE(t, rvm_updateRope(rope, index, "X"), next);
+            flat[index] = 'X';
+            break;
+        }
+        }
+        rvm_freeRope(rope);
+        rope = next;
+        UNIT_ASSERT(t, equalsBytes(rope, flat));
+    }
+    rvm_freeRope(rope);
+}
+
+void rvm_rope(unit_S *s) {
+    unit_test(s, shouldConcatAndSliceRopes);
+    unit_test(s, shouldUpdateRopesPersistently);
+    unit_test(s, shouldAppendToRopesInLoop);
+    unit_test(s, shouldKeepRopesEqualToFlatSequences);
+}
@@ -0,0 +1,25 @@
+#ifndef TESTS_LIB_RVM_UNIT_H
+#define TESTS_LIB_RVM_UNIT_H
+
+/// Unit testing utilities shared by RVM suites.
+///
+/// \file
+
+#include "../../../src/lib/rvm/error.h"
+#include "../../../src/util/unit/unit.h"
+
+/// Asserts that given rvm_Error expression indicates no error.
+///
+/// If assertion fails, the currently executed test is failed and the
+/// expression is printed along with the kind of the error.
+///
+/// \param t          Pointer to test context.
+/// \param expression Expression evaluating to an rvm_Error.
+#define UNIT_ASSERT_OK(t, expression)                                      \
+    do {                                                                   \
+        const rvm_Error e0 = (expression);                                 \
+        UNIT_ASSERTF(t, rvm_getErrorKind(e0) == RVM_ERROR_NONE,            \
+            #expression " failed with error kind %d", rvm_getErrorKind(e0)) \
+    } while (0)
+
+#endif
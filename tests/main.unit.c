@@ -2,11 +2,25 @@
 #include "../src/util/unit/unit.h"
 
 void mem_string(unit_S *s);
+void rvm_codec(unit_S *s);
 void rvm_error(unit_S *s);
+void rvm_evaluation(unit_S *s);
+void rvm_hash(unit_S *s);
+void rvm_heap(unit_S *s);
+void rvm_integers(unit_S *s);
+void rvm_memo(unit_S *s);
+void rvm_rope(unit_S *s);
 
 void unit_main(unit_G *g) {
     puts(META_VERSION " (" META_VERSION_HASH ")");
 
     unit_suite(g, mem_string);
+    unit_suite(g, rvm_codec);
     unit_suite(g, rvm_error);
+    unit_suite(g, rvm_evaluation);
+    unit_suite(g, rvm_hash);
+    unit_suite(g, rvm_heap);
+    unit_suite(g, rvm_integers);
+    unit_suite(g, rvm_memo);
+    unit_suite(g, rvm_rope);
 }